@@ -0,0 +1,45 @@
+// Records the capture console command streams through CaptureStream
+//
+// R(name, id, COLUMNS) per record and X(type, name) per column, see
+// CaptureFrame.h. tools/wlccap writes one file per column. Never reuse
+// an id, and only append columns.
+//
+// Meter   one per meter read, every pzemReadInterval (1 s)
+//   time       millis() of the read
+//   readMs     time the read took (0 when the meter library had it cached)
+//   flags      bit 0 motorRunning, 1 relay output, 2 UGT float, 3 OHT float
+//   error      checkSystemStatus() code
+//   mode       systemMode: 0 AUTO, 1 manual, 2 calibration
+// Inputs  one per debounce tick on which a raw input changed
+//   raw, debounced  bit 0 UGT, 1 OHT, 2 SET, 3 UP, 4 DOWN, 5 AUTO, 6 MANUAL
+
+#ifndef CAPTURE_RECORDS_H
+#define CAPTURE_RECORDS_H
+
+#include <CaptureFrame.h>
+
+#define WLC_CAPTURE_METER(X) \
+    X(uint32_t, time)        \
+    X(float, voltage)        \
+    X(float, current)        \
+    X(float, power)          \
+    X(float, pf)             \
+    X(float, energy)         \
+    X(float, frequency)      \
+    X(uint16_t, readMs)      \
+    X(uint8_t, flags)        \
+    X(uint8_t, error)        \
+    X(uint8_t, mode)
+
+#define WLC_CAPTURE_INPUTS(X) \
+    X(uint32_t, time)         \
+    X(uint8_t, raw)           \
+    X(uint8_t, debounced)
+
+#define WLC_CAPTURE_RECORDS(R)         \
+    R(Meter, 1, WLC_CAPTURE_METER)     \
+    R(Inputs, 2, WLC_CAPTURE_INPUTS)
+
+CAPTURE_DECLARE_RECORDS(WLC_CAPTURE_RECORDS)
+
+#endif // CAPTURE_RECORDS_H
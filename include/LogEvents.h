@@ -0,0 +1,40 @@
+// Events the controller logs through EventLog
+//
+// X(name, format, types): the format is printf style and is applied on
+// the host (tools), types has one character per argument (see LogFrame.h).
+// Ids are the position in this list, so only ever append; the Status
+// format is the line the old text log printed every 5 s.
+
+#ifndef LOG_EVENTS_H
+#define LOG_EVENTS_H
+
+#include <LogFrame.h>
+
+#define WLC_LOG_EVENTS(X)                                                                                  \
+    X(Boot, "System Booted on ESP32", "")                                                                  \
+    X(Status, "V:%.2f I:%.2f PF:%.2f P:%.2f UGT:%d OHT:%d Motor:%d ERROR:%d", "ffffbbbb")                  \
+    X(SystemState, "System State: %d", "b")                                                                \
+    X(MenuClick, "Menu Index: %d  IN Menu: %d", "bb")                                                      \
+    X(SettingsMissing, "Settings partition missing, using defaults", "")                                   \
+    X(SettingsLoaded, "Settings: slot %c seq %u, %u flash erases, journal %u/%u bytes", "buuhh")           \
+    X(CalibStart, "Starting auto-calibration...", "")                                                      \
+    X(CalibBadReading, "Error: Invalid PZEM reading (NaN)", "")                                            \
+    X(CalibResult, "Min PF: %.2f Over Current: %.2f A Under Current: %.2f A Over Voltage: %.1f V "         \
+                   "Under Voltage: %.1f V", "fffff")                                                       \
+    X(OnTimeElapsed, "More than 60sec", "")                                                                \
+    X(WifiFailed, "Failed to connect", "")                                                                 \
+    X(WifiConnected, "connected...yeey :)", "")                                                            \
+    X(HistoryLoaded, "History: %u/%u pages used, last sample at %u", "hhu")                                \
+    X(HistoryMissing, "History partition missing, not logging", "")                                        \
+    X(MetricsLoaded, "Metrics: %u/%u/%u pages used", "hhh")                                                \
+    X(MetricsMissing, "Metrics partitions missing, not recording", "")                                     \
+    X(Metrics24h, "24h: Vavg %.1f Vmax %.1f Iavg %.2f Imax %.2f Pavg %.0f run %u min", "fffffu")           \
+    X(EnergyRestored, "Energy book: restored from RTC memory, %u commits on flash", "u")                   \
+    X(EnergyLoaded, "Energy book: loaded from flash, %u commits on flash", "u")                            \
+    X(EnergyMissing, "Energy partition missing, not booking energy", "")                                   \
+    X(Energy, "Energy today %.3f kWh %u starts run %u min, month %.2f kWh %u starts run %u h, "            \
+              "total %.1f kWh (PZEM %+.1f%%)", "fhufhuff")
+
+LOG_DECLARE_EVENTS(WLC_LOG_EVENTS)
+
+#endif // LOG_EVENTS_H
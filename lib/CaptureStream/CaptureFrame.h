@@ -0,0 +1,219 @@
+// CaptureStream frame format, shared by the firmware and the host tools
+//
+// On the wire every frame is
+//   0x00  COBS(record, seq, payload, crc)  0x00
+// record  record id
+// seq     sequence number, 2 bytes, counts every frame the firmware
+//         tried to send, so the receiver sees drops as gaps
+// payload the record struct, packed, little endian
+// crc     crc16 of record .. payload, 2 bytes
+//
+// COBS (Consistent Overhead Byte Stuffing) removes every zero byte from
+// the frame for at most one extra byte per 254, so the zero delimiters
+// are the only zeros in it. The leading zero ends whatever text or event
+// frame came before, and the receiver finds frames in a stream shared
+// with EventLog and the console by trying every zero-delimited segment.
+//
+// Records are declared once as an X-macro of R(name, id, COLUMNS) with
+// COLUMNS an X-macro of X(type, name). CAPTURE_DECLARE_RECORDS declares
+// a packed struct CaptureName per record, with the id in its enum, and
+// captureRecordTable with the columns for the host. Only ever append
+// columns: the host reads the columns it knows and ignores the rest.
+//
+// Nothing here needs Arduino.h, so host tools include it as it is.
+
+/*
+ Example (host):
+
+ uint8_t frame[capture::maxFrame];
+ int n = capture::decodeFrame (segment, length, frame);  // the bytes between two zeros
+ if (n >= 0)
+   {
+   uint16_t seq = frame[1] | frame[2] << 8;
+   const CaptureRecordInfo *r = findCaptureRecord (frame[0], captureRecordTable, captureRecordCount);
+   ...                                // n payload bytes at frame + capture::headerSize
+   }
+ */
+
+#ifndef CAPTURE_FRAME_H
+#define CAPTURE_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <Crc.h>
+
+namespace capture
+{
+enum : uint8_t
+{
+    delimiter = 0,
+    headerSize = 3, // record, seq
+    crcSize = 2,
+    maxPayload = 96,
+    maxFrame = headerSize + maxPayload + crcSize,
+    maxEncoded = maxFrame + 1 + 2 // one COBS code byte per 254, plus the two delimiters
+};
+
+// COBS encode n bytes into out (n + n / 254 + 1 bytes); returns the size
+inline size_t cobsEncode(const uint8_t *in, size_t n, uint8_t *out)
+{
+    size_t at = 0, o = 1; // at: the code byte of the current block
+    uint8_t code = 1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (in[i] != 0)
+        {
+            out[o++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF)
+        {
+            out[at] = code;
+            at = o++;
+            code = 1;
+        }
+    }
+    out[at] = code;
+    return o;
+}
+
+// COBS decode n bytes (no zeros) into out; returns the size, 0 if the
+// data is not valid COBS or longer than size
+inline size_t cobsDecode(const uint8_t *in, size_t n, uint8_t *out, size_t size)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < n;)
+    {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > n)
+            return 0;
+        for (uint8_t k = 1; k < code; k++)
+        {
+            if (o == size || in[i] == 0)
+                return 0;
+            out[o++] = in[i++];
+        }
+        if (code != 0xFF && i < n)
+        {
+            if (o == size)
+                return 0;
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
+
+// Build the wire frame, delimiters included, in out (maxEncoded bytes);
+// returns its size
+inline size_t encodeFrame(uint8_t record, uint16_t seq, const void *payload, uint8_t len, uint8_t *out)
+{
+    uint8_t frame[maxFrame];
+    frame[0] = record;
+    frame[1] = seq;
+    frame[2] = seq >> 8;
+    memcpy(frame + headerSize, payload, len);
+    uint16_t crc = crc16(frame, headerSize + len);
+    frame[headerSize + len] = crc;
+    frame[headerSize + len + 1] = crc >> 8;
+    out[0] = delimiter;
+    size_t n = 1 + cobsEncode(frame, headerSize + len + crcSize, out + 1);
+    out[n] = delimiter;
+    return n + 1;
+}
+
+// Decode a segment found between two zeros into frame (maxFrame bytes);
+// returns the payload size, -1 if it is not a valid frame
+inline int decodeFrame(const uint8_t *segment, size_t n, uint8_t *frame)
+{
+    size_t size = cobsDecode(segment, n, frame, maxFrame);
+    if (size < (size_t)headerSize + crcSize)
+        return -1;
+    uint16_t crc = crc16(frame, size - crcSize);
+    if (frame[size - 2] != (uint8_t)crc || frame[size - 1] != (uint8_t)(crc >> 8))
+        return -1;
+    return size - headerSize - crcSize;
+}
+} // namespace capture
+
+// Column type codes: 'u' unsigned, 'i' signed, 'f' float, with the size
+template <class T>
+struct CaptureType;
+template <>
+struct CaptureType<uint8_t>
+{
+    static constexpr char code = 'u';
+};
+template <>
+struct CaptureType<uint16_t>
+{
+    static constexpr char code = 'u';
+};
+template <>
+struct CaptureType<uint32_t>
+{
+    static constexpr char code = 'u';
+};
+template <>
+struct CaptureType<int16_t>
+{
+    static constexpr char code = 'i';
+};
+template <>
+struct CaptureType<int32_t>
+{
+    static constexpr char code = 'i';
+};
+template <>
+struct CaptureType<float>
+{
+    static constexpr char code = 'f';
+};
+
+struct CaptureColumn
+{
+    const char *name;
+    char type;
+    uint8_t size;
+};
+
+struct CaptureRecordInfo
+{
+    uint8_t id;
+    const char *name;
+    uint8_t size;
+    const CaptureColumn *columns;
+    uint8_t columnCount;
+};
+
+#define CAPTURE_FIELD(type, name) type name;
+#define CAPTURE_COLUMN(type, name) {#name, CaptureType<type>::code, sizeof(type)},
+#define CAPTURE_STRUCT(rec, id, COLUMNS)                                                              \
+    struct Capture##rec                                                                               \
+    {                                                                                                 \
+        enum : uint8_t                                                                                \
+        {                                                                                             \
+            record = id                                                                               \
+        };                                                                                            \
+        COLUMNS(CAPTURE_FIELD)                                                                        \
+    } __attribute__((packed));                                                                        \
+    static_assert(sizeof(Capture##rec) <= capture::maxPayload, "capture record too big");
+#define CAPTURE_COLUMNS(rec, id, COLUMNS) static const CaptureColumn capture##rec##Columns[] = {COLUMNS(CAPTURE_COLUMN)};
+#define CAPTURE_INFO(rec, id, COLUMNS)                                                                \
+    {id, #rec, sizeof(Capture##rec), capture##rec##Columns,                                           \
+     sizeof(capture##rec##Columns) / sizeof(CaptureColumn)},
+#define CAPTURE_DECLARE_RECORDS(LIST)                                                                 \
+    LIST(CAPTURE_STRUCT)                                                                              \
+    LIST(CAPTURE_COLUMNS)                                                                             \
+    static const CaptureRecordInfo captureRecordTable[] = {LIST(CAPTURE_INFO)};                       \
+    static const size_t captureRecordCount = sizeof(captureRecordTable) / sizeof(CaptureRecordInfo);
+
+inline const CaptureRecordInfo *findCaptureRecord(uint8_t id, const CaptureRecordInfo *table, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (table[i].id == id)
+            return &table[i];
+    return NULL;
+}
+
+#endif // CAPTURE_FRAME_H
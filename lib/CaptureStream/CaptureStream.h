@@ -0,0 +1,119 @@
+// Binary measurement capture over a serial port
+//
+// write() turns a record struct into a COBS frame with a sequence number
+// and a CRC (see CaptureFrame.h) and queues it in a ring buffer. drain()
+// sends whole frames, and only when the port takes the complete frame
+// without waiting. So the control loop never blocks on the UART, and the
+// port is always at a frame boundary between two drain() calls, free for
+// other writers. Frames are at most capture::maxEncoded bytes, which fits
+// the 128 byte UART FIFO. A full ring drops the new frame. Its sequence
+// number is used up anyway, so the receiver counts the drop as a gap.
+//
+// Everything runs on the loop task; there is no locking.
+
+/*
+ Example:
+
+ // CaptureRecords.h
+ #define APP_CAPTURE_READING(X) X (uint32_t, time) X (float, voltage)
+ #define APP_CAPTURE_RECORDS(R) R (Reading, 1, APP_CAPTURE_READING)
+ CAPTURE_DECLARE_RECORDS (APP_CAPTURE_RECORDS)
+
+ // main.cpp
+ CaptureStream<2048> captureStream;
+
+ CaptureReading r;
+ r.time = millis ();
+ r.voltage = pzem.voltage ();
+ captureStream.write (r);
+
+ void loop ()
+   {
+   captureStream.drain (Serial);
+   }
+ */
+
+#ifndef CAPTURE_STREAM_H
+#define CAPTURE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CaptureFrame.h"
+
+template <size_t SIZE>
+class CaptureStream
+{
+    static_assert(SIZE >= 256 && (SIZE & (SIZE - 1)) == 0, "ring size must be a power of two");
+
+public:
+    struct Stats
+    {
+        uint32_t frames;    // queued
+        uint32_t dropped;   // lost to a full ring
+        uint32_t bytes;     // drained
+        uint16_t highWater; // most bytes waiting at once
+    };
+
+    CaptureStream() : head_(0), tail_(0), seq_(0), stats_() {}
+
+    template <class R>
+    bool write(const R &r)
+    {
+        return put(R::record, &r, sizeof(r));
+    }
+
+    bool put(uint8_t record, const void *payload, uint8_t len)
+    {
+        if (len > capture::maxPayload)
+            return false;
+        uint8_t wire[capture::maxEncoded];
+        size_t n = capture::encodeFrame(record, seq_++, payload, len, wire);
+        uint32_t used = head_ - tail_;
+        if (SIZE - used < n + 1)
+        {
+            stats_.dropped++;
+            return false;
+        }
+        buf_[head_++ & (SIZE - 1)] = n; // length prefix, not sent
+        for (size_t i = 0; i < n; i++)
+            buf_[head_++ & (SIZE - 1)] = wire[i];
+        stats_.frames++;
+        if (used + n + 1 > stats_.highWater)
+            stats_.highWater = used + n + 1;
+        return true;
+    }
+
+    // Send the frames the output takes whole; returns bytes written.
+    // Out needs availableForWrite() and write(const uint8_t *, size_t).
+    template <class Out>
+    size_t drain(Out &out)
+    {
+        size_t done = 0;
+        while (head_ != tail_)
+        {
+            uint8_t n = buf_[tail_ & (SIZE - 1)];
+            if (out.availableForWrite() < n)
+                break;
+            uint8_t wire[capture::maxEncoded];
+            for (uint8_t i = 0; i < n; i++)
+                wire[i] = buf_[(tail_ + 1 + i) & (SIZE - 1)];
+            out.write(wire, n);
+            tail_ += n + 1;
+            done += n;
+        }
+        stats_.bytes += done;
+        return done;
+    }
+
+    bool empty() const { return head_ == tail_; }
+    uint16_t sequence() const { return seq_; }
+    const Stats &stats() const { return stats_; }
+
+private:
+    uint8_t buf_[SIZE];
+    uint32_t head_, tail_; // free running, masked on access
+    uint16_t seq_;
+    Stats stats_;
+};
+
+#endif // CAPTURE_STREAM_H
@@ -0,0 +1,38 @@
+// Small table-less CRC helpers shared by the flash stores and serial framing
+//
+// crc16 is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), crc32 is the
+// usual reflected CRC-32 (poly 0xEDB88320). Both can be chained by passing
+// the previous result as crc.
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+inline uint16_t crc16(const void *data, size_t len, uint16_t crc = 0xFFFF)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len--)
+    {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+inline uint32_t crc32(const void *data, size_t len, uint32_t crc = 0)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *p++;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+    }
+    return ~crc;
+}
+
+#endif // CRC_H
@@ -0,0 +1,200 @@
+#include "EnergyBook.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <Crc.h>
+
+EnergyBook::EnergyBook(FlashRegion &flash, Shadow &shadow)
+    : store_(flash, schema), shadow_(shadow), lastMs_(0), lastCommitMs_(0), started_(false), changed_(false),
+      stats_()
+{
+}
+
+uint16_t EnergyBook::shadowCrc(const Shadow &s)
+{
+    return crc16(&s, offsetof(Shadow, crc));
+}
+
+void EnergyBook::seal()
+{
+    shadow_.magic = shadowMagic;
+    shadow_.crc = shadowCrc(shadow_);
+}
+
+bool EnergyBook::begin()
+{
+    Book stored;
+    bool loaded = store_.load(stored, Book());
+
+    // RTC memory survives a reset but not a power cut; take it if it
+    // carries on from what is on flash
+    stats_.restored = shadow_.magic == shadowMagic && shadow_.crc == shadowCrc(shadow_) &&
+                      (int32_t)(shadow_.book.generation - stored.generation) >= 0;
+    if (!stats_.restored)
+    {
+        memset(&shadow_, 0, sizeof(shadow_));
+        shadow_.book = stored;
+    }
+    shadow_.lastPzem = NAN; // the meter may have been reset meanwhile
+    shadow_.running = false;
+    changed_ = memcmp(&shadow_.book, &stored, sizeof(Book)) != 0; // booked after the last commit
+    started_ = false;
+    seal();
+    return loaded || stats_.restored;
+}
+
+// Civil month from days since 1970-01-01 (H. Hinnant's algorithm)
+uint16_t EnergyBook::monthOf(uint32_t localTime)
+{
+    uint32_t z = localTime / 86400 + 719468;
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t month = mp < 10 ? mp + 2 : mp - 10; // 0 = January
+    uint32_t year = yoe + era * 400 + (month < 2);
+    return year * 12 + month;
+}
+
+uint16_t EnergyBook::newest(const Bucket *ring, uint16_t count)
+{
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < count; i++)
+        if (ring[i].index > n)
+            n = ring[i].index;
+    return n;
+}
+
+EnergyBook::Bucket &EnergyBook::open(Bucket *ring, uint16_t count, uint16_t index)
+{
+    Bucket &b = ring[index % count];
+    if (b.index != index)
+    {
+        memset(&b, 0, sizeof(b));
+        b.index = index;
+    }
+    return b;
+}
+
+void EnergyBook::post(uint16_t dayIndex, uint16_t monthIndex, uint32_t wh, uint32_t seconds, uint16_t starts)
+{
+    Book &b = shadow_.book;
+    Bucket *buckets[] = {&open(b.days, dayCount, dayIndex), &open(b.months, monthCount, monthIndex)};
+    for (Bucket *k : buckets)
+    {
+        k->wh += wh;
+        k->runSeconds += seconds;
+        k->starts += starts;
+    }
+}
+
+void EnergyBook::update(unsigned long nowMs, uint32_t localTime, float power, float pzemKWh, bool running)
+{
+    Book &b = shadow_.book;
+    unsigned long dt = started_ ? nowMs - lastMs_ : 0;
+    if (dt > maxStep)
+        dt = maxStep; // stalled reads, don't extrapolate the last power for long
+    lastMs_ = nowMs;
+    if (!started_)
+    {
+        lastCommitMs_ = nowMs;
+        started_ = true;
+    }
+
+    // the clock may be set back (NTP after a free running start): keep
+    // booking on the newest day rather than reopening an old one
+    bool dated = clockSet(localTime);
+    uint16_t lastDay = newest(b.days, dayCount);
+    uint16_t dayIndex = dayOf(localTime);
+    uint16_t monthIndex = monthOf(localTime);
+    if (dayIndex < lastDay)
+    {
+        dayIndex = lastDay;
+        monthIndex = newest(b.months, monthCount);
+    }
+    bool dayEnded = dated && dayIndex != lastDay;
+
+    float joules = isnan(power) || power < 0 ? 0 : power * dt / 1000.0f;
+    shadow_.joules += joules;
+
+    // the meter's counter only counts while it reads and does not restart
+    if (!isnan(pzemKWh) && !isnan(shadow_.lastPzem) && pzemKWh >= shadow_.lastPzem)
+    {
+        shadow_.checkedJoules += joules;
+        shadow_.pzemWh += (pzemKWh - shadow_.lastPzem) * 1000.0f;
+    }
+    shadow_.lastPzem = pzemKWh;
+
+    uint16_t starts = running && !shadow_.running;
+    bool stopped = !running && shadow_.running;
+    if (running)
+        shadow_.runMs += dt;
+    shadow_.running = running;
+
+    // move whole units into the book
+    uint32_t wh = shadow_.joules / 3600.0f;
+    shadow_.joules -= wh * 3600.0f;
+    uint32_t seconds = shadow_.runMs / 1000;
+    shadow_.runMs -= seconds * 1000;
+    uint32_t checked = shadow_.checkedJoules / 3600.0f;
+    shadow_.checkedJoules -= checked * 3600.0f;
+    uint32_t metered = shadow_.pzemWh;
+    shadow_.pzemWh -= metered;
+    b.checkedWh += checked;
+    b.pzemWh += metered;
+    b.totalWh += wh;
+    b.totalStarts += starts;
+    if (dated)
+        post(dayIndex, monthIndex, wh, seconds, starts);
+    if (wh || seconds || starts || checked || metered || dayEnded)
+        changed_ = true;
+
+    if (changed_ && (dayEnded || stopped || nowMs - lastCommitMs_ >= commitInterval))
+        commit();
+    else
+        seal();
+}
+
+bool EnergyBook::commit()
+{
+    shadow_.book.generation++;
+    store_.stage(shadow_.book);
+    bool ok = store_.commit();
+    seal();
+    lastCommitMs_ = lastMs_;
+    changed_ = false;
+    stats_.commits++;
+    return ok;
+}
+
+EnergyBook::Bucket EnergyBook::day(uint16_t index) const
+{
+    Bucket b = shadow_.book.days[index % dayCount];
+    if (b.index != index)
+    {
+        memset(&b, 0, sizeof(b));
+        b.index = index;
+    }
+    return b;
+}
+
+EnergyBook::Bucket EnergyBook::month(uint16_t index) const
+{
+    Bucket b = shadow_.book.months[index % monthCount];
+    if (b.index != index)
+    {
+        memset(&b, 0, sizeof(b));
+        b.index = index;
+    }
+    return b;
+}
+
+float EnergyBook::deviation() const
+{
+    const Book &b = shadow_.book;
+    if (b.pzemWh == 0)
+        return 0;
+    return ((float)b.checkedWh - (float)b.pzemWh) / b.pzemWh;
+}
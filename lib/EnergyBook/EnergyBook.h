@@ -0,0 +1,158 @@
+// Energy accounting: daily and monthly kWh, run time and motor starts
+//
+// The PZEM energy register is a single counter that restarts whenever the
+// meter is reset. EnergyBook integrates the measured power itself and keeps
+// buckets for the last days and months, plus lifetime totals. While the
+// PZEM counter counts up, its increase is summed next to the integrated
+// energy of the same intervals, so deviation() shows how far the two
+// disagree.
+//
+// The book is a plain struct kept by a SettingsStore on its own partition
+// (two sectors). It is committed when a day ends, when the motor stops
+// and at most once every commitInterval otherwise. Between commits the
+// running state, including the fractions of a Wh and of a second not yet
+// booked, lives in a Shadow the caller places in RTC memory, which keeps
+// its contents across resets. On boot a valid shadow that is not older
+// than the flash copy is used, so a watchdog reset or crash loses
+// nothing. A power cut loses at most what happened since the last commit.
+//
+// Day and month buckets are rings indexed by day number (local seconds /
+// 86400) and month number (year * 12 + month). A bucket is only valid
+// for the index stored in it. Until the clock has been set (a local time
+// before 2020) energy, run time and starts count in the totals only: the
+// day they belong to is not known.
+
+/*
+ Example:
+
+ RTC_NOINIT_ATTR EnergyBook::Shadow energyShadow;
+ EspPartitionRegion energyFlash;
+ EnergyBook book (energyFlash, energyShadow);
+
+ void setup ()
+   {
+   energyFlash.begin ("energy");
+   book.begin ();
+   }
+
+ void everySecond ()
+   {
+   book.update (millis (), localTime, pzem.power (), pzem.energy (), motorRunning);
+   }
+
+ EnergyBook::Bucket today = book.day (localTime / 86400);
+ */
+
+#ifndef ENERGY_BOOK_H
+#define ENERGY_BOOK_H
+
+#include <stdint.h>
+#include <FlashRegion.h>
+#include <SettingsStore.h>
+
+class EnergyBook
+{
+public:
+    enum : uint16_t
+    {
+        dayCount = 7,
+        monthCount = 12,
+        schema = 1
+    };
+
+    enum : uint32_t
+    {
+        commitInterval = 3600000UL, // ms between commits while nothing else forces one
+        maxStep = 60000UL,          // longer gaps between updates are counted as this
+        clockSetFrom = 1577836800UL // 2020-01-01; earlier times are a clock not yet set
+    };
+
+    struct Bucket
+    {
+        uint16_t index;       // day or month number
+        uint16_t starts;      // motor starts
+        uint32_t wh;          // integrated energy
+        uint32_t runSeconds;
+    };
+
+    // Persistent part, at most 254 bytes (a SettingsStore limit)
+    struct Book
+    {
+        uint32_t generation;  // incremented by every commit
+        Bucket days[dayCount];
+        Bucket months[monthCount];
+        uint32_t totalWh;
+        uint32_t totalStarts;
+        uint32_t checkedWh;   // integrated energy of the intervals the PZEM counter covered
+        uint32_t pzemWh;      // the PZEM counter's increase over the same intervals
+    };
+
+    // State between commits, for RTC memory
+    struct Shadow
+    {
+        uint32_t magic;
+        Book book;
+        float joules;         // not yet booked as whole Wh
+        float checkedJoules;
+        float pzemWh;         // fraction not yet booked
+        float lastPzem;       // kWh at the previous update, NaN if unknown
+        uint32_t runMs;       // not yet booked as whole seconds
+        uint8_t running;
+        uint16_t crc;         // crc16 of the fields above
+    };
+
+    struct Stats
+    {
+        uint32_t commits;     // since boot
+        bool restored;        // begin() took the RTC shadow
+    };
+
+    EnergyBook(FlashRegion &flash, Shadow &shadow);
+
+    // Load the book; false if neither flash nor RTC memory held one
+    bool begin();
+
+    // Integrate power (W) since the previous call. pzemKWh is the meter's
+    // counter, NaN if the read failed. localTime is seconds in local time,
+    // or 0 while the clock is not set.
+    void update(unsigned long nowMs, uint32_t localTime, float power, float pzemKWh, bool running);
+
+    // Write the book to flash now
+    bool commit();
+
+    // Bucket of a day or month number; zero if it is no longer (or not yet) kept
+    Bucket day(uint16_t index) const;
+    Bucket month(uint16_t index) const;
+
+    const Book &book() const { return shadow_.book; }
+    const Stats &stats() const { return stats_; }
+
+    // (integrated - PZEM) / PZEM over the intervals both saw, 0 without data
+    float deviation() const;
+
+    static bool clockSet(uint32_t localTime) { return localTime >= clockSetFrom; }
+    static uint16_t dayOf(uint32_t localTime) { return localTime / 86400; }
+    static uint16_t monthOf(uint32_t localTime);
+
+private:
+    enum : uint32_t
+    {
+        shadowMagic = 0x45434C57 // "WLCE"
+    };
+
+    SettingsStore<Book> store_;
+    Shadow &shadow_;
+    unsigned long lastMs_;
+    unsigned long lastCommitMs_;
+    bool started_;
+    bool changed_;          // since the last commit
+    Stats stats_;
+
+    static uint16_t shadowCrc(const Shadow &s);
+    void seal();
+    static Bucket &open(Bucket *ring, uint16_t count, uint16_t index);
+    static uint16_t newest(const Bucket *ring, uint16_t count);
+    void post(uint16_t dayIndex, uint16_t monthIndex, uint32_t wh, uint32_t seconds, uint16_t starts);
+};
+
+#endif // ENERGY_BOOK_H
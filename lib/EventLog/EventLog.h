@@ -0,0 +1,203 @@
+// Deferred binary event log
+//
+// Printing text at 115200 baud blocks the caller for about 87 us per
+// character once the UART FIFO is full. EventLog instead copies an event
+// id, a millisecond timestamp and the raw argument bytes into a ring
+// buffer, and drain() later writes only as many bytes as the UART can take
+// without waiting. Text is produced on the host from the event table
+// (format string and argument types per id, see include/LogEvents.h).
+//
+// The ring is lock free for one producer and one consumer: record() only
+// moves the head, drain() only the tail. Both may run on different tasks
+// or cores, but events must be recorded from a single task. A full ring
+// drops the new event and counts it; the next event that fits is preceded
+// by a droppedEvent frame with the count.
+//
+// Frames (see LogFrame.h) start with a sync byte and end with a CRC, so
+// a reader finds them in a stream that also carries text from other code
+// (WiFiManager, the ESP-IDF log).
+//
+// Levels are filtered at compile time: LOG_ERROR .. LOG_DEBUG above
+// LOG_LEVEL expand to nothing, their arguments are not even evaluated.
+//
+// Arguments are converted to the types of the event's type string, and a
+// wrong argument count is a compile error.
+
+/*
+ Example:
+
+ // LogEvents.h
+ #define APP_LOG_EVENTS(X)                        \
+     X (Boot, "Booted", "")                       \
+     X (Reading, "V:%.2f I:%.2f", "ff")
+ LOG_DECLARE_EVENTS (APP_LOG_EVENTS)
+
+ // main.cpp
+ EventLog<1024> eventLog;                        // the macros log here
+
+ LOG_INFO (Reading, voltage, current);
+
+ void loop ()
+   {
+   eventLog.drain (Serial);
+   }
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <Crc.h>
+#include "LogFrame.h"
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+template <size_t SIZE>
+class EventLog
+{
+    static_assert(SIZE >= 64 && (SIZE & (SIZE - 1)) == 0, "ring size must be a power of two");
+
+public:
+    struct Stats
+    {
+        uint32_t events;    // recorded
+        uint32_t dropped;   // lost to a full ring
+        uint32_t bytes;     // drained
+        uint16_t highWater; // most bytes waiting at once
+    };
+
+    EventLog() : head_(0), tail_(0), pendingDrops_(0), stats_() {}
+
+    // Use the macros below rather than calling this directly
+    template <uint8_t ID, class... A>
+    bool record(uint8_t level, const A &...args)
+    {
+        typedef LogEventTraits<ID> E;
+        static_assert(sizeof...(A) == E::count(), "argument count does not match the event's type string");
+        static_assert(eventlog::argsSize<E>() <= eventlog::maxArgs, "too many argument bytes");
+
+        uint8_t payload[eventlog::argsSize<E>() + 1];
+        eventlog::pack<E, 0>(payload, args...);
+        uint32_t now = millis();
+
+        if (pendingDrops_)
+        {
+            if (!put(eventlog::droppedEvent, LOG_LEVEL_WARN, now, &pendingDrops_, sizeof(pendingDrops_)))
+                return drop();
+            pendingDrops_ = 0;
+        }
+        if (!put(ID, level, now, payload, eventlog::argsSize<E>()))
+            return drop();
+        stats_.events++;
+        return true;
+    }
+
+    // Write what the output takes without blocking; returns bytes written.
+    // Out needs availableForWrite() and write(const uint8_t *, size_t).
+    template <class Out>
+    size_t drain(Out &out)
+    {
+        size_t done = 0;
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        while (head != tail)
+        {
+            int room = out.availableForWrite();
+            if (room <= 0)
+                break;
+            size_t at = tail & (SIZE - 1);
+            size_t n = head - tail;
+            if (n > SIZE - at)
+                n = SIZE - at; // up to the end of the ring, the rest on the next turn
+            if (n > (size_t)room)
+                n = room;
+            n = out.write(buf_ + at, n);
+            if (n == 0)
+                break;
+            tail += n;
+            done += n;
+            tail_.store(tail, std::memory_order_release);
+        }
+        stats_.bytes += done;
+        return done;
+    }
+
+    bool empty() const { return head_.load() == tail_.load(); }
+    const Stats &stats() const { return stats_; }
+
+private:
+    uint8_t buf_[SIZE];
+    std::atomic<uint32_t> head_; // free running, masked on access
+    std::atomic<uint32_t> tail_;
+    uint32_t pendingDrops_;
+    Stats stats_;
+
+    bool drop()
+    {
+        pendingDrops_++;
+        stats_.dropped++;
+        return false;
+    }
+
+    bool put(uint8_t id, uint8_t level, uint32_t time, const void *args, uint8_t len)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t used = head - tail_.load(std::memory_order_acquire);
+        size_t size = eventlog::headerSize + len + eventlog::crcSize;
+        if (SIZE - used < size)
+            return false;
+
+        uint8_t frame[eventlog::headerSize + eventlog::maxArgs + eventlog::crcSize];
+        frame[0] = eventlog::sync;
+        frame[1] = len;
+        frame[2] = id;
+        frame[3] = level;
+        memcpy(frame + 4, &time, 4);
+        memcpy(frame + eventlog::headerSize, args, len);
+        uint16_t crc = crc16(frame + 1, eventlog::headerSize - 1 + len);
+        frame[eventlog::headerSize + len] = crc;
+        frame[eventlog::headerSize + len + 1] = crc >> 8;
+
+        for (size_t i = 0; i < size; i++)
+            buf_[(head + i) & (SIZE - 1)] = frame[i];
+        head_.store(head + size, std::memory_order_release);
+
+        if (used + size > stats_.highWater)
+            stats_.highWater = used + size;
+        return true;
+    }
+};
+
+#define LOG_AT(level, id, ...) eventLog.record<(uint8_t)LogEvent::id>(level, ##__VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(id, ...) LOG_AT(LOG_LEVEL_ERROR, id, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(id, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(id, ...) LOG_AT(LOG_LEVEL_WARN, id, ##__VA_ARGS__)
+#else
+#define LOG_WARN(id, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(id, ...) LOG_AT(LOG_LEVEL_INFO, id, ##__VA_ARGS__)
+#else
+#define LOG_INFO(id, ...) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(id, ...) LOG_AT(LOG_LEVEL_DEBUG, id, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(id, ...) ((void)0)
+#endif
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,282 @@
+// EventLog frame format, shared by the firmware and the host tools
+//
+// Frame (little endian):
+//   0xA5  sync
+//   len   argument bytes
+//   id    event id
+//   level LOG_LEVEL_*
+//   time  millis(), 4 bytes
+//   args  len bytes, packed as the event's type string says
+//   crc   crc16 of len .. args, 2 bytes
+//
+// Argument types, one character per argument:
+//   f float   i int32   u uint32   h uint16   b uint8
+//
+// The application lists its events once as an X-macro of
+// X(name, format, types) and passes it to LOG_DECLARE_EVENTS, which
+// declares the LogEvent ids, the compile time traits EventLog checks the
+// arguments against, and logEventTable for formatting on the host.
+//
+// Nothing here needs Arduino.h, so host tools include it as it is.
+
+/*
+ Example (host):
+
+ size_t n;
+ for (size_t i = 0; i < size; i += n)
+   {
+   LogFrame f;
+   n = parseLogFrame (data + i, size - i, f);
+   if (n == 0)
+     {
+     putchar (data[i]);              // text between frames
+     n = 1;
+     continue;
+     }
+   char line[200];
+   formatLogFrame (line, sizeof (line), f, logEventTable, logEventCount);
+   puts (line);
+   }
+ */
+
+#ifndef LOG_FRAME_H
+#define LOG_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <Crc.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Per event: format and type string, specialised by LOG_DECLARE_EVENTS
+template <uint8_t ID>
+struct LogEventTraits;
+
+struct LogEventInfo
+{
+    const char *name;
+    const char *format;
+    const char *types;
+};
+
+struct LogFrame
+{
+    uint8_t len;
+    uint8_t id;
+    uint8_t level;
+    uint32_t time;          // ms since boot
+    const uint8_t *args;    // points into the parsed buffer
+};
+
+namespace eventlog
+{
+enum : uint8_t
+{
+    sync = 0xA5,
+    headerSize = 8,     // sync, len, id, level, time
+    crcSize = 2,
+    maxArgs = 32,       // argument bytes per event
+    droppedEvent = 0xFF // args "u": events lost to a full ring
+};
+
+template <char C>
+struct Arg;
+template <>
+struct Arg<'f'>
+{
+    typedef float type;
+};
+template <>
+struct Arg<'i'>
+{
+    typedef int32_t type;
+};
+template <>
+struct Arg<'u'>
+{
+    typedef uint32_t type;
+};
+template <>
+struct Arg<'h'>
+{
+    typedef uint16_t type;
+};
+template <>
+struct Arg<'b'>
+{
+    typedef uint8_t type;
+};
+
+constexpr uint8_t argSize(char c)
+{
+    return c == 'f' || c == 'i' || c == 'u' ? 4 : c == 'h' ? 2 : c == 'b' ? 1 : 0;
+}
+
+// Bytes taken by the arguments from k on
+template <class E>
+constexpr size_t argsSize(size_t k = 0)
+{
+    return k >= E::count() ? 0 : argSize(E::type(k)) + argsSize<E>(k + 1);
+}
+
+template <class E, size_t K>
+inline void pack(uint8_t *)
+{
+}
+
+template <class E, size_t K, class A, class... Rest>
+inline void pack(uint8_t *p, const A &a, const Rest &...rest)
+{
+    typename Arg<E::type(K)>::type v = a;
+    memcpy(p, &v, sizeof(v));
+    pack<E, K + 1>(p + sizeof(v), rest...);
+}
+} // namespace eventlog
+
+#define LOG_EVENT_ID(name, fmt, types) name,
+#define LOG_EVENT_TRAITS(name, fmt, types)                                       \
+    template <>                                                                  \
+    struct LogEventTraits<(uint8_t)LogEvent::name>                               \
+    {                                                                            \
+        static constexpr const char *format() { return fmt; }                    \
+        static constexpr char type(size_t k) { return types[k]; }                \
+        static constexpr size_t count() { return sizeof(types) - 1; }            \
+    };
+#define LOG_EVENT_INFO(name, fmt, types) {#name, fmt, types},
+#define LOG_DECLARE_EVENTS(LIST)                                                 \
+    enum class LogEvent : uint8_t                                                \
+    {                                                                            \
+        LIST(LOG_EVENT_ID) eventCount                                            \
+    };                                                                           \
+    LIST(LOG_EVENT_TRAITS)                                                       \
+    static const LogEventInfo logEventTable[] = {LIST(LOG_EVENT_INFO)};          \
+    static const size_t logEventCount = (size_t)LogEvent::eventCount;
+
+// Size of the valid frame at p, 0 if there is none (not a sync byte, cut
+// short or a CRC error)
+inline size_t parseLogFrame(const uint8_t *p, size_t n, LogFrame &f)
+{
+    if (n < (size_t)eventlog::headerSize + eventlog::crcSize || p[0] != eventlog::sync || p[1] > eventlog::maxArgs)
+        return 0;
+    size_t size = eventlog::headerSize + p[1] + eventlog::crcSize;
+    if (n < size)
+        return 0;
+    uint16_t crc = crc16(p + 1, eventlog::headerSize - 1 + p[1]);
+    if (p[size - 2] != (uint8_t)crc || p[size - 1] != (uint8_t)(crc >> 8))
+        return 0;
+    f.len = p[1];
+    f.id = p[2];
+    f.level = p[3];
+    memcpy(&f.time, p + 4, 4);
+    f.args = p + eventlog::headerSize;
+    return size;
+}
+
+namespace eventlog
+{
+// snprintf at out + len that keeps counting once the buffer is full
+template <class... A>
+inline int append(char *out, size_t size, int len, const char *format, A... args)
+{
+    size_t at = (size_t)len < size ? len : size;
+    return len + snprintf(out + at, size - at, format, args...);
+}
+} // namespace eventlog
+
+// Render a frame with its event's format string; returns the length like
+// snprintf. Unknown ids and argument sizes that don't match the table
+// are shown raw, so a newer firmware still produces readable output.
+inline int formatLogFrame(char *out, size_t size, const LogFrame &f, const LogEventInfo *table, size_t count)
+{
+    using eventlog::append;
+
+    if (f.id == eventlog::droppedEvent && f.len == 4)
+    {
+        uint32_t n;
+        memcpy(&n, f.args, 4);
+        return snprintf(out, size, "(%u events dropped)", (unsigned)n);
+    }
+
+    const LogEventInfo *e = f.id < count ? &table[f.id] : NULL;
+    size_t expect = 0;
+    for (const char *t = e ? e->types : ""; *t; t++)
+        expect += eventlog::argSize(*t);
+    if (!e || expect != f.len)
+    {
+        int len = snprintf(out, size, "(event %u:", f.id);
+        for (uint8_t i = 0; i < f.len; i++)
+            len = append(out, size, len, " %02x", f.args[i]);
+        return append(out, size, len, ")");
+    }
+
+    // one conversion at a time, each with its own argument
+    int len = 0;
+    const uint8_t *a = f.args;
+    const char *t = e->types;
+    for (const char *p = e->format; *p;)
+    {
+        if (*p != '%')
+        {
+            len = append(out, size, len, "%c", *p++);
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            len = append(out, size, len, "%%");
+            p += 2;
+            continue;
+        }
+
+        char spec[16];
+        size_t n = 0;
+        while (*p && n < sizeof(spec) - 1)
+        {
+            spec[n++] = *p;
+            if (strchr("diouxXcfFeEgG", *p++))
+                break;
+        }
+        spec[n] = 0;
+
+        union
+        {
+            float f;
+            int32_t i;
+            uint32_t u;
+            uint16_t h;
+            uint8_t b;
+        } v;
+        char type = *t ? *t++ : 0;
+        memcpy(&v, a, eventlog::argSize(type));
+        a += eventlog::argSize(type);
+        switch (type)
+        {
+        case 'f':
+            len = append(out, size, len, spec, (double)v.f);
+            break;
+        case 'i':
+            len = append(out, size, len, spec, (int)v.i);
+            break;
+        case 'u':
+            len = append(out, size, len, spec, (unsigned)v.u);
+            break;
+        case 'h':
+            len = append(out, size, len, spec, (unsigned)v.h);
+            break;
+        case 'b':
+            len = append(out, size, len, spec, (unsigned)v.b);
+            break;
+        default:
+            len = append(out, size, len, "?");
+            break;
+        }
+    }
+    return len;
+}
+
+#endif // LOG_FRAME_H
@@ -0,0 +1,31 @@
+#include "FlashRegion.h"
+
+#if defined(ESP32)
+
+bool EspPartitionRegion::begin(const char *label)
+{
+    part_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    return part_ != nullptr;
+}
+
+size_t EspPartitionRegion::size() const
+{
+    return part_ ? part_->size : 0;
+}
+
+bool EspPartitionRegion::read(size_t addr, void *data, size_t len) const
+{
+    return part_ && esp_partition_read(part_, addr, data, len) == ESP_OK;
+}
+
+bool EspPartitionRegion::doWrite(size_t addr, const void *data, size_t len)
+{
+    return part_ && esp_partition_write(part_, addr, data, len) == ESP_OK;
+}
+
+bool EspPartitionRegion::doErase(size_t addr)
+{
+    return part_ && esp_partition_erase_range(part_, addr, sectorSize) == ESP_OK;
+}
+
+#endif // ESP32
@@ -0,0 +1,88 @@
+// Raw flash region with wear accounting
+//
+// The stores in this project (settings, history) program flash directly
+// instead of going through EEPROM emulation. FlashRegion is the small
+// interface they need: read, program (1 -> 0 bits only) and erase whole
+// sectors. The base class counts erases and bytes programmed so every
+// store can report its wear.
+//
+// EspPartitionRegion maps a region onto a data partition from
+// partitions.csv, found by label.
+
+#ifndef FLASH_REGION_H
+#define FLASH_REGION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class FlashRegion
+{
+    uint32_t erases_;
+    uint32_t bytesWritten_;
+
+protected:
+    virtual bool doWrite(size_t addr, const void *data, size_t len) = 0;
+    virtual bool doErase(size_t addr) = 0;
+
+public:
+    enum
+    {
+        sectorSize = 4096
+    };
+
+    FlashRegion() : erases_(0), bytesWritten_(0) {}
+    virtual ~FlashRegion() {}
+
+    virtual size_t size() const = 0;
+    virtual bool read(size_t addr, void *data, size_t len) const = 0;
+
+    // Program bytes; only clears bits, the range must be erased first
+    bool write(size_t addr, const void *data, size_t len)
+    {
+        if (addr + len > size())
+            return false;
+        bytesWritten_ += len;
+        return doWrite(addr, data, len);
+    }
+
+    // Erase the sector that contains addr (sets it to 0xFF)
+    bool eraseSector(size_t addr)
+    {
+        if (addr >= size())
+            return false;
+        erases_++;
+        return doErase(addr - addr % sectorSize);
+    }
+
+    size_t sectors() const { return size() / sectorSize; }
+
+    // Wear since boot
+    uint32_t erases() const { return erases_; }
+    uint32_t bytesWritten() const { return bytesWritten_; }
+};
+
+#if defined(ESP32)
+
+#include <esp_partition.h>
+
+class EspPartitionRegion : public FlashRegion
+{
+    const esp_partition_t *part_;
+
+protected:
+    bool doWrite(size_t addr, const void *data, size_t len) override;
+    bool doErase(size_t addr) override;
+
+public:
+    EspPartitionRegion() : part_(nullptr) {}
+
+    // Look up a data partition by its label in partitions.csv
+    bool begin(const char *label);
+
+    size_t size() const override;
+    bool read(size_t addr, void *data, size_t len) const override;
+};
+
+#endif // ESP32
+
+#endif // FLASH_REGION_H
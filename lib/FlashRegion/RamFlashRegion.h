@@ -0,0 +1,113 @@
+// FlashRegion in RAM, for host tests and benchmarks
+//
+// Behaves like NOR flash: erased bytes read 0xFF, programming only clears
+// bits, and erasing works on whole sectors. It counts erases per sector
+// on top of the base class totals, so a test can see how the wear spreads.
+//
+// cutAfter(n) simulates a power cut: the next n programmed bytes and
+// erases go through, then every write and erase fails (returns false)
+// without touching memory, as if the chip had lost power. A cut inside a
+// write leaves the bytes before it programmed. powerOn() ends the cut;
+// keep the region and build new stores on it to simulate the reboot.
+//
+// Nothing here needs Arduino.h or ESP-IDF.
+
+/*
+ Example:
+
+ RamFlashRegion flash (2);
+ SettingsStore<Settings> store (flash, 1);
+ ...
+ flash.cutAfter (37);               // brown-out 37 bytes into the next commit
+ store.commit ();
+ flash.powerOn ();
+ SettingsStore<Settings> rebooted (flash, 1);
+ */
+
+#ifndef RAM_FLASH_REGION_H
+#define RAM_FLASH_REGION_H
+
+#include <string.h>
+#include <vector>
+#include "FlashRegion.h"
+
+class RamFlashRegion : public FlashRegion
+{
+    std::vector<uint8_t> mem_;
+    std::vector<uint32_t> sectorErases_;
+    long budget_; // bytes and erases left before the power cut, -1 for none
+    bool cut_;    // a write or erase has failed for want of power
+
+protected:
+    bool doWrite(size_t addr, const void *data, size_t len) override
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < len; i++)
+        {
+            if (budget_ == 0)
+            {
+                cut_ = true;
+                return false;
+            }
+            if (budget_ > 0)
+                budget_--;
+            mem_[addr + i] &= p[i];
+        }
+        return true;
+    }
+
+    bool doErase(size_t addr) override
+    {
+        if (budget_ == 0)
+        {
+            cut_ = true;
+            return false;
+        }
+        if (budget_ > 0)
+            budget_--;
+        memset(&mem_[addr], 0xFF, sectorSize);
+        sectorErases_[addr / sectorSize]++;
+        return true;
+    }
+
+public:
+    explicit RamFlashRegion(size_t sectors)
+        : mem_(sectors * sectorSize, 0xFF), sectorErases_(sectors), budget_(-1), cut_(false)
+    {
+    }
+
+    size_t size() const override { return mem_.size(); }
+
+    bool read(size_t addr, void *data, size_t len) const override
+    {
+        if (addr + len > mem_.size())
+            return false;
+        memcpy(data, &mem_[addr], len);
+        return true;
+    }
+
+    // Lose power after n more programmed bytes and erases
+    void cutAfter(long n)
+    {
+        budget_ = n;
+        cut_ = false;
+    }
+
+    void powerOn()
+    {
+        budget_ = -1;
+        cut_ = false;
+    }
+
+    // True once a write or erase has hit the cut; one that used up the
+    // last of the budget still completed
+    bool powerCut() const { return cut_; }
+
+    // Erases of one sector since construction
+    uint32_t sectorErases(size_t sector) const { return sectorErases_[sector]; }
+
+    // Raw contents, to corrupt or inspect in tests
+    uint8_t *data() { return mem_.data(); }
+};
+
+#endif // RAM_FLASH_REGION_H
@@ -0,0 +1,303 @@
+// Streaming compression for slowly changing measurement series
+//
+// After Facebook's Gorilla time series format: timestamps are stored as
+// delta-of-delta, so a steady sample rate costs one bit per sample. The
+// values are fixed point integers (0.1 V, 0.01 A, ...) and are stored as
+// the difference to the previous sample in a few prefix-coded size
+// classes; an unchanged value also costs one bit. Fixed point deltas
+// compress these quantised readings better than XOR-ing floats, whose
+// mantissas change in many bits for a 0.1 V step.
+//
+//   time   first sample 32 bits, then delta-of-delta:
+//          0 | 10 +7 bits | 110 +9 | 1110 +12 | 1111 +32
+//   value  first sample 32 bits, then zigzag delta:
+//          0 | 10 +3 bits | 110 +7 | 1110 +12 | 1111 +32
+//
+// Everything works on a caller provided buffer, RAM use is fixed.
+// append() is all or nothing: a sample that does not fit leaves the
+// buffer as it was, so a full block can be written out and a new one
+// started with that sample. The decoder keeps only its position and the
+// previous values, it can be copied and pointed at a copy of the buffer.
+
+/*
+ Example:
+
+ uint8_t block[240];
+ GorillaEncoder<2> enc;
+ enc.reset (block, sizeof (block));
+ int32_t v[2] = {2301, 512};
+ if (!enc.append (now, v))
+   {
+   write (block, enc.bytes (), enc.count ());   // full: flush, start again
+   enc.reset (block, sizeof (block));
+   enc.append (now, v);
+   }
+
+ GorillaDecoder<2> dec;
+ uint32_t t;
+ while (dec.next (block, bytes, count, t, v))
+   use (t, v);
+ */
+
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class BitWriter
+{
+    uint8_t *buf_;
+    size_t size_;       // bytes
+    size_t bits_;       // written so far
+
+public:
+    BitWriter() : buf_(NULL), size_(0), bits_(0) {}
+
+    void reset(uint8_t *buf, size_t size)
+    {
+        buf_ = buf;
+        size_ = size;
+        bits_ = 0;
+        if (buf_)
+            memset(buf_, 0, size_);
+    }
+
+    size_t bits() const { return bits_; }
+    size_t bytes() const { return (bits_ + 7) / 8; }
+    bool fits(size_t n) const { return bits_ + n <= size_ * 8; }
+
+    // Append the low n bits of v, most significant first; caller checks fits()
+    void write(uint32_t v, uint8_t n)
+    {
+        while (n)
+        {
+            uint8_t room = 8 - (bits_ & 7);
+            uint8_t take = n < room ? n : room;
+            uint8_t part = (v >> (n - take)) & ((1u << take) - 1);
+            buf_[bits_ / 8] |= part << (room - take);
+            bits_ += take;
+            n -= take;
+        }
+    }
+};
+
+class BitReader
+{
+    const uint8_t *buf_;
+    size_t size_;
+    size_t pos_;        // bit position
+
+public:
+    BitReader(const uint8_t *buf, size_t size, size_t pos = 0) : buf_(buf), size_(size), pos_(pos) {}
+
+    size_t position() const { return pos_; }
+
+    bool read(uint8_t n, uint32_t &v)
+    {
+        if (pos_ + n > size_ * 8)
+            return false;
+        v = 0;
+        while (n)
+        {
+            uint8_t room = 8 - (pos_ & 7);
+            uint8_t take = n < room ? n : room;
+            v = (v << take) | ((buf_[pos_ / 8] >> (room - take)) & ((1u << take) - 1));
+            pos_ += take;
+            n -= take;
+        }
+        return true;
+    }
+};
+
+namespace gorilla
+{
+struct Class
+{
+    uint8_t prefix;     // value of the prefix bits
+    uint8_t prefixBits;
+    uint8_t bits;       // payload
+};
+
+// size classes: the payload of the last class is a full 32 bit word
+const Class timeClasses[] = {{0x0, 1, 0}, {0x2, 2, 7}, {0x6, 3, 9}, {0xE, 4, 12}, {0xF, 4, 32}};
+const Class valueClasses[] = {{0x0, 1, 0}, {0x2, 2, 3}, {0x6, 3, 7}, {0xE, 4, 12}, {0xF, 4, 32}};
+const uint8_t classCount = 5;
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+inline uint8_t encodedBits(const Class *classes, uint32_t zz)
+{
+    for (uint8_t i = 0; i < classCount - 1; i++)
+        if (zz < (1ul << classes[i].bits))
+            return classes[i].prefixBits + classes[i].bits;
+    return classes[classCount - 1].prefixBits + 32;
+}
+
+inline void put(BitWriter &w, const Class *classes, uint32_t zz)
+{
+    for (uint8_t i = 0; i < classCount; i++)
+    {
+        if (i == classCount - 1 || zz < (1ul << classes[i].bits))
+        {
+            w.write(classes[i].prefix, classes[i].prefixBits);
+            if (classes[i].bits)
+                w.write(zz, classes[i].bits);
+            return;
+        }
+    }
+}
+
+inline bool get(BitReader &r, const Class *classes, uint32_t &zz)
+{
+    // the prefix is a run of ones ended by a zero; the last class is all
+    // ones without the zero
+    uint8_t i = 0;
+    uint32_t bit;
+    while (i < classCount - 1)
+    {
+        if (!r.read(1, bit))
+            return false;
+        if (!bit)
+            break;
+        i++;
+    }
+    zz = 0;
+    return classes[i].bits == 0 || r.read(classes[i].bits, zz);
+}
+} // namespace gorilla
+
+template <uint8_t CHANNELS>
+class GorillaEncoder
+{
+    BitWriter w_;
+    uint16_t count_;
+    uint32_t lastTime_;
+    int32_t lastDelta_;
+    int32_t last_[CHANNELS];
+
+public:
+    GorillaEncoder() : count_(0), lastTime_(0), lastDelta_(0), last_() {}
+
+    void reset(uint8_t *buf, size_t size)
+    {
+        w_.reset(buf, size);
+        count_ = 0;
+        lastTime_ = 0;
+        lastDelta_ = 0;
+    }
+
+    uint16_t count() const { return count_; }
+    size_t bytes() const { return w_.bytes(); }
+    size_t bits() const { return w_.bits(); }
+
+    // Add one sample; false if it does not fit (buffer unchanged)
+    bool append(uint32_t t, const int32_t *values)
+    {
+        using namespace gorilla;
+
+        if (count_ == 0)
+        {
+            if (!w_.fits(32 * (1 + CHANNELS)))
+                return false;
+            w_.write(t, 32);
+            for (uint8_t c = 0; c < CHANNELS; c++)
+                w_.write(values[c], 32);
+        }
+        else
+        {
+            int32_t delta = (int32_t)(t - lastTime_);
+            uint32_t dod = zigzag((int32_t)((uint32_t)delta - (uint32_t)lastDelta_));
+            uint32_t zz[CHANNELS];
+            size_t need = encodedBits(timeClasses, dod);
+            for (uint8_t c = 0; c < CHANNELS; c++)
+            {
+                zz[c] = zigzag((int32_t)((uint32_t)values[c] - (uint32_t)last_[c]));
+                need += encodedBits(valueClasses, zz[c]);
+            }
+            if (!w_.fits(need))
+                return false;
+
+            put(w_, timeClasses, dod);
+            for (uint8_t c = 0; c < CHANNELS; c++)
+                put(w_, valueClasses, zz[c]);
+            lastDelta_ = delta;
+        }
+
+        lastTime_ = t;
+        memcpy(last_, values, sizeof(last_));
+        count_++;
+        return true;
+    }
+};
+
+template <uint8_t CHANNELS>
+class GorillaDecoder
+{
+    size_t pos_;        // bit position in the block
+    uint16_t index_;    // samples decoded
+    uint32_t lastTime_;
+    int32_t lastDelta_;
+    int32_t last_[CHANNELS];
+
+public:
+    GorillaDecoder() { reset(); }
+
+    void reset()
+    {
+        pos_ = 0;
+        index_ = 0;
+        lastTime_ = 0;
+        lastDelta_ = 0;
+        memset(last_, 0, sizeof(last_));
+    }
+
+    uint16_t index() const { return index_; }
+
+    // Decode the next of count samples from a block of bytes
+    bool next(const uint8_t *buf, size_t bytes, uint16_t count, uint32_t &t, int32_t *values)
+    {
+        using namespace gorilla;
+
+        if (index_ >= count)
+            return false;
+
+        BitReader r(buf, bytes, pos_);
+        uint32_t v;
+        if (index_ == 0)
+        {
+            if (!r.read(32, v))
+                return false;
+            lastTime_ = v;
+            for (uint8_t c = 0; c < CHANNELS; c++)
+            {
+                if (!r.read(32, v))
+                    return false;
+                last_[c] = v;
+            }
+        }
+        else
+        {
+            if (!get(r, timeClasses, v))
+                return false;
+            lastDelta_ = (int32_t)((uint32_t)lastDelta_ + (uint32_t)unzigzag(v));
+            lastTime_ += lastDelta_;
+            for (uint8_t c = 0; c < CHANNELS; c++)
+            {
+                if (!get(r, valueClasses, v))
+                    return false;
+                last_[c] = (int32_t)((uint32_t)last_[c] + (uint32_t)unzigzag(v));
+            }
+        }
+
+        pos_ = r.position();
+        index_++;
+        t = lastTime_;
+        memcpy(values, last_, sizeof(last_));
+        return true;
+    }
+};
+
+#endif // GORILLA_H
@@ -0,0 +1,413 @@
+#include "HistoryLog.h"
+
+#include <math.h>
+#include <string.h>
+#include <Crc.h>
+
+namespace
+{
+int32_t fixed(float v, float scale)
+{
+    if (isnan(v) || v < 0)
+        return 0;
+    return (int32_t)lroundf(v * scale);
+}
+
+bool erased(const void *p, size_t len)
+{
+    const uint8_t *b = static_cast<const uint8_t *>(p);
+    while (len--)
+        if (*b++ != 0xFF)
+            return false;
+    return true;
+}
+} // namespace
+
+HistoryLog::HistoryLog(FlashRegion &flash)
+    : flash_(flash), pages_(0), head_(0), pagesUsed_(0), seq_(0), writeOffset_(0), full_(false), lastTime_(0),
+      pendingFirst_(0), stats_()
+{
+}
+
+// ---------------------------------------------------------------------------
+// Encoding
+
+void HistoryLog::toValues(const Sample &s, int32_t *values)
+{
+    values[0] = fixed(s.voltage, 10);
+    values[1] = fixed(s.current, 100);
+    values[2] = fixed(s.pf, 100);
+    values[3] = fixed(s.power, 1);
+    values[4] = fixed(s.energy, 1000);
+    values[5] = s.flags | s.error << 8;
+}
+
+HistoryLog::Sample HistoryLog::toSample(uint32_t time, const int32_t *values)
+{
+    Sample s;
+    s.time = time;
+    s.voltage = values[0] / 10.0f;
+    s.current = values[1] / 100.0f;
+    s.pf = values[2] / 100.0f;
+    s.power = values[3];
+    s.energy = values[4] / 1000.0f;
+    s.flags = values[5];
+    s.error = values[5] >> 8;
+    return s;
+}
+
+// ---------------------------------------------------------------------------
+// Flash access
+
+bool HistoryLog::readHeader(uint16_t physical, PageHeader &h) const
+{
+    return flash_.read(pageAddr(physical), &h, sizeof(h)) && h.magic == pageMagic &&
+           h.crc == crc16(&h, offsetof(PageHeader, crc));
+}
+
+HistoryLog::ChunkState HistoryLog::readChunk(uint16_t physical, uint16_t offset, ChunkHeader &h,
+                                             uint8_t *payload) const
+{
+    if (offset + sizeof(ChunkHeader) > FlashRegion::sectorSize)
+        return chunkNone;
+    if (!flash_.read(pageAddr(physical) + offset, &h, sizeof(h)))
+        return chunkBad;
+    if (erased(&h, sizeof(h)))
+        return chunkNone;
+    if (h.bytes > maxChunkBytes || offset + footprint(h.bytes) > FlashRegion::sectorSize)
+        return chunkBad;
+    if (!flash_.read(pageAddr(physical) + offset + sizeof(h), payload, h.bytes))
+        return chunkBad;
+    uint16_t crc = crc16(&h, offsetof(ChunkHeader, crc));
+    return crc16(payload, h.bytes, crc) == h.crc ? chunkOk : chunkBad;
+}
+
+// ---------------------------------------------------------------------------
+// Writing
+
+bool HistoryLog::begin()
+{
+    pages_ = flash_.sectors();
+    stats_.pages = pages_;
+    pagesUsed_ = 0;
+    head_ = 0;
+    seq_ = 0;
+    writeOffset_ = 0;
+    full_ = false;
+    lastTime_ = 0;
+    encoder_.reset(pending_, 0);
+    if (pages_ < 2)
+        return false;
+
+    // the head is the valid page with the highest sequence number
+    bool found = false;
+    PageHeader h;
+    for (uint16_t i = 0; i < pages_; i++)
+    {
+        if (readHeader(i, h) && (!found || (int32_t)(h.seq - seq_) > 0))
+        {
+            found = true;
+            seq_ = h.seq;
+            head_ = i;
+        }
+    }
+    if (!found)
+    {
+        stats_.pagesUsed = 0;
+        return true;
+    }
+
+    // walk back over the contiguous run of older pages
+    pagesUsed_ = 1;
+    while (pagesUsed_ < pages_)
+    {
+        uint16_t p = (head_ + pages_ - pagesUsed_) % pages_;
+        if (!readHeader(p, h) || h.seq != seq_ - pagesUsed_)
+            break;
+        pagesUsed_++;
+    }
+
+    // find the end of the chunks in the head page
+    readHeader(head_, h);
+    lastTime_ = h.time;
+    writeOffset_ = sizeof(PageHeader);
+    for (;;)
+    {
+        ChunkHeader c;
+        ChunkState state = readChunk(head_, writeOffset_, c, pending_);
+        if (state == chunkNone)
+            break;
+        if (state == chunkBad)
+        {
+            full_ = true; // torn write, don't program over it
+            break;
+        }
+        lastTime_ = c.last;
+        writeOffset_ += footprint(c.bytes);
+    }
+    stats_.pagesUsed = pagesUsed_;
+    return true;
+}
+
+bool HistoryLog::openPage(uint32_t t)
+{
+    uint16_t next = pagesUsed_ ? (head_ + 1) % pages_ : head_;
+    if (!flash_.eraseSector(pageAddr(next)))
+        return false;
+
+    PageHeader h;
+    memset(&h, 0xFF, sizeof(h));
+    h.magic = pageMagic;
+    h.seq = seq_ + 1;
+    h.time = t;
+    h.crc = crc16(&h, offsetof(PageHeader, crc));
+
+    // the erased page now holds nothing; count it only once its header is in
+    if (pagesUsed_ == pages_)
+        pagesUsed_--;
+    if (!flash_.write(pageAddr(next), &h, sizeof(h)))
+        return false;
+
+    head_ = next;
+    seq_ = h.seq;
+    pagesUsed_++;
+    writeOffset_ = sizeof(PageHeader);
+    full_ = false;
+    stats_.pagesUsed = pagesUsed_;
+    return true;
+}
+
+// Reserve the place of the next chunk: the rest of the head page, or a
+// new page if too little is left
+bool HistoryLog::startChunk(uint32_t t)
+{
+    if (pagesUsed_ == 0 || full_ ||
+        (size_t)(FlashRegion::sectorSize - writeOffset_) < sizeof(ChunkHeader) + minChunkBytes)
+    {
+        if (!openPage(t))
+            return false;
+    }
+    size_t room = FlashRegion::sectorSize - writeOffset_ - sizeof(ChunkHeader);
+    encoder_.reset(pending_, room < maxChunkBytes ? room : (size_t)maxChunkBytes);
+    pendingFirst_ = t;
+    return true;
+}
+
+bool HistoryLog::flush()
+{
+    if (encoder_.count() == 0)
+        return true;
+
+    ChunkHeader h;
+    h.bytes = encoder_.bytes();
+    h.count = encoder_.count();
+    h.first = pendingFirst_;
+    h.last = lastTime_;
+    h.reserved = 0xFFFF;
+    h.crc = crc16(pending_, h.bytes, crc16(&h, offsetof(ChunkHeader, crc)));
+
+    // header first: if the payload is cut short the CRC fails
+    size_t addr = pageAddr(head_) + writeOffset_;
+    bool ok = flash_.write(addr, &h, sizeof(h)) &&
+              flash_.write(addr + sizeof(h), pending_, footprint(h.bytes) - sizeof(h));
+    if (ok)
+    {
+        writeOffset_ += footprint(h.bytes);
+        stats_.chunks++;
+    }
+    else
+    {
+        full_ = true; // don't program over a failed write
+    }
+    encoder_.reset(pending_, 0);
+    return ok;
+}
+
+bool HistoryLog::append(const Sample &s)
+{
+    if (pages_ < 2)
+        return false;
+
+    uint32_t t = s.time;
+    if ((pagesUsed_ || encoder_.count()) && t < lastTime_)
+        t = lastTime_ + 1; // clock not set (or set back), keep the log ordered
+
+    int32_t values[channels];
+    toValues(s, values);
+
+    if (encoder_.count() == 0 && !startChunk(t))
+        return false;
+    if (!encoder_.append(t, values))
+    {
+        // chunk full: write it and start the next one with this sample
+        flush();
+        if (!startChunk(t) || !encoder_.append(t, values))
+            return false;
+    }
+    lastTime_ = t;
+    stats_.appended++;
+
+    if ((s.flags & flagEvent) || t - pendingFirst_ >= maxChunkAge)
+        return flush();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Reading
+
+uint32_t HistoryLog::firstTime() const
+{
+    PageHeader h;
+    if (pagesUsed_ == 0 || !readHeader(physical(0), h))
+        return 0;
+    return h.time;
+}
+
+// Point c at the chunk at c.seq / c.offset or the first one after it;
+// false past the end of the log
+bool HistoryLog::loadChunk(Cursor &c) const
+{
+    c.decoder.reset();
+    c.bytes = 0;
+    c.count = 0;
+    c.last = 0;
+    c.pending = false;
+
+    while (c.seq - oldestSeq() < pagesUsed_)
+    {
+        if (c.seq == seq_ && c.offset == writeOffset_)
+        {
+            // at the writer: follows the RAM chunk, which may still be empty
+            c.pending = true;
+            refresh(c);
+            return true;
+        }
+
+        ChunkHeader h;
+        ChunkState state = readChunk(physicalOf(c.seq), c.offset, h, c.buf);
+        if (state == chunkOk)
+        {
+            c.bytes = h.bytes;
+            c.count = h.count;
+            c.last = h.last;
+            return true;
+        }
+        if (state == chunkBad)
+            stats_.badChunks++; // nothing after it in this page can be trusted
+        if (c.seq == seq_)
+            return false;
+        c.seq++;
+        c.offset = sizeof(PageHeader);
+    }
+    return false;
+}
+
+// Update a cursor that follows the RAM chunk
+void HistoryLog::refresh(Cursor &c) const
+{
+    if (c.seq == seq_ && c.offset == writeOffset_)
+    {
+        c.count = encoder_.count();
+        c.bytes = encoder_.bytes();
+        c.last = lastTime_;
+        memcpy(c.buf, pending_, c.bytes);
+        return;
+    }
+
+    // written out since: the same bits are on flash now, keep decoding there
+    c.pending = false;
+    ChunkHeader h;
+    if (c.seq - oldestSeq() < pagesUsed_ && readChunk(physicalOf(c.seq), c.offset, h, c.buf) == chunkOk)
+    {
+        c.bytes = h.bytes;
+        c.count = h.count;
+        c.last = h.last;
+    }
+    else
+    {
+        // the writer moved on to a new page without using this place
+        c.bytes = 0;
+        c.count = c.decoder.index();
+    }
+}
+
+bool HistoryLog::next(Cursor &c, Sample &out) const
+{
+    if (pagesUsed_ == 0)
+        return false;
+
+    // the page may have been overwritten since the cursor was positioned
+    if (c.seq - oldestSeq() >= pagesUsed_)
+    {
+        c.seq = oldestSeq();
+        c.offset = sizeof(PageHeader);
+        if (!loadChunk(c))
+            return false;
+    }
+
+    for (;;)
+    {
+        if (c.pending)
+            refresh(c);
+
+        uint32_t t;
+        int32_t values[channels];
+        if (c.decoder.next(c.buf, c.bytes, c.count, t, values))
+        {
+            out = toSample(t, values);
+            return true;
+        }
+        if (c.pending)
+            return false; // caught up with the writer
+
+        // next chunk; past the page end if this one was never written
+        c.offset += c.bytes ? footprint(c.bytes) : (uint16_t)FlashRegion::sectorSize;
+        if (!loadChunk(c))
+            return false;
+    }
+}
+
+bool HistoryLog::seek(uint32_t t, Cursor &c) const
+{
+    if (pagesUsed_ == 0)
+        return false;
+
+    // last page whose first sample is not after t
+    uint32_t lo = 0, hi = pagesUsed_;
+    while (hi - lo > 1)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        PageHeader h;
+        if (readHeader(physical(mid), h) && h.time <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    c.seq = oldestSeq() + lo;
+    c.offset = sizeof(PageHeader);
+    if (!loadChunk(c))
+        return false;
+
+    // skip whole chunks that end before t
+    while (!c.pending && c.last < t)
+    {
+        c.offset += footprint(c.bytes);
+        if (!loadChunk(c))
+            return false;
+    }
+
+    // then decode forward to the first sample at or after t
+    Cursor at = c;
+    Sample s;
+    while (next(c, s))
+    {
+        if (s.time >= t)
+        {
+            c = at;
+            return true;
+        }
+        at = c;
+    }
+    return false;
+}
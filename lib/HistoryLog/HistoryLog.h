@@ -0,0 +1,176 @@
+// Append-only measurement and event log on raw flash
+//
+// The log is a ring of 4 KiB pages in a FlashRegion (the "history"
+// partition). Each page starts with a header holding a sequence number and
+// the time of its first sample, followed by compressed chunks. A chunk is
+// a 16-byte header (payload size, sample count, first and last time,
+// CRC16 over header and payload) and up to maxChunkBytes of Gorilla
+// encoded samples (see lib/Gorilla): delta-of-delta timestamps and fixed
+// point value deltas, about 2-3 bytes per sample instead of 16.
+//
+// Samples collect in a RAM chunk whose place in the page is reserved
+// when it starts; it is written out when full, after maxChunkAge seconds
+// or at once for an event sample. Readers see the RAM chunk too. A chunk
+// cut short by a power loss fails its CRC and the writer moves on to a
+// new page; at most maxChunkAge seconds of periodic samples are lost.
+//
+// Timestamps are seconds and never go backwards in the log: if the clock
+// is not set yet (no NTP), samples are stamped one second after the last
+// logged one. Seeking by time is a binary search over page headers, then
+// a walk over chunk headers and decoding inside one chunk.
+//
+// Wear: with about 1.2k samples per page, even at 1 Hz a page lasts 20
+// minutes, so with 54 pages a sector is erased less than once a day.
+// At the 10 s rate main.cpp uses the log holds about a week.
+
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <FlashRegion.h>
+#include <Gorilla.h>
+
+class HistoryLog
+{
+public:
+    enum : uint8_t
+    {
+        flagUGT = 0x01,   // underground tank float OK
+        flagOHT = 0x02,   // overhead tank float OK
+        flagMotor = 0x04, // motor relay on
+        flagEvent = 0x80  // logged because motor or error state changed
+    };
+
+    enum : uint16_t
+    {
+        channels = 6,         // V, I, PF, P, E, flags + error
+        maxChunkBytes = 240,  // compressed payload of one chunk
+        maxChunkAge = 300     // s a periodic sample may wait in RAM
+    };
+
+    struct Sample
+    {
+        uint32_t time;    // seconds (epoch when NTP is set)
+        float voltage;    // V
+        float current;    // A
+        float pf;
+        float power;      // W
+        float energy;     // kWh, PZEM counter
+        uint8_t flags;
+        uint8_t error;    // checkSystemStatus() code
+    };
+
+    struct Stats
+    {
+        uint16_t pages;       // pages in the region
+        uint16_t pagesUsed;   // pages holding data
+        uint32_t appended;    // samples appended since boot
+        uint32_t chunks;      // chunks written since boot
+        uint32_t badChunks;   // chunks skipped by readers because of a CRC error
+    };
+
+    // Read position; valid after seek()
+    struct Cursor
+    {
+        uint32_t seq;         // page being read
+        uint16_t offset;      // of the chunk in the page
+        uint16_t bytes;       // chunk payload
+        uint16_t count;       // samples in chunk
+        uint32_t last;        // time of the last sample in chunk
+        bool pending;         // chunk is the one still in RAM
+        GorillaDecoder<channels> decoder;
+        uint8_t buf[maxChunkBytes];
+    };
+
+    explicit HistoryLog(FlashRegion &flash);
+
+    // Scan page headers and find the write position
+    bool begin();
+
+    bool append(const Sample &s);
+
+    // Write the RAM chunk now
+    bool flush();
+
+    bool empty() const { return pagesUsed_ == 0; }
+    uint32_t lastTime() const { return lastTime_; }
+    uint32_t firstTime() const;
+
+    // Position c at the first sample with time >= t
+    bool seek(uint32_t t, Cursor &c) const;
+
+    // Read the sample at c and advance; false at the end of the log
+    bool next(Cursor &c, Sample &out) const;
+
+    const Stats &stats() const { return stats_; }
+
+    // Stored fixed point form: 0.1 V, 0.01 A, 0.01, W, Wh, flags | error << 8
+    static void toValues(const Sample &s, int32_t *values);
+    static Sample toSample(uint32_t time, const int32_t *values);
+
+private:
+    struct PageHeader
+    {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t time;      // of the first sample
+        uint8_t reserved[18];
+        uint16_t crc;       // crc16 of the fields above
+    };
+
+    struct ChunkHeader
+    {
+        uint16_t bytes;
+        uint16_t count;
+        uint32_t first;
+        uint32_t last;
+        uint16_t reserved;
+        uint16_t crc;       // crc16 of the fields above and the payload
+    };
+
+    enum ChunkState : uint8_t
+    {
+        chunkOk,
+        chunkNone,          // erased, nothing written here
+        chunkBad
+    };
+
+    enum : uint32_t
+    {
+        pageMagic = 0x32484C57, // "WLH2"
+        minChunkBytes = 64      // start a new page rather than a smaller chunk
+    };
+
+    static_assert(sizeof(PageHeader) == 32, "page header layout");
+    static_assert(sizeof(ChunkHeader) == 16, "chunk header layout");
+
+    FlashRegion &flash_;
+    uint16_t pages_;
+    uint16_t head_;         // physical page being written
+    uint16_t pagesUsed_;
+    uint32_t seq_;          // of head page
+    uint16_t writeOffset_;  // of the next chunk in the head page
+    bool full_;             // head page takes no more chunks (torn write)
+    uint32_t lastTime_;
+    GorillaEncoder<channels> encoder_;
+    uint8_t pending_[maxChunkBytes];
+    uint32_t pendingFirst_;
+    mutable Stats stats_;
+
+    static uint16_t footprint(uint16_t bytes) { return sizeof(ChunkHeader) + ((bytes + 3) & ~3); }
+
+    size_t pageAddr(uint16_t physical) const { return (size_t)physical * FlashRegion::sectorSize; }
+    uint16_t physical(uint32_t logical) const { return (head_ + 1 + pages_ - pagesUsed_ + logical) % pages_; }
+    uint16_t physicalOf(uint32_t seq) const { return (head_ + pages_ - (seq_ - seq) % pages_) % pages_; }
+    uint32_t oldestSeq() const { return seq_ + 1 - pagesUsed_; }
+
+    bool readHeader(uint16_t physical, PageHeader &h) const;
+    ChunkState readChunk(uint16_t physical, uint16_t offset, ChunkHeader &h, uint8_t *payload) const;
+    bool openPage(uint32_t t);
+    bool startChunk(uint32_t t);
+    bool loadChunk(Cursor &c) const;
+    void refresh(Cursor &c) const;
+};
+
+#endif // HISTORY_LOG_H
@@ -0,0 +1,247 @@
+// Event based key gesture recogniser
+//
+// Turns a bitmask of keys that are down (already debounced) into
+// Press, Click, DoubleClick, LongPress, Repeat, Release and Chord events.
+// Nothing blocks: update() is called at loop speed with the current mask
+// and fires the handler for whatever became due.
+//
+//  Press       a single key went down (fires at once, good for UP/DOWN)
+//  Click       a single key was released before the long-press time
+//  DoubleClick second click within doubleClickMs (only for keys in
+//              doubleClickKeys, their Click is delayed by doubleClickMs)
+//  LongPress   a single key held for longPressMs (keys not in repeatKeys)
+//  Repeat      a single key in repeatKeys is held: first after
+//              repeatDelayMs, then at an interval that shrinks by
+//              repeatAccelPct percent per repeat down to repeatMinMs
+//  Release     the key of a single-key gesture went up
+//  Chord       two or more keys held together for chordMs; the rest of
+//              that gesture (until all keys are up) produces no events
+
+/*
+ Example:
+
+ #include <KeyGestures.h>
+
+ KeyGestures keys;
+
+ void handleKeys (const KeyGestures::Event &e)
+   {
+   if (e.type == KeyGestures::Repeat && e.keys == UP_BIT)
+     value += 1;                      // e.count is the repeat number
+   }
+
+ void setup ()
+   {
+   keys.begin (handleKeys, SET_BIT, UP_BIT | DOWN_BIT);
+   }
+
+ void loop ()
+   {
+   keys.update (debouncedKeysDown (), millis ());
+   }
+ */
+
+#ifndef KEY_GESTURES_H
+#define KEY_GESTURES_H
+
+#include <Arduino.h>
+
+class KeyGestures
+{
+public:
+    enum Type : uint8_t
+    {
+        Press,
+        Click,
+        DoubleClick,
+        LongPress,
+        Repeat,
+        Release,
+        Chord
+    };
+
+    struct Event
+    {
+        Type type;
+        uint8_t keys;   // one bit per key, several bits for Chord
+        uint16_t count; // repeat number for Repeat, otherwise 1
+    };
+
+    typedef void (*handlerFunction)(const Event &e);
+
+    struct Config
+    {
+        uint16_t doubleClickMs = 300;
+        uint16_t longPressMs = 1000;
+        uint16_t repeatDelayMs = 500;
+        uint16_t repeatStartMs = 200;
+        uint16_t repeatMinMs = 30;
+        uint8_t repeatAccelPct = 85; // next interval = this percent of the last one
+        uint16_t chordMs = 80;
+    };
+
+private:
+    handlerFunction f_;
+    Config cfg_;
+    uint8_t doubleClickKeys_;
+    uint8_t repeatKeys_;
+
+    uint8_t down_;           // keys down on the previous update
+    uint8_t gestureKey_;     // the single key of the current gesture, 0 if none
+    bool chord_;             // current gesture became a chord
+    bool held_;              // long press or repeat fired, no Click on release
+    unsigned long pressTime_;
+    unsigned long chordTime_; // when the current multi-key mask appeared
+    unsigned long nextRepeat_;
+    uint16_t repeatInterval_;
+    uint16_t repeatCount_;
+
+    uint8_t pendingKey_;     // released once, waiting for a possible second click
+    unsigned long pendingTime_;
+
+    void fire(Type type, uint8_t keys, uint16_t count = 1)
+    {
+        if (f_ == NULL)
+            return;
+        Event e = {type, keys, count};
+        f_(e);
+    }
+
+    static bool single(uint8_t mask)
+    {
+        return mask != 0 && (mask & (mask - 1)) == 0;
+    }
+
+    void keyUp(unsigned long now)
+    {
+        uint8_t key = gestureKey_;
+        gestureKey_ = 0;
+
+        if (!held_)
+        {
+            if (doubleClickKeys_ & key)
+            {
+                if (pendingKey_ == key && now - pendingTime_ <= cfg_.doubleClickMs)
+                {
+                    pendingKey_ = 0;
+                    fire(DoubleClick, key, 2);
+                }
+                else
+                {
+                    pendingKey_ = key;
+                    pendingTime_ = now;
+                }
+            }
+            else
+            {
+                fire(Click, key);
+            }
+        }
+        fire(Release, key);
+    }
+
+public:
+    KeyGestures()
+        : f_(NULL), doubleClickKeys_(0), repeatKeys_(0), down_(0), gestureKey_(0),
+          chord_(false), held_(false), pressTime_(0), chordTime_(0), nextRepeat_(0),
+          repeatInterval_(0), repeatCount_(0), pendingKey_(0), pendingTime_(0)
+    {
+    }
+
+    void begin(handlerFunction f, uint8_t doubleClickKeys = 0, uint8_t repeatKeys = 0)
+    {
+        f_ = f;
+        doubleClickKeys_ = doubleClickKeys;
+        repeatKeys_ = repeatKeys;
+    }
+
+    Config &config() { return cfg_; }
+
+    // down: one bit per key that is currently (debounced) down
+    void update(uint8_t down, unsigned long now)
+    {
+        // a pending single click expires into a Click
+        if (pendingKey_ && now - pendingTime_ > cfg_.doubleClickMs)
+        {
+            uint8_t key = pendingKey_;
+            pendingKey_ = 0;
+            fire(Click, key);
+        }
+
+        uint8_t pressed = down & ~down_;
+        uint8_t previous = down_;
+        down_ = down;
+
+        if (chord_)
+        {
+            // swallow everything until all keys are up
+            if (down == 0)
+                chord_ = false;
+            return;
+        }
+
+        if (!single(down) && down != 0)
+        {
+            // more than one key: chord candidate
+            if (down != previous)
+                chordTime_ = now;
+            if (now - chordTime_ >= cfg_.chordMs)
+            {
+                chord_ = true;
+                gestureKey_ = 0;
+                pendingKey_ = 0;
+                fire(Chord, down);
+            }
+            return;
+        }
+
+        if (gestureKey_ && !(down & gestureKey_))
+            keyUp(now);
+
+        if (down == 0)
+            return;
+
+        if (pressed & down)
+        {
+            // a fresh single key gesture
+            gestureKey_ = down;
+            held_ = false;
+            pressTime_ = now;
+            repeatCount_ = 0;
+            repeatInterval_ = cfg_.repeatStartMs;
+            nextRepeat_ = now + cfg_.repeatDelayMs;
+            if (pendingKey_ && pendingKey_ != down)
+            {
+                // a different key interrupts a pending click: deliver it now
+                uint8_t key = pendingKey_;
+                pendingKey_ = 0;
+                fire(Click, key);
+            }
+            fire(Press, down);
+            return;
+        }
+
+        if (gestureKey_ != down)
+            return; // the key left over after a chord, wait for release
+
+        if (repeatKeys_ & gestureKey_)
+        {
+            if ((long)(now - nextRepeat_) >= 0)
+            {
+                held_ = true;
+                fire(Repeat, gestureKey_, ++repeatCount_);
+                nextRepeat_ = now + repeatInterval_;
+                uint16_t next = (uint32_t)repeatInterval_ * cfg_.repeatAccelPct / 100;
+                repeatInterval_ = next < cfg_.repeatMinMs ? cfg_.repeatMinMs : next;
+            }
+        }
+        else if (!held_ && now - pressTime_ >= cfg_.longPressMs)
+        {
+            held_ = true;
+            pendingKey_ = 0;
+            fire(LongPress, gestureKey_);
+        }
+    }
+};
+
+#endif // KEY_GESTURES_H
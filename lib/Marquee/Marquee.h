@@ -0,0 +1,204 @@
+// Non-blocking multi-row marquee for character LCDs
+//
+// Every row keeps its own message, scroll position and timer, so several
+// rows can scroll independently. The class keeps a shadow copy of what is
+// on the glass and only writes the cells that changed since the last step,
+// which keeps I2C traffic to a few bytes per step instead of a full row.
+
+/*
+ Example:
+
+ #include <LiquidCrystal_I2C.h>
+ #include <Marquee.h>
+
+ LiquidCrystal_I2C lcd(0x3F, 16, 2);
+ Marquee<LiquidCrystal_I2C> marquee(lcd);
+
+ static char faultLine[40];
+
+ void setup ()
+   {
+   lcd.init ();
+   snprintf (faultLine, sizeof (faultLine), "Over current - SET key resets");
+   marquee.set (1, faultLine);
+   }
+
+ void loop ()
+   {
+   marquee.update ();  // call at loop speed, never blocks
+   }
+
+ Anything that clears the display behind the marquee's back (lcd.clear())
+ must call invalidate() so the shadow copy matches the glass again.
+ */
+
+#ifndef MARQUEE_H
+#define MARQUEE_H
+
+#include <Arduino.h>
+
+template <class LCD, uint8_t COLS = 16, uint8_t ROWS = 2>
+class Marquee
+{
+    enum
+    {
+        gap = 3 // blank cells between the tail and the head of a scrolling message
+    };
+
+    struct Row
+    {
+        const char *message;      // not copied, caller keeps it alive (static buffer)
+        uint8_t length;
+        uint8_t offset;           // first message character shown in column 0
+        uint16_t stepMs;
+        unsigned long lastStep;
+        bool active;
+        bool dirty;               // redraw on next update() regardless of timer
+        char shadow[COLS];        // what is currently on the glass
+    };
+
+    LCD &lcd_;
+    Row rows_[ROWS];
+
+    // Fill frame with what the row should show right now
+    void compose(const Row &r, char *frame) const
+    {
+        memset(frame, ' ', COLS);
+        if (r.length <= COLS)
+        {
+            // fits, centre it like the old scrollMessage() did
+            memcpy(frame + (COLS - r.length) / 2, r.message, r.length);
+            return;
+        }
+
+        // wrap around through a short gap so the loop reads naturally
+        const uint8_t period = r.length + gap;
+        uint8_t pos = r.offset;
+        for (uint8_t col = 0; col < COLS; col++)
+        {
+            if (pos < r.length)
+                frame[col] = r.message[pos];
+            if (++pos >= period)
+                pos = 0;
+        }
+    }
+
+    // Write only the runs of cells that differ from the shadow copy
+    void flush(uint8_t row, const char *frame)
+    {
+        Row &r = rows_[row];
+        uint8_t col = 0;
+        while (col < COLS)
+        {
+            if (frame[col] == r.shadow[col])
+            {
+                col++;
+                continue;
+            }
+            lcd_.setCursor(col, row);
+            while (col < COLS && frame[col] != r.shadow[col])
+            {
+                lcd_.write((uint8_t)frame[col]);
+                r.shadow[col] = frame[col];
+                col++;
+            }
+        }
+    }
+
+public:
+    explicit Marquee(LCD &lcd) : lcd_(lcd)
+    {
+        for (uint8_t i = 0; i < ROWS; i++)
+        {
+            rows_[i].message = nullptr;
+            rows_[i].length = 0;
+            rows_[i].offset = 0;
+            rows_[i].stepMs = 300;
+            rows_[i].lastStep = 0;
+            rows_[i].active = false;
+            rows_[i].dirty = false;
+        }
+        invalidate();
+    }
+
+    // Show message on row. Scrolling restarts only when the message pointer
+    // or its length changes, so calling this on every redraw is cheap.
+    void set(uint8_t row, const char *message, uint16_t stepMs = 300)
+    {
+        if (row >= ROWS || message == nullptr)
+            return;
+
+        Row &r = rows_[row];
+        size_t len = strlen(message);
+        uint8_t length = len > 255 - gap ? 255 - gap : len;
+        if (!r.active || r.message != message || r.length != length)
+        {
+            r.message = message;
+            r.length = length;
+            r.offset = 0;
+            r.lastStep = millis();
+            r.dirty = true;
+        }
+        r.stepMs = stepMs;
+        r.active = true;
+    }
+
+    // Stop driving row; whatever is on the glass stays there
+    void stop(uint8_t row)
+    {
+        if (row < ROWS)
+            rows_[row].active = false;
+    }
+
+    void stopAll()
+    {
+        for (uint8_t i = 0; i < ROWS; i++)
+            rows_[i].active = false;
+    }
+
+    bool active(uint8_t row) const
+    {
+        return row < ROWS && rows_[row].active;
+    }
+
+    // The display was cleared by someone else: assume blank glass
+    void invalidate()
+    {
+        for (uint8_t i = 0; i < ROWS; i++)
+        {
+            memset(rows_[i].shadow, ' ', COLS);
+            rows_[i].dirty = true;
+        }
+    }
+
+    // Advance and redraw due rows. Call at loop speed.
+    void update()
+    {
+        const unsigned long now = millis();
+        char frame[COLS];
+
+        for (uint8_t i = 0; i < ROWS; i++)
+        {
+            Row &r = rows_[i];
+            if (!r.active)
+                continue;
+
+            bool step = r.length > COLS && now - r.lastStep >= r.stepMs;
+            if (!step && !r.dirty)
+                continue;
+
+            if (step)
+            {
+                r.lastStep = now;
+                if (++r.offset >= r.length + gap)
+                    r.offset = 0;
+            }
+            r.dirty = false;
+
+            compose(r, frame);
+            flush(i, frame);
+        }
+    }
+};
+
+#endif // MARQUEE_H
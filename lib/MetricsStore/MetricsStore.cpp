@@ -0,0 +1,127 @@
+#include "MetricsStore.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+// flush the seconds tier once a minute, coarser rows as they come
+const MetricsTier::Layout secondsLayout = {1, 4, {2, 2, 2, 1}, 60};
+const MetricsTier::Layout minutesLayout = {60, 6, {2, 2, 2, 1, 2, 2}, 1};
+const MetricsTier::Layout hoursLayout = {3600, 6, {2, 2, 2, 1, 2, 2}, 1};
+
+uint16_t fixed(float v, float scale)
+{
+    if (isnan(v) || v <= 0)
+        return 0;
+    float f = v * scale + 0.5f;
+    return f >= MetricsTier::maxValue ? (uint16_t)MetricsTier::maxValue : (uint16_t)f;
+}
+} // namespace
+
+MetricsStore::MetricsStore(FlashRegion &seconds, FlashRegion &minutes, FlashRegion &hours)
+    : seconds_(seconds, secondsLayout, secondsIndex_, secondsStarts_, secondsPages),
+      minutes_(minutes, minutesLayout, minutesIndex_, minutesStarts_, minutesPages),
+      hours_(hours, hoursLayout, hoursIndex_, hoursStarts_, hoursPages),
+      tiers_{&seconds_, &minutes_, &hours_}, minute_(), hour_(), lastTime_(0), last_()
+{
+}
+
+bool MetricsStore::begin()
+{
+    bool ok = true;
+    for (uint8_t t = 0; t < tierCount; t++)
+        ok = tiers_[t]->begin() && ok;
+    return ok;
+}
+
+void MetricsStore::accumulate(Accumulator &a, uint32_t period, const uint16_t *row)
+{
+    if (a.samples == 0)
+    {
+        memset(&a, 0, sizeof(a));
+        a.period = period;
+    }
+    a.voltage += row[colVoltage];
+    a.current += row[colCurrent];
+    a.power += row[colPower];
+    if (row[colVoltage] > a.voltageMax)
+        a.voltageMax = row[colVoltage];
+    if (row[colCurrent] > a.currentMax)
+        a.currentMax = row[colCurrent];
+    a.running += row[colRun];
+    a.samples++;
+}
+
+// Write the finished period as one row; running time is scaled to 0..60
+// (seconds of a minute, minutes of an hour)
+void MetricsStore::emit(MetricsTier &tier, Accumulator &a)
+{
+    if (a.samples == 0)
+        return;
+    uint16_t n = a.samples;
+    uint16_t row[MetricsTier::maxColumns];
+    row[colVoltage] = (a.voltage + n / 2) / n;
+    row[colCurrent] = (a.current + n / 2) / n;
+    row[colPower] = (a.power + n / 2) / n;
+    row[colRun] = ((uint32_t)a.running * 60 + n / 2) / n;
+    row[colVoltageMax] = a.voltageMax;
+    row[colCurrentMax] = a.currentMax;
+    tier.append(a.period * tier.layout().step, row);
+    a.samples = 0;
+}
+
+void MetricsStore::add(uint32_t t, float voltage, float current, float power, bool running)
+{
+    uint16_t row[4];
+    row[colVoltage] = fixed(voltage, 10);
+    row[colCurrent] = fixed(current, 100);
+    row[colPower] = fixed(power, 1);
+    row[colRun] = running;
+
+    // a clock set back (an SNTP correction) resumes once it passes the
+    // last sample; the tiers only ever grow forward in time
+    if (lastTime_ && t <= lastTime_)
+        return;
+
+    // the 1 s reads drift against the clock; hold the last value over a
+    // single skipped second rather than leaving a hole
+    if (lastTime_ && t == lastTime_ + 2)
+        seconds_.append(t - 1, last_);
+    seconds_.append(t, row);
+    lastTime_ = t;
+    memcpy(last_, row, sizeof(last_));
+
+    if (minute_.samples && t / 60 != minute_.period)
+        emit(minutes_, minute_);
+    if (hour_.samples && t / 3600 != hour_.period)
+        emit(hours_, hour_);
+    accumulate(minute_, t / 60, row);
+    accumulate(hour_, t / 3600, row);
+}
+
+void MetricsStore::flush()
+{
+    for (uint8_t t = 0; t < tierCount; t++)
+        tiers_[t]->flush();
+}
+
+MetricsStore::Summary MetricsStore::summary(Tier tier, uint32_t from, uint32_t to) const
+{
+    MetricsTier::Aggregate a;
+    tiers_[tier]->aggregate(from, to, a);
+
+    // the seconds tier has no max columns, its values are the maxima
+    uint8_t vMax = tier == Seconds ? colVoltage : colVoltageMax;
+    uint8_t iMax = tier == Seconds ? colCurrent : colCurrentMax;
+
+    Summary s;
+    s.rows = a.rows;
+    s.voltageAvg = a.rows ? a.sum[colVoltage] / 10.0f / a.rows : 0;
+    s.voltageMax = a.max[vMax] / 10.0f;
+    s.currentAvg = a.rows ? a.sum[colCurrent] / 100.0f / a.rows : 0;
+    s.currentMax = a.max[iMax] / 100.0f;
+    s.powerAvg = a.rows ? (float)a.sum[colPower] / a.rows : 0;
+    s.runSeconds = a.sum[colRun] * runScale(tier);
+    return s;
+}
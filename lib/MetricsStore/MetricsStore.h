@@ -0,0 +1,156 @@
+// Tiered, downsampled metrics: voltage, current, power and run state
+//
+//   Seconds  1 s rows, the last day
+//   Minutes  1 min rows, the last month
+//   Hours    1 h rows, the last year
+//
+// Each tier is a MetricsTier on its own flash partition. Samples come in
+// at 1 Hz through add(); the seconds tier stores them directly and the
+// minute and hour rows are built from running sums and written when their
+// period ends. Coarser rows also keep the maximum voltage and current,
+// so a peak is not averaged away.
+//
+// Columns (units 0.1 V, 0.01 A, W):
+//   Seconds  V, I, P, running (0/1)
+//   Minutes  avg V, avg I, avg P, running seconds, max V, max I
+//   Hours    avg V, avg I, avg P, running minutes, max V, max I
+//
+// summary() is a range query on the tiers' page indexes, so "max voltage
+// yesterday" or "average current last week" costs a few tree nodes and at
+// most two pages of reads, not a scan of the range.
+//
+// RAM is one page image and one page index per tier plus the accumulators,
+// see ramBudget.
+
+/*
+ Example:
+
+ EspPartitionRegion secFlash, minFlash, hourFlash;
+ MetricsStore metrics (secFlash, minFlash, hourFlash);
+
+ void setup ()
+   {
+   secFlash.begin ("m_sec");
+   minFlash.begin ("m_min");
+   hourFlash.begin ("m_hour");
+   metrics.begin ();
+   }
+
+ void everySecond ()
+   {
+   metrics.add (time (nullptr), voltage, current, power, motorRunning);
+   }
+
+ MetricsStore::Summary day = metrics.summary (MetricsStore::Minutes, now - 86400, now);
+ */
+
+#ifndef METRICS_STORE_H
+#define METRICS_STORE_H
+
+#include <stdint.h>
+#include <MetricsTier.h>
+
+class MetricsStore
+{
+public:
+    enum Tier : uint8_t
+    {
+        Seconds,
+        Minutes,
+        Hours,
+        tierCount
+    };
+
+    enum Column : uint8_t
+    {
+        colVoltage,
+        colCurrent,
+        colPower,
+        colRun,
+        colVoltageMax, // Minutes and Hours only
+        colCurrentMax
+    };
+
+    struct Summary
+    {
+        uint32_t rows;        // rows with data
+        float voltageAvg;
+        float voltageMax;
+        float currentAvg;
+        float currentMax;
+        float powerAvg;
+        uint32_t runSeconds;
+    };
+
+    enum : uint16_t
+    {
+        // pages per tier, the sizes of m_sec, m_min and m_hour in partitions.csv
+        secondsPages = 150,
+        minutesPages = 119,
+        hoursPages = 25,
+        totalPages = secondsPages + minutesPages + hoursPages
+    };
+
+    enum : uint32_t
+    {
+        // page images, page indexes and accumulators; checked below the class
+        ramBudget = tierCount * FlashRegion::sectorSize +
+                    totalPages * (2 * sizeof(MetricsTier::Aggregate) + sizeof(uint32_t)) + 512
+    };
+
+    MetricsStore(FlashRegion &seconds, FlashRegion &minutes, FlashRegion &hours);
+
+    bool begin();
+
+    // One sample per second; t in seconds. Samples at or before the
+    // previous one (a clock set back) are dropped.
+    void add(uint32_t t, float voltage, float current, float power, bool running);
+
+    // Program rows still held in RAM (the seconds tier batches a minute)
+    void flush();
+
+    Summary summary(Tier tier, uint32_t from, uint32_t to) const;
+
+    const MetricsTier &tier(Tier t) const { return *tiers_[t]; }
+
+    // Time after the newest second row, 0 when empty
+    uint32_t endTime() const { return seconds_.endTime(); }
+
+    // Seconds of running recorded per row of the tier
+    static uint16_t runScale(Tier t) { return t == Hours ? 60 : 1; }
+
+private:
+    struct Accumulator
+    {
+        uint32_t period;
+        uint32_t voltage;
+        uint32_t current;
+        uint32_t power;
+        uint16_t voltageMax;
+        uint16_t currentMax;
+        uint16_t samples;
+        uint16_t running;
+    };
+
+    MetricsTier::Aggregate secondsIndex_[2 * secondsPages];
+    MetricsTier::Aggregate minutesIndex_[2 * minutesPages];
+    MetricsTier::Aggregate hoursIndex_[2 * hoursPages];
+    uint32_t secondsStarts_[secondsPages];
+    uint32_t minutesStarts_[minutesPages];
+    uint32_t hoursStarts_[hoursPages];
+    MetricsTier seconds_;
+    MetricsTier minutes_;
+    MetricsTier hours_;
+    MetricsTier *tiers_[tierCount];
+    Accumulator minute_;
+    Accumulator hour_;
+    uint32_t lastTime_;
+    uint16_t last_[4];     // last seconds row, repeated over a one second gap
+
+    static void accumulate(Accumulator &a, uint32_t period, const uint16_t *row);
+    static void emit(MetricsTier &tier, Accumulator &a);
+};
+
+static_assert(sizeof(MetricsStore) <= MetricsStore::ramBudget, "metrics RAM budget");
+
+#endif // METRICS_STORE_H
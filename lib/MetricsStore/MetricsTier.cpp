@@ -0,0 +1,437 @@
+#include "MetricsTier.h"
+
+#include <string.h>
+#include <Crc.h>
+
+MetricsTier::MetricsTier(FlashRegion &flash, const Layout &layout, Aggregate *index, uint32_t *starts,
+                         uint16_t maxPages)
+    : flash_(flash), layout_(layout), index_(index), starts_(starts), maxPages_(maxPages), wide_(0), rowsPerPage_(0), pages_(0), head_(0), pagesUsed_(0), seq_(0),
+      start_(0), rows_(0), flushed_(0), open_(false)
+{
+    size_t rowBytes = 0;
+    for (uint8_t c = 0; c < layout_.columns; c++)
+    {
+        if (layout_.width[c] == 2)
+            wide_ |= 1 << c;
+        rowBytes += width(c);
+    }
+    rowsPerPage_ = (FlashRegion::sectorSize - sizeof(PageHeader)) / rowBytes;
+
+    size_t offset = sizeof(PageHeader);
+    for (uint8_t c = 0; c < layout_.columns; c++)
+    {
+        offset_[c] = offset;
+        offset += (size_t)rowsPerPage_ * width(c);
+    }
+}
+
+uint16_t MetricsTier::cell(uint8_t c, uint16_t i) const
+{
+    const uint8_t *p = page_ + offset_[c] + (size_t)i * width(c);
+    return width(c) == 2 ? p[0] | p[1] << 8 : p[0];
+}
+
+void MetricsTier::setCell(uint8_t c, uint16_t i, uint16_t v)
+{
+    uint8_t *p = page_ + offset_[c] + (size_t)i * width(c);
+    if (width(c) == 2)
+    {
+        p[0] = v;
+        p[1] = v >> 8;
+    }
+    else
+    {
+        p[0] = v > 0xFF ? 0xFF : v;
+    }
+}
+
+bool MetricsTier::readHeader(uint16_t physical, PageHeader &h) const
+{
+    return flash_.read(pageAddr(physical), &h, sizeof(h)) && h.magic == pageMagic &&
+           h.crc == crc16(&h, offsetof(PageHeader, crc)) && h.step == layout_.step &&
+           h.columns == layout_.columns && h.wide == wide_ && h.rowsPerPage == rowsPerPage_;
+}
+
+// Rows are written as a prefix of column 0, so the first erased entry
+// can be found by bisection
+uint16_t MetricsTier::countRows(uint16_t physical) const
+{
+    uint16_t lo = 0, hi = rowsPerPage_;
+    while (lo < hi)
+    {
+        uint16_t mid = (lo + hi) / 2;
+        uint16_t v = 0xFFFF;
+        flash_.read(pageAddr(physical) + offset_[0] + (size_t)mid * 2, &v, 2);
+        if (v == 0xFFFF)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+bool MetricsTier::pageInfo(uint16_t logical, uint32_t &start, uint16_t &rows) const
+{
+    uint16_t phys = physical(logical);
+    if (phys == head_)
+    {
+        start = start_;
+        rows = rows_;
+        return true;
+    }
+    PageHeader h;
+    if (!readHeader(phys, h))
+        return false;
+    start = h.start;
+    rows = countRows(phys);
+    return true;
+}
+
+bool MetricsTier::readBlock(uint16_t logical, uint16_t first, uint16_t n, Block &b) const
+{
+    uint16_t phys = physical(logical);
+    b.rows = n;
+    for (uint8_t c = 0; c < layout_.columns; c++)
+    {
+        if (phys == head_)
+        {
+            for (uint16_t i = 0; i < n; i++)
+                b.col[c][i] = cell(c, first + i);
+            continue;
+        }
+
+        size_t addr = pageAddr(phys) + offset_[c] + (size_t)first * width(c);
+        if (width(c) == 2)
+        {
+            // little endian on flash and in RAM
+            if (!flash_.read(addr, b.col[c], (size_t)n * 2))
+                return false;
+        }
+        else
+        {
+            // widen in place, back to front
+            uint8_t *bytes = reinterpret_cast<uint8_t *>(b.col[c]);
+            if (!flash_.read(addr, bytes, n))
+                return false;
+            for (uint16_t i = n; i-- > 0;)
+                b.col[c][i] = bytes[i];
+        }
+    }
+    return true;
+}
+
+bool MetricsTier::begin()
+{
+    pages_ = flash_.sectors() < maxPages_ ? flash_.sectors() : maxPages_;
+    memset(index_, 0, 2 * (size_t)maxPages_ * sizeof(Aggregate));
+    pagesUsed_ = 0;
+    head_ = 0;
+    seq_ = 0;
+    start_ = 0;
+    rows_ = 0;
+    flushed_ = 0;
+    open_ = false;
+    if (pages_ < 2 || rowsPerPage_ == 0)
+        return false;
+
+    bool found = false;
+    PageHeader h;
+    for (uint16_t i = 0; i < pages_; i++)
+    {
+        if (readHeader(i, h) && (!found || (int32_t)(h.seq - seq_) > 0))
+        {
+            found = true;
+            seq_ = h.seq;
+            head_ = i;
+        }
+    }
+    if (!found)
+        return true;
+
+    pagesUsed_ = 1;
+    while (pagesUsed_ < pages_)
+    {
+        uint16_t p = (head_ + pages_ - pagesUsed_) % pages_;
+        if (!readHeader(p, h) || h.seq != seq_ - pagesUsed_)
+            break;
+        pagesUsed_++;
+    }
+
+    if (!flash_.read(pageAddr(head_), page_, sizeof(page_)))
+    {
+        pagesUsed_ = 0;
+        return false;
+    }
+    memcpy(&h, page_, sizeof(h));
+    start_ = h.start;
+    while (rows_ < rowsPerPage_ && cell(0, rows_) != 0xFFFF)
+        rows_++;
+    flushed_ = rows_;
+
+    // a flush cut short leaves a half written row or programmed cells past
+    // the last row; writing over them would corrupt the next row, so start
+    // a new page
+    open_ = rows_ < rowsPerPage_ && (rows_ == 0 || cell(0, rows_ - 1) <= maxValue || cell(0, rows_ - 1) == noData);
+    for (uint8_t c = 1; open_ && c < layout_.columns; c++)
+        for (uint16_t i = rows_; open_ && i < rowsPerPage_; i++)
+            open_ = cell(c, i) == (width(c) == 2 ? 0xFFFF : 0xFF);
+
+    // index: one leaf per page from its rows, then the inner nodes
+    Block b;
+    for (uint16_t p = 0; p < pagesUsed_; p++)
+    {
+        uint16_t phys = physical(p);
+        uint16_t rows = phys == head_ ? rows_ : rowsPerPage_;
+        if (phys != head_)
+        {
+            readHeader(phys, h);
+            starts_[phys] = h.start;
+        }
+        for (uint16_t i = 0; i < rows; i += blockRows)
+        {
+            uint16_t n = rows - i < blockRows ? rows - i : (uint16_t)blockRows;
+            if (readBlock(p, i, n, b))
+                add(index_[maxPages_ + phys], b, 0, n, layout_.columns);
+        }
+    }
+    starts_[head_] = start_;
+    for (uint16_t i = maxPages_ - 1; i > 0; i--)
+    {
+        index_[i] = index_[2 * i];
+        merge(index_[i], index_[2 * i + 1]);
+    }
+    return true;
+}
+
+bool MetricsTier::flush()
+{
+    if (flushed_ == rows_)
+        return true;
+
+    // column 0 last: it is what makes the rows visible
+    bool ok = true;
+    for (uint8_t k = 0; ok && k < layout_.columns; k++)
+    {
+        uint8_t c = (k + 1) % layout_.columns;
+        size_t at = offset_[c] + (size_t)flushed_ * width(c);
+        ok = flash_.write(pageAddr(head_) + at, page_ + at, (size_t)(rows_ - flushed_) * width(c));
+    }
+    if (!ok)
+        open_ = false; // don't program over a failed write
+    flushed_ = rows_;
+    return ok;
+}
+
+bool MetricsTier::openPage(uint32_t t)
+{
+    flush();
+
+    uint16_t next = pagesUsed_ ? (head_ + 1) % pages_ : head_;
+    if (!flash_.eraseSector(pageAddr(next)))
+        return false;
+    if (pagesUsed_ == pages_)
+        pagesUsed_--;
+    clearLeaf(next);
+
+    PageHeader h;
+    memset(&h, 0xFF, sizeof(h));
+    h.magic = pageMagic;
+    h.seq = seq_ + 1;
+    h.start = t - t % layout_.step;
+    h.step = layout_.step;
+    h.columns = layout_.columns;
+    h.wide = wide_;
+    h.rowsPerPage = rowsPerPage_;
+    h.crc = crc16(&h, offsetof(PageHeader, crc));
+    if (!flash_.write(pageAddr(next), &h, sizeof(h)))
+        return false;
+
+    memset(page_, 0xFF, sizeof(page_));
+    memcpy(page_, &h, sizeof(h));
+    head_ = next;
+    seq_ = h.seq;
+    start_ = h.start;
+    starts_[head_] = start_;
+    rows_ = 0;
+    flushed_ = 0;
+    open_ = true;
+    pagesUsed_++;
+    return true;
+}
+
+bool MetricsTier::append(uint32_t t, const uint16_t *row)
+{
+    if (pages_ < 2)
+        return false;
+
+    // a clock that went back: drop rows until it passes the newest one, a
+    // page starting before the head would break the order pageAt() bisects
+    if (pagesUsed_ && t < endTime())
+        return false;
+
+    // a gap past the page end starts a new page
+    if (!open_ || (t - start_) / layout_.step >= rowsPerPage_)
+    {
+        if (!openPage(t))
+            return false;
+    }
+
+    uint32_t slot = (t - start_) / layout_.step;
+    while (rows_ < slot)
+        setCell(0, rows_++, noData);
+
+    setCell(0, rows_, row[0] > maxValue ? (uint16_t)maxValue : row[0]);
+    for (uint8_t c = 1; c < layout_.columns; c++)
+        setCell(c, rows_, row[c]);
+
+    // the head page leaf and every node above it gain this row
+    for (uint16_t i = maxPages_ + head_; i > 0; i /= 2)
+    {
+        Aggregate &a = index_[i];
+        a.rows++;
+        for (uint8_t c = 0; c < layout_.columns; c++)
+        {
+            uint16_t v = cell(c, rows_);
+            a.sum[c] += v;
+            if (v > a.max[c])
+                a.max[c] = v;
+        }
+    }
+    rows_++;
+
+    if (rows_ - flushed_ >= layout_.flushRows || rows_ == rowsPerPage_)
+        return flush();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Range aggregates
+
+void MetricsTier::add(Aggregate &a, const Block &b, uint16_t first, uint16_t n, uint8_t columns)
+{
+    for (uint16_t i = first; i < first + n; i++)
+    {
+        if (b.col[0][i] > maxValue)
+            continue; // erased, skipped or torn
+        a.rows++;
+        for (uint8_t c = 0; c < columns; c++)
+        {
+            a.sum[c] += b.col[c][i];
+            if (b.col[c][i] > a.max[c])
+                a.max[c] = b.col[c][i];
+        }
+    }
+}
+
+void MetricsTier::merge(Aggregate &a, const Aggregate &b)
+{
+    a.rows += b.rows;
+    for (uint8_t c = 0; c < maxColumns; c++)
+    {
+        a.sum[c] += b.sum[c];
+        if (b.max[c] > a.max[c])
+            a.max[c] = b.max[c];
+    }
+}
+
+void MetricsTier::clearLeaf(uint16_t physical)
+{
+    uint16_t i = maxPages_ + physical;
+    memset(&index_[i], 0, sizeof(Aggregate));
+    for (i /= 2; i > 0; i /= 2)
+    {
+        index_[i] = index_[2 * i];
+        merge(index_[i], index_[2 * i + 1]);
+    }
+}
+
+// Merge the leaves of physical pages first..last into out
+void MetricsTier::query(uint16_t first, uint16_t last, Aggregate &out) const
+{
+    uint16_t l = maxPages_ + first, r = maxPages_ + last + 1;
+    while (l < r)
+    {
+        if (l & 1)
+            merge(out, index_[l++]);
+        if (r & 1)
+            merge(out, index_[--r]);
+        l /= 2;
+        r /= 2;
+    }
+}
+
+// Number of pages (oldest first) that start at or before t
+uint16_t MetricsTier::pageAt(uint32_t t) const
+{
+    uint16_t lo = 0, hi = pagesUsed_;
+    while (lo < hi)
+    {
+        uint16_t mid = (lo + hi) / 2;
+        if (starts_[physical(mid)] <= t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Rows of one page inside [from, to); the leaf if that is the whole page
+void MetricsTier::pageRows(uint16_t logical, uint32_t from, uint32_t to, Aggregate &out) const
+{
+    uint16_t phys = physical(logical);
+    uint32_t start = starts_[phys];
+    uint32_t step = layout_.step;
+    uint32_t first = from > start ? (from - start + step - 1) / step : 0;
+    uint32_t end = to > start ? (to - start + step - 1) / step : 0;
+    uint16_t rows = phys == head_ ? rows_ : rowsPerPage_;
+
+    if (first == 0 && end >= rows)
+    {
+        merge(out, index_[maxPages_ + phys]);
+        return;
+    }
+    if (end > rows)
+        end = rows;
+
+    Block b;
+    for (uint32_t i = first; i < end; i += blockRows)
+    {
+        uint16_t n = end - i < (uint32_t)blockRows ? end - i : (uint32_t)blockRows;
+        if (readBlock(logical, i, n, b))
+            add(out, b, 0, n, layout_.columns);
+    }
+}
+
+void MetricsTier::aggregate(uint32_t from, uint32_t to, Aggregate &out) const
+{
+    memset(&out, 0, sizeof(out));
+    if (pagesUsed_ == 0 || from >= to)
+        return;
+
+    uint16_t before = pageAt(to - 1);
+    if (before == 0)
+        return; // range ends before the oldest row
+    uint16_t last = before - 1;
+    uint16_t first = pageAt(from);
+    first = first ? first - 1 : 0;
+
+    pageRows(first, from, to, out);
+    if (last == first)
+        return;
+
+    // whole pages in between come from the tree; the ring may wrap
+    if (last > first + 1)
+    {
+        uint16_t a = physical(first + 1), b = physical(last - 1);
+        if (a <= b)
+        {
+            query(a, b, out);
+        }
+        else
+        {
+            query(a, pages_ - 1, out);
+            query(0, b, out);
+        }
+    }
+    pageRows(last, from, to, out);
+}
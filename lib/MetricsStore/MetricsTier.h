@@ -0,0 +1,180 @@
+// One resolution of the metrics store: a ring of flash pages holding rows
+// at a fixed time step, stored column by column (struct of arrays)
+//
+// A page is a header followed by one array per column, each rowsPerPage
+// entries of 1 or 2 bytes. Row i of a page is at time start + i * step,
+// so no timestamps are stored. The page being filled lives in RAM as an
+// exact image of its flash sector; new rows are programmed every
+// flushRows rows, the other columns first and column 0 last, so a row is
+// only visible on flash once all of its columns are. Column 0 doubles as
+// the fill marker: erased (0xFFFF) means the row was never written,
+// noData marks a slot skipped because no sample arrived. Values are kept
+// below 0xFF00, so a column 0 entry cut in half by a power loss (high byte
+// still erased) reads as not data either.
+//
+// Reading goes through scan(), which hands over the rows of a time range
+// in blocks of up to blockRows, again one array per column, so an
+// aggregate is a tight loop over a few arrays.
+//
+// Range aggregates (row count, per column sum and max) do not scan at
+// all for whole pages: every page has an Aggregate leaf in a segment tree
+// indexed by physical page, kept in RAM and updated on each append in
+// O(log pages). aggregate() finds the first and last page of the range by
+// bisecting the page start times, takes everything in between from the
+// tree and only reads the rows of those two boundary pages. The tree is
+// rebuilt from flash by begin(). Sums are 32 bit: fine while the average
+// of a column over the whole ring stays below 2^32 / capacity().
+
+#ifndef METRICS_TIER_H
+#define METRICS_TIER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <FlashRegion.h>
+
+class MetricsTier
+{
+public:
+    enum : uint16_t
+    {
+        maxColumns = 6,
+        blockRows = 64,
+        noData = 0xFFFE,   // column 0 of a skipped slot
+        maxValue = 0xFEFF  // largest value column 0 can hold; anything above is not data
+    };
+
+    struct Layout
+    {
+        uint32_t step;              // seconds per row
+        uint8_t columns;
+        uint8_t width[maxColumns];  // bytes per entry, 1 or 2; column 0 must be 2
+        uint16_t flushRows;         // program flash after this many new rows
+    };
+
+    struct Aggregate
+    {
+        uint32_t rows;              // rows with data
+        uint32_t sum[maxColumns];
+        uint16_t max[maxColumns];
+    };
+
+    struct Block
+    {
+        uint32_t time;              // of the first row
+        uint16_t rows;
+        uint16_t col[maxColumns][blockRows];
+    };
+
+    // index: 2 * maxPages nodes, starts: maxPages entries; a larger region
+    // only uses its first maxPages sectors
+    MetricsTier(FlashRegion &flash, const Layout &layout, Aggregate *index, uint32_t *starts, uint16_t maxPages);
+
+    // Find the newest page, load it into RAM and rebuild the index
+    bool begin();
+
+    // Store row (one value per column) in the slot of time t. Slots that
+    // were skipped since the last row are marked noData. False for a t
+    // before endTime(): rows are never overwritten or stored out of order.
+    bool append(uint32_t t, const uint16_t *row);
+
+    // Program rows that are still only in RAM
+    bool flush();
+
+    const Layout &layout() const { return layout_; }
+    uint16_t rowsPerPage() const { return rowsPerPage_; }
+    uint16_t pages() const { return pages_; }
+    uint16_t pagesUsed() const { return pagesUsed_; }
+    // Rows the ring always keeps (the oldest page is erased to make room)
+    uint32_t capacity() const { return pages_ > 1 ? (uint32_t)(pages_ - 1) * rowsPerPage_ : 0; }
+    // Time just after the newest row, 0 when empty
+    uint32_t endTime() const { return pagesUsed_ ? start_ + rows_ * layout_.step : 0; }
+
+    // Rows with data and their per column sum and max, from <= time < to
+    void aggregate(uint32_t from, uint32_t to, Aggregate &out) const;
+
+    // Call fn(const Block &) for the rows with from <= time < to, oldest first
+    template <class F>
+    void scan(uint32_t from, uint32_t to, F fn) const
+    {
+        Block b;
+        for (uint16_t p = 0; p < pagesUsed_; p++)
+        {
+            uint32_t start;
+            uint16_t rows;
+            if (!pageInfo(p, start, rows) || start >= to)
+                continue;
+            uint32_t end = (to - start + layout_.step - 1) / layout_.step;
+            uint32_t first = from > start ? (from - start + layout_.step - 1) / layout_.step : 0;
+            if (end > rows)
+                end = rows;
+            for (uint32_t i = first; i < end; i += blockRows)
+            {
+                uint16_t n = end - i < (uint32_t)blockRows ? end - i : (uint32_t)blockRows;
+                if (!readBlock(p, i, n, b))
+                    continue;
+                b.time = start + i * layout_.step;
+                fn(b);
+            }
+        }
+    }
+
+private:
+    struct PageHeader
+    {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t start;     // time of row 0
+        uint32_t step;
+        uint8_t columns;
+        uint8_t wide;       // bit c set: column c is 2 bytes
+        uint16_t rowsPerPage;
+        uint16_t crc;       // crc16 of the fields above
+        uint8_t pad[10];
+    };
+
+    enum : uint32_t
+    {
+        pageMagic = 0x5354454D // "METS"
+    };
+
+    static_assert(sizeof(PageHeader) == 32, "page header layout");
+
+    FlashRegion &flash_;
+    Layout layout_;
+    Aggregate *index_;              // segment tree, leaf of physical page p at maxPages_ + p
+    uint32_t *starts_;              // start time of each physical page
+    uint16_t maxPages_;
+    uint8_t wide_;
+    uint16_t rowsPerPage_;
+    uint16_t offset_[maxColumns];   // of each column array in a page
+    uint16_t pages_;
+    uint16_t head_;                 // physical page in RAM
+    uint16_t pagesUsed_;
+    uint32_t seq_;                  // of head page
+    uint32_t start_;                // of head page
+    uint16_t rows_;                 // rows in head page
+    uint16_t flushed_;              // of those, rows on flash
+    bool open_;                     // head page takes more rows
+    uint8_t page_[FlashRegion::sectorSize];
+
+    size_t pageAddr(uint16_t physical) const { return (size_t)physical * FlashRegion::sectorSize; }
+    uint16_t physical(uint32_t logical) const { return (head_ + 1 + pages_ - pagesUsed_ + logical) % pages_; }
+    uint8_t width(uint8_t c) const { return (wide_ >> c) & 1 ? 2 : 1; }
+
+    uint16_t cell(uint8_t c, uint16_t i) const;
+    void setCell(uint8_t c, uint16_t i, uint16_t v);
+    bool readHeader(uint16_t physical, PageHeader &h) const;
+    uint16_t countRows(uint16_t physical) const;
+    bool pageInfo(uint16_t logical, uint32_t &start, uint16_t &rows) const;
+    bool readBlock(uint16_t logical, uint16_t first, uint16_t n, Block &b) const;
+    bool openPage(uint32_t t);
+
+    static void add(Aggregate &a, const Block &b, uint16_t first, uint16_t n, uint8_t columns);
+    static void merge(Aggregate &a, const Aggregate &b);
+    void clearLeaf(uint16_t physical);
+    void query(uint16_t first, uint16_t last, Aggregate &out) const;
+    uint16_t pageAt(uint32_t t) const;
+    void pageRows(uint16_t logical, uint32_t from, uint32_t to, Aggregate &out) const;
+};
+
+#endif // METRICS_TIER_H
@@ -0,0 +1,201 @@
+// PCF8574 driver that batches I/O into one transaction per control tick
+//
+// The PCF8574 has no direction register. A pin written 1 is a weak
+// pull-up that can be read as an input, a pin written 0 is pulled low.
+// So every write must keep the input pins at 1, and a pin is only
+// changed by writing the whole port. The driver keeps a shadow of the
+// port: set(), clear() and write() change only the shadow, and commit()
+// sends it in one transaction if it differs from what the chip holds.
+// A failed write stays pending and is retried by the next commit().
+//
+// refresh() reads the pins. The chip's open-drain INT output goes low
+// when an input changes and is released by the next read or write of
+// the port. With the INT line wired to a pin, refresh() skips the read
+// while INT is high. A write also releases INT, which could hide a change
+// just before it, so the read after a commit() is never skipped. Without
+// an INT pin every refresh() reads.
+//
+// Transactions (reads, writes, failures and skipped reads) are counted.
+// endTick() closes a control tick and keeps the most transactions any
+// tick needed.
+//
+// Bus is a TinyWireM/Wire style class: beginTransmission(), send(),
+// endTransmission(), requestFrom(), available(), receive().
+
+/*
+ Example (ATtiny85 with TinyWireM, inputs on P3..P5):
+
+ #include <TinyWireM.h>
+ #include <PCF8574Shadow.h>
+
+ PCF8574Shadow<USI_TWI> pcf (TinyWireM, 0x20, 0b00111000);
+
+ void setup ()
+   {
+   TinyWireM.begin ();
+   pcf.begin (0);
+   }
+
+ void loop ()                          // one control tick
+   {
+   pcf.refresh ();                     // at most one read
+   bool flow = pcf.read (0b00001000);
+   pcf.write (0b00000001, flow);       // relay
+   pcf.write (0b01000000, !flow);      // error LED
+   pcf.commit ();                      // at most one write
+   pcf.endTick ();
+   delay (100);
+   }
+ */
+
+#ifndef PCF8574_SHADOW_H
+#define PCF8574_SHADOW_H
+
+#include <Arduino.h>
+
+template <typename Bus>
+class PCF8574Shadow
+{
+public:
+    struct Stats
+    {
+        uint32_t reads;
+        uint32_t writes;
+        uint32_t failures;     // reads or writes that got no ACK or no data
+        uint32_t skippedReads; // refresh() calls INT saved
+        uint32_t ticks;
+        uint8_t lastTick;      // transactions in the last closed tick
+        uint8_t maxTick;       // most transactions in one tick
+    };
+
+    // inputs are the pins that are always written 1; intPin < 0: no INT line
+    PCF8574Shadow(Bus &bus, uint8_t address, uint8_t inputs, int8_t intPin = -1)
+        : bus_(bus), address_(address), inputs_(inputs), intPin_(intPin), shadow_(inputs), chip_(inputs),
+          pins_(inputs), dirty_(true), stale_(true), tick_(0), stats_()
+    {
+    }
+
+    // Write the outputs and read the pins once; false if the chip does not answer
+    bool begin(uint8_t outputs)
+    {
+        if (intPin_ >= 0)
+            pinMode(intPin_, INPUT_PULLUP);
+        shadow_ = outputs | inputs_;
+        dirty_ = true;
+        return commit() && refresh(true);
+    }
+
+    void set(uint8_t mask)
+    {
+        write(mask, true);
+    }
+
+    void clear(uint8_t mask)
+    {
+        write(mask, false);
+    }
+
+    void write(uint8_t mask, bool on)
+    {
+        uint8_t next = on ? shadow_ | mask : shadow_ & ~mask;
+        next |= inputs_;
+        if (next != shadow_)
+        {
+            shadow_ = next;
+            dirty_ = shadow_ != chip_;
+        }
+    }
+
+    // The levels commit() writes
+    uint8_t outputs() const
+    {
+        return shadow_;
+    }
+
+    // Send the shadow if it changed; true when the chip holds it
+    bool commit()
+    {
+        if (!dirty_)
+            return true;
+        tick_++;
+        stats_.writes++;
+        bus_.beginTransmission(address_);
+        bus_.send(shadow_);
+        if (bus_.endTransmission() != 0)
+        {
+            stats_.failures++;
+            return false;
+        }
+        chip_ = shadow_;
+        dirty_ = false;
+        stale_ = true; // the write released INT
+        return true;
+    }
+
+    // Read the pins unless INT says nothing changed; false on a failed read
+    bool refresh(bool force = false)
+    {
+        if (!force && !stale_ && intPin_ >= 0 && digitalRead(intPin_) == HIGH)
+        {
+            stats_.skippedReads++;
+            return true;
+        }
+        tick_++;
+        stats_.reads++;
+        bus_.requestFrom(address_, (uint8_t)1);
+        if (!bus_.available())
+        {
+            stats_.failures++;
+            return false;
+        }
+        pins_ = bus_.receive();
+        stale_ = false;
+        return true;
+    }
+
+    // Pin levels as of the last refresh()
+    uint8_t pins() const
+    {
+        return pins_;
+    }
+
+    bool read(uint8_t mask) const
+    {
+        return (pins_ & mask) != 0;
+    }
+
+    void endTick()
+    {
+        stats_.ticks++;
+        stats_.lastTick = tick_;
+        if (tick_ > stats_.maxTick)
+            stats_.maxTick = tick_;
+        tick_ = 0;
+    }
+
+    // Transactions so far in the current tick
+    uint8_t tickTransactions() const
+    {
+        return tick_;
+    }
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+private:
+    Bus &bus_;
+    uint8_t address_;
+    uint8_t inputs_;
+    int8_t intPin_;
+    uint8_t shadow_; // what commit() writes
+    uint8_t chip_;   // what the chip was last written
+    uint8_t pins_;   // what the chip was last read
+    bool dirty_;     // shadow_ != chip_, or the last write failed
+    bool stale_;     // INT may not show a change: read on the next refresh()
+    uint8_t tick_;
+    Stats stats_;
+};
+
+#endif // PCF8574_SHADOW_H
@@ -0,0 +1,103 @@
+// Bit-parallel debouncer for a whole input port
+//
+// Debounces every bit of a port word at once using a 2-bit vertical
+// counter (one counter bit per plane, one pin per bit position). A pin
+// changes its debounced state only after it has read the same new level
+// on 4 consecutive ticks; any disagreement restarts its count. One tick
+// is a handful of AND/XOR instructions no matter how many pins are used.
+
+/*
+ Example (ESP32, GPIO0..39 in one 64-bit word):
+
+ #include "soc/gpio_struct.h"
+ #include <PortDebouncer.h>
+
+ PortDebouncer<uint64_t> inputs;
+
+ uint64_t readGpioInputs ()
+   {
+   return GPIO.in | ((uint64_t) GPIO.in1.data << 32);
+   }
+
+ void setup ()
+   {
+   inputs.begin (readGpioInputs ());
+   }
+
+ void loop ()
+   {
+   static unsigned long lastTick;
+   if (millis () - lastTick >= 5)     // fixed tick, 4 ticks = 20 ms debounce
+     {
+     lastTick = millis ();
+     inputs.update (readGpioInputs ());
+     }
+
+   if (inputs.fell (1ULL << 26))      // active-low key went down
+     ...
+   if (inputs.read (13))              // debounced level of GPIO13
+     ...
+   }
+ */
+
+#ifndef PORT_DEBOUNCER_H
+#define PORT_DEBOUNCER_H
+
+#include <Arduino.h>
+
+template <typename T>
+class PortDebouncer
+{
+    T state_; // debounced levels
+    T ct0_;   // vertical counter, low bit plane
+    T ct1_;   // vertical counter, high bit plane
+    T fell_;  // latched 1 -> 0 transitions, cleared when taken
+    T rose_;  // latched 0 -> 1 transitions, cleared when taken
+
+public:
+    PortDebouncer() : state_(0), ct0_(~T(0)), ct1_(~T(0)), fell_(0), rose_(0) {}
+
+    // Seed the debounced state from a first raw read so nothing "changes" at boot
+    void begin(T raw)
+    {
+        state_ = raw;
+        ct0_ = ct1_ = ~T(0);
+        fell_ = rose_ = 0;
+    }
+
+    // Feed one raw sample of the port. Returns the bits whose debounced
+    // state toggled on this tick.
+    T update(T raw)
+    {
+        T delta = raw ^ state_;        // pins disagreeing with their debounced state
+        ct0_ = ~(ct0_ & delta);        // count, or reset to 3 where they agree
+        ct1_ = ct0_ ^ (ct1_ & delta);
+        T toggled = delta & ct0_ & ct1_; // counter rolled over: 4 agreeing samples
+        state_ ^= toggled;
+        fell_ |= toggled & ~state_;
+        rose_ |= toggled & state_;
+        return toggled;
+    }
+
+    T state() const { return state_; }
+
+    bool read(uint8_t bit) const { return (state_ >> bit) & 1; }
+
+    // Return and clear latched falling edges within mask
+    T fell(T mask)
+    {
+        T r = fell_ & mask;
+        fell_ &= ~mask;
+        return r;
+    }
+
+    // Return and clear latched rising edges within mask
+    T rose(T mask)
+    {
+        T r = rose_ & mask;
+        rose_ &= ~mask;
+        return r;
+    }
+};
+
+#endif // PORT_DEBOUNCER_H
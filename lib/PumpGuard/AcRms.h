@@ -0,0 +1,160 @@
+// True RMS of an AC signal on a mid-rail ADC input, in integer math
+//
+// One analogRead() of the ACS712 on an AC motor is one point of a sine,
+// anything from -peak to +peak. AcRms takes a window of samples, ideally
+// whole mains cycles, and gives the RMS of the signal around its mean:
+//
+//   rms^2 = sum(d^2) / N - (sum(d) / N)^2      d = sample - center
+//
+// so the mid-rail offset drops out whatever it is; center is only there
+// to keep the sums small and follows the mean of the last window.
+//
+// Oversampling: every 4^bits raw 10-bit samples are summed and shifted
+// down to one (10 + bits)-bit sample. With the ADC noise as dither this
+// adds bits of resolution, and it cuts the rate the squares have to be
+// summed at (the ATtiny85 has no hardware multiplier).
+//
+// add() is short enough for the ADC interrupt and keeps no sample, only
+// the running sums: a few dozen bytes of RAM for any window. When it
+// returns true the window is complete; stop feeding it, call finish(),
+// then begin() the next window. N * 2^(22 + 2 * bits) must fit 32 bits,
+// e.g. up to 1024 samples at bits = 1. tools/adccycles counts the cycles
+// of add() in the controller's ADC interrupt.
+//
+// No Arduino headers, so tools/rmscheck runs it on synthetic waveforms.
+
+/*
+ Example (ACS712 on ADC2, free running ADC):
+
+ #include <AcRms.h>
+
+ AcRms current (192, 1);               // 4 cycles of 50 Hz at 2404 Hz
+
+ ISR (ADC_vect)
+   {
+   if (current.add (ADC))
+     ADCSRA &= ~_BV (ADIE);            // window complete
+   }
+
+ void loop ()
+   {
+   if (current.done ())
+     {
+     Serial.println (current.finish () / 16.0);   // RMS in ADC counts
+     current.begin ();
+     ADCSRA |= _BV (ADIE);
+     }
+   }
+ */
+
+#ifndef AC_RMS_H
+#define AC_RMS_H
+
+#include <stdint.h>
+
+class AcRms
+{
+public:
+    // window: samples after oversampling, 4^bits raw samples each
+    AcRms(uint16_t window, uint8_t bits = 1)
+        : window_(window), bits_(bits), center_(512 << bits), rmsX16_(0), meanX16_(512 << 4)
+    {
+        begin();
+    }
+
+    void begin()
+    {
+        acc_ = 0;
+        sub_ = 0;
+        n_ = 0;
+        sum_ = 0;
+        sumSq_ = 0;
+        done_ = false;
+    }
+
+    // One raw 10-bit sample; true when the window is complete
+    bool add(uint16_t raw)
+    {
+        if (done_)
+            return true;
+        acc_ += raw;
+        if (++sub_ < (uint16_t)1 << (2 * bits_))
+            return false;
+        int16_t d = (int16_t)(acc_ >> bits_) - center_;
+        acc_ = 0;
+        sub_ = 0;
+        sum_ += d;
+        // |d| squared unsigned, 16 x 16 bits (__umulhisi3): a negative d
+        // sign-extended into __mulsi3 would take all 32 rounds of its loop
+        uint16_t m = d < 0 ? -d : d;
+        sumSq_ += (uint32_t)m * m;
+        if (++n_ < window_)
+            return false;
+        done_ = true;
+        return true;
+    }
+
+    bool done() const
+    {
+        return done_;
+    }
+
+    // RMS of the window in 1/16 ADC counts; call once add() returned true
+    uint16_t finish()
+    {
+        int32_t sum = sum_;
+        uint32_t n = n_;
+        // n^2 * variance, in (10 + bits)-bit counts squared
+        uint64_t v = (uint64_t)n * sumSq_ - (uint64_t)((int64_t)sum * sum);
+        // to 10-bit counts, times 256 for the 1/16 scale, over n^2
+        v = (v << 8 >> (2 * bits_)) / ((uint64_t)n * n);
+        rmsX16_ = isqrt((uint32_t)v);
+
+        int32_t mean = (int32_t)center_ + sum / (int32_t)n;
+        meanX16_ = (uint16_t)(((int32_t)center_ * 16 + sum * 16 / (int32_t)n) >> bits_);
+        center_ = (int16_t)mean;
+        return rmsX16_;
+    }
+
+    uint16_t rmsX16() const
+    {
+        return rmsX16_;
+    }
+
+    // Mean of the window (the offset) in 1/16 ADC counts
+    uint16_t meanX16() const
+    {
+        return meanX16_;
+    }
+
+    static uint16_t isqrt(uint32_t x)
+    {
+        uint32_t root = 0;
+        for (uint32_t bit = (uint32_t)1 << 30; bit; bit >>= 2)
+        {
+            if (x >= root + bit)
+            {
+                x -= root + bit;
+                root = (root >> 1) + bit;
+            }
+            else
+                root >>= 1;
+        }
+        return (uint16_t)root;
+    }
+
+private:
+    uint16_t window_;
+    uint8_t bits_;
+    int16_t center_;       // (10 + bits)-bit counts
+    volatile uint16_t acc_; // raw samples of the current oversampled one
+    volatile uint16_t sub_;
+    volatile uint16_t n_;
+    volatile int32_t sum_;
+    volatile uint32_t sumSq_;
+    volatile bool done_;
+    uint16_t rmsX16_;
+    uint16_t meanX16_;
+};
+
+#endif // AC_RMS_H
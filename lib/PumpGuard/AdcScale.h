@@ -0,0 +1,102 @@
+// ADC counts to milliamps for the ACS712, with a precomputed Q8 factor
+//
+// The ACS712 gives mVPerAmp per amp (185 for the 5 A part, 100 for 20 A,
+// 66 for 30 A) and the ADC measures against Vcc, so one count is
+//
+//   Vcc / 1023 / mVPerAmp * 1000 mA      (74.05 mA at 5 V, 30 A part)
+//
+// update() works that out, with the one division, only when Vcc has moved
+// more than toleranceMV from the Vcc the factor was made for. The factor
+// is kept as mA per count in Q8 (256ths), so a conversion is a 16 x 16 bit
+// multiply and a shift: rounding the factor costs at most 0.003%, the
+// shift at most 1 mA. Vcc up to 16 V.
+//
+// factor() and vccMV() are what a sketch stores to start with the factor
+// it had; set() takes them back, and refuses a pair that does not belong
+// to this mVPerAmp.
+//
+// No Arduino headers, so tools/adccycles runs the same code on a PC.
+
+/*
+ Example (ACS712-30A on A2, Vcc measured against the bandgap):
+
+ #include <AdcScale.h>
+
+ AdcScale scale (66, 50);
+
+ void loop ()
+   {
+   scale.update (readVcc ());         // divides only when Vcc moved 50 mV
+   Serial.println (scale.toMA (analogRead (A2)));
+   delay (1000);
+   }
+ */
+
+#ifndef ADC_SCALE_H
+#define ADC_SCALE_H
+
+#include <stdint.h>
+
+class AdcScale
+{
+public:
+    AdcScale(uint16_t mVPerAmp = 66, uint16_t toleranceMV = 50)
+        : mVPerAmp_(mVPerAmp), toleranceMV_(toleranceMV), factor_(0), vccMV_(0)
+    {
+    }
+
+    // True when the factor was made anew for this Vcc
+    bool update(uint16_t vccMV)
+    {
+        uint16_t drift = vccMV > vccMV_ ? vccMV - vccMV_ : vccMV_ - vccMV;
+        if (factor_ && drift <= toleranceMV_)
+            return false;
+        uint32_t den = 1023UL * mVPerAmp_;
+        factor_ = (uint16_t)(((uint32_t)vccMV * 256000UL + den / 2) / den);
+        vccMV_ = vccMV;
+        return true;
+    }
+
+    // A stored factor and its Vcc; false (and no change) if they do not match
+    bool set(uint16_t factor, uint16_t vccMV)
+    {
+        uint32_t den = 1023UL * mVPerAmp_;
+        uint32_t have = (uint32_t)factor * den;
+        uint32_t want = (uint32_t)vccMV * 256000UL;
+        if (!factor || vccMV > 16000 || (have > want ? have - want : want - have) > den / 2)
+            return false;
+        factor_ = factor;
+        vccMV_ = vccMV;
+        return true;
+    }
+
+    uint32_t toMA(uint16_t counts) const
+    {
+        return (uint32_t)counts * factor_ >> 8;
+    }
+
+    // From 1/16 counts, as AcRms gives them
+    uint32_t x16ToMA(uint16_t countsX16) const
+    {
+        return (uint32_t)countsX16 * factor_ >> 12;
+    }
+
+    // mA per count in Q8, 0 before the first update()
+    uint16_t factor() const
+    {
+        return factor_;
+    }
+
+    uint16_t vccMV() const
+    {
+        return vccMV_;
+    }
+
+private:
+    uint16_t mVPerAmp_;
+    uint16_t toleranceMV_;
+    uint16_t factor_;
+    uint16_t vccMV_; // the Vcc the factor was made for
+};
+
+#endif // ADC_SCALE_H
@@ -0,0 +1,98 @@
+// Non-blocking blink codes for an error LED
+//
+// A code n is n flashes (onMs on, offMs off) and a gapMs pause, over and
+// over. show() picks the code, update() returns the LED level for the
+// current time and is called every tick, so nothing waits in delay().
+// A new code starts when the running pattern has finished its gap, so a
+// code that changes every tick is never cut short. Code 0 is off.
+//
+// Like PumpGuard.h it needs no Arduino headers.
+
+/*
+ Example:
+
+ #include <BlinkPattern.h>
+
+ BlinkPattern led;
+
+ void loop ()
+   {
+   led.show (errorCode);
+   digitalWrite (LED_PIN, led.update (millis ()));
+   }
+ */
+
+#ifndef BLINK_PATTERN_H
+#define BLINK_PATTERN_H
+
+#include <stdint.h>
+
+class BlinkPattern
+{
+public:
+    BlinkPattern(uint16_t onMs = 200, uint16_t offMs = 200, uint16_t gapMs = 1000)
+        : onMs_(onMs), offMs_(offMs), gapMs_(gapMs), code_(0), next_(0), step_(0), stepStart_(0)
+    {
+    }
+
+    void show(uint8_t code)
+    {
+        next_ = code;
+    }
+
+    // LED level at now
+    bool update(uint32_t now)
+    {
+        if (code_ == 0)
+        {
+            if (next_ == 0)
+                return false;
+            start(now);
+        }
+        // step 2k: flash k on, 2k+1: off, 2 * code_: the gap
+        while (now - stepStart_ >= stepMs())
+        {
+            stepStart_ += stepMs();
+            if (++step_ > 2 * code_)
+            {
+                if (next_ == 0)
+                {
+                    code_ = 0;
+                    return false;
+                }
+                code_ = next_;
+                step_ = 0;
+            }
+        }
+        return step_ < 2 * code_ && !(step_ & 1);
+    }
+
+    // The code being shown, 0 when the LED is idle
+    uint8_t code() const
+    {
+        return code_;
+    }
+
+private:
+    uint16_t onMs_;
+    uint16_t offMs_;
+    uint16_t gapMs_;
+    uint8_t code_; // pattern running
+    uint8_t next_; // pattern after it
+    uint8_t step_;
+    uint32_t stepStart_;
+
+    void start(uint32_t now)
+    {
+        code_ = next_;
+        step_ = 0;
+        stepStart_ = now;
+    }
+
+    uint16_t stepMs() const
+    {
+        return step_ == 2 * code_ ? gapMs_ : step_ & 1 ? offMs_ : onMs_;
+    }
+};
+
+#endif // BLINK_PATTERN_H
@@ -0,0 +1,163 @@
+// Flow rate and volume from the pulses of a flow meter
+//
+// A turbine flow meter gives K pulses per litre (the K-factor, e.g. 450
+// for the common YF-S201 hall sensors). The pulses are counted where they
+// arrive, by a pin change interrupt or by polling, as a running count and
+// the micros() time of the last one. update() gets those two values and
+// measures the rate from the time between pulses, not by counting pulses
+// per interval, so a few pulses per second still give a usable rate:
+//
+//   rate = (pulses since the last measurement) / (time they took)
+//
+// A new measurement is taken once the pulses span at least minWindowMs,
+// which keeps a timestamp error (1 ms for a polled input) small against
+// the window; after a start or a stall the pulses so far are used until
+// the window is full. While no pulse comes the rate is at most one pulse
+// per the time since the last, so it falls off like 1/t when the flow
+// stops, and a rate threshold also acts as a timeout: a pump guard that
+// stops below Q mL/min stops 60e9 / (K * Q) us after the last pulse.
+//
+// Like PumpGuard.h no Arduino headers: the count and the time are passed
+// in, the sketch reads them from the interrupt with interrupts off.
+
+/*
+ Example (flow meter on PB5, pin change interrupt):
+
+ #include <FlowMeter.h>
+
+ FlowMeter flow (450);
+ volatile uint32_t pulses, lastPulseUs;
+
+ ISR (PCINT0_vect)
+   {
+   if (!(PINB & _BV (PB5)))            // falling edge
+     {
+     pulses++;
+     lastPulseUs = micros ();
+     }
+   }
+
+ void loop ()
+   {
+   noInterrupts ();
+   uint32_t n = pulses, at = lastPulseUs;
+   interrupts ();
+   flow.update (micros (), n, at);
+   Serial.println (flow.mlPerMinute ());
+   delay (100);
+   }
+ */
+
+#ifndef FLOW_METER_H
+#define FLOW_METER_H
+
+#include <stdint.h>
+
+class FlowMeter
+{
+public:
+    // pulsesPerLitre at least 14, so the rate constant fits 32 bits
+    FlowMeter(uint16_t pulsesPerLitre, uint16_t minWindowMs = 250)
+        : k_(pulsesPerLitre), minWindowUs_((uint32_t)minWindowMs * 1000),
+          rateConst_((uint32_t)(60000000000ULL / pulsesPerLitre)), count_(0), edgeCount_(0), edgeUs_(0),
+          measuredUs_(0), periodUs_(0), rate_(0), started_(false), stalled_(false), warming_(false)
+    {
+    }
+
+    // count: pulses so far, lastPulseUs: micros() of the last one
+    void update(uint32_t nowUs, uint32_t count, uint32_t lastPulseUs)
+    {
+        bool fresh = count != count_; // pulses since the last update
+        count_ = count;
+        uint32_t n = count - edgeCount_;
+        if (fresh && (!started_ || stalled_))
+        {
+            // the first pulse, or the first after a stall, starts the clock;
+            // the rate so far stands until the next pulse
+            edgeCount_ = count;
+            edgeUs_ = lastPulseUs;
+            measuredUs_ = 0;
+            started_ = true;
+            stalled_ = false;
+            warming_ = true;
+            return;
+        }
+        if (!started_)
+            return;
+
+        if (n)
+        {
+            // until the window is full the rate is measured over what there is
+            uint32_t span = lastPulseUs - edgeUs_;
+            if (span >= minWindowUs_ || warming_)
+                measuredUs_ = span / n;
+            if (span >= minWindowUs_)
+            {
+                edgeCount_ = count;
+                edgeUs_ = lastPulseUs;
+                warming_ = false;
+            }
+        }
+
+        uint32_t since = nowUs - lastPulseUs;
+        if (since > maxGapUs)
+        {
+            // stopped; also before micros() wraps and makes the last pulse look new
+            started_ = false;
+            periodUs_ = measuredUs_ = 0;
+            rate_ = 0;
+            return;
+        }
+        if (!measuredUs_)
+        {
+            // one pulse is no rate yet, but the time since it bounds it
+            if (since && rateConst_ / since < rate_)
+                rate_ = rateConst_ / since;
+            return;
+        }
+        if (since > 2 * measuredUs_)
+            stalled_ = true;
+        periodUs_ = since > measuredUs_ ? since : measuredUs_;
+        rate_ = rateConst_ / periodUs_;
+    }
+
+    uint32_t mlPerMinute() const
+    {
+        return rate_;
+    }
+
+    // Volume since start-up
+    uint32_t totalMl() const
+    {
+        return count_ / k_ * 1000 + count_ % k_ * 1000 / k_;
+    }
+
+    uint32_t pulses() const
+    {
+        return count_;
+    }
+
+    // Mean time between the pulses of the last measurement, 0 before two pulses
+    uint32_t periodUs() const
+    {
+        return measuredUs_;
+    }
+
+private:
+    static const uint32_t maxGapUs = 60000000; // a minute without a pulse: no flow
+
+    uint16_t k_;
+    uint32_t minWindowUs_;
+    uint32_t rateConst_; // mL/min at one pulse per us
+    uint32_t count_;
+    uint32_t edgeCount_; // count and time of the pulse that ends the last measurement
+    uint32_t edgeUs_;
+    uint32_t measuredUs_; // mean time between the pulses of the last measurement
+    uint32_t periodUs_;   // the same, or the time since the last pulse if longer
+    uint32_t rate_;
+    bool started_;
+    bool stalled_; // no pulse for two periods: measure afresh from the next
+    bool warming_; // less than a window since the clock started
+};
+
+#endif // FLOW_METER_H
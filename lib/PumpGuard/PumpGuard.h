@@ -0,0 +1,136 @@
+// Relay decision of the ATtiny controller (supportFiles/main1.cpp)
+//
+// The pump may run while the flow rate is at least lowFlow and the motor
+// current stays between two thresholds. Each control tick the sketch
+// passes the flow rate (FlowMeter.h) and the current reading to update(),
+// which returns the relay state:
+//
+//   flow       below noFlow mL/min there is no flow, below lowFlow too
+//              little; either opens the relay, which closes again at
+//              lowFlow + 1/8 so a rate near the threshold cannot chatter
+//   current    at or below lowTh, or at or above highTh, for tripMs in a
+//              row trips the relay (0: on the first reading); it is only
+//              checked while the relay is closed and not for inrushMs
+//              after it closed, since an open relay carries no current.
+//              A trip holds the relay open for retryMs, then it may close
+//              again
+//
+// error() tells why the relay is off: NoFlow, LowFlow, UnderCurrent,
+// OverCurrent.
+//
+// No hardware access and no Arduino headers, so tools/pumpsim runs the
+// same code on a PC. Times are millis() values and may wrap.
+
+/*
+ Example (one tick per millisecond):
+
+ #include <PumpGuard.h>
+
+ PumpGuard guard;
+
+ void loop ()
+   {
+   static unsigned long last;
+   unsigned long now = millis ();
+   if (now == last)
+     return;
+   last = now;
+   digitalWrite (RELAY_PIN, guard.update (now, flowMlPerMinute, currentMA, 4000, 6000));
+   }
+ */
+
+#ifndef PUMP_GUARD_H
+#define PUMP_GUARD_H
+
+#include <stdint.h>
+
+class PumpGuard
+{
+public:
+    enum Error
+    {
+        None = 0,
+        NoFlow = 1,
+        UnderCurrent = 2,
+        OverCurrent = 3,
+        LowFlow = 5 // 4 is the controller's relay write error
+    };
+
+    // Flow thresholds in mL/min
+    PumpGuard(uint16_t lowFlow = 1000, uint16_t noFlow = 300, uint16_t inrushMs = 5000, uint16_t tripMs = 20,
+              uint16_t retryMs = 10000)
+        : lowFlow_(lowFlow), noFlow_(noFlow), inrushMs_(inrushMs), tripMs_(tripMs), retryMs_(retryMs), flow_(false),
+          relay_(false), badSide_(0), tripSide_(0), error_(None), relayOnAt_(0), badSince_(0), trippedAt_(0)
+    {
+    }
+
+    // The relay state for this tick
+    bool update(uint32_t now, uint32_t flowMlMin, int32_t current, int32_t lowTh, int32_t highTh)
+    {
+        flow_ = flowMlMin >= noFlow_;
+
+        bool check = relay_ && now - relayOnAt_ >= inrushMs_;
+        int8_t side = current <= lowTh ? -1 : current >= highTh ? 1 : 0;
+        if (side == 0 || !check)
+            badSide_ = 0;
+        else if (side != badSide_)
+        {
+            badSide_ = side;
+            badSince_ = now;
+        }
+        if (tripSide_ != 0 && now - trippedAt_ >= retryMs_)
+            tripSide_ = 0;
+        if (badSide_ != 0 && now - badSince_ >= tripMs_)
+        {
+            tripSide_ = badSide_;
+            trippedAt_ = now;
+            badSide_ = 0;
+        }
+        bool tripped = tripSide_ != 0;
+
+        bool enough = flowMlMin >= (relay_ ? lowFlow_ : lowFlow_ + lowFlow_ / 8u);
+        bool on = enough && !tripped;
+        if (on && !relay_)
+            relayOnAt_ = now;
+        relay_ = on;
+        if (!flow_)
+            error_ = NoFlow;
+        else if (!enough)
+            error_ = LowFlow;
+        else
+            error_ = !tripped ? None : tripSide_ < 0 ? UnderCurrent : OverCurrent;
+        return relay_;
+    }
+
+    bool relay() const
+    {
+        return relay_;
+    }
+
+    bool flow() const
+    {
+        return flow_;
+    }
+
+    uint8_t error() const
+    {
+        return error_;
+    }
+
+private:
+    uint16_t lowFlow_;
+    uint16_t noFlow_;
+    uint16_t inrushMs_;
+    uint16_t tripMs_;
+    uint16_t retryMs_;
+    bool flow_;
+    bool relay_;
+    int8_t badSide_;  // -1 below lowTh, 1 above highTh, 0 in range
+    int8_t tripSide_; // the same, of the trip that holds the relay open
+    uint8_t error_;
+    uint32_t relayOnAt_;
+    uint32_t badSince_;
+    uint32_t trippedAt_;
+};
+
+#endif // PUMP_GUARD_H
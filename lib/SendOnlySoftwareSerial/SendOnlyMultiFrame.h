@@ -0,0 +1,110 @@
+/*
+SendOnlyMultiFrame.h - bit-sliced frames of SendOnlyMultiSerial
+
+SendOnlyMultiSerial sends up to 8 channels at once, one per bit of the
+same port. Before interrupts go off, write() turns the channels' bytes
+into one port level per bit time (start, 8 data bits, stop), each with
+the delay that follows it, so sending costs the same for 1 channel or 8.
+This header holds that precomputation. It needs no AVR headers, so host
+tools (tools/sossmulti) build and check the same frames.
+
+A frame is multiSlots slots of 3 bytes: the channel pins' level, then the
+delay loop count, little endian. The transmit loop of a slot:
+
+  ld level, X+ 2; or other 1; st Z 2      the edge
+  ld, ld 4; sbiw/brne 4 N - 1             the delay
+  dec 1; brne 2 (1 after the stop slot)
+
+so a slot takes 4 N + 11 cycles. The counts are chosen per slot so each
+edge lands within 2 cycles of its ideal time, without drift over the
+frame. The stop slot gets the shortest delay: the rest of the stop bit
+is waited with interrupts on again.
+*/
+
+#ifndef SendOnlyMultiFrame_h
+#define SendOnlyMultiFrame_h
+
+#include <stdint.h>
+
+namespace soss
+{
+enum : uint8_t
+{
+  multiSlots = 10,       // start, 8 data bits, stop
+  multiSlotBytes = 3,    // level, count low, count high
+  multiSlotCode = 11,    // cycles of a slot besides its delay loop
+  multiStopCode = 10     // stop edge to interrupts on: rest of the stop slot, out SREG
+};
+
+const uint8_t multiFrameSize = multiSlots * multiSlotBytes;
+
+// Delay loop counts of the 9 slots before the stop edge; false when the
+// rate needs fewer cycles per bit than the loop takes, or too many
+inline bool multiCounts(uint32_t fcpu, uint32_t baud, uint16_t counts[multiSlots])
+{
+  if (baud == 0)
+    return false;
+  uint32_t at = 0; // edge times so far, cycles after the start edge
+  for (uint8_t k = 1; k < multiSlots; k++)
+  {
+    uint32_t target = ((uint64_t)k * fcpu + baud / 2) / baud;
+    int32_t loop = (int32_t)(target - at) - multiSlotCode;
+    int32_t n = (loop + 2) / 4;
+    if (n < 1 || n > 0xFFFF)
+      return false;
+    counts[k - 1] = n;
+    at += 4 * n + multiSlotCode;
+  }
+  counts[multiSlots - 1] = 1;
+  return true;
+}
+
+// _delay_loop_2 count that completes the stop bit after the critical part
+inline uint16_t multiStopLoops(uint32_t fcpu, uint32_t baud)
+{
+  uint32_t bit = (fcpu + baud / 2) / baud;
+  uint32_t loops = bit > multiStopCode ? (bit - multiStopCode + 3) / 4 : 1;
+  return loops > 0xFFFF ? 0xFFFF : loops;
+}
+
+// Build the frame. bytes[p] is sent by the channel on port bit p, for
+// each bit p of send; the other bits of pins idle. other port bits are
+// ORed in by the transmit loop.
+inline void buildMultiFrame(const uint8_t bytes[8], uint8_t send, uint8_t pins, bool inverse,
+                            const uint16_t counts[multiSlots], uint8_t frame[multiFrameSize])
+{
+  uint8_t shift[8];
+  for (uint8_t p = 0; p < 8; p++)
+    shift[p] = bytes[p];
+
+  const uint8_t idle = inverse ? 0 : pins;
+  const uint8_t flip = inverse ? pins : 0;
+  send &= pins;
+  uint8_t *slot = frame;
+  for (uint8_t k = 0; k < multiSlots; k++, slot += multiSlotBytes)
+  {
+    uint8_t level;
+    if (k == 0)
+      level = idle & ~send; // start bits are 0
+    else if (k == multiSlots - 1)
+      level = 0xFF;         // stop bits are 1
+    else
+    {
+      // gather bit k - 1 of every channel into its port bit
+      level = 0;
+      for (uint8_t p = 8; p--;)
+      {
+        level = level << 1 | (shift[p] & 1);
+        shift[p] >>= 1;
+      }
+    }
+    if (k != 0)
+      level = (level & send) | (idle & ~send);
+    slot[0] = (level ^ (flip & send)) & pins;
+    slot[1] = counts[k] & 0xFF;
+    slot[2] = counts[k] >> 8;
+  }
+}
+} // namespace soss
+
+#endif // SendOnlyMultiFrame_h
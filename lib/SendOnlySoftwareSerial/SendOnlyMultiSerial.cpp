@@ -0,0 +1,184 @@
+/*
+
+SendOnlyMultiSerial - send on up to 8 pins of one port at the same time
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+*/
+
+#ifdef __AVR__
+
+//
+// Includes
+//
+#include <avr/interrupt.h>
+#include <Arduino.h>
+#include <SendOnlyMultiSerial.h>
+#include <util/delay_basic.h>
+
+//
+// Private methods
+//
+
+// The frame's levels go out with interrupts off, one slot per bit time,
+// with the cycle counts SendOnlyMultiFrame.h assumes
+void SendOnlyMultiSerial::sendFrame(const uint8_t *bytes, uint8_t send)
+{
+  uint8_t frame[soss::multiFrameSize];
+  soss::buildMultiFrame(bytes, send, _pins, _inverse_logic, _counts, frame);
+
+  volatile uint8_t *reg = _transmitPortRegister;
+  const uint8_t *slot = frame;
+  uint8_t keep = ~_pins;
+  uint8_t slots = soss::multiSlots;
+  uint8_t level;
+  uint16_t count;
+  uint8_t oldSREG = SREG;
+
+  cli();  // turn off interrupts for a clean txmit
+  uint8_t other = *reg & keep;
+  asm volatile(
+    "1: ld %[level], X+\n\t"
+    "or %[level], %[other]\n\t"
+    "st Z, %[level]\n\t"
+    "ld %A[count], X+\n\t"
+    "ld %B[count], X+\n\t"
+    "2: sbiw %[count], 1\n\t"
+    "brne 2b\n\t"
+    "dec %[slots]\n\t"
+    "brne 1b\n\t"
+    : [slot] "+x"(slot), [slots] "+r"(slots), [level] "=&r"(level), [count] "=&w"(count)
+    : [reg] "z"(reg), [other] "r"(other)
+    : "memory");
+  SREG = oldSREG; // turn interrupts back on
+  _delay_loop_2(_stopLoops);
+}
+
+//
+// Constructor
+//
+SendOnlyMultiSerial::SendOnlyMultiSerial(const uint8_t *transmitPins, uint8_t count, bool inverse_logic /* = false */) :
+  _transmitPortRegister(NULL),
+  _pins(0),
+  _count(0),
+  _inverse_logic(inverse_logic),
+  _stopLoops(0)
+{
+  _counts[0] = 0;
+  for (uint8_t i = 0; i < SOSS_MULTI_MAX_CHANNELS; i++)
+  {
+    _channels[i]._owner = this;
+    _channels[i]._index = i;
+    _fill[i] = 0;
+  }
+  uint8_t port = count ? digitalPinToPort(transmitPins[0]) : NOT_A_PORT;
+  for (uint8_t i = 0; i < count && _count < SOSS_MULTI_MAX_CHANNELS; i++)
+  {
+    uint8_t pin = transmitPins[i];
+    uint8_t mask = digitalPinToBitMask(pin);
+    if (digitalPinToPort(pin) != port || (_pins & mask))
+      continue;
+    // idle level first, then output; see SendOnlySoftwareSerial::setTX
+    digitalWrite(pin, _inverse_logic ? LOW : HIGH);
+    pinMode(pin, OUTPUT);
+    uint8_t bit = 0;
+    while (!(mask & (1 << bit)))
+      bit++;
+    _pinBit[_count] = bit;
+    _pins |= mask;
+    _count++;
+  }
+  if (_count)
+    _transmitPortRegister = portOutputRegister(port);
+}
+
+//
+// Destructor
+//
+SendOnlyMultiSerial::~SendOnlyMultiSerial()
+{
+  end();
+}
+
+//
+// Public methods
+//
+
+void SendOnlyMultiSerial::begin(long speed)
+{
+  if (speed <= 0 || !_count || !soss::multiCounts(F_CPU, speed, _counts))
+  {
+    _counts[0] = 0; // write() reports the error
+    return;
+  }
+  _stopLoops = soss::multiStopLoops(F_CPU, speed);
+}
+
+void SendOnlyMultiSerial::end()
+{
+  _counts[0] = 0;
+}
+
+size_t SendOnlyMultiSerial::write(const uint8_t *data, uint8_t channels)
+{
+  if (_counts[0] == 0)
+    return 0;
+
+  // bytes by port bit, as the frame wants them
+  uint8_t bytes[8] = {0};
+  uint8_t send = 0;
+  for (uint8_t i = 0; i < _count; i++)
+    if (channels & (1 << i))
+    {
+      bytes[_pinBit[i]] = data[i];
+      send |= 1 << _pinBit[i];
+    }
+  if (send)
+    sendFrame(bytes, send);
+  return 1;
+}
+
+void SendOnlyMultiSerial::flush()
+{
+  uint8_t longest = 0;
+  for (uint8_t i = 0; i < _count; i++)
+    if (_fill[i] > longest)
+      longest = _fill[i];
+
+  uint8_t data[SOSS_MULTI_MAX_CHANNELS];
+  for (uint8_t n = 0; n < longest; n++)
+  {
+    uint8_t channels = 0;
+    for (uint8_t i = 0; i < _count; i++)
+      if (n < _fill[i])
+      {
+        data[i] = _buffer[i][n];
+        channels |= 1 << i;
+      }
+    write(data, channels);
+  }
+  for (uint8_t i = 0; i < _count; i++)
+    _fill[i] = 0;
+}
+
+size_t SendOnlyMultiSerial::Channel::write(uint8_t b)
+{
+  SendOnlyMultiSerial *owner = _owner;
+  if (owner->_counts[0] == 0) {
+    setWriteError();
+    return 0;
+  }
+  if (owner->_fill[_index] == SOSS_MULTI_BUFFER_SIZE)
+    owner->flush();
+  owner->_buffer[_index][owner->_fill[_index]++] = b;
+  return 1;
+}
+
+#endif // __AVR__
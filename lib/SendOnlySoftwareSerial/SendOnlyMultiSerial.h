@@ -0,0 +1,124 @@
+/*
+SendOnlyMultiSerial - send on up to 8 pins of one port at the same time
+
+Several SendOnlySoftwareSerial instances send one after the other, each
+byte with interrupts off for a whole frame. SendOnlyMultiSerial sends a
+byte on every channel in one frame: write() first works out the port
+level of each bit time for all channels together (see
+SendOnlyMultiFrame.h), then one loop writes those levels to the port,
+so 8 channels take the CPU (and block interrupts) for as long as one.
+
+All pins must be on the same port; pins on another port than the first
+are ignored. The other bits of the port are read once interrupts are
+off and written back unchanged with every level.
+
+Each channel is also a Print (channel(i)). What is printed there waits
+in a small buffer per channel (SOSS_MULTI_BUFFER_SIZE) until flush(), or
+until a buffer is full, and then all channels send together: the first
+bytes of every channel in one frame, then the second bytes, and so on.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+*/
+
+/*
+ Example:
+
+ #include <SendOnlyMultiSerial.h>
+
+ const uint8_t pins[] = {0, 1, 2};       // PB0..PB2 of an ATtiny85
+ SendOnlyMultiSerial lines (pins, 3);
+
+ void setup ()
+   {
+   lines.begin (9600);
+   }
+
+ void loop ()
+   {
+   lines.channel (0).println (F("motor"));
+   lines.channel (1).println (analogRead (A2));
+   lines.channel (2).println (millis ());
+   lines.flush ();                        // all three lines at once
+   }
+ */
+
+#ifndef SendOnlyMultiSerial_h
+#define SendOnlyMultiSerial_h
+
+#include <inttypes.h>
+#include <Print.h>
+#include "SendOnlyMultiFrame.h"
+
+/******************************************************************************
+* Definitions
+******************************************************************************/
+
+#ifndef SOSS_MULTI_BUFFER_SIZE
+#define SOSS_MULTI_BUFFER_SIZE 8 // bytes per channel for channel(i)
+#endif
+
+#define SOSS_MULTI_MAX_CHANNELS 8
+
+class SendOnlyMultiSerial
+{
+public:
+  // One channel as a Print; buffered until SendOnlyMultiSerial::flush()
+  class Channel : public Print
+  {
+  public:
+    virtual size_t write(uint8_t byte);
+    using Print::write;
+
+  private:
+    friend class SendOnlyMultiSerial;
+    SendOnlyMultiSerial *_owner;
+    uint8_t _index;
+  };
+
+private:
+  volatile uint8_t *_transmitPortRegister;
+  uint8_t _pinBit[SOSS_MULTI_MAX_CHANNELS];  // port bit of each channel
+  uint8_t _pins;                             // port bits of all channels
+  uint8_t _count;
+  bool _inverse_logic;
+
+  // begin() precomputes the frame timing; _counts[0] == 0: not begun
+  uint16_t _counts[soss::multiSlots];
+  uint16_t _stopLoops;
+
+  Channel _channels[SOSS_MULTI_MAX_CHANNELS];
+  uint8_t _buffer[SOSS_MULTI_MAX_CHANNELS][SOSS_MULTI_BUFFER_SIZE];
+  uint8_t _fill[SOSS_MULTI_MAX_CHANNELS];
+
+  void sendFrame(const uint8_t *bytes, uint8_t send);
+
+public:
+  SendOnlyMultiSerial(const uint8_t *transmitPins, uint8_t count, bool inverse_logic = false);
+  ~SendOnlyMultiSerial();
+  void begin(long speed);
+  void end();
+
+  // Send data[i] on channel i for each bit i of channels, all in one
+  // frame; returns 0 before begin() or when the rate was refused
+  size_t write(const uint8_t *data, uint8_t channels = 0xFF);
+
+  Channel &channel(uint8_t i) { return _channels[i < _count ? i : 0]; }
+  uint8_t channels() const { return _count; }
+
+  // Send what channel(i) buffered, all channels together
+  void flush();
+};
+
+// Arduino 0012 workaround
+#undef int
+#undef char
+#undef long
+#undef byte
+#undef float
+#undef abs
+#undef round
+
+#endif  // SendOnlyMultiSerial_h
@@ -32,6 +32,9 @@ The latest version of this library can always be found at
 http://arduiniana.org.
 */
 
+// The AVR backend; see SendOnlySoftwareSerial.h for the others
+#if defined(__AVR__) && !defined(SOSS_BACKEND_MOCK)
+
 // When set, _DEBUG co-opts pins 11 and 13 for debugging with an
 // oscilloscope or logic analyzer.  Beware: it also slightly modifies
 // the bit times, so don't rely on it too much at high baud rates
@@ -219,3 +222,5 @@ int SendOnlySoftwareSerial::peek()
 {
   return -1;
 }
+
+#endif // __AVR__
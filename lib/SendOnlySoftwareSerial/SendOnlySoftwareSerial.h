@@ -43,9 +43,38 @@ http://arduiniana.org.
 #define GCC_VERSION (__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__)
 #endif
 
+// Backends, one translation unit each:
+//   SOSS_BACKEND_AVR    bit banged with interrupts off (SendOnlySoftwareSerial.cpp)
+//   SOSS_BACKEND_RMT    ESP32 RMT peripheral, buffered (SendOnlySoftwareSerialRmt.cpp)
+//   SOSS_BACKEND_MOCK   host builds for tests, records what is sent
+//                       (SendOnlySoftwareSerialMock.cpp); define it to get it
+#if defined(SOSS_BACKEND_MOCK)
+#elif defined(__AVR__)
+#define SOSS_BACKEND_AVR
+#elif defined(ARDUINO_ARCH_ESP32)
+#define SOSS_BACKEND_RMT
+#include <driver/rmt.h>
+#else
+#error "SendOnlySoftwareSerial has no backend for this target (define SOSS_BACKEND_MOCK for host builds)"
+#endif
+
+#ifdef SOSS_BACKEND_RMT
+#ifndef SOSS_RMT_BUFFER_SIZE
+#define SOSS_RMT_BUFFER_SIZE 64 // power of two, at most 256
+#endif
+#define SOSS_RMT_CHUNK 12       // bytes per RMT memory block (5 items each at most)
+#endif
+
+#ifdef SOSS_BACKEND_MOCK
+#ifndef SOSS_MOCK_CAPTURE_SIZE
+#define SOSS_MOCK_CAPTURE_SIZE 256
+#endif
+#endif
+
 class SendOnlySoftwareSerial : public Stream
 {
 private:
+#if defined(SOSS_BACKEND_AVR)
   uint8_t _transmitBitMask;
   volatile uint8_t *_transmitPortRegister;
   volatile uint8_t *_pcint_maskreg;
@@ -66,6 +95,33 @@ private:
   // private static method for timing
   static inline void tunedDelay(uint16_t delay);
 
+#elif defined(SOSS_BACKEND_RMT)
+  uint8_t _transmitPin;
+  bool _inverse_logic;
+  bool _buffer_overflow;
+  int8_t _channel;            // RMT channel, -1 before begin()
+  uint32_t _tickRate;         // RMT ticks per second
+  long _speed;
+
+  uint8_t _buffer[SOSS_RMT_BUFFER_SIZE];
+  volatile uint8_t _head;     // written by write()
+  volatile uint8_t _tail;     // written by sendChunk()
+  volatile bool _busy;        // the RMT is sending
+
+  void setTX(uint8_t transmitPin);
+  void sendChunk();
+  static void txEnd(rmt_channel_t channel, void *arg);
+
+#elif defined(SOSS_BACKEND_MOCK)
+  uint8_t _transmitPin;
+  bool _inverse_logic;
+  bool _buffer_overflow;
+  long _speed;
+  uint8_t _sent[SOSS_MOCK_CAPTURE_SIZE];
+  size_t _sentCount;
+
+#endif
+
 public:
   // public methods
   SendOnlySoftwareSerial(uint8_t transmitPin, bool inverse_logic = false);
@@ -83,6 +139,16 @@ public:
 
   using Print::write;
 
+#ifdef SOSS_BACKEND_MOCK
+  // What write() sent since begin() or clearSent(), for tests
+  const uint8_t *sent() const { return _sent; }
+  size_t sentCount() const { return _sentCount; }
+  void clearSent() { _sentCount = 0; }
+  // Line level during bit n of the frames sent (10 bits per byte), then idle
+  int levelAt(size_t n) const;
+  // Time the frames take on the line
+  uint32_t sentMicros() const;
+#endif
 };
 
 // Arduino 0012 workaround
@@ -0,0 +1,327 @@
+/*
+
+SendOnlySoftwareSerialBuffered - interrupt driven variant of SendOnlySoftwareSerial
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+*/
+
+#ifdef __AVR__
+
+//
+// Includes
+//
+#include <avr/interrupt.h>
+#include <Arduino.h>
+#include <SendOnlySoftwareSerialBuffered.h>
+
+#if (SOSS_TX_BUFFER_SIZE & (SOSS_TX_BUFFER_SIZE - 1)) || SOSS_TX_BUFFER_SIZE > 128
+#error "SOSS_TX_BUFFER_SIZE must be a power of two up to 128"
+#endif
+
+//
+// Timer
+//
+// Prescaler choices as clock shifts; the clock select bits are the
+// index + 1.
+#if defined(__AVR_ATtiny25__) || defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__)
+#define SOSS_TIMER_VECT TIMER1_COMPA_vect
+#define SOSS_TIMER_COUNT TCNT1
+static const uint8_t prescaleShifts[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14};
+#elif defined(TCCR2A) && defined(TIMER2_COMPA_vect)
+#define SOSS_TIMER_VECT TIMER2_COMPA_vect
+#define SOSS_TIMER_COUNT TCNT2
+static const uint8_t prescaleShifts[] = {0, 3, 5, 6, 7, 8, 10};
+#else
+#error "SendOnlySoftwareSerialBuffered needs Timer1 of an ATtiny25/45/85 or Timer2 of an ATmega"
+#endif
+
+SendOnlySoftwareSerialBuffered *SendOnlySoftwareSerialBuffered::active_ = NULL;
+
+//
+// Private methods
+//
+
+void SendOnlySoftwareSerialBuffered::setTX(uint8_t tx)
+{
+  // idle level first, then output; see SendOnlySoftwareSerial::setTX
+  digitalWrite(tx, _inverse_logic ? LOW : HIGH);
+  pinMode(tx, OUTPUT);
+  _transmitBitMask = digitalPinToBitMask(tx);
+  uint8_t port = digitalPinToPort(tx);
+  _transmitPortRegister = portOutputRegister(port);
+}
+
+// Interrupts must be off
+inline void SendOnlySoftwareSerialBuffered::startTimer()
+{
+#ifdef TCCR1
+  TCNT1 = 0;
+  TIFR = _BV(OCF1A); // drop a stale compare match
+  TIMSK |= _BV(OCIE1A);
+#else
+  TCNT2 = 0;
+  TIFR2 = _BV(OCF2A);
+  TIMSK2 |= _BV(OCIE2A);
+#endif
+}
+
+inline void SendOnlySoftwareSerialBuffered::stopTimer()
+{
+#ifdef TCCR1
+  TIMSK &= ~_BV(OCIE1A);
+#else
+  TIMSK2 &= ~_BV(OCIE2A);
+#endif
+}
+
+// Work out the level of the next edge. _bits counts what is left of the
+// current frame; -1 means the stop bit is on the line and nothing was
+// queued when it went out, so the next interrupt ends the transmission
+// once the stop bit has had its full bit time.
+inline void SendOnlySoftwareSerialBuffered::prepareNext()
+{
+  if (_bits <= 0)
+  {
+    if (_head == _tail)
+    {
+      _nextLevel = !_inverse_logic;
+      _bits = -1;
+      return;
+    }
+    uint8_t b = _buffer[_tail];
+    _tail = (_tail + 1) & (SOSS_TX_BUFFER_SIZE - 1);
+    _frame = (uint16_t)b << 1 | 0x200; // start bit 0, 8 data bits, stop bit 1
+    _bits = 10;
+    _stats.bytes++;
+  }
+  _nextLevel = (_frame & 1) ^ _inverse_logic;
+  _frame >>= 1;
+  _bits--;
+}
+
+//
+// Interrupt handling
+//
+
+/* static */
+inline void SendOnlySoftwareSerialBuffered::handleInterrupt()
+{
+  SendOnlySoftwareSerialBuffered *s = active_;
+  if (!s)
+    return;
+
+  // the edge first, so its delay after the compare match is always the same
+  if (s->_nextLevel)
+    *s->_transmitPortRegister |= s->_transmitBitMask;
+  else
+    *s->_transmitPortRegister &= ~s->_transmitBitMask;
+
+  if (s->_bits < 0 && s->_head == s->_tail)
+  {
+    s->stopTimer();
+    s->_bits = 0;
+    s->_busy = false;
+  }
+  else
+    s->prepareNext();
+
+  // the counter restarted at the compare match: it has counted our time
+  uint16_t cycles = (uint16_t)SOSS_TIMER_COUNT << s->_prescaleShift;
+  s->_stats.interrupts++;
+  s->_stats.isrCycles += cycles;
+  if (cycles > s->_stats.maxIsrCycles)
+    s->_stats.maxIsrCycles = cycles;
+}
+
+ISR(SOSS_TIMER_VECT)
+{
+  SendOnlySoftwareSerialBuffered::handleInterrupt();
+}
+
+//
+// Constructor
+//
+SendOnlySoftwareSerialBuffered::SendOnlySoftwareSerialBuffered(uint8_t transmitPin, bool inverse_logic /* = false */) :
+  _inverse_logic(inverse_logic),
+  _ticks(0),
+  _prescaleBits(0),
+  _prescaleShift(0),
+  _head(0),
+  _tail(0),
+  _busy(false),
+  _frame(0),
+  _bits(0),
+  _nextLevel(!inverse_logic),
+  _buffer_overflow(false),
+  _stats()
+{
+  setTX(transmitPin);
+}
+
+//
+// Destructor
+//
+SendOnlySoftwareSerialBuffered::~SendOnlySoftwareSerialBuffered()
+{
+  end();
+}
+
+//
+// Public methods
+//
+
+void SendOnlySoftwareSerialBuffered::begin(long speed)
+{
+  end();
+  _ticks = 0;
+  if (speed <= 0 || F_CPU / speed < SOSS_MIN_BIT_CYCLES)
+    return; // write() reports the error
+
+  // the smallest prescaler that fits a bit time into the 8-bit timer
+  for (uint8_t i = 0; i < sizeof(prescaleShifts); i++)
+  {
+    uint32_t div = (uint32_t)speed << prescaleShifts[i];
+    uint32_t ticks = (F_CPU + div / 2) / div;
+    if (ticks <= 256)
+    {
+      _ticks = ticks;
+      _prescaleBits = i + 1;
+      _prescaleShift = prescaleShifts[i];
+      break;
+    }
+  }
+  if (!_ticks)
+    return;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  active_ = this;
+#ifdef TCCR1
+  TCCR1 = 0;
+  OCR1C = _ticks - 1; // top, the counter restarts after it
+  OCR1A = _ticks - 1;
+  TCCR1 = _BV(CTC1) | _prescaleBits;
+#else
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _prescaleBits;
+  OCR2A = _ticks - 1;
+#endif
+  stopTimer(); // runs, but interrupts only while sending
+  SREG = oldSREG;
+}
+
+void SendOnlySoftwareSerialBuffered::end()
+{
+  if (active_ != this)
+    return;
+  uint8_t oldSREG = SREG;
+  cli();
+  stopTimer();
+  active_ = NULL;
+  _head = _tail = 0;
+  _bits = 0;
+  _busy = false;
+  // back to idle, even in the middle of a byte
+  if (_inverse_logic)
+    *_transmitPortRegister &= ~_transmitBitMask;
+  else
+    *_transmitPortRegister |= _transmitBitMask;
+  SREG = oldSREG;
+}
+
+size_t SendOnlySoftwareSerialBuffered::write(uint8_t b)
+{
+  if (_ticks == 0 || active_ != this) {
+    setWriteError();
+    return 0;
+  }
+
+  uint8_t next = (_head + 1) & (SOSS_TX_BUFFER_SIZE - 1);
+  while (next == _tail)
+  {
+    if (!(SREG & _BV(SREG_I)))
+    {
+      // nothing would ever make room
+      _buffer_overflow = true;
+      _stats.overflows++;
+      return 0;
+    }
+  }
+  _buffer[_head] = b;
+  _head = next;
+
+  if (!_busy)
+  {
+    uint8_t oldSREG = SREG;
+    cli();
+    if (!_busy)
+    {
+      _busy = true;
+      _bits = 0;
+      prepareNext(); // the start bit goes out at the first compare match
+      startTimer();
+    }
+    SREG = oldSREG;
+  }
+  return 1;
+}
+
+int SendOnlySoftwareSerialBuffered::availableForWrite()
+{
+  return SOSS_TX_BUFFER_SIZE - 1 - ((_head - _tail) & (SOSS_TX_BUFFER_SIZE - 1));
+}
+
+void SendOnlySoftwareSerialBuffered::flush()
+{
+  // until the stop bit of the last byte has had its time
+  while (_busy && (SREG & _BV(SREG_I)))
+    ;
+}
+
+long SendOnlySoftwareSerialBuffered::actualBaud() const
+{
+  if (!_ticks)
+    return 0;
+  return F_CPU / ((uint32_t)_ticks << _prescaleShift);
+}
+
+SendOnlySoftwareSerialBuffered::Stats SendOnlySoftwareSerialBuffered::stats() const
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  Stats s = _stats;
+  SREG = oldSREG;
+  return s;
+}
+
+uint16_t SendOnlySoftwareSerialBuffered::cyclesPerByte() const
+{
+  Stats s = stats();
+  return s.bytes ? s.isrCycles / s.bytes : 0;
+}
+
+// Read data from buffer
+int SendOnlySoftwareSerialBuffered::read()
+{
+  return -1;
+}
+
+int SendOnlySoftwareSerialBuffered::available()
+{
+  return 0;
+}
+
+int SendOnlySoftwareSerialBuffered::peek()
+{
+  return -1;
+}
+
+#endif // __AVR__
@@ -0,0 +1,145 @@
+/*
+SendOnlySoftwareSerialBuffered - interrupt driven variant of SendOnlySoftwareSerial
+
+SendOnlySoftwareSerial::write() sends a byte with interrupts off and busy
+waits each bit, so a 40 character line at 9600 baud holds the CPU for
+over 40 ms. This class queues bytes in a ring buffer instead, and a timer
+compare interrupt shifts out one bit per bit time. write() returns as
+soon as the byte is queued, unless the buffer is full. flush() waits
+until the last stop bit has gone out.
+
+Timer used (one instance per sketch, it owns the timer):
+  ATtiny25/45/85   Timer1 in CTC mode (OCR1C top, OCR1A interrupt)
+  ATmega328 etc.   Timer2 in CTC mode (OCR2A top), tone() and PWM on
+                   pins 3 and 11 are lost
+
+Each interrupt first writes the level computed by the previous one, so
+every edge has the same latency after the compare match. Other interrupts
+(millis() on Timer0) can still delay an edge by a few microseconds.
+Below about 160 CPU cycles per bit the interrupt would take most of the
+CPU, so begin() refuses such rates (e.g. above 38400 baud at 8 MHz).
+
+The pin is written with a read-modify-write of its port register from
+the interrupt. Other code writing the same port must use single bit
+instructions (digitalWrite, or |= / &= on a constant port) so it cannot
+undo the interrupt's write.
+
+stats() profiles the transmitter: the cycles spent in the interrupt,
+measured from the compare match to the end of the handler with the
+timer itself, so cyclesPerByte() includes the interrupt entry.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+*/
+
+/*
+ Example:
+
+ #include <SendOnlySoftwareSerialBuffered.h>
+
+ SendOnlySoftwareSerialBuffered mySerial (1);  // Tx pin
+
+ void setup ()
+   {
+   mySerial.begin (9600);
+   }
+
+ void loop ()
+   {
+   mySerial.println (F("status"));    // returns while the line is still going out
+   }
+ */
+
+#ifndef SendOnlySoftwareSerialBuffered_h
+#define SendOnlySoftwareSerialBuffered_h
+
+#include <inttypes.h>
+#include <Stream.h>
+
+/******************************************************************************
+* Definitions
+******************************************************************************/
+
+#ifndef SOSS_TX_BUFFER_SIZE
+#define SOSS_TX_BUFFER_SIZE 32 // power of two, at most 128
+#endif
+
+#define SOSS_MIN_BIT_CYCLES 160
+
+class SendOnlySoftwareSerialBuffered : public Stream
+{
+public:
+  struct Stats
+  {
+    uint32_t bytes;       // sent
+    uint32_t interrupts;  // one per bit time while sending
+    uint32_t isrCycles;   // spent in the interrupt, entry included
+    uint16_t maxIsrCycles;
+    uint16_t overflows;   // bytes dropped, buffer full with interrupts off
+  };
+
+private:
+  uint8_t _transmitBitMask;
+  volatile uint8_t *_transmitPortRegister;
+  bool _inverse_logic;
+
+  // Timer setup chosen by begin(); 0 ticks = not begun or rate refused
+  uint16_t _ticks;
+  uint8_t _prescaleBits;
+  uint8_t _prescaleShift;
+
+  uint8_t _buffer[SOSS_TX_BUFFER_SIZE];
+  volatile uint8_t _head;     // written by write()
+  volatile uint8_t _tail;     // written by the interrupt
+  volatile bool _busy;        // the interrupt is sending
+  uint16_t _frame;            // bits still to send, LSB first
+  int8_t _bits;               // how many, -1 while the last stop bit goes out
+  uint8_t _nextLevel;         // level of the next edge on the line
+  bool _buffer_overflow;
+  Stats _stats;
+
+  static SendOnlySoftwareSerialBuffered *active_;
+
+  void setTX(uint8_t transmitPin);
+  void startTimer();
+  void stopTimer();
+  void prepareNext();
+
+public:
+  SendOnlySoftwareSerialBuffered(uint8_t transmitPin, bool inverse_logic = false);
+  ~SendOnlySoftwareSerialBuffered();
+  void begin(long speed);
+  void end();
+  bool overflow() { bool ret = _buffer_overflow; if (ret) _buffer_overflow = false; return ret; }
+  int peek();
+
+  virtual size_t write(uint8_t byte);
+  virtual int read();
+  virtual int available();
+  virtual int availableForWrite();
+  virtual void flush();
+  operator bool() { return true; }
+
+  using Print::write;
+
+  // Baud rate the timer really produces, 0 before begin()
+  long actualBaud() const;
+  Stats stats() const;
+  uint16_t cyclesPerByte() const;
+
+  // called from the timer interrupt
+  static inline void handleInterrupt();
+};
+
+// Arduino 0012 workaround
+#undef int
+#undef char
+#undef long
+#undef byte
+#undef float
+#undef abs
+#undef round
+
+#endif  // SendOnlySoftwareSerialBuffered_h
@@ -0,0 +1,114 @@
+/*
+
+SendOnlySoftwareSerialMock.cpp - host backend of SendOnlySoftwareSerial
+
+Built instead of the AVR or RMT backend when SOSS_BACKEND_MOCK is
+defined, for tests of code that prints to a SendOnlySoftwareSerial on a
+PC. It touches no hardware: write() records the byte (the first
+SOSS_MOCK_CAPTURE_SIZE bytes after begin() or clearSent(), later ones set
+overflow()). sent() and sentCount() give the bytes back, levelAt() the
+line level bit by bit as the hardware backends would drive it, and
+sentMicros() how long that would take at the begin() rate. Only Print
+and Stream are needed from the test's Arduino stand-in.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+*/
+
+#include <SendOnlySoftwareSerial.h>
+
+#ifdef SOSS_BACKEND_MOCK
+
+//
+// Constructor
+//
+SendOnlySoftwareSerial::SendOnlySoftwareSerial(uint8_t transmitPin, bool inverse_logic /* = false */) :
+  _transmitPin(transmitPin),
+  _inverse_logic(inverse_logic),
+  _buffer_overflow(false),
+  _speed(0),
+  _sentCount(0)
+{
+}
+
+//
+// Destructor
+//
+SendOnlySoftwareSerial::~SendOnlySoftwareSerial()
+{
+  end();
+}
+
+//
+// Public methods
+//
+
+void SendOnlySoftwareSerial::begin(long speed)
+{
+  _speed = speed > 0 ? speed : 0;
+  _sentCount = 0;
+}
+
+void SendOnlySoftwareSerial::end()
+{
+  _speed = 0;
+}
+
+size_t SendOnlySoftwareSerial::write(uint8_t b)
+{
+  if (_speed == 0) {
+    setWriteError();
+    return 0;
+  }
+  if (_sentCount == SOSS_MOCK_CAPTURE_SIZE) {
+    _buffer_overflow = true;
+    return 1; // sent, but not recorded
+  }
+  _sent[_sentCount++] = b;
+  return 1;
+}
+
+int SendOnlySoftwareSerial::levelAt(size_t n) const
+{
+  int level = 1; // idle and stop bits
+  if (n < _sentCount * 10)
+  {
+    uint16_t frame = (uint16_t)_sent[n / 10] << 1 | 0x200;
+    level = frame >> (n % 10) & 1;
+  }
+  return level ^ _inverse_logic;
+}
+
+uint32_t SendOnlySoftwareSerial::sentMicros() const
+{
+  return _speed ? (uint64_t)_sentCount * 10 * 1000000 / _speed : 0;
+}
+
+void SendOnlySoftwareSerial::flush()
+{
+}
+
+// Read data from buffer
+int SendOnlySoftwareSerial::read()
+{
+  return -1;
+}
+
+int SendOnlySoftwareSerial::available()
+{
+  return 0;
+}
+
+int SendOnlySoftwareSerial::peek()
+{
+  return -1;
+}
+
+#endif // SOSS_BACKEND_MOCK
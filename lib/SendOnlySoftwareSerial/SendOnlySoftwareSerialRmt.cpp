@@ -0,0 +1,281 @@
+/*
+
+SendOnlySoftwareSerialRmt.cpp - ESP32 backend of SendOnlySoftwareSerial
+
+The ESP32 cannot bit bang a UART reliably: interrupts of the other core,
+the WiFi stack and flash cache misses move the edges. The RMT peripheral
+plays a list of (level, duration) pairs from its own memory with its own
+clock, so the edges are exact and the CPU is free while a line goes out.
+
+write() queues the byte in a ring buffer (SOSS_RMT_BUFFER_SIZE) and
+returns; only a full buffer waits. Up to SOSS_RMT_CHUNK bytes at a time
+are turned into RMT items (one per two runs of equal bits) that fit one
+64-item RMT memory block, and the RMT's end-of-transmission interrupt
+starts the next chunk. flush() waits until the queue is empty.
+
+Each instance takes one RMT channel (8 on the ESP32) and installs the
+legacy RMT driver on it. The RMT clock divider is chosen so 9 bits fit
+the 15-bit duration of an item: about 86 baud up to some MBaud. Edges
+are placed from the exact bit times, so there is no drift within a
+chunk; the stop bit at the end of a chunk only gets longer.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+*/
+
+#include <SendOnlySoftwareSerial.h>
+
+#ifdef SOSS_BACKEND_RMT
+
+//
+// Includes
+//
+#include <Arduino.h>
+#include <soc/soc.h>
+
+#if (SOSS_RMT_BUFFER_SIZE & (SOSS_RMT_BUFFER_SIZE - 1)) || SOSS_RMT_BUFFER_SIZE > 256
+#error "SOSS_RMT_BUFFER_SIZE must be a power of two up to 256"
+#endif
+
+// A run of 9 equal bits (start and 8 zeros, or 8 ones and stop) must fit
+// the 15-bit duration of an item
+#define SOSS_RMT_MAX_BIT_TICKS (32767 / 9)
+
+static SendOnlySoftwareSerial *active_[RMT_CHANNEL_MAX];
+static portMUX_TYPE rmtMux = portMUX_INITIALIZER_UNLOCKED;
+static bool callbackRegistered = false;
+
+//
+// Private methods
+//
+
+void SendOnlySoftwareSerial::setTX(uint8_t tx)
+{
+  // idle level until the RMT takes the pin over in begin()
+  digitalWrite(tx, _inverse_logic ? LOW : HIGH);
+  pinMode(tx, OUTPUT);
+  _transmitPin = tx;
+}
+
+// Turn the next chunk of the queue into RMT items and start them. Called
+// with rmtMux held, from write() or from the RMT interrupt.
+void SendOnlySoftwareSerial::sendChunk()
+{
+  rmt_item32_t items[SOSS_RMT_CHUNK * 5 + 1];
+  uint16_t n = 0;
+  bool second = false; // the next run goes into the item's second half
+
+  uint32_t bits = 0;   // bits of the chunk so far
+  uint32_t runStart = 0;
+  int runLevel = -1;
+  uint8_t bytes = 0;
+  while (_tail != _head && bytes < SOSS_RMT_CHUNK)
+  {
+    uint16_t frame = (uint16_t)_buffer[_tail] << 1 | 0x200; // start bit 0, 8 data bits, stop bit 1
+    _tail = (_tail + 1) & (SOSS_RMT_BUFFER_SIZE - 1);
+    bytes++;
+    for (uint8_t i = 0; i < 10; i++, bits++, frame >>= 1)
+    {
+      int level = (frame & 1) ^ _inverse_logic;
+      if (level == runLevel)
+        continue;
+      if (runLevel >= 0)
+      {
+        // durations from the exact bit times, so rounding does not add up
+        uint32_t from = ((uint64_t)runStart * _tickRate + _speed / 2) / _speed;
+        uint32_t to = ((uint64_t)bits * _tickRate + _speed / 2) / _speed;
+        if (second)
+        {
+          items[n].level1 = runLevel;
+          items[n++].duration1 = to - from;
+        }
+        else
+        {
+          items[n].level0 = runLevel;
+          items[n].duration0 = to - from;
+        }
+        second = !second;
+      }
+      runLevel = level;
+      runStart = bits;
+    }
+  }
+  if (runLevel < 0)
+  {
+    _busy = false;
+    return;
+  }
+
+  // the last run, the stop bit, then a zero duration ends the chunk
+  uint32_t from = ((uint64_t)runStart * _tickRate + _speed / 2) / _speed;
+  uint32_t to = ((uint64_t)bits * _tickRate + _speed / 2) / _speed;
+  if (second)
+  {
+    items[n].level1 = runLevel;
+    items[n++].duration1 = to - from;
+    items[n++].val = 0;
+  }
+  else
+  {
+    items[n].level0 = runLevel;
+    items[n].duration0 = to - from;
+    items[n].level1 = runLevel;
+    items[n++].duration1 = 0;
+  }
+
+  _busy = true;
+  rmt_fill_tx_items((rmt_channel_t)_channel, items, n, 0);
+  rmt_tx_start((rmt_channel_t)_channel, true);
+}
+
+//
+// Interrupt handling
+//
+
+/* static */
+void SendOnlySoftwareSerial::txEnd(rmt_channel_t channel, void *)
+{
+  SendOnlySoftwareSerial *s = active_[channel];
+  if (!s)
+    return;
+  portENTER_CRITICAL_ISR(&rmtMux);
+  s->sendChunk();
+  portEXIT_CRITICAL_ISR(&rmtMux);
+}
+
+//
+// Constructor
+//
+SendOnlySoftwareSerial::SendOnlySoftwareSerial(uint8_t transmitPin, bool inverse_logic /* = false */) :
+  _inverse_logic(inverse_logic),
+  _buffer_overflow(false),
+  _channel(-1),
+  _tickRate(0),
+  _speed(0),
+  _head(0),
+  _tail(0),
+  _busy(false)
+{
+  setTX(transmitPin);
+}
+
+//
+// Destructor
+//
+SendOnlySoftwareSerial::~SendOnlySoftwareSerial()
+{
+  end();
+}
+
+//
+// Public methods
+//
+
+void SendOnlySoftwareSerial::begin(long speed)
+{
+  end();
+  if (speed <= 0)
+    return; // write() reports the error
+
+  uint32_t div = (APB_CLK_FREQ / speed + SOSS_RMT_MAX_BIT_TICKS - 1) / SOSS_RMT_MAX_BIT_TICKS;
+  if (div == 0)
+    div = 1;
+  if (div > 255)
+    return;
+
+  int8_t channel = -1;
+  for (uint8_t i = 0; i < RMT_CHANNEL_MAX && channel < 0; i++)
+    if (!active_[i])
+      channel = i;
+  if (channel < 0)
+    return;
+
+  rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)_transmitPin, (rmt_channel_t)channel);
+  config.clk_div = div;
+  config.tx_config.idle_level = _inverse_logic ? RMT_IDLE_LEVEL_LOW : RMT_IDLE_LEVEL_HIGH;
+  config.tx_config.idle_output_en = true;
+  if (rmt_config(&config) != ESP_OK || rmt_driver_install((rmt_channel_t)channel, 0, 0) != ESP_OK)
+    return;
+  if (!callbackRegistered)
+  {
+    rmt_register_tx_end_callback(txEnd, NULL);
+    callbackRegistered = true;
+  }
+
+  _tickRate = APB_CLK_FREQ / div;
+  _speed = speed;
+  _head = _tail = 0;
+  _busy = false;
+  active_[channel] = this;
+  _channel = channel;
+}
+
+void SendOnlySoftwareSerial::end()
+{
+  if (_channel < 0)
+    return;
+  flush();
+  active_[_channel] = NULL;
+  rmt_driver_uninstall((rmt_channel_t)_channel);
+  _channel = -1; // the RMT keeps the pin at the idle level
+}
+
+size_t SendOnlySoftwareSerial::write(uint8_t b)
+{
+  if (_channel < 0) {
+    setWriteError();
+    return 0;
+  }
+
+  uint8_t next = (_head + 1) & (SOSS_RMT_BUFFER_SIZE - 1);
+  while (next == _tail)
+  {
+    if (xPortInIsrContext())
+    {
+      // nothing would ever make room
+      _buffer_overflow = true;
+      return 0;
+    }
+    delay(1); // the RMT interrupt makes room
+  }
+  _buffer[_head] = b;
+  _head = next;
+
+  portENTER_CRITICAL(&rmtMux);
+  if (!_busy)
+    sendChunk();
+  portEXIT_CRITICAL(&rmtMux);
+  return 1;
+}
+
+void SendOnlySoftwareSerial::flush()
+{
+  // until the stop bit of the last byte has gone out
+  while (_busy && !xPortInIsrContext())
+    delay(1);
+}
+
+// Read data from buffer
+int SendOnlySoftwareSerial::read()
+{
+  return -1;
+}
+
+int SendOnlySoftwareSerial::available()
+{
+  return 0;
+}
+
+int SendOnlySoftwareSerial::peek()
+{
+  return -1;
+}
+
+#endif // SOSS_BACKEND_RMT
@@ -0,0 +1,178 @@
+/*
+SendOnlySoftwareSerialT.h - SendOnlySoftwareSerial with pin, baud rate
+and inverse logic fixed at compile time
+
+SendOnlySoftwareSerial works out its bit delay in begin() and, in write(),
+loads the port address and bit mask from the object, then relies on a
+guess of the loop overhead (12 to 16 cycles depending on the gcc version).
+Here the pin's port is a constant I/O address, so the pin is written with
+single cycle-exact sbi/cbi instructions, and the whole frame is one block
+of inline assembler whose cycle count does not depend on the compiler.
+The delays are constexpr (see SendOnlyTiming.h) and the class holds no
+data, so it is also smaller.
+
+A baud rate that the CPU clock cannot produce closely enough does not
+compile: the static_assert checks that no edge lands more than
+SOSS_MAX_OFFSET_PERMILLE thousandths of a bit from its ideal place.
+
+Like SendOnlySoftwareSerial, interrupts are off while a byte goes out
+(until the stop edge), and there is no buffer.
+
+Pins: ATtiny25/45/85 0..5 (PB0..PB5); ATmega168/328 0..7 (PORTD),
+8..13 (PORTB), 14..19 (PORTC).
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+*/
+
+/*
+ Example:
+
+ #include <SendOnlySoftwareSerialT.h>
+
+ SendOnlySoftwareSerialT<1, 38400> mySerial;  // PB1, 38400 baud
+
+ void setup ()
+   {
+   mySerial.begin ();
+   mySerial.println (F("hello"));
+   }
+ */
+
+#ifndef SendOnlySoftwareSerialT_h
+#define SendOnlySoftwareSerialT_h
+
+#include <inttypes.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <Stream.h>
+#include "SendOnlyTiming.h"
+
+namespace soss
+{
+// I/O addresses (as sbi/cbi take them) of the PORT registers; the DDR
+// register is the one below
+#if defined(__AVR_ATtiny25__) || defined(__AVR_ATtiny45__) || defined(__AVR_ATtiny85__)
+constexpr uint8_t portAddress(uint8_t pin) { return pin <= 5 ? 0x18 : 0xFF; }
+constexpr uint8_t portBit(uint8_t pin) { return pin; }
+#elif defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega328__) || \
+    defined(__AVR_ATmega328P__)
+constexpr uint8_t portAddress(uint8_t pin) { return pin <= 7 ? 0x0B : pin <= 13 ? 0x05 : pin <= 19 ? 0x08 : 0xFF; }
+constexpr uint8_t portBit(uint8_t pin) { return pin <= 7 ? pin : pin <= 13 ? pin - 8 : pin - 14; }
+#else
+#error "SendOnlySoftwareSerialT knows the pins of the ATtiny25/45/85 and ATmega168/328 only"
+#endif
+} // namespace soss
+
+// One delay of the cycle count in operands n and r (see SendOnlyTiming.h)
+#define SOSS_DELAY(n, r)                        \
+  "ldi %A[count], lo8(%[" n "])\n\t"            \
+  "ldi %B[count], hi8(%[" n "])\n\t"            \
+  "2: sbiw %[count], 1\n\t"                     \
+  "brne 2b\n\t"                                 \
+  ".rept %[" r "]\n\t"                          \
+  "nop\n\t"                                     \
+  ".endr\n\t"
+
+template <uint8_t Pin, uint32_t Baud, bool Inverse = false>
+class SendOnlySoftwareSerialT : public Stream
+{
+  static constexpr uint8_t port = soss::portAddress(Pin);
+  static constexpr uint8_t bit = soss::portBit(Pin);
+  static constexpr uint32_t cycles = soss::bitCycles(F_CPU, Baud);
+
+  static_assert(port < 0x20, "no such pin on this MCU");
+  static_assert(soss::feasible(F_CPU, Baud), "baud rate too high (or too low) for this CPU clock");
+  static_assert(soss::offsetPermille(F_CPU, Baud) <= SOSS_MAX_OFFSET_PERMILLE,
+                "the CPU clock cannot produce this baud rate accurately enough");
+
+public:
+  SendOnlySoftwareSerialT() {}
+
+  void begin()
+  {
+    // idle level first, then output (see SendOnlySoftwareSerial::setTX)
+    if (Inverse)
+      asm volatile("cbi %[port], %[bit]" : : [port] "I"(port), [bit] "I"(bit));
+    else
+      asm volatile("sbi %[port], %[bit]" : : [port] "I"(port), [bit] "I"(bit));
+    asm volatile("sbi %[ddr], %[bit]" : : [ddr] "I"(port - 1), [bit] "I"(bit));
+  }
+  // for drop-in use; the rate is the template's
+  void begin(long) { begin(); }
+  void end() {}
+  bool overflow() { return false; }
+  int peek() { return -1; }
+
+  virtual size_t write(uint8_t b)
+  {
+    uint8_t oldSREG = SREG;
+    uint8_t bits;
+    uint16_t count;
+    if (Inverse)
+      b = ~b;
+
+    cli();
+    asm volatile(
+      // start bit
+      ".if %[inv]\n\t"
+      "sbi %[port], %[bit]\n\t"
+      ".else\n\t"
+      "cbi %[port], %[bit]\n\t"
+      ".endif\n\t"
+      "ldi %[bits], 8\n\t"
+      SOSS_DELAY("startN", "startR")
+      // data bits, LSB first; both paths take 5 cycles
+      "1: sbrc %[b], 0\n\t"
+      "sbi %[port], %[bit]\n\t"
+      "sbrs %[b], 0\n\t"
+      "cbi %[port], %[bit]\n\t"
+      "lsr %[b]\n\t"
+      SOSS_DELAY("bitN", "bitR")
+      "dec %[bits]\n\t"
+      "brne 1b\n\t"
+      // stop bit
+      "nop\n\t"
+      "nop\n\t"
+      "nop\n\t"
+      ".if %[inv]\n\t"
+      "cbi %[port], %[bit]\n\t"
+      ".else\n\t"
+      "sbi %[port], %[bit]\n\t"
+      ".endif\n\t"
+      : [b] "+r"(b), [bits] "=&d"(bits), [count] "=&w"(count)
+      : [port] "I"(port), [bit] "I"(bit), [inv] "n"(Inverse),
+        [startN] "n"(soss::delayLoops(soss::startDelay(cycles))),
+        [startR] "n"(soss::delayNops(soss::startDelay(cycles))),
+        [bitN] "n"(soss::delayLoops(soss::bitDelay(cycles))),
+        [bitR] "n"(soss::delayNops(soss::bitDelay(cycles))));
+    SREG = oldSREG;
+    __builtin_avr_delay_cycles(soss::stopDelay(cycles));
+    return 1;
+  }
+
+  virtual int read() { return -1; }
+  virtual int available() { return 0; }
+  virtual void flush() {}
+  operator bool() { return true; }
+
+  using Print::write;
+
+  // The rate the CPU clock really produces
+  static constexpr uint32_t actualBaud() { return F_CPU / cycles; }
+};
+
+#undef SOSS_DELAY
+
+// Arduino 0012 workaround
+#undef int
+#undef char
+#undef long
+#undef byte
+#undef float
+#undef abs
+#undef round
+
+#endif  // SendOnlySoftwareSerialT_h
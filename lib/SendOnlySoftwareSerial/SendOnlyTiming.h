@@ -0,0 +1,86 @@
+/*
+SendOnlyTiming.h - bit timing of SendOnlySoftwareSerialT
+
+The transmit code of SendOnlySoftwareSerialT::write() is inline assembler
+with a fixed number of cycles per bit, so all of its delays are known at
+compile time. This header holds the cycle budget and the error figures
+the template checks with static_assert. It needs no AVR headers, so host
+tools (tools/sosscycles) use the same numbers.
+
+Per frame (C = bitCycles, edges are where the port write completes):
+
+  start   cbi/sbi 2, ldi 1, delay C - 5       start edge at 2
+  8 bits  sbrc/sbi/sbrs/cbi 5, lsr 1,         a 1 is written 1 cycle
+          delay C - 9, dec 1, brne 2          early, a 0 1 cycle late
+  stop    3 nop (one pays for the last brne   stop edge at 2 + 9 C
+          not taken), sbi/cbi 2, out SREG 1,
+          delay C - 3
+
+A delay of D cycles is ldi, ldi, then sbiw/brne 4 cycles per pass (one
+less on the last), then D - 1 mod 4 nops: D = 4 N + 1 + nops, N >= 1.
+*/
+
+#ifndef SendOnlyTiming_h
+#define SendOnlyTiming_h
+
+#include <stdint.h>
+
+#ifndef SOSS_MAX_OFFSET_PERMILLE
+// The receiver samples mid-bit: keep every edge within 0.2 bit of where
+// it expects it, the rest is for its own clock error and sampling
+#define SOSS_MAX_OFFSET_PERMILLE 200
+#endif
+
+namespace soss
+{
+enum : uint8_t
+{
+  startCode = 5,   // start delay C - 5 puts the first data edge C after the start edge
+  bitCode = 9,     // cycles of a data bit besides its delay
+  stopCode = 3,    // stop delay C - 3 holds the stop bit C even if write() follows at once
+  edgeJitter = 1,  // a data edge is this many cycles early or late
+  minDelay = 5     // the shortest delay the delay loop makes
+};
+
+// CPU cycles per bit, rounded
+constexpr uint32_t bitCycles(uint32_t fcpu, uint32_t baud)
+{
+  return (fcpu + baud / 2) / baud;
+}
+
+constexpr uint32_t startDelay(uint32_t c) { return c - startCode; }
+constexpr uint32_t bitDelay(uint32_t c) { return c - bitCode; }
+constexpr uint32_t stopDelay(uint32_t c) { return c - stopCode; }
+
+// Delay loop passes and trailing nops for a delay of d cycles
+constexpr uint16_t delayLoops(uint32_t d) { return (d - 1) / 4; }
+constexpr uint8_t delayNops(uint32_t d) { return (d - 1) % 4; }
+
+// Enough cycles per bit for the code, and a delay the loop can count:
+// the start delay, the longest, in at most 0xFFFF passes of the 16-bit
+// counter. Checked before the narrowing of delayLoops(), which would
+// wrap a longer delay into a short one
+constexpr bool feasible(uint32_t fcpu, uint32_t baud)
+{
+  return baud > 0 && bitCycles(fcpu, baud) >= bitCode + minDelay &&
+         (startDelay(bitCycles(fcpu, baud)) - 1) / 4 <= 0xFFFF;
+}
+
+constexpr uint32_t absDiff(uint32_t a, uint32_t b) { return a > b ? a - b : b - a; }
+
+// Rate error of the rounded bit time, parts per million
+constexpr uint32_t baudErrorPpm(uint32_t fcpu, uint32_t baud)
+{
+  return (uint64_t)absDiff(bitCycles(fcpu, baud) * baud, fcpu) * 1000000 / fcpu;
+}
+
+// Worst distance of an edge from its ideal place, in thousandths of a
+// bit: the drift of the rounded bit time up to the stop edge, plus the
+// data edge jitter
+constexpr uint32_t offsetPermille(uint32_t fcpu, uint32_t baud)
+{
+  return ((uint64_t)9 * absDiff(bitCycles(fcpu, baud) * baud, fcpu) + (uint64_t)edgeJitter * baud) * 1000 / fcpu;
+}
+} // namespace soss
+
+#endif // SendOnlyTiming_h
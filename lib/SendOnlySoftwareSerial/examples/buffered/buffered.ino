@@ -0,0 +1,26 @@
+#include <SendOnlySoftwareSerialBuffered.h>
+
+SendOnlySoftwareSerialBuffered mySerial(1);  // Tx pin
+
+void setup()
+{
+  mySerial.begin(9600);
+}
+
+int i;
+
+void loop()
+{
+  unsigned long start = micros();
+  mySerial.print("test: ");
+  mySerial.println(i++);
+  unsigned long queued = micros() - start;  // time write() held the caller
+
+  mySerial.print("queued in ");
+  mySerial.print(queued);
+  mySerial.print(" us, ");
+  mySerial.print(mySerial.cyclesPerByte());
+  mySerial.println(" cycles per byte in the interrupt");
+  mySerial.flush();  // wait for the last stop bit
+  delay(100);
+}
@@ -0,0 +1,26 @@
+#include <SendOnlyMultiSerial.h>
+
+const uint8_t pins[] = {0, 1, 2};  // Tx pins, all on one port (PB0..PB2 of an ATtiny85)
+SendOnlyMultiSerial lines(pins, 3);
+
+void setup()
+{
+  lines.begin(9600);
+}
+
+int i;
+
+void loop()
+{
+  // buffered per channel, then sent on all three pins at once
+  lines.channel(0).print("count ");
+  lines.channel(0).println(i++);
+  lines.channel(1).println(millis());
+  lines.channel(2).println(F("ok"));
+  lines.flush();
+
+  // or one byte per channel in a single frame
+  const uint8_t marks[] = {'a', 'b', 'c'};
+  lines.write(marks);
+  delay(100);
+}
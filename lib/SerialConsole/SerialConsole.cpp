@@ -0,0 +1,200 @@
+#include "SerialConsole.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static_assert((SerialConsole::outSize & (SerialConsole::outSize - 1)) == 0, "output ring must be a power of two");
+
+SerialConsole::SerialConsole(const Command *commands, uint8_t count)
+    : commands_(commands), count_(count), len_(0), overflow_(false), argc_(0), active_(NULL), step_(0), head_(0),
+      tail_(0), midLine_(false), stats_()
+{
+}
+
+void SerialConsole::poll(Stream &in)
+{
+    // the line buffer holds the arguments until the command is done
+    for (uint16_t n = 0; !active_ && n < readBudget && in.available() > 0; n++)
+    {
+        int ch = in.read();
+        if (ch == '\r' || ch == '\n')
+        {
+            if (overflow_)
+            {
+                print("line too long, %u characters at most\n", lineSize - 1);
+                stats_.overflows++;
+            }
+            else if (len_)
+                run();
+            len_ = 0;
+            overflow_ = false;
+        }
+        else if (ch == '\b' || ch == 0x7F)
+        {
+            if (len_)
+                len_--;
+        }
+        else if (ch >= ' ' && !overflow_)
+        {
+            if (len_ < lineSize - 1)
+                line_[len_++] = ch;
+            else
+                overflow_ = true;
+        }
+    }
+
+    if (active_ && room() >= lineRoom)
+        step();
+}
+
+// Split the line into words and find the command
+void SerialConsole::run()
+{
+    line_[len_] = 0;
+    argc_ = 0;
+    for (char *p = line_; *p;)
+    {
+        while (*p == ' ' || *p == '\t')
+            *p++ = 0;
+        if (!*p)
+            break;
+        if (argc_ == maxArgs)
+        {
+            print("too many arguments\n");
+            return;
+        }
+        argv_[argc_++] = p;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+    }
+    if (!argc_)
+        return;
+
+    for (uint8_t i = 0; i < count_; i++)
+        if (strcmp(argv_[0], commands_[i].name) == 0)
+        {
+            active_ = &commands_[i];
+            step_ = 0;
+            stats_.lines++;
+            return;
+        }
+    print("unknown command '%s', try help\n", argv_[0]);
+}
+
+void SerialConsole::step()
+{
+    if (!active_->run(*this, argc_, argv_, step_++))
+        active_ = NULL;
+}
+
+bool SerialConsole::print(const char *format, ...)
+{
+    char text[lineRoom];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n < 0)
+        return false;
+    if ((size_t)n >= sizeof(text))
+        n = sizeof(text) - 1; // cut, a step should not print more than this
+    if (n > room())
+    {
+        stats_.dropped++;
+        return false;
+    }
+    for (int i = 0; i < n; i++)
+        out_[(head_ + i) & (outSize - 1)] = text[i];
+    head_ += n;
+    return true;
+}
+
+size_t SerialConsole::drain(Print &out)
+{
+    size_t done = 0;
+    while (head_ != tail_)
+    {
+        int free = out.availableForWrite();
+        if (free <= 0)
+            break;
+        uint16_t at = tail_ & (outSize - 1);
+        size_t n = (uint16_t)(head_ - tail_);
+        if (n > (size_t)(outSize - at))
+            n = outSize - at; // up to the end of the ring, the rest on the next turn
+        if (n > (size_t)free)
+            n = free;
+        n = out.write((const uint8_t *)out_ + at, n);
+        if (n == 0)
+            break;
+        midLine_ = out_[at + n - 1] != '\n';
+        tail_ += n;
+        done += n;
+    }
+    return done;
+}
+
+bool SerialConsole::help(SerialConsole &c, uint8_t, char **, uint16_t step)
+{
+    if (step >= c.count_)
+        return false;
+    c.print("%-8s %s\n", c.commands_[step].name, c.commands_[step].help);
+    return step + 1 < c.count_;
+}
+
+const SerialConsole::Field *SerialConsole::findField(const Field *fields, uint8_t count, const char *name)
+{
+    for (uint8_t i = 0; i < count; i++)
+        if (strcmp(fields[i].name, name) == 0)
+            return &fields[i];
+    return NULL;
+}
+
+bool SerialConsole::printField(const Field &f, const void *base)
+{
+    const uint8_t *p = (const uint8_t *)base + f.offset;
+    switch (f.type)
+    {
+    case 'f':
+        return print("%s = %.2f\n", f.name, (double)*(const float *)p);
+    case 'u':
+        return print("%s = %u\n", f.name, *(const unsigned int *)p);
+    case 'b':
+        return print("%s = %s\n", f.name, *(const bool *)p ? "on" : "off");
+    }
+    return false;
+}
+
+bool SerialConsole::setField(const Field &f, void *base, const char *text)
+{
+    uint8_t *p = (uint8_t *)base + f.offset;
+    char *end;
+    float v;
+    if (f.type == 'b' && (strcmp(text, "on") == 0 || strcmp(text, "off") == 0))
+        v = text[1] == 'n';
+    else
+    {
+        v = strtof(text, &end);
+        if (end == text || *end || !(v >= f.min && v <= f.max)) // also rejects NaN
+            return false;
+    }
+
+    switch (f.type)
+    {
+    case 'f':
+        *(float *)p = v;
+        return true;
+    case 'u':
+        if (v != (unsigned int)v)
+            return false; // whole numbers only
+        *(unsigned int *)p = v;
+        return true;
+    case 'b':
+        if (v != 0 && v != 1)
+            return false;
+        *(bool *)p = v;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,133 @@
+// Line based command console that never makes the caller wait
+//
+// poll() reads at most readBudget bytes per call into a fixed line
+// buffer. A finished line is split in place into words and the first word
+// is looked up in the command table. Nothing is allocated.
+//
+// Replies go into an output ring, and drain() writes only as many bytes
+// as the port takes without blocking. A handler prints about one line per
+// call. It gets a step number, counting from 0 for each command line, and
+// returns true to be called again on a later poll(). poll() runs at most
+// one step, and only when the ring has lineRoom bytes free. A long listing
+// is therefore spread over many loop passes, and input waits in the UART
+// buffer until the command is done.
+//
+// midLine() is true while drain() has sent part of a line, so that
+// another writer on the same port (EventLog) waits for the line end.
+//
+// Field describes a variable that get/set style commands reach through a
+// table of names, types, offsets and allowed ranges:
+//   f float   u unsigned int   b bool (0/1, on/off)
+
+/*
+ Example:
+
+ bool hello (SerialConsole &c, uint8_t argc, char **argv, uint16_t step)
+   {
+   c.print ("hello %s\n", argc > 1 ? argv[1] : "world");
+   return false;                      // done, no further steps
+   }
+
+ const SerialConsole::Command commands[] = {
+     {"help", "list commands", SerialConsole::help},
+     {"hello", "[name]  say hello", hello},
+ };
+ SerialConsole console (commands, 2);
+
+ void loop ()
+   {
+   console.poll (Serial);
+   console.drain (Serial);
+   }
+ */
+
+#ifndef SERIAL_CONSOLE_H
+#define SERIAL_CONSOLE_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+
+class SerialConsole
+{
+public:
+    enum : uint16_t
+    {
+        lineSize = 64,   // longest input line, including the terminator
+        maxArgs = 6,     // words per line, the command included
+        readBudget = 32, // input bytes looked at per poll()
+        outSize = 1024,  // output ring, a power of two
+        lineRoom = 128   // free output a step needs before it runs
+    };
+
+    // Returns true to be called again with step + 1 on a later poll()
+    typedef bool (*Handler)(SerialConsole &c, uint8_t argc, char **argv, uint16_t step);
+
+    struct Command
+    {
+        const char *name;
+        const char *help;
+        Handler run;
+    };
+
+    struct Field
+    {
+        const char *name;
+        char type; // 'f', 'u' or 'b'
+        uint16_t offset;
+        float min, max;
+    };
+
+    struct Stats
+    {
+        uint32_t lines;     // command lines run
+        uint32_t overflows; // input lines longer than lineSize
+        uint32_t dropped;   // output lines lost to a full ring
+    };
+
+    SerialConsole(const Command *commands, uint8_t count);
+
+    // Read input and run one step of the current command, if any
+    void poll(Stream &in);
+
+    // Queue output; the whole text or nothing. Returns false if it did not fit.
+    bool print(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Write what the port takes without blocking; returns bytes written
+    size_t drain(Print &out);
+
+    bool midLine() const { return midLine_; }
+    bool idle() const { return head_ == tail_ && !active_; }
+    const Stats &stats() const { return stats_; }
+
+    // The "help" command: one line per command
+    static bool help(SerialConsole &c, uint8_t argc, char **argv, uint16_t step);
+
+    static const Field *findField(const Field *fields, uint8_t count, const char *name);
+    bool printField(const Field &f, const void *base);
+    // Parse and range check text, then store it; false leaves the field as it was
+    static bool setField(const Field &f, void *base, const char *text);
+
+private:
+    const Command *commands_;
+    uint8_t count_;
+
+    char line_[lineSize];
+    uint8_t len_;
+    bool overflow_;   // discarding the rest of a long line
+    char *argv_[maxArgs];
+    uint8_t argc_;
+    const Command *active_;
+    uint16_t step_;
+
+    char out_[outSize];
+    uint16_t head_, tail_; // free running, masked on access
+    bool midLine_;
+    Stats stats_;
+
+    uint16_t room() const { return outSize - (uint16_t)(head_ - tail_); }
+    void run();
+    void step();
+};
+
+#endif // SERIAL_CONSOLE_H
@@ -0,0 +1,483 @@
+// Journaled, power-fail-safe settings store on raw flash
+//
+// Keeps a plain struct (trivially copyable, at most 254 bytes) in two
+// flash sectors used as A/B slots. A slot holds a header with sequence
+// number, schema version and CRC, a full snapshot, then a journal of
+// small records holding only the bytes that changed since the last
+// commit. Changes are staged in RAM and committed after a quiet period,
+// so a burst of menu edits costs one short journal append.
+//
+// When the active slot's journal is full the newest settings are written
+// as a snapshot into the other slot and its header (with the next sequence
+// number) is programmed last. That header write is the atomic switch-over:
+// until it is complete the old slot stays the newest valid one. Journal
+// records of one commit are applied only if the record flagged "last" is
+// intact, and a torn record fails its CRC, so a brown-out at any byte
+// leaves either the old or the new settings, never a mix.
+//
+// Boot reads both headers, takes the valid one with the higher sequence
+// number and falls back to the other if its snapshot CRC fails.
+//
+// Slot layout (all records 4-byte aligned):
+//   Header   magic, sequence, schema, size, lifetime erases, snapshot CRC, header CRC
+//   Snapshot size bytes
+//   Records  offset, length, flags, CRC, changed bytes ... then erased (0xFF)
+//
+// Schema evolution is append-only: if the stored schema is older, its
+// bytes are copied over the defaults and new trailing fields keep their
+// default values. If it is newer (a firmware rollback), the leading
+// sizeof(T) bytes are loaded and the slot is left as it is, so the newer
+// firmware finds its settings again after an upgrade. Edits go into the
+// journal, which the newer layout replays too; only a compaction rewrites
+// the slot in the older layout, dropping the fields this firmware lacks.
+
+/*
+ Example:
+
+ EspPartitionRegion settingsFlash;           // at least two sectors
+ SettingsStore<Settings> store (settingsFlash, 1);
+
+ void setup ()
+   {
+   settingsFlash.begin ("settings");
+   store.load (settings, Settings ());
+   }
+
+ void loop ()
+   {
+   store.poll (millis ());          // commits staged changes when due
+   }
+
+ void saveSettings ()
+   {
+   store.stage (settings);          // cheap, no flash access
+   }
+ */
+
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include <Crc.h>
+#include <FlashRegion.h>
+
+template <class T>
+class SettingsStore
+{
+    static_assert(std::is_trivially_copyable<T>::value, "settings must be a plain struct");
+    static_assert(sizeof(T) <= 254, "journal records address at most 254 bytes");
+
+    enum : uint32_t
+    {
+        magic = 0x53434C57, // "WLCS"
+        erasedByte = 0xFF,
+        mergeGap = 4        // equal bytes between changes worth bridging in one record
+    };
+
+    enum
+    {
+        slots = 2
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t seq;       // higher is newer, compared with wrap-around
+        uint16_t schema;
+        uint16_t size;      // sizeof(T) when the snapshot was written
+        uint32_t erases;    // lifetime erases of this store
+        uint16_t dataCrc;   // crc16 of the snapshot
+        uint16_t crc;       // crc16 of the fields above
+    };
+
+    struct Record
+    {
+        uint8_t offset;
+        uint8_t len;
+        uint8_t flags;      // lastInCommit on the final record of a commit
+        uint8_t reserved;
+        uint16_t crc;       // crc16 of the fields above and the data bytes
+    };
+
+    enum
+    {
+        lastInCommit = 0x01
+    };
+
+public:
+    struct Stats
+    {
+        uint32_t commits;         // since boot
+        uint32_t records;         // journal records appended since boot
+        uint32_t compactions;     // slot switches since boot
+        uint32_t lifetimeErases;  // stored in the header, survives reboots
+        uint16_t journalUsed;
+        uint16_t journalSize;
+        uint8_t slot;             // active slot, 0 = A, 1 = B
+        uint32_t seq;             // its sequence number
+    };
+
+private:
+    FlashRegion &flash_;
+    const uint16_t schema_;
+    const unsigned long commitDelayMs_;
+
+    T committed_; // what flash holds
+    T pending_;   // what the application wants
+    bool dirty_;
+    unsigned long dirtySince_;
+    bool needCompact_;
+    size_t writePos_;  // offset inside the active slot
+    size_t journalStart_; // of the active slot; later than usual under a newer, larger snapshot
+    uint8_t slot_;
+    uint32_t seq_;
+    uint32_t erases_;
+    Stats stats_;
+
+    static size_t align4(size_t n) { return (n + 3) & ~size_t(3); }
+
+    static size_t dataStart() { return sizeof(Header); }
+    static size_t journalStart(size_t size) { return dataStart() + align4(size); }
+
+    static size_t base(uint8_t slot) { return (size_t)slot * FlashRegion::sectorSize; }
+
+    static bool newer(uint32_t a, uint32_t b) { return (int32_t)(a - b) > 0; }
+
+    bool headerValid(const Header &h) const
+    {
+        return h.magic == magic && h.crc == crc16(&h, offsetof(Header, crc)) && h.size <= 254 &&
+               journalStart(h.size) <= FlashRegion::sectorSize;
+    }
+
+    static uint16_t recordCrc(const Record &r, const uint8_t *data)
+    {
+        return crc16(data, r.len, crc16(&r, offsetof(Record, crc)));
+    }
+
+    // Apply the journal of slot after a snapshot of size bytes to image and
+    // leave writePos_ after the last complete commit. False if a torn or
+    // unfinished commit was found.
+    bool replay(uint8_t slot, size_t size, uint8_t *image)
+    {
+        uint8_t data[254];
+        uint8_t next[254]; // image with the commit being read applied
+        memcpy(next, image, size);
+        size_t pos = journalStart(size);
+        size_t good = pos;
+        bool clean = true;
+        while (pos + sizeof(Record) <= FlashRegion::sectorSize)
+        {
+            Record r;
+            if (!flash_.read(base(slot) + pos, &r, sizeof(r)))
+                break;
+            if (r.offset == erasedByte && r.len == erasedByte)
+                break; // end of journal
+
+            size_t total = align4(sizeof(Record) + r.len);
+            if (r.len == 0 || r.offset + r.len > size || pos + total > FlashRegion::sectorSize ||
+                !flash_.read(base(slot) + pos + sizeof(Record), data, r.len) || recordCrc(r, data) != r.crc)
+            {
+                clean = false;
+                break;
+            }
+            memcpy(next + r.offset, data, r.len);
+            pos += total;
+            if (r.flags & lastInCommit)
+            {
+                memcpy(image, next, size);
+                good = pos;
+            }
+        }
+        if (good != pos)
+            clean = false; // records without their final one
+        writePos_ = good;
+        return clean;
+    }
+
+    // Write pending_ as a snapshot into the inactive slot and switch to it
+    bool compact()
+    {
+        uint8_t next = slot_ ^ 1;
+        if (!flash_.eraseSector(base(next)))
+            return false;
+        erases_++;
+
+        // snapshot first, header last: a header only exists over a complete snapshot
+        if (!flash_.write(base(next) + dataStart(), &pending_, sizeof(T)))
+            return false;
+
+        Header h;
+        h.magic = magic;
+        h.seq = seq_ + 1;
+        h.schema = schema_;
+        h.size = sizeof(T);
+        h.erases = erases_;
+        h.dataCrc = crc16(&pending_, sizeof(T));
+        h.crc = crc16(&h, offsetof(Header, crc));
+        if (!flash_.write(base(next), &h, sizeof(h)))
+            return false;
+
+        // switched: the old slot is now only a fallback until it is reused
+        slot_ = next;
+        seq_ = h.seq;
+        stats_.compactions++;
+        writePos_ = journalStart(sizeof(T));
+        journalStart_ = writePos_;
+        needCompact_ = false;
+        return true;
+    }
+
+    // Append one record for bytes [from, to) of pending_
+    bool append(size_t from, size_t to, bool last)
+    {
+        uint8_t buf[sizeof(Record) + sizeof(T) + 3];
+        Record r;
+        r.offset = from;
+        r.len = to - from;
+        r.flags = last ? lastInCommit : 0;
+        r.reserved = 0;
+        const uint8_t *src = reinterpret_cast<const uint8_t *>(&pending_) + from;
+        r.crc = recordCrc(r, src);
+
+        size_t total = align4(sizeof(Record) + r.len);
+        memset(buf, erasedByte, total);
+        memcpy(buf, &r, sizeof(Record));
+        memcpy(buf + sizeof(Record), src, r.len);
+
+        if (!flash_.write(base(slot_) + writePos_, buf, total))
+            return false;
+        writePos_ += total;
+        stats_.records++;
+        return true;
+    }
+
+    // Journal bytes needed to record the difference, 0 if none
+    size_t journalCost() const
+    {
+        const uint8_t *a = reinterpret_cast<const uint8_t *>(&committed_);
+        const uint8_t *b = reinterpret_cast<const uint8_t *>(&pending_);
+        size_t cost = 0;
+        size_t i = 0;
+        while (i < sizeof(T))
+        {
+            if (a[i] == b[i])
+            {
+                i++;
+                continue;
+            }
+            size_t end = runEnd(i);
+            cost += align4(sizeof(Record) + end - i);
+            i = end;
+        }
+        return cost;
+    }
+
+    // True if nothing changed at or after i
+    bool lastChange(size_t i) const
+    {
+        const uint8_t *a = reinterpret_cast<const uint8_t *>(&committed_);
+        const uint8_t *b = reinterpret_cast<const uint8_t *>(&pending_);
+        for (; i < sizeof(T); i++)
+            if (a[i] != b[i])
+                return false;
+        return true;
+    }
+
+    // End of the changed run starting at i, bridging short equal gaps
+    size_t runEnd(size_t i) const
+    {
+        const uint8_t *a = reinterpret_cast<const uint8_t *>(&committed_);
+        const uint8_t *b = reinterpret_cast<const uint8_t *>(&pending_);
+        size_t end = i + 1;
+        size_t j = end;
+        while (j < sizeof(T) && j - end < mergeGap)
+        {
+            if (a[j] != b[j])
+                end = j + 1;
+            j++;
+        }
+        return end;
+    }
+
+public:
+    SettingsStore(FlashRegion &flash, uint16_t schema, unsigned long commitDelayMs = 3000)
+        : flash_(flash), schema_(schema), commitDelayMs_(commitDelayMs), committed_(), pending_(),
+          dirty_(false), dirtySince_(0), needCompact_(true), writePos_(0), journalStart_(journalStart(sizeof(T))),
+          slot_(1), seq_(0), erases_(0), stats_()
+    {
+    }
+
+    // Read the newest settings into out. Returns false (and stages the
+    // defaults for writing) when nothing valid was stored.
+    bool load(T &out, const T &defaults)
+    {
+        out = defaults;
+        needCompact_ = true;
+        journalStart_ = journalStart(sizeof(T));
+        slot_ = 1; // so the first compaction writes slot A
+        seq_ = 0;
+        erases_ = 0;
+        stats_.journalSize = FlashRegion::sectorSize - journalStart(sizeof(T));
+        if (flash_.sectors() < slots)
+            return false;
+
+        // both headers, newest valid first
+        Header hdr[slots];
+        bool ok[slots];
+        for (uint8_t i = 0; i < slots; i++)
+            ok[i] = flash_.read(base(i), &hdr[i], sizeof(Header)) && headerValid(hdr[i]);
+
+        uint8_t order[slots] = {0, 1};
+        if (ok[1] && (!ok[0] || newer(hdr[1].seq, hdr[0].seq)))
+        {
+            order[0] = 1;
+            order[1] = 0;
+        }
+
+        // lifetime erases and sequence continue from the newest header seen
+        for (uint8_t i = 0; i < slots; i++)
+        {
+            if (ok[i] && hdr[i].erases > erases_)
+                erases_ = hdr[i].erases;
+            if (ok[i] && newer(hdr[i].seq, seq_))
+                seq_ = hdr[i].seq;
+        }
+
+        bool valid = false;
+        uint8_t image[254];
+        const Header *h = nullptr;
+        for (uint8_t i = 0; i < slots && !valid; i++)
+        {
+            uint8_t s = order[i];
+            if (!ok[s])
+                continue;
+            h = &hdr[s];
+            valid = flash_.read(base(s) + dataStart(), image, h->size) && crc16(image, h->size) == h->dataCrc;
+            if (valid)
+                slot_ = s;
+        }
+
+        if (valid)
+        {
+            bool clean = replay(slot_, h->size, image);
+
+            if (h->schema == schema_ && h->size == sizeof(T))
+            {
+                memcpy(&out, image, sizeof(T));
+                needCompact_ = !clean; // torn append, start clean on the next commit
+            }
+            else if (h->schema < schema_)
+            {
+                // older layout: fields were only ever appended
+                memcpy(&out, image, h->size < sizeof(T) ? h->size : sizeof(T));
+            }
+            else if (h->schema > schema_ && h->size >= sizeof(T))
+            {
+                // newer layout: ours is its prefix. Keep the slot, so a
+                // rollback does not overwrite the newer firmware's settings.
+                memcpy(&out, image, sizeof(T));
+                needCompact_ = !clean;
+                journalStart_ = journalStart(h->size);
+            }
+            // else a layout that is not ours to read: keep the defaults
+        }
+
+        committed_ = out;
+        pending_ = out;
+        if (needCompact_)
+        {
+            // persist whatever we settled on
+            dirty_ = true;
+            dirtySince_ = 0;
+        }
+        stats_.lifetimeErases = erases_;
+        stats_.journalUsed = needCompact_ ? 0 : writePos_ - journalStart_;
+        stats_.journalSize = FlashRegion::sectorSize - journalStart_;
+        stats_.slot = slot_;
+        stats_.seq = seq_;
+        return valid;
+    }
+
+    // Remember value for the next commit; no flash access
+    void stage(const T &value)
+    {
+        pending_ = value;
+        if (memcmp(&pending_, &committed_, sizeof(T)) == 0 && !needCompact_)
+        {
+            dirty_ = false;
+            return;
+        }
+        if (!dirty_)
+        {
+            dirty_ = true;
+            dirtySince_ = millis();
+        }
+    }
+
+    // Commit staged changes once they have been quiet for commitDelayMs
+    void poll(unsigned long now)
+    {
+        if (dirty_ && now - dirtySince_ >= commitDelayMs_)
+            commit();
+    }
+
+    // Write staged changes now
+    bool commit()
+    {
+        if (!dirty_)
+            return true;
+
+        bool ok = true;
+        if (!needCompact_ && writePos_ + journalCost() > FlashRegion::sectorSize)
+            needCompact_ = true;
+
+        if (!needCompact_)
+        {
+            size_t i = 0;
+            while (ok && i < sizeof(T))
+            {
+                const uint8_t *a = reinterpret_cast<const uint8_t *>(&committed_);
+                const uint8_t *b = reinterpret_cast<const uint8_t *>(&pending_);
+                if (a[i] == b[i])
+                {
+                    i++;
+                    continue;
+                }
+                size_t end = runEnd(i);
+                ok = append(i, end, lastChange(end));
+                i = end;
+            }
+            if (!ok)
+                needCompact_ = true;
+        }
+
+        if (needCompact_)
+            ok = compact();
+
+        if (ok)
+        {
+            committed_ = pending_;
+            dirty_ = false;
+            stats_.commits++;
+        }
+        else
+        {
+            needCompact_ = true;
+            dirtySince_ = millis(); // retry after another delay
+        }
+        stats_.lifetimeErases = erases_;
+        stats_.journalUsed = writePos_ - journalStart_;
+        stats_.journalSize = FlashRegion::sectorSize - journalStart_;
+        stats_.slot = slot_;
+        stats_.seq = seq_;
+        return ok;
+    }
+
+    bool dirty() const { return dirty_; }
+    const Stats &stats() const { return stats_; }
+};
+
+#endif // SETTINGS_STORE_H
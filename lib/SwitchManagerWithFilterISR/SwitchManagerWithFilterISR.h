@@ -0,0 +1,235 @@
+//         c l a s s   S w i t c h M a n a g e r W i t h F i l t e r I S R
+//********************************************^************************************************
+/*
+  Interrupt driven variant of SwitchManagerWithFilter
+
+  The polled class samples the pin every debounceTime and needs two
+  agreeing samples, so it has to be called at loop() speed and can miss
+  short events. This variant timestamps every pin change in the interrupt
+  into a small lock-free queue. check() then replays the queued edges and
+  validates each change from the real edge timings:
+  - a level must be held for at least debounceTime to count (noise filter)
+  - bounces inside that window restart the hold time (debounce)
+  check() can be called as rarely as you like, nothing is lost as long as
+  the queue does not overflow between calls. The queue has one writer and
+  one reader; fences order each slot against the index that hands it
+  over, so it also holds when the ISR runs on the other ESP32 core.
+
+  The callback signature is the same as SwitchManagerWithFilter, but the
+  interval is measured between the validated edges, not between samples.
+
+  Example:
+  #include <SwitchManagerWithFilterISR.h>
+
+  SwitchManagerWithFilterISR mySwitch;
+
+  void setup()
+  {
+      mySwitch.begin (2, handleSwitches);   //attaches a CHANGE interrupt on ESP32
+  }
+
+  void loop()
+  {
+      mySwitch.check();  //any rate is fine
+  }
+
+  void handleSwitches(const byte newState, const unsigned long interval, const byte whichPin)
+   {
+      //do something
+   }
+
+  On cores without attachInterruptArg() (AVR), call onEdge() from your own
+  pin change ISR instead.
+*/
+
+#ifndef SWITCH_MANAGER_WITH_FILTER_ISR_H
+#define SWITCH_MANAGER_WITH_FILTER_ISR_H
+
+#include <Arduino.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+class SwitchManagerWithFilterISR
+{
+    enum {debounceTime = 10, noSwitch = -1, queueSize = 16};  //queueSize must be a power of 2
+
+    typedef void (*handlerFunction)
+    (
+      const byte newState,
+      const unsigned long interval,
+      const byte whichSwitch
+    );
+
+    struct Edge
+    {
+      unsigned long time;
+      byte level;
+    };
+
+    int pinNumber_;
+    handlerFunction f_;
+
+    //written by the ISR only
+    Edge queue_[queueSize];
+    volatile byte head_;
+    volatile bool overflow_;
+
+    //read side, written by check() only
+    volatile byte tail_;
+    byte oldSwitchState_;        //validated state
+    byte rawState_;              //level after the last replayed edge
+    unsigned long rawTime_;      //when that level appeared
+    unsigned long lastLowTime_;
+    unsigned long lastHighTime_;
+
+    //****************************************
+    static void IRAM_ATTR isr(void *arg)
+    {
+      static_cast<SwitchManagerWithFilterISR *>(arg)->onEdge();
+    }
+
+    //****************************************
+    //a level change has been held long enough, report it
+    void accept(const byte state, const unsigned long when)
+    {
+      oldSwitchState_ = state;
+
+      if (state == LOW)
+      {
+        lastLowTime_ = when;
+        f_ (LOW, lastLowTime_ - lastHighTime_, pinNumber_);
+      }
+      else
+      {
+        lastHighTime_ = when;
+        f_ (HIGH, lastHighTime_ - lastLowTime_, pinNumber_);
+      }
+    }
+
+    //****************************************
+    //replay one level that held from rawTime_ until "until"
+    void settle(const unsigned long until)
+    {
+      if (rawState_ != oldSwitchState_ && until - rawTime_ >= debounceTime)
+      {
+        accept(rawState_, rawTime_);
+      }
+    }
+
+  public:
+    //constructor
+    SwitchManagerWithFilterISR()
+    {
+      pinNumber_       = noSwitch;
+      f_               = NULL;
+      head_            = 0;
+      overflow_        = false;
+      tail_            = 0;
+      oldSwitchState_  = 0;
+      rawState_        = 0;
+      rawTime_         = 0;
+      lastLowTime_     = 0;
+      lastHighTime_    = 0;
+    }
+
+    //****************************************
+    void begin (const int pinNumber, handlerFunction f)
+    {
+      pinNumber_ = pinNumber;
+      f_ = f;
+
+      //*********************
+      if (pinNumber_ != noSwitch)
+      {
+        pinMode (pinNumber_, INPUT_PULLUP);
+
+        oldSwitchState_ = rawState_ = digitalRead(pinNumber_);
+        rawTime_ = millis();
+
+#if defined(ESP32)
+        attachInterruptArg(digitalPinToInterrupt(pinNumber_), isr, this, CHANGE);
+#endif
+      }
+    }  //END of    begin()
+
+    //****************************************
+    //call from the pin change interrupt; safe against a concurrent check()
+    void IRAM_ATTR onEdge()
+    {
+      byte next = (head_ + 1) & (queueSize - 1);
+
+      //*********************
+      //queue full: drop the edge, check() resynchronises from the pin
+      if (next == tail_)
+      {
+        overflow_ = true;
+        return;
+      }
+
+      //tail_ read above: check() is done with this slot
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+      queue_[head_].time  = millis();
+      queue_[head_].level = digitalRead(pinNumber_);
+
+      //the slot must be in memory before check() can see the new head_
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      head_ = next;  //publish after the slot is written
+    }  //END of   onEdge()
+
+    //****************************************
+    void check()
+    {
+      //*********************
+      //we need a valid pin number and a valid function to call
+      if (pinNumber_ == noSwitch || f_ == NULL)
+      {
+        return;
+      }
+
+      //*********************
+      //replay queued edges in order
+      while (tail_ != head_)
+      {
+        //head_ read above: onEdge() has written this slot
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        const Edge e = queue_[tail_];
+
+        //copied out before onEdge() may reuse the slot
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        tail_ = (tail_ + 1) & (queueSize - 1);
+
+        //the previous level held until this edge
+        settle(e.time);
+
+        //a bounce back to the same level does not restart the hold time
+        if (e.level != rawState_)
+        {
+          rawState_ = e.level;
+          rawTime_  = e.time;
+        }
+      }
+
+      //*********************
+      //edges were dropped, resynchronise from the pin itself
+      if (overflow_)
+      {
+        overflow_ = false;
+        byte level = digitalRead(pinNumber_);
+        if (level != rawState_)
+        {
+          rawState_ = level;
+          rawTime_  = millis();
+        }
+      }
+
+      //*********************
+      //the last level may have held long enough by now
+      settle(millis());
+    }  //END of   check()
+
+};  //END of   class SwitchManagerWithFilterISR
+
+#endif
@@ -1,11 +1,26 @@
 #include <Arduino.h>
-#include <EEPROM.h>
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
 #include <PZEM004Tv30.h>
-#include <JC_Button.h>
 // #include <LibPrintf.h>
 #include <WiFiManager.h> // https://github.com/tzapu/WiFiManager
+#include <Marquee.h>
+#include <PortDebouncer.h>
+#include <KeyGestures.h>
+#include <FlashRegion.h>
+#include <SettingsStore.h>
+#include <HistoryLog.h>
+#include <MetricsStore.h>
+#include <EnergyBook.h>
+#include <EventLog.h>
+#include "LogEvents.h"
+#include <SerialConsole.h>
+#include <CaptureStream.h>
+#include "CaptureRecords.h"
+#include <stddef.h>
+#include <WebServer.h>
+#include <time.h>
+#include "soc/gpio_struct.h" // For GPIO register access
 
 // --------------------- Pin Definitions (ESP32) -------------------------
 // GPIO6 to GPIO11 → Used for flash memory (SPI), do not use.
@@ -33,26 +48,21 @@
 #define I2C_SCL 22
 
 // // --------------------- Globals -------------------------
-// Button btnSET(KEY_SET);
-// Button btnUP(KEY_UP);
-// Button btnDN(KEY_DOWN);
-// pin assignments
-const byte DN_PIN(KEY_DOWN), // connect a button switch from this pin to ground
-    UP_PIN(KEY_UP),          // ditto
-    SET_PIN(KEY_SET);
+// Keys connect from the pin to ground; bits as seen by the gesture engine
+#define KEY_BIT_SET 0x01
+#define KEY_BIT_UP 0x02
+#define KEY_BIT_DOWN 0x04
 
-Button btnSET(SET_PIN), btnUP(UP_PIN), btnDN(DN_PIN); // define the buttons
+KeyGestures keys;
 
 const unsigned long
     REPEAT_FIRST(500), // ms required before repeating on long press
-    REPEAT_INCR(100);  // repeat interval for long press
-const int
-    MIN_COUNT(0),
-    MAX_COUNT(59);
+    REPEAT_INCR(200);  // first repeat interval, shrinks while held
 
 bool calibCancelled = 0;
 
 LiquidCrystal_I2C lcd(0x3F, 16, 2); // Address may be 0x3F on some modules
+Marquee<LiquidCrystal_I2C> marquee(lcd);
 
 // HardwareSerial PZEMSerial(2);
 // PZEM004Tv30 pzem(PZEMSerial);
@@ -74,8 +84,38 @@ struct Settings
     bool cyclicTimer = false;
 } settings;
 
+// Bump when Settings changes; only ever append fields to keep old data readable
+const uint16_t SETTINGS_SCHEMA = 1;
+
+EspPartitionRegion settingsFlash;                                // "settings" in partitions.csv
+SettingsStore<Settings> settingsStore(settingsFlash, SETTINGS_SCHEMA); // commits 3 s after the last change
+
+EspPartitionRegion historyFlash; // "history" in partitions.csv
+HistoryLog history(historyFlash); // a sample every historyInterval plus motor/error events
+bool loggedMotor = false;
+int loggedError = 0;
+
+EspPartitionRegion secondsFlash, minutesFlash, hoursFlash; // "m_sec", "m_min", "m_hour"
+MetricsStore metrics(secondsFlash, minutesFlash, hoursFlash); // 1 s for a day, 1 min for a month, 1 h for a year
+uint32_t metricsClockBase = 0; // continues the stored timeline until NTP has synced
+uint32_t lastMetricsReport = 0;
+
+EventLog<2048> eventLog; // binary frames, drained to Serial as the UART takes them (tools/ decode them)
+
+CaptureStream<2048> captureStream; // binary records for tools/wlccap while the capture command has it on
+bool capturing = false; // also keeps the 5 s Status line off Serial
+int lastCapturedInputs = -1; // raw | debounced << 8 of the last Inputs record, -1 sends the next tick
+
+RTC_NOINIT_ATTR EnergyBook::Shadow energyShadow; // survives resets, carries the book between commits
+EspPartitionRegion energyFlash;                  // "energy"
+EnergyBook energyBook(energyFlash, energyShadow); // kWh, run time and starts per day and month
+bool energyReady = false;                        // energyBook.begin() ran; before it the shadow is stale RTC memory
+const long utcOffset = 19800;                    // IST; days and months are booked in local time
+WebServer server(80);
+
 float voltage = 0, current = 0, power = 0, pf = 0, energy = 0;
 char errorMessage[17] = "No ERROR";
+char faultLine[40]; // scrolled on screen 3, must outlive the marquee
 
 bool inMenu = false;
 bool motorRunning = false;
@@ -88,18 +128,29 @@ unsigned long lastOnTime = 0;
 unsigned long lastOffTime = 0;
 unsigned long lastBlinkTime = 0;
 unsigned long lastPzemRead = 0;
+unsigned long lastHistoryLog = 0;
 unsigned long lastInteractionTime = 0;
 unsigned long lastScreenSwitch = 0;
 unsigned long lastDisplayUpdate = 0;
 unsigned long lasterrorTime = 0;
-unsigned long buttonPressStart = 0;
 unsigned long lastRepeatTime = 0;
 const unsigned long pzemReadInterval = 1000;
+const unsigned long historyInterval = 10000; // the 1 s detail is in the metrics store
+const unsigned long debounceTick = 5; // 4 agreeing ticks = 20 ms debounce
+unsigned long lastDebounceTick = 0;
 const unsigned long repeatInterval = 200;
 bool ledState = false;
 const uint8_t totalMenuItems = 11;
+const uint8_t totalScreens = 6;
 static uint8_t screenIndex = 0;
 
+// Loop pass times for the console's hist command: bucket k counts passes
+// of 2^(k-1) to 2^k - 1 us, the last one everything longer
+const uint8_t loopBuckets = 24;
+uint32_t loopHistogram[loopBuckets];
+uint32_t loopMax = 0;
+unsigned long lastLoopStart = 0;
+
 // --------------------- Function Declarations -------------------------
 void showStatusScreen();
 void onUpClick();
@@ -110,11 +161,23 @@ void calibrateMotor();
 void saveSettings();
 void loadSettings();
 void readPzemValues();
+void logSample(uint8_t flags);
+uint32_t metricsTime();
+uint32_t energyTime(uint32_t now);
+void reportMetrics(uint32_t now);
+void reportEnergy(uint32_t now);
+void captureMeter(unsigned long readMs);
+void captureInputs(uint64_t raw);
+void handleMetrics();
+void handleHistory();
 void blinkLED(int pin);
 int checkSystemStatus();
 void buttonCheck();
-void scrollMessage(const char *message, uint8_t row, uint16_t delayMs = 300);
-// #include "soc/gpio_struct.h" // For GPIO register access
+void onKeyGesture(const KeyGestures::Event &e);
+void armCalibration();
+void drainSerial();
+uint64_t readGpioInputs();
+bool inputLevel(uint8_t pin);
 
 // void printGpioInputs()
 // {
@@ -140,76 +203,59 @@ void scrollMessage(const char *message, uint8_t row, uint16_t delayMs = 300);
 //     Serial.println();
 // }
 
-void scrollMessage(const char *message, uint8_t row, uint16_t delayMs)
-{
-    static uint32_t lastUpdate = 0;
-    static uint8_t index = 0;
-    static const char *prevMessage = nullptr;
+// All input pins debounced together from one register read per tick
+PortDebouncer<uint64_t> inputs;
 
-    // Reset scrolling if a new message is passed
-    if (message != prevMessage)
-    {
-        index = 0;
-        prevMessage = message;
-    }
-
-    uint8_t messageLen = strlen(message);
-
-    if (millis() - lastUpdate >= delayMs)
-    {
-        lastUpdate = millis();
-
-        char displayBuffer[17]; // 16 chars + null terminator
-
-        if (messageLen <= 16)
-        {
-            // No need to scroll, just center it
-            uint8_t pad = (16 - messageLen) / 2;
-            memset(displayBuffer, ' ', sizeof(displayBuffer));
-            memcpy(displayBuffer + pad, message, messageLen);
-        }
-        else
-        {
-            // Scroll if message is longer than 16 characters
-            strncpy(displayBuffer, message + index, 16);
-            displayBuffer[16] = '\0';
-            index++;
-            if (index > messageLen - 16)
-            {
-                index = 0;
-            }
-        }
+uint64_t readGpioInputs()
+{
+    return GPIO.in | ((uint64_t)GPIO.in1.data << 32); // GPIO0-31, GPIO32-39
+}
 
-        lcd.setCursor(0, row);
-        lcd.print(displayBuffer);
-    }
+bool inputLevel(uint8_t pin)
+{
+    return inputs.read(pin);
 }
 
 void loadSettings()
 {
-    EEPROM.get(0, settings);
+    if (!settingsFlash.begin("settings"))
+    {
+        LOG_WARN(SettingsMissing);
+        settings = Settings();
+        return;
+    }
+
+    settingsStore.load(settings, Settings());
+    LOG_INFO(SettingsLoaded,
+             'A' + settingsStore.stats().slot,
+             settingsStore.stats().seq,
+             settingsStore.stats().lifetimeErases,
+             settingsStore.stats().journalUsed,
+             settingsStore.stats().journalSize);
+    // CRC protects the stored bytes; this only catches values out of range
     if (settings.overVoltage < 100 || settings.overVoltage > 300)
     {
         settings = Settings(); // load defaults if invalid
-        EEPROM.put(0, settings);
+        settingsStore.stage(settings);
     }
 }
 
+// Stage the settings; settingsStore.poll() in loop() writes the changed
+// fields once the user has stopped editing
 void saveSettings()
 {
-    EEPROM.put(0, settings);
+    settingsStore.stage(settings);
 }
 
 void showStatusScreen()
 {
 
     lcd.clear();
-    static bool alternateScreen = false;
-    static unsigned long lastToggleTime = 0;
-    const unsigned long toggleInterval = 1000; // 1 second
+    marquee.invalidate();
     switch (screenIndex)
     {
     case 0:
+        marquee.stop(1);
         lcd.setCursor(0, 0);
         lcd.print("V:");
         lcd.print(voltage);
@@ -224,6 +270,7 @@ void showStatusScreen()
         break;
 
     case 1:
+        marquee.stop(1);
         lcd.setCursor(0, 0);
         lcd.print("Power:");
         lcd.print(power);
@@ -235,11 +282,12 @@ void showStatusScreen()
         break;
 
     case 2:
+        marquee.stop(1);
         lcd.setCursor(0, 0);
         lcd.print("UGT:");
-        lcd.print(digitalRead(FLOAT_UGT_PIN) ? "OK" : "LOW");
+        lcd.print(inputLevel(FLOAT_UGT_PIN) ? "OK" : "LOW");
         lcd.print(" OHT:");
-        lcd.print(digitalRead(FLOAT_OHT_PIN) ? "OK" : "LOW");
+        lcd.print(inputLevel(FLOAT_OHT_PIN) ? "OK" : "LOW");
 
         lcd.setCursor(0, 1);
         lcd.print(" Mode:");
@@ -250,9 +298,7 @@ void showStatusScreen()
 
     case 3:
         lcd.setCursor(0, 0);
-        Serial.print("System State: ");
-        Serial.println(error);
-        Serial.println();
+        LOG_DEBUG(SystemState, error);
         if (error >= 1)
         {
             if (error >= 2)
@@ -263,38 +309,22 @@ void showStatusScreen()
             {
                 lcd.print("System State: ");
             }
-            lcd.setCursor(0, 1);
             if (error >= 3)
             {
-                if (millis() - lastToggleTime >= toggleInterval)
-                {
-                    alternateScreen = !alternateScreen;
-                    lastToggleTime = millis();
-
-                    // lcd.setCursor(0, 1);
-                    // lcd.print("                "); // Clear line
-
-                    lcd.setCursor(0, 1);
-                    if (alternateScreen)
-                    {
-                        lcd.print(errorMessage);
-                    }
-                    else
-                    {
-                        lcd.print("SET key resets  ");
-                    }
-                }
+                // scrolled by marquee.update() from loop()
+                snprintf(faultLine, sizeof(faultLine), "%s - SET key resets", errorMessage);
+                marquee.set(1, faultLine);
             }
             else
             {
+                marquee.stop(1);
                 lcd.setCursor(0, 1);
                 lcd.print(errorMessage);
             }
-
-            // scrollMessage("Over current - SET key resets ", 1); // 0 = first line
         }
         else
         {
+            marquee.stop(1);
             if (motorRunning && settings.onTime > 0)
             {
                 unsigned long elapsed = ((millis() - lastOnTime) / 1000); // in sec
@@ -307,7 +337,7 @@ void showStatusScreen()
 
                 lcd.print(remaining > 600 ? " min" : " sec");
             }
-            else if (!motorRunning && settings.offTime > 0 && !digitalRead(FLOAT_OHT_PIN))
+            else if (!motorRunning && settings.offTime > 0 && !inputLevel(FLOAT_OHT_PIN))
             {
                 unsigned long elapsed = ((millis() - lastOffTime) / 1000);
                 unsigned long remaining = settings.offTime * 60 - elapsed;
@@ -326,12 +356,61 @@ void showStatusScreen()
             }
             break;
         }
+        break;
+
+    case 4:
+    {
+        marquee.stop(1);
+        uint32_t now = metricsTime();
+        MetricsStore::Summary day = metrics.summary(MetricsStore::Minutes, now - 86400, now);
+        char line[17];
+        snprintf(line, sizeof(line), "24h Vmax:%.1f", day.voltageMax);
+        lcd.setCursor(0, 0);
+        lcd.print(line);
+        snprintf(line, sizeof(line), "Run %02lu:%02lu I^%.2f",
+                 (unsigned long)(day.runSeconds / 3600),
+                 (unsigned long)(day.runSeconds / 60 % 60),
+                 day.currentMax);
+        lcd.setCursor(0, 1);
+        lcd.print(line);
+        break;
+    }
+
+    case 5:
+    {
+        marquee.stop(1);
+        if (!energyReady)
+        {
+            lcd.setCursor(0, 0);
+            lcd.print("Energy: no data");
+            break;
+        }
+        uint32_t local = energyTime(metricsTime());
+        if (!EnergyBook::clockSet(local))
+        {
+            lcd.setCursor(0, 0);
+            lcd.print("Energy: no clock");
+            break;
+        }
+        EnergyBook::Bucket day = energyBook.day(EnergyBook::dayOf(local));
+        EnergyBook::Bucket month = energyBook.month(EnergyBook::monthOf(local));
+        char line[17];
+        snprintf(line, sizeof(line), "Day %.2fkWh %ux", day.wh / 1000.0f, day.starts);
+        lcd.setCursor(0, 0);
+        lcd.print(line);
+        snprintf(line, sizeof(line), "Mon %.1fkWh %luh", month.wh / 1000.0f, (unsigned long)(month.runSeconds / 3600));
+        lcd.setCursor(0, 1);
+        lcd.print(line);
+        break;
+    }
     }
 }
 
 void showMenu()
 {
     lcd.clear();
+    marquee.stopAll();
+    marquee.invalidate();
     lcd.setCursor(0, 0);
     lcd.print("Menu mode:");
     lcd.setCursor(0, 1);
@@ -393,13 +472,11 @@ void showMenu()
 
 void onSetClick()
 {
-    Serial.print("Menu Index: ");
-    Serial.print(menuIndex);
-    Serial.print("  IN Menu: ");
-    Serial.println(inMenu);
+    LOG_DEBUG(MenuClick, menuIndex, inMenu);
     if (!inMenu)
     {
-        buttonPressStart = millis();
+        inMenu = true;
+        menuIndex = 0;
     }
     else
     {
@@ -421,14 +498,17 @@ void onSetClick()
             menuIndex = 11;
         }
 
-        if (menuIndex > totalMenuItems)
+        if (menuIndex >= totalMenuItems)
         {
             inMenu = false;
             menuIndex = 0;
             saveSettings();
             showStatusScreen();
+            lastInteractionTime = millis();
+            return;
         }
     }
+    showMenu();
     lastInteractionTime = millis();
 }
 
@@ -565,13 +645,13 @@ int checkSystemStatus()
             return 6; // Dry run
         }
     }
-    if (!digitalRead(FLOAT_UGT_PIN))
+    if (!inputLevel(FLOAT_UGT_PIN))
     {
 
         strcpy(errorMessage, "UGT empty");
         return 2; // UGT empty
     }
-    if (!digitalRead(FLOAT_OHT_PIN))
+    if (!inputLevel(FLOAT_OHT_PIN))
     {
         strcpy(errorMessage, "OHT LOW");
         return 1; // OHT low
@@ -591,123 +671,83 @@ void blinkLED(int led)
     }
 }
 
-void buttonCheck()
+uint8_t keysDown()
 {
-    static int
-        count,         // the number that is adjusted
-        lastCount(-1); // previous value of count (initialized to ensure it's different when the sketch starts)
-    static unsigned long
-        rpt(REPEAT_FIRST); // a variable time that is used to drive the repeats for long presses
-    enum states_t
-    {
-        WAIT,
-        INCR,
-        DECR,
-        MENU
-    }; // states for the state machine
-    static states_t STATE; // current state machine state
-    btnUP.read();          // read the buttons
-    btnDN.read();
-    btnSET.read();
-    if (btnSET.wasPressed())
-    {
-        Serial.println("Set button pressed");
-    }
-    if (btnUP.wasPressed())
-    {
-        Serial.println("UP button pressed");
-    }
-    else if (btnDN.wasPressed())
-    {
-        Serial.println("DOWN button pressed");
-    }
+    uint8_t down = 0;
+    if (!inputLevel(KEY_SET))
+        down |= KEY_BIT_SET;
+    if (!inputLevel(KEY_UP))
+        down |= KEY_BIT_UP;
+    if (!inputLevel(KEY_DOWN))
+        down |= KEY_BIT_DOWN;
+    return down;
+}
 
-    if (count != lastCount) // print the count if it has changed
-    {
-        lastCount = count;
-        Serial.println(count, DEC);
-    }
+void buttonCheck()
+{
+    keys.update(keysDown(), millis());
+}
 
-    switch (STATE)
+void onKeyGesture(const KeyGestures::Event &e)
+{
+    switch (e.type)
     {
-    case WAIT: // wait for a button event
-        if (btnSET.wasPressed())
-            STATE = MENU;
-        if (btnUP.wasPressed())
-            STATE = INCR;
-        else if (btnDN.wasPressed())
-            STATE = DECR;
-        else if (btnUP.wasReleased()) // reset the long press interval
-            rpt = REPEAT_FIRST;
-        else if (btnDN.wasReleased())
-            rpt = REPEAT_FIRST;
-        else if (btnUP.pressedFor(rpt)) // check for long press
-        {
-            rpt += REPEAT_INCR; // increment the long press interval
-            STATE = INCR;
-        }
-        else if (btnDN.pressedFor(rpt))
-        {
-            rpt += REPEAT_INCR;
-            STATE = DECR;
-        }
+    case KeyGestures::Press:
+    case KeyGestures::Repeat: // accelerates while held, so values sweep quickly
+        if (e.keys == KEY_BIT_UP)
+            onUpClick();
+        else if (e.keys == KEY_BIT_DOWN)
+            onDownClick();
         break;
 
-    case INCR:
-        ++count; // increment the counter
-        onUpClick();
-        count = min(count, MAX_COUNT); // but not more than the specified maximum
-        STATE = WAIT;
+    case KeyGestures::Click:
+        if (e.keys == KEY_BIT_SET)
+            onSetClick();
         break;
 
-    case DECR:
-        --count; // decrement the counter
-        onDownClick();
-        count = max(count, MIN_COUNT); // but not less than the specified minimum
-        STATE = WAIT;
-        break;
-    case MENU:
-        printf("inMenu: %d", inMenu);
-        printf(",  menuIndex: %d \n", menuIndex);
-        showMenu();
-
-        menuIndex++;
+    case KeyGestures::LongPress:
+        if (e.keys != KEY_BIT_SET)
+            break;
         if (inMenu)
         {
-            if ((menuIndex == 1 || menuIndex == 2) && !settings.detectVoltage)
-            {
-                menuIndex = 3;
-            }
-            else if ((menuIndex == 4 || menuIndex == 5) && !settings.detectCurrent)
-            {
-                menuIndex = 6;
-            }
-            else if ((menuIndex == 7) && !settings.dryRun)
-            {
-                menuIndex = 8;
-            }
-            else if ((menuIndex == 9 || menuIndex == 10) && !settings.cyclicTimer)
-            {
-                menuIndex = 11;
-            }
-
-            if (menuIndex > totalMenuItems)
-            {
-                inMenu = false;
-                menuIndex = 0;
-                saveSettings();
-                showStatusScreen();
-            }
+            // leave the menu from any item
+            inMenu = false;
+            menuIndex = 0;
+            saveSettings();
+            showStatusScreen();
         }
-        else
+        else if (error >= 3)
         {
-            inMenu = true;
+            // "SET key resets" a latched fault
+            error = 0;
+            lasterrorTime = millis();
+            showStatusScreen();
         }
-        STATE = WAIT;
+        lastInteractionTime = millis();
+        break;
+
+    case KeyGestures::Chord:
+        if (e.keys == (KEY_BIT_SET | KEY_BIT_UP) && !inMenu)
+            armCalibration();
+        break;
+
+    default:
         break;
     }
 }
 
+// Service: re-arm motor calibration for the next AUTO/MANUAL centre position
+void armCalibration()
+{
+    calibCancelled = false;
+    calibMode = 1;
+    lcd.clear();
+    marquee.stopAll();
+    marquee.invalidate();
+    lcd.setCursor(0, 0);
+    lcd.print("Calib re-armed");
+}
+
 void calibrateMotor()
 {
     if (calibCancelled)
@@ -750,7 +790,7 @@ void calibrateMotor()
 
     float sumV = 0, sumI = 0, sumPF = 0;
 
-    Serial.println("Starting auto-calibration...");
+    LOG_INFO(CalibStart);
     lcd.setCursor(0, 0);
     lcd.print("Starting Auto   ");
     lcd.setCursor(0, 1);
@@ -764,7 +804,7 @@ void calibrateMotor()
 
         if (isnan(v) || isnan(i_) || isnan(pf))
         {
-            Serial.println("Error: Invalid PZEM reading (NaN)");
+            LOG_ERROR(CalibBadReading);
             lcd.clear();
             lcd.setCursor(0, 0);
             lcd.print("Error:");
@@ -806,15 +846,17 @@ void calibrateMotor()
     settings.underVoltage = max(50.0, voltage - voltage * 0.2);
     settings.offTime = 1;
     settings.onTime = 1;
-    // Save to EEPROM
+    // Save to flash now, loop() does not run until the switch is moved
     saveSettings();
+    settingsStore.commit();
 
     // Feedbackprintf("Calibration completed successfully:\n");
-    printf("Min PF: %.2f\n", settings.minPF);
-    printf("Over Current: %.2f A\n", settings.overCurrent);
-    printf("Under Current: %.2f A\n", settings.underCurrent);
-    printf("Over Voltage: %.1f V\n", settings.overVoltage);
-    printf("Under Voltage: %.1f V\n", settings.underVoltage);
+    LOG_INFO(CalibResult,
+             settings.minPF,
+             settings.overCurrent,
+             settings.underCurrent,
+             settings.overVoltage,
+             settings.underVoltage);
 
     // Serial.println("Calibration completed successfully:");
     // Serial.print("Min PF: ");
@@ -849,6 +891,496 @@ void readPzemValues()
     energy = pzem.energy();
 }
 
+// Append the current readings to the flash history
+void logSample(uint8_t flags)
+{
+    HistoryLog::Sample s;
+    s.time = time(nullptr); // epoch once NTP has synced, the log keeps order before that
+    s.voltage = voltage;
+    s.current = current;
+    s.pf = pf;
+    s.power = power;
+    s.energy = energy;
+    s.flags = flags;
+    if (inputLevel(FLOAT_UGT_PIN))
+        s.flags |= HistoryLog::flagUGT;
+    if (inputLevel(FLOAT_OHT_PIN))
+        s.flags |= HistoryLog::flagOHT;
+    if (motorRunning)
+        s.flags |= HistoryLog::flagMotor;
+    s.error = error;
+    history.append(s);
+    loggedMotor = motorRunning;
+    loggedError = error;
+}
+
+// Seconds for the metrics store. Until NTP has synced time() counts from
+// boot, so carry on from the newest stored row instead.
+uint32_t metricsTime()
+{
+    time_t now = time(nullptr);
+    if (now >= 1577836800) // 2020-01-01, the clock has been set
+        return now;
+    return metricsClockBase + millis() / 1000;
+}
+
+// Local seconds for the energy book, 0 until NTP has set the clock: the
+// free running metricsTime() does not say which day it is
+uint32_t energyTime(uint32_t now)
+{
+    return time(nullptr) >= (time_t)EnergyBook::clockSetFrom ? now + utcOffset : 0;
+}
+
+void reportMetrics(uint32_t now)
+{
+    MetricsStore::Summary day = metrics.summary(MetricsStore::Minutes, now - 86400, now);
+    LOG_INFO(Metrics24h,
+             day.voltageAvg,
+             day.voltageMax,
+             day.currentAvg,
+             day.currentMax,
+             day.powerAvg,
+             day.runSeconds / 60);
+}
+
+void reportEnergy(uint32_t now)
+{
+    if (!energyReady)
+        return;
+    uint32_t local = energyTime(now); // day and month read empty until the clock is set
+    EnergyBook::Bucket day = energyBook.day(EnergyBook::dayOf(local));
+    EnergyBook::Bucket month = energyBook.month(EnergyBook::monthOf(local));
+    LOG_INFO(Energy,
+             day.wh / 1000.0f,
+             day.starts,
+             day.runSeconds / 60,
+             month.wh / 1000.0f,
+             month.starts,
+             month.runSeconds / 3600,
+             energyBook.book().totalWh / 1000.0f,
+             energyBook.deviation() * 100);
+}
+
+// Capture bits of the inputs in one GPIO word, see CaptureRecords.h
+uint8_t captureBits(uint64_t word)
+{
+    static const uint8_t pins[] = {FLOAT_UGT_PIN, FLOAT_OHT_PIN, KEY_SET, KEY_UP, KEY_DOWN, SW_AUTO, SW_MANUAL};
+    uint8_t bits = 0;
+    for (uint8_t i = 0; i < sizeof(pins); i++)
+        if (word >> pins[i] & 1)
+            bits |= 1 << i;
+    return bits;
+}
+
+void captureMeter(unsigned long readMs)
+{
+    CaptureMeter r;
+    r.time = millis();
+    r.voltage = voltage;
+    r.current = current;
+    r.power = power;
+    r.pf = pf;
+    r.energy = energy;
+    r.frequency = pzem.frequency();
+    r.readMs = readMs;
+    r.flags = motorRunning | digitalRead(MOTOR_RELAY_PIN) << 1 | inputLevel(FLOAT_UGT_PIN) << 2 |
+              inputLevel(FLOAT_OHT_PIN) << 3;
+    r.error = error;
+    r.mode = systemMode;
+    captureStream.write(r);
+}
+
+// Called every debounce tick; records only changes of either state
+void captureInputs(uint64_t raw)
+{
+    CaptureInputs r;
+    r.time = millis();
+    r.raw = captureBits(raw);
+    r.debounced = captureBits(inputs.state());
+    if ((r.raw | r.debounced << 8) == lastCapturedInputs)
+        return;
+    lastCapturedInputs = r.raw | r.debounced << 8;
+    captureStream.write(r);
+}
+
+// GET /metrics                          summaries of the last hour, day, month and year
+// GET /metrics?tier=s|m|h&from=&to=     CSV rows of one tier, times in epoch seconds;
+//                                       at most maxRows a request, the header
+//                                       X-Next-From has the from= of the next page
+void handleMetrics()
+{
+    static const struct
+    {
+        const char *name;
+        MetricsStore::Tier tier;
+        uint32_t span;
+    } spans[] = {
+        {"1h", MetricsStore::Seconds, 3600UL},
+        {"24h", MetricsStore::Minutes, 86400UL},
+        {"30d", MetricsStore::Hours, 30 * 86400UL},
+        {"365d", MetricsStore::Hours, 365 * 86400UL},
+    };
+    const uint32_t maxRows = 300; // the pump loop waits while a request is served
+
+    uint32_t now = metricsTime();
+    char buf[512];
+    size_t len = 0;
+
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    if (!server.hasArg("tier"))
+    {
+        server.send(200, "text/plain", "");
+        for (const auto &s : spans)
+        {
+            MetricsStore::Summary m = metrics.summary(s.tier, now - s.span, now);
+            snprintf(buf, sizeof(buf), "%s rows=%lu v_avg=%.1f v_max=%.1f i_avg=%.2f i_max=%.2f p_avg=%.0f run_s=%lu\n",
+                     s.name, (unsigned long)m.rows, m.voltageAvg, m.voltageMax, m.currentAvg, m.currentMax, m.powerAvg,
+                     (unsigned long)m.runSeconds);
+            server.sendContent(buf);
+        }
+        return;
+    }
+
+    char t = server.arg("tier")[0];
+    MetricsStore::Tier tier = t == 'h' ? MetricsStore::Hours : t == 'm' ? MetricsStore::Minutes : MetricsStore::Seconds;
+    uint32_t step = metrics.tier(tier).layout().step;
+    uint32_t to = server.hasArg("to") ? (uint32_t)server.arg("to").toInt() : now + 1;
+    uint32_t from = server.hasArg("from") ? (uint32_t)server.arg("from").toInt() : to - 60 * step;
+    if (from > to)
+        from = to;
+    uint32_t end = to;
+    if (to - from > maxRows * step)
+    {
+        end = from + maxRows * step;
+        server.sendHeader("X-Next-From", String(end));
+    }
+
+    server.send(200, "text/csv", "");
+    bool coarse = tier != MetricsStore::Seconds;
+    server.sendContent(coarse ? "time,voltage,current,power,run,voltage_max,current_max\n"
+                              : "time,voltage,current,power,run\n");
+    metrics.tier(tier).scan(from, end, [&](const MetricsTier::Block &b) {
+        for (uint16_t i = 0; i < b.rows; i++)
+        {
+            if (b.col[MetricsStore::colVoltage][i] > MetricsTier::maxValue)
+                continue;
+            len += snprintf(buf + len, sizeof(buf) - len, "%lu,%.1f,%.2f,%u,%u",
+                            (unsigned long)(b.time + i * step),
+                            b.col[MetricsStore::colVoltage][i] / 10.0f,
+                            b.col[MetricsStore::colCurrent][i] / 100.0f,
+                            b.col[MetricsStore::colPower][i],
+                            b.col[MetricsStore::colRun][i]);
+            if (coarse)
+                len += snprintf(buf + len, sizeof(buf) - len, ",%.1f,%.2f",
+                                b.col[MetricsStore::colVoltageMax][i] / 10.0f,
+                                b.col[MetricsStore::colCurrentMax][i] / 100.0f);
+            len += snprintf(buf + len, sizeof(buf) - len, "\n");
+            if (len > sizeof(buf) - 64)
+            {
+                server.sendContent(buf, len);
+                len = 0;
+            }
+        }
+    });
+    if (len)
+        server.sendContent(buf, len);
+}
+
+// GET /history?from=&to=           compressed: "WLH2", then per block
+//                                  uint16 bytes, uint16 samples, Gorilla payload
+//                                  (channels as HistoryLog::toValues), little endian
+// GET /history?from=&to=&csv=1     the same samples as CSV
+//                                  at most maxSamples a request, the header
+//                                  X-Next-From has the from= of the next page
+void handleHistory()
+{
+    const uint32_t maxSamples = 500; // the pump loop waits while a request is served
+
+    uint32_t to = server.hasArg("to") ? (uint32_t)server.arg("to").toInt() : UINT32_MAX;
+    uint32_t from = server.hasArg("from") ? (uint32_t)server.arg("from").toInt() : 0;
+    bool csv = server.hasArg("csv");
+
+    static HistoryLog::Cursor c, ahead; // too big for the loop task stack
+    HistoryLog::Sample s;
+    bool more = history.seek(from, c);
+
+    // find where this page ends: the time of the first sample past the cap
+    if (more)
+    {
+        ahead = c;
+        uint32_t n = 0;
+        while (history.next(ahead, s) && s.time < to)
+            if (n++ == maxSamples)
+            {
+                to = s.time;
+                server.sendHeader("X-Next-From", String(to));
+                break;
+            }
+    }
+
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    if (csv)
+    {
+        server.send(200, "text/csv", "");
+        server.sendContent("time,voltage,current,pf,power,energy,flags,error\n");
+        char buf[512];
+        size_t len = 0;
+        while (more && history.next(c, s) && s.time < to)
+        {
+            len += snprintf(buf + len, sizeof(buf) - len, "%lu,%.1f,%.2f,%.2f,%.0f,%.3f,%u,%u\n",
+                            (unsigned long)s.time, s.voltage, s.current, s.pf, s.power, s.energy, s.flags, s.error);
+            if (len > sizeof(buf) - 80)
+            {
+                server.sendContent(buf, len);
+                len = 0;
+            }
+        }
+        if (len)
+            server.sendContent(buf, len);
+        return;
+    }
+
+    server.send(200, "application/octet-stream", "");
+    server.sendContent("WLH2", 4);
+    static uint8_t block[4 + HistoryLog::maxChunkBytes];
+    GorillaEncoder<HistoryLog::channels> enc;
+    enc.reset(block + 4, HistoryLog::maxChunkBytes);
+    int32_t values[HistoryLog::channels];
+    while (more && history.next(c, s) && s.time < to)
+    {
+        HistoryLog::toValues(s, values);
+        if (enc.append(s.time, values))
+            continue;
+        block[0] = enc.bytes();
+        block[1] = enc.bytes() >> 8;
+        block[2] = enc.count();
+        block[3] = enc.count() >> 8;
+        server.sendContent((const char *)block, 4 + enc.bytes());
+        enc.reset(block + 4, HistoryLog::maxChunkBytes);
+        enc.append(s.time, values);
+    }
+    if (enc.count())
+    {
+        block[0] = enc.bytes();
+        block[1] = enc.bytes() >> 8;
+        block[2] = enc.count();
+        block[3] = enc.count() >> 8;
+        server.sendContent((const char *)block, 4 + enc.bytes());
+    }
+}
+
+// --------------------- Serial Console -------------------------
+// Settings reachable with get/set; ranges as the menu and loadSettings() allow
+const SerialConsole::Field settingFields[] = {
+    {"overVoltage", 'f', offsetof(Settings, overVoltage), 100, 300},
+    {"underVoltage", 'f', offsetof(Settings, underVoltage), 50, 300},
+    {"overCurrent", 'f', offsetof(Settings, overCurrent), 0, 100},
+    {"underCurrent", 'f', offsetof(Settings, underCurrent), 0, 100},
+    {"minPF", 'f', offsetof(Settings, minPF), 0, 1},
+    {"onTime", 'u', offsetof(Settings, onTime), 1, 1440},
+    {"offTime", 'u', offsetof(Settings, offTime), 1, 1440},
+    {"dryRun", 'b', offsetof(Settings, dryRun), 0, 1},
+    {"detectVoltage", 'b', offsetof(Settings, detectVoltage), 0, 1},
+    {"detectCurrent", 'b', offsetof(Settings, detectCurrent), 0, 1},
+    {"cyclicTimer", 'b', offsetof(Settings, cyclicTimer), 0, 1},
+};
+const uint8_t settingFieldCount = sizeof(settingFields) / sizeof(settingFields[0]);
+
+// get [name]     one setting, or all of them
+bool consoleGet(SerialConsole &c, uint8_t argc, char **argv, uint16_t step)
+{
+    if (argc > 1)
+    {
+        const SerialConsole::Field *f = SerialConsole::findField(settingFields, settingFieldCount, argv[1]);
+        if (f)
+            c.printField(*f, &settings);
+        else
+            c.print("unknown setting '%s'\n", argv[1]);
+        return false;
+    }
+    c.printField(settingFields[step], &settings);
+    return step + 1 < settingFieldCount;
+}
+
+// set name value   takes effect at once, written to flash like a menu edit
+bool consoleSet(SerialConsole &c, uint8_t argc, char **argv, uint16_t)
+{
+    if (argc != 3)
+    {
+        c.print("usage: set name value\n");
+        return false;
+    }
+    const SerialConsole::Field *f = SerialConsole::findField(settingFields, settingFieldCount, argv[1]);
+    if (!f)
+        c.print("unknown setting '%s'\n", argv[1]);
+    else if (!SerialConsole::setField(*f, &settings, argv[2]))
+        c.print("%s: '%s' is not in %g .. %g\n", f->name, argv[2], (double)f->min, (double)f->max);
+    else
+    {
+        saveSettings();
+        if (inMenu)
+            showMenu();
+        c.printField(*f, &settings);
+    }
+    return false;
+}
+
+bool consoleSave(SerialConsole &c, uint8_t, char **, uint16_t)
+{
+    saveSettings();
+    c.print(settingsStore.commit() ? "saved\n" : "flash write failed\n");
+    return false;
+}
+
+bool consoleStats(SerialConsole &c, uint8_t, char **, uint16_t step)
+{
+    switch (step)
+    {
+    case 0:
+        c.print("uptime %lu s, loop max %lu us, error %d, motor %d, screen %u\n",
+                millis() / 1000, (unsigned long)loopMax, error, motorRunning, screenIndex);
+        return true;
+    case 1:
+        c.print("log: %lu events, %lu dropped, %lu bytes, ring high water %u\n",
+                (unsigned long)eventLog.stats().events, (unsigned long)eventLog.stats().dropped,
+                (unsigned long)eventLog.stats().bytes, eventLog.stats().highWater);
+        return true;
+    case 2:
+        c.print("settings: slot %c seq %lu, %lu commits, %lu compactions, %lu flash erases, journal %u/%u\n",
+                'A' + settingsStore.stats().slot, (unsigned long)settingsStore.stats().seq,
+                (unsigned long)settingsStore.stats().commits, (unsigned long)settingsStore.stats().compactions,
+                (unsigned long)settingsStore.stats().lifetimeErases, settingsStore.stats().journalUsed,
+                settingsStore.stats().journalSize);
+        return true;
+    case 3:
+        c.print("history: %u/%u pages, %lu samples, %lu chunks, %lu bad chunks\n",
+                history.stats().pagesUsed, history.stats().pages, (unsigned long)history.stats().appended,
+                (unsigned long)history.stats().chunks, (unsigned long)history.stats().badChunks);
+        return true;
+    case 4:
+        c.print("metrics: %u/%u/%u pages\n",
+                metrics.tier(MetricsStore::Seconds).pagesUsed(),
+                metrics.tier(MetricsStore::Minutes).pagesUsed(),
+                metrics.tier(MetricsStore::Hours).pagesUsed());
+        return true;
+    default:
+        if (energyReady)
+            c.print("energy: %.1f kWh total, %lu starts, %lu commits, PZEM %+.1f%%\n",
+                    energyBook.book().totalWh / 1000.0f, (unsigned long)energyBook.book().totalStarts,
+                    (unsigned long)energyBook.stats().commits, energyBook.deviation() * 100);
+        c.print("console: %lu lines, %lu too long, %lu output lines dropped\n",
+                (unsigned long)c.stats().lines, (unsigned long)c.stats().overflows,
+                (unsigned long)c.stats().dropped);
+        return false;
+    }
+}
+
+// hist [reset]   loop pass times, empty buckets left out
+bool consoleHist(SerialConsole &c, uint8_t argc, char **argv, uint16_t step)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        memset(loopHistogram, 0, sizeof(loopHistogram));
+        loopMax = 0;
+        c.print("loop histogram cleared\n");
+        return false;
+    }
+    if (step == 0)
+    {
+        c.print("loop pass    count (max %lu us)\n", (unsigned long)loopMax);
+        return true;
+    }
+    uint8_t k = step - 1;
+    if (loopHistogram[k])
+    {
+        if (k + 1 < loopBuckets)
+            c.print("< %7lu us %lu\n", 1UL << k, (unsigned long)loopHistogram[k]);
+        else
+            c.print(">= %6lu us %lu\n", 1UL << (k - 1), (unsigned long)loopHistogram[k]);
+    }
+    return k + 1 < loopBuckets;
+}
+
+// screen n   show a status screen now; rotation resumes after 5 s
+bool consoleScreen(SerialConsole &c, uint8_t argc, char **argv, uint16_t)
+{
+    char *end = NULL;
+    long n = argc == 2 ? strtol(argv[1], &end, 10) : -1;
+    if (n < 0 || n >= totalScreens || end == argv[1] || *end)
+        c.print("usage: screen 0..%u\n", totalScreens - 1);
+    else if (inMenu)
+        c.print("menu open on the panel\n");
+    else
+    {
+        screenIndex = n;
+        lastScreenSwitch = millis();
+        showStatusScreen();
+        c.print("screen %ld\n", n);
+    }
+    return false;
+}
+
+// capture [on|off]   binary records for tools/wlccap, counters without an argument
+bool consoleCapture(SerialConsole &c, uint8_t argc, char **argv, uint16_t)
+{
+    if (argc > 1 && strcmp(argv[1], "on") == 0)
+    {
+        capturing = true;
+        lastCapturedInputs = -1; // start with the current inputs
+    }
+    else if (argc > 1 && strcmp(argv[1], "off") == 0)
+        capturing = false;
+    else if (argc > 1)
+    {
+        c.print("usage: capture [on|off]\n");
+        return false;
+    }
+    c.print("capture %s: %lu frames, %lu dropped, %lu bytes, ring high water %u, seq %u\n",
+            capturing ? "on" : "off", (unsigned long)captureStream.stats().frames,
+            (unsigned long)captureStream.stats().dropped, (unsigned long)captureStream.stats().bytes,
+            captureStream.stats().highWater, captureStream.sequence());
+    return false;
+}
+
+// calib   same as the SET+UP chord
+bool consoleCalib(SerialConsole &c, uint8_t, char **, uint16_t)
+{
+    if (inMenu)
+    {
+        c.print("menu open on the panel\n");
+        return false;
+    }
+    armCalibration();
+    c.print("calibration armed, runs when the switch is at the centre position\n");
+    return false;
+}
+
+const SerialConsole::Command consoleCommands[] = {
+    {"help", "list commands", SerialConsole::help},
+    {"get", "[name]  show settings", consoleGet},
+    {"set", "name value  change a setting", consoleSet},
+    {"save", "write settings to flash now", consoleSave},
+    {"stats", "log, storage and energy counters", consoleStats},
+    {"hist", "[reset]  loop pass time histogram", consoleHist},
+    {"screen", "n  show status screen n", consoleScreen},
+    {"calib", "re-arm motor calibration", consoleCalib},
+    {"capture", "[on|off]  binary meter and input records", consoleCapture},
+};
+SerialConsole console(consoleCommands, sizeof(consoleCommands) / sizeof(consoleCommands[0]));
+
+// Event frames, console text and capture frames share Serial; none is
+// written into the middle of another (capture only sends whole frames)
+void drainSerial()
+{
+    if (!console.midLine())
+        eventLog.drain(Serial);
+    if (!eventLog.empty())
+        return;
+    console.drain(Serial);
+    if (!console.midLine())
+        captureStream.drain(Serial);
+}
+
 // --------------------- Setup -------------------------
 void setup()
 {
@@ -891,26 +1423,79 @@ void setup()
 
     if (!res)
     {
-        Serial.println("Failed to connect");
+        LOG_WARN(WifiFailed);
         // ESP.restart();
     }
     else
     {
         // if you get here you have connected to the WiFi
-        Serial.println("connected...yeey :)");
+        LOG_INFO(WifiConnected);
+        configTime(utcOffset, 0, "pool.ntp.org"); // history timestamps, local time for the energy book
     }
 
-    btnSET.begin();
-    btnUP.begin();
-    btnDN.begin();
+    pinMode(KEY_SET, INPUT_PULLUP);
+    pinMode(KEY_UP, INPUT_PULLUP);
+    pinMode(KEY_DOWN, INPUT_PULLUP);
+    inputs.begin(readGpioInputs()); // after all pull-ups are enabled
+
+    keys.config().repeatDelayMs = REPEAT_FIRST;
+    keys.config().repeatStartMs = REPEAT_INCR;
+    keys.begin(onKeyGesture, 0, KEY_BIT_UP | KEY_BIT_DOWN);
 
     loadSettings();
-    printf("System Booted on ESP32\n");
+    if (historyFlash.begin("history") && history.begin())
+        LOG_INFO(HistoryLoaded, history.stats().pagesUsed, history.stats().pages, history.lastTime());
+    else
+        LOG_WARN(HistoryMissing);
+    if (secondsFlash.begin("m_sec") && minutesFlash.begin("m_min") && hoursFlash.begin("m_hour") && metrics.begin())
+        LOG_INFO(MetricsLoaded,
+                 metrics.tier(MetricsStore::Seconds).pagesUsed(),
+                 metrics.tier(MetricsStore::Minutes).pagesUsed(),
+                 metrics.tier(MetricsStore::Hours).pagesUsed());
+    else
+        LOG_WARN(MetricsMissing);
+    metricsClockBase = metrics.endTime();
+    if (energyFlash.begin("energy"))
+    {
+        energyBook.begin();
+        energyReady = true;
+        if (energyBook.stats().restored)
+            LOG_INFO(EnergyRestored, energyBook.book().generation);
+        else
+            LOG_INFO(EnergyLoaded, energyBook.book().generation);
+        reportEnergy(metricsTime());
+    }
+    else
+        LOG_WARN(EnergyMissing);
+    server.on("/metrics", handleMetrics);
+    server.on("/history", handleHistory);
+    server.begin();
+    LOG_INFO(Boot);
+    drainSerial();
 }
 
 // --------------------- Main Loop -------------------------
 void loop()
 {
+    unsigned long loopStart = micros();
+    if (lastLoopStart)
+    {
+        uint32_t us = loopStart - lastLoopStart;
+        uint8_t k = us ? 32 - __builtin_clz(us) : 0;
+        loopHistogram[k < loopBuckets ? k : loopBuckets - 1]++;
+        if (us > loopMax)
+            loopMax = us;
+    }
+    lastLoopStart = loopStart;
+
+    if (millis() - lastDebounceTick >= debounceTick)
+    {
+        lastDebounceTick = millis();
+        uint64_t raw = readGpioInputs();
+        inputs.update(raw);
+        if (capturing)
+            captureInputs(raw);
+    }
 
     buttonCheck();
     if ((millis() - lastOnTime > 5000) && error <= 3)
@@ -936,25 +1521,54 @@ void loop()
         {
             if (millis() - lasterrorTime > 60 * 60 * 1000UL)
                 error = 0;
-            screenIndex = (screenIndex + 1) % 4;
+            screenIndex = (screenIndex + 1) % totalScreens;
         }
         lastScreenSwitch = millis();
         showStatusScreen();
-        printf("V:%.2f I:%.2f PF:%.2f P:%.2f UGT:%d OHT:%d Motor:%d ERROR:%d\n",
-               voltage,
-               current,
-               pf,
-               power,
-               digitalRead(FLOAT_UGT_PIN),
-               digitalRead(FLOAT_OHT_PIN),
-               digitalRead(MOTOR_RELAY_PIN),
-               error);
+        if (!capturing)
+            LOG_INFO(Status,
+                     voltage,
+                     current,
+                     pf,
+                     power,
+                     inputLevel(FLOAT_UGT_PIN),
+                     inputLevel(FLOAT_OHT_PIN),
+                     digitalRead(MOTOR_RELAY_PIN),
+                     error);
     }
 
+    if (!inMenu)
+        marquee.update();
+
+    settingsStore.poll(millis());
+    server.handleClient();
+    console.poll(Serial);
+    drainSerial();
+
     if (!inMenu && millis() - lastPzemRead >= pzemReadInterval)
     {
+        unsigned long readStart = millis();
         readPzemValues();
         lastPzemRead = millis();
+        if (capturing)
+            captureMeter(lastPzemRead - readStart); // the capture shares this read, it adds no bus time
+
+        uint32_t now = metricsTime();
+        metrics.add(now, voltage, current, power, motorRunning);
+        if (energyReady)
+            energyBook.update(millis(), energyTime(now), power, energy, motorRunning);
+        if (now / 3600 != lastMetricsReport)
+        {
+            lastMetricsReport = now / 3600;
+            reportMetrics(now);
+            reportEnergy(now);
+        }
+
+        if (millis() - lastHistoryLog >= historyInterval)
+        {
+            lastHistoryLog = millis();
+            logSample(0);
+        }
     }
 
     if (isnan(energy))
@@ -968,6 +1582,10 @@ void loop()
     if (isnan(pf))
         pf = 0.0;
 
+    // transitions are logged as they happen, not at the next 1 s sample
+    if (motorRunning != loggedMotor || error != loggedError)
+        logSample(HistoryLog::flagEvent);
+
     // Serial.print("V:");
     // Serial.print(voltage);
     // Serial.print(" I:");
@@ -985,11 +1603,11 @@ void loop()
     // Serial.print(" ERROR:");
     // Serial.println(error);
 
-    if (digitalRead(SW_MANUAL) && digitalRead(SW_AUTO) && calibMode)
+    if (inputLevel(SW_MANUAL) && inputLevel(SW_AUTO) && calibMode)
     {
         calibrateMotor();
     }
-    else if (!digitalRead(SW_AUTO) && digitalRead(SW_MANUAL))
+    else if (!inputLevel(SW_AUTO) && inputLevel(SW_MANUAL))
     {
         systemMode = 0;
         if (manulallyON)
@@ -1012,7 +1630,7 @@ void loop()
             // Serial.println((settings.onTime * 60) - (millis() - lastOnTime) / 1000);
             if ((settings.cyclicTimer ? millis() - lastOnTime >= settings.onTime * 60000UL : 0) || error >= 2)
             {
-                Serial.println("More than 60sec");
+                LOG_INFO(OnTimeElapsed);
                 digitalWrite(MOTOR_RELAY_PIN, LOW);
                 digitalWrite(MOTOR_STATUS_LED, LOW);
                 motorRunning = false;
@@ -1047,7 +1665,7 @@ void loop()
             }
         }
     }
-    else if (!digitalRead(SW_MANUAL) && digitalRead(SW_AUTO))
+    else if (!inputLevel(SW_MANUAL) && inputLevel(SW_AUTO))
     {
         systemMode = 1;
         if (error == 1)
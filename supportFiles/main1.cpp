@@ -1,10 +1,16 @@
 #include <TinyWireM.h>
-#include <SendOnlySoftwareSerial.h>
+#include <SendOnlySoftwareSerialBuffered.h>
 #include <EEPROM.h>
+#include <PCF8574Shadow.h>
+#include <PumpGuard.h>
+#include <FlowMeter.h>
+#include <BlinkPattern.h>
+#include <AcRms.h>
+#include <AdcScale.h>
 
 #define TX_PIN 1       // PB1
 #define POT_ADC_PIN A3 // PB3
-#define ACS712_PIN A2  // PB4
+#define ACS712_PIN A2  // PB4, ADC2
 
 #define PCF_ADDR 0x20
 
@@ -16,37 +22,90 @@
 #define MODE_P5_BIT 0b00100000    // P5
 #define ERROR_LED_BIT 0b01000000  // P6
 
-SendOnlySoftwareSerial mySerial(TX_PIN);
+// Inputs are written 1 (weak pull-up) so they can be read
+#define PCF_INPUTS (FLOW_BIT | MODE_P4_BIT | MODE_P5_BIT)
+
+// PCF8574 INT output, if it is wired to a free pin (PB5 needs the reset
+// disabled); -1 reads the expander every tick
+#define PCF_INT_PIN -1
+
+// Flow meter wired straight to a pin with a pin change interrupt instead
+// of P3 (PB5, with the reset disabled); -1 polls P3 every tick
+#define FLOW_PCINT_PIN -1
+
+#define TICK_MS 1            // control loop period
+#define POT_SETTLE_MS 5      // after switching the pot selection
+#define VCC_PERIOD_MS 1000
+#define VCC_SETTLE_MS 2      // bandgap selected before the conversion
+#define STATUS_PERIOD_MS 1000
+#define FLOW_K_FACTOR 450    // flow meter pulses per litre
+#define FLOW_UPDATE_MS 10    // flow rate recomputed this often
+#define LOW_FLOW_ML_MIN 1000 // less flow than this stops the pump
+#define NO_FLOW_ML_MIN 300   // below this there is no flow at all
+#define INRUSH_MS 5000       // current not checked after the relay closes
+#define CURRENT_TRIP_MS 20   // current out of range this long: trip
+#define RETRY_MS 10000       // relay held open after a current trip
+#define ACS712_MV_PER_A 66   // 30 A part
+#define VCC_TOLERANCE_MV 50  // Vcc drift that makes a new scale factor
+#define RELAY_ERROR 4        // blink code when the relay write fails
+
+// Motor current: true RMS over whole mains cycles, from the free running
+// ADC (clock F_CPU / 64, 13 clocks a conversion, about 9.6 kHz at 8 MHz)
+#define MAINS_HZ 50
+#define RMS_CYCLES 4          // mains cycles per current reading
+#define RMS_OVERSAMPLE_BITS 1 // 4 conversions per RMS sample
+#define ADC_SAMPLE_HZ (F_CPU / 64 / 13)
+#define RMS_WINDOW ((ADC_SAMPLE_HZ * RMS_CYCLES / MAINS_HZ) >> (2 * RMS_OVERSAMPLE_BITS))
+
+SendOnlySoftwareSerialBuffered mySerial(TX_PIN); // Timer1 interrupt
+PCF8574Shadow<USI_TWI> pcf(TinyWireM, PCF_ADDR, PCF_INPUTS, PCF_INT_PIN);
+PumpGuard guard(LOW_FLOW_ML_MIN, NO_FLOW_ML_MIN, INRUSH_MS, CURRENT_TRIP_MS, RETRY_MS);
+BlinkPattern errorLed;
+FlowMeter flow(FLOW_K_FACTOR);
+AcRms currentRms(RMS_WINDOW, RMS_OVERSAMPLE_BITS);
+AdcScale scale(ACS712_MV_PER_A, VCC_TOLERANCE_MV);
 
-uint8_t pcfState = 0x00;
 uint16_t internalRefMV = 1100;
-bool relayIsOn = false;
-unsigned long lastRelayOnTime = 0;
-unsigned long lastFlowPulseTime = 0;
+unsigned long lastTick = 0;
+bool relayFailed = false;
+
+bool centerSelected = true; // which pot the ADC sees
+unsigned long potSelectedAt = 0;
+int centerADC = 0;
+int rangeADC = 0;
+uint16_t currentRmsX16 = 0; // RMS of the last window, 1/16 ADC counts
+
+// The readings in mA, scaled when a window completes
+long currentMA = 0;
+long centerMA = 0;
+long rangeMA = 0;
+
+long vccMV = 0;
+bool vccPending = false;
+unsigned long vccRequestedAt = 0;
+unsigned long lastVccTime = 0;
+
+// Flow pulses so far and the micros() of the last, from the interrupt or
+// from pollFlow()
+volatile uint32_t flowPulses = 0;
+volatile uint32_t flowLastUs = 0;
 bool lastFlowLevel = true;
-bool flowActive = false;
+unsigned long lastFlowTime = 0;
 
-bool writeToPCF(uint8_t bitMask, bool setBit)
+// Snapshot printed by printStatus(); statusField 0: nothing to print
+struct Status
 {
-  if (setBit)
-    pcfState |= bitMask;
-  else
-    pcfState &= ~bitMask;
-  TinyWireM.beginTransmission(PCF_ADDR);
-  TinyWireM.send(pcfState);
-  return (TinyWireM.endTransmission() == 0);
-}
-
-bool readPCF(uint8_t &value)
-{
-  TinyWireM.requestFrom(PCF_ADDR, 1);
-  if (TinyWireM.available())
-  {
-    value = TinyWireM.receive();
-    return true;
-  }
-  return false;
-}
+  uint32_t flowMlMin;
+  uint32_t totalMl;
+  bool relay;
+  long currentMA;
+  long centerMA;
+  long rangeMA;
+  long vccMV;
+  uint8_t transactions;
+} status;
+uint8_t statusField = 0;
+unsigned long lastStatusTime = 0;
 
 void saveInternalRefToEEPROM(uint16_t mv)
 {
@@ -63,67 +122,156 @@ void loadInternalRefFromEEPROM()
     internalRefMV = 1100;
 }
 
-long readVcc()
+// The scale factor and the Vcc it was made for, after internalRefMV. Only
+// saved at start-up, so a supply that wanders cannot wear out the EEPROM.
+void saveScaleToEEPROM()
+{
+  EEPROM.update(2, lowByte(scale.factor()));
+  EEPROM.update(3, highByte(scale.factor()));
+  EEPROM.update(4, lowByte(scale.vccMV()));
+  EEPROM.update(5, highByte(scale.vccMV()));
+}
+
+// Leaves the scale unset when the stored pair is not for this sensor
+void loadScaleFromEEPROM()
+{
+  uint16_t factor = (EEPROM.read(3) << 8) | EEPROM.read(2);
+  uint16_t mv = (EEPROM.read(5) << 8) | EEPROM.read(4);
+  scale.set(factor, mv);
+}
+
+// Select the bandgap as ADC input; it needs VCC_SETTLE_MS before convertVcc()
+void requestVcc()
 {
   ADMUX = (1 << MUX3) | (1 << MUX2) | (1 << MUX1);
-  delay(2);
+}
+
+long convertVcc()
+{
   ADCSRA |= (1 << ADSC);
   while (ADCSRA & (1 << ADSC))
     ;
   return ((long)internalRefMV * 1023L) / ADC;
 }
 
-void blinkError(uint8_t count)
+long readVcc()
 {
-  for (uint8_t i = 0; i < count; i++)
-  {
-    writeToPCF(ERROR_LED_BIT, true);
-    delay(200);
-    writeToPCF(ERROR_LED_BIT, false);
-    delay(200);
-  }
-  delay(1000);
+  requestVcc();
+  delay(VCC_SETTLE_MS);
+  return convertVcc();
 }
 
-void updateFlowStatus()
+// Stage the switch that puts one pot on the ADC
+void selectPot(bool isCenter)
 {
-  uint8_t val;
-  if (!readPCF(val))
+  pcf.write(CENTER_POT_BIT, isCenter);
+  pcf.write(RANGE_POT_BIT, !isCenter);
+  centerSelected = isCenter;
+}
+
+// Blocking: select, one write, settle, read
+int readPot(bool isCenter)
+{
+  selectPot(isCenter);
+  pcf.commit();
+  delay(POT_SETTLE_MS);
+  return analogRead(POT_ADC_PIN);
+}
+
+// The readings in mA: a multiply and a shift each
+void scaleReadings()
+{
+  currentMA = scale.x16ToMA(currentRmsX16);
+  centerMA = scale.toMA(centerADC);
+  rangeMA = scale.toMA(rangeADC) >> 1;
+}
+
+// Pot state machine: read the selected pot once it has settled, then
+// select the other. The selection goes out with the tick's commit() and
+// settles while the next RMS window runs.
+void updatePots(unsigned long now)
+{
+  if (now - potSelectedAt < POT_SETTLE_MS)
     return;
-  bool flowPin = val & FLOW_BIT;
-  if (lastFlowLevel && !flowPin)
-    lastFlowPulseTime = millis();
-  lastFlowLevel = flowPin;
-  flowActive = (millis() - lastFlowPulseTime < 2000);
+  int adc = analogRead(POT_ADC_PIN);
+  if (centerSelected)
+    centerADC = adc;
+  else
+    rangeADC = adc;
+  selectPot(!centerSelected);
+  potSelectedAt = now;
 }
 
-void setRelay(bool on)
+// Free running conversions of the ACS712 into currentRms, until the
+// interrupt has a full window
+void startRms()
 {
-  if (!writeToPCF(RELAY_BIT, on))
-  {
-    mySerial.println(F("ERROR: Relay write failed."));
-    blinkError(4);
-  }
-  relayIsOn = on;
-  if (on)
-    lastRelayOnTime = millis();
+  currentRms.begin();
+  ADMUX = (1 << MUX1); // ADC2, Vcc reference
+  ADCSRB = 0;          // free running
+  ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADATE) | (1 << ADIF) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1);
 }
 
-int readPot(bool isCenter)
+// Interruptible, so the serial transmitter's edges do not wait for the
+// software multiply. Its own interrupt is off meanwhile: should the nested
+// Timer1 and millis interrupts hold it past the next conversion, it must
+// not start again inside itself and tear AcRms's sums; that conversion is
+// taken when it returns. ADIF is masked out of the writes, writing it 1
+// would clear a pending conversion. tools/adccycles counts its cycles.
+ISR(ADC_vect)
 {
-  writeToPCF(RANGE_POT_BIT | CENTER_POT_BIT, false);
-  writeToPCF(isCenter ? CENTER_POT_BIT : RANGE_POT_BIT, true);
-  delay(5);
-  return analogRead(POT_ADC_PIN);
+  uint16_t sample = ADC;
+  ADCSRA &= ~((1 << ADIE) | (1 << ADIF));
+  sei();
+  bool done = currentRms.add(sample);
+  cli();
+  if (done)
+    ADCSRA &= ~((1 << ADATE) | (1 << ADIF));
+  else
+    ADCSRA = (ADCSRA & ~(1 << ADIF)) | (1 << ADIE);
+}
+
+// The ADC's share of a tick. It converts the motor current on its own for
+// a window; between two windows come the pot that has settled and, once a
+// second, Vcc, which renews the scale factor if it has drifted. While the
+// bandgap settles for the Vcc reading the current is not sampled and keeps
+// its last value.
+void updateAdc(unsigned long now)
+{
+  if (vccPending)
+  {
+    if (now - vccRequestedAt < VCC_SETTLE_MS)
+      return;
+    vccMV = convertVcc();
+    vccPending = false;
+    lastVccTime = now;
+    scale.update(vccMV);
+    startRms();
+    return;
+  }
+  if (!currentRms.done())
+    return;
+  while (ADCSRA & (1 << ADSC)) // the conversion started before the window closed
+    ;
+  currentRmsX16 = currentRms.finish();
+  updatePots(now);
+  scaleReadings();
+  if (now - lastVccTime >= VCC_PERIOD_MS)
+  {
+    requestVcc();
+    vccPending = true;
+    vccRequestedAt = now;
+    return;
+  }
+  startRms();
 }
 
 uint8_t getMode()
 {
-  uint8_t val;
-  if (!readPCF(val))
+  if (!pcf.refresh(true))
     return 0xFF;
-  bool p4 = val & MODE_P4_BIT;
-  bool p5 = val & MODE_P5_BIT;
+  bool p4 = pcf.read(MODE_P4_BIT);
+  bool p5 = pcf.read(MODE_P5_BIT);
   if (p4 && p5)
     return 0;
   if (p4 && !p5)
@@ -149,7 +297,7 @@ void calibrateADC()
 
 void calibrateCenter()
 {
-  int adc = analogRead(POT_ADC_PIN);
+  int adc = readPot(true);
   mySerial.print(F("Center POT ADC = "));
   mySerial.println(adc);
   while (1)
@@ -158,64 +306,154 @@ void calibrateCenter()
 
 void calibrateRange()
 {
-  int adc = analogRead(POT_ADC_PIN);
+  int adc = readPot(false);
   mySerial.print(F("Range POT ADC = "));
   mySerial.println(adc);
   while (1)
     ;
 }
 
-void runController()
+// One field per tick, and only when it fits the transmit buffer, so a
+// tick never waits for the serial line
+void printStatus()
 {
-  loadInternalRefFromEEPROM();
-
-  while (1)
+  if (!statusField || mySerial.availableForWrite() < 16)
+    return;
+  switch (statusField++)
   {
-    updateFlowStatus();
-    int centerADC = readPot(true);
-    int rangeADC = readPot(false);
-    long vccMV = readVcc();
-
-    // Integer scale factor for converting ADC to mA
-    int adcToMAx1000 = (vccMV * 1000L) / (1023L * 66L);
-
-    int centerMA = (centerADC * adcToMAx1000) / 1000;
-    int rangeMA = (rangeADC * adcToMAx1000) / 2000;
-    int currentADC = analogRead(ACS712_PIN);
-    int currentMA = (currentADC * adcToMAx1000) / 1000;
+  case 1:
+    mySerial.print(F("Flow:"));
+    mySerial.print(status.flowMlMin);
+    mySerial.print(F("mL/min"));
+    break;
+  case 2:
+    mySerial.print(F(" | Vol="));
+    mySerial.print(status.totalMl / 1000);
+    mySerial.print(F("L"));
+    break;
+  case 3:
+    mySerial.print(F(" | I="));
+    mySerial.print(status.currentMA);
+    mySerial.print(F(" mA"));
+    break;
+  case 4:
+    mySerial.print(F(" | C="));
+    mySerial.print(status.centerMA);
+    break;
+  case 5:
+    mySerial.print(F(" | R="));
+    mySerial.print(status.rangeMA);
+    break;
+  case 6:
+    mySerial.print(F(" | Vcc="));
+    mySerial.print(status.vccMV);
+    mySerial.print(F("mV"));
+    break;
+  case 7:
+    mySerial.print(F(" | Relay="));
+    mySerial.print(status.relay ? F("ON") : F("OFF"));
+    break;
+  default:
+    mySerial.print(F(" | I2C="));
+    mySerial.println(status.transactions);
+    statusField = 0;
+    break;
+  }
+}
 
-    int lowTh = centerMA - rangeMA;
-    int highTh = centerMA + rangeMA;
+#if FLOW_PCINT_PIN >= 0
+ISR(PCINT0_vect)
+{
+  if (!(PINB & _BV(FLOW_PCINT_PIN))) // falling edge
+  {
+    flowPulses++;
+    flowLastUs = micros();
+  }
+}
+#else
+// A falling edge of P3 between two reads is a pulse, timed at the read
+void pollFlow()
+{
+  pcf.refresh();
+  bool level = pcf.read(FLOW_BIT);
+  if (lastFlowLevel && !level)
+  {
+    flowPulses++;
+    flowLastUs = micros();
+  }
+  lastFlowLevel = level;
+}
+#endif
 
-    bool inrushOK = relayIsOn && (millis() - lastRelayOnTime < 5000);
-    bool currentOK = (currentMA > lowTh && currentMA < highTh) || inrushOK;
-    bool flow = flowActive = (millis() - lastFlowPulseTime < 2000);
-    bool shouldRun = flow && currentOK;
+void updateFlow()
+{
+  noInterrupts();
+  uint32_t pulses = flowPulses;
+  uint32_t lastUs = flowLastUs;
+  interrupts();
+  flow.update(micros(), pulses, lastUs);
+}
 
-    if (!flow)
-      blinkError(1);
-    else if (!inrushOK && currentMA < lowTh)
-      blinkError(2);
-    else if (!inrushOK && currentMA > highTh)
-      blinkError(3);
+// One control tick: at most one expander read at the start (none with the
+// flow meter on an interrupt) and one write at the end, and nothing that
+// waits
+void controllerTick(unsigned long now)
+{
+#if FLOW_PCINT_PIN < 0
+  pollFlow();
+#endif
+  if (now - lastFlowTime >= FLOW_UPDATE_MS)
+  {
+    updateFlow();
+    lastFlowTime = now;
+  }
+  updateAdc(now);
 
-    setRelay(shouldRun);
+  bool shouldRun = guard.update(now, flow.mlPerMinute(), currentMA, centerMA - rangeMA, centerMA + rangeMA);
 
-    mySerial.print(F("Flow:"));
-    mySerial.print(flow ? F("Y") : F("N"));
-    mySerial.print(F(" | I="));
-    mySerial.print(currentMA);
-    mySerial.print(F(" mA | C="));
-    mySerial.print(centerMA);
-    mySerial.print(F(" | R="));
-    mySerial.print(rangeMA);
-    mySerial.print(F(" | Vcc="));
-    mySerial.print(vccMV);
-    mySerial.print(F("mV | Relay="));
-    mySerial.println(shouldRun ? F("ON") : F("OFF"));
+  pcf.write(RELAY_BIT, shouldRun);
+  errorLed.show(relayFailed ? RELAY_ERROR : guard.error());
+  pcf.write(ERROR_LED_BIT, errorLed.update(now));
+  bool failed = !pcf.commit();
+  if (failed && !relayFailed)
+    mySerial.println(F("ERROR: Relay write failed."));
+  relayFailed = failed;
+  pcf.endTick();
 
-    delay(1000);
+  if (now - lastStatusTime >= STATUS_PERIOD_MS && !statusField)
+  {
+    status.flowMlMin = flow.mlPerMinute();
+    status.totalMl = flow.totalMl();
+    status.relay = shouldRun;
+    status.currentMA = currentMA;
+    status.centerMA = centerMA;
+    status.rangeMA = rangeMA;
+    status.vccMV = vccMV;
+    status.transactions = pcf.stats().lastTick;
+    statusField = 1;
+    lastStatusTime = now;
   }
+  printStatus();
+}
+
+// First readings, blocking; loop() runs the ticks from here on
+void startController()
+{
+  loadInternalRefFromEEPROM();
+  loadScaleFromEEPROM();
+  vccMV = readVcc();
+  if (scale.update(vccMV))
+    saveScaleToEEPROM();
+  centerADC = readPot(true);
+  rangeADC = readPot(false);
+  scaleReadings();
+  startRms();
+#if FLOW_PCINT_PIN >= 0
+  pinMode(FLOW_PCINT_PIN, INPUT_PULLUP);
+  PCMSK |= _BV(FLOW_PCINT_PIN);
+  GIMSK |= _BV(PCIE);
+#endif
+  potSelectedAt = lastVccTime = lastFlowTime = lastTick = millis();
 }
 
 void setup()
@@ -224,16 +462,13 @@ void setup()
   mySerial.begin(9600);
   delay(100);
 
-  writeToPCF(ERROR_LED_BIT, true);
-  delay(10);
-  uint8_t state;
-  if (!readPCF(state))
+  if (!pcf.begin(ERROR_LED_BIT | CENTER_POT_BIT))
   {
     mySerial.println(F("ERROR: PCF8574 not responding!"));
     while (1)
       ;
   }
-  if (!(state & ERROR_LED_BIT))
+  if (!pcf.read(ERROR_LED_BIT))
   {
     mySerial.println(F("ERROR: PCF8574 P6 did not go HIGH!"));
     while (1)
@@ -248,7 +483,15 @@ void setup()
   else if (mode == 3)
     calibrateRange();
   else
-    runController();
+    startController();
 }
 
-void loop() {}
+// Calibration modes never get here
+void loop()
+{
+  unsigned long now = millis();
+  if (now - lastTick < TICK_MS)
+    return;
+  lastTick = now;
+  controllerTick(now);
+}
@@ -0,0 +1,82 @@
+// Arduino core stand-in for host builds
+//
+// The native tests (platformio.ini, env:native) and the benchmarks under
+// tools/ compile libraries that include <Arduino.h> on a PC. This header
+// gives them the few core calls those libraries use, driven by the test
+// instead of hardware:
+//
+//   hostMillis()           what millis() returns; set it, it never moves
+//   hostPins().level[pin]  what digitalRead(pin) returns, HIGH at start
+//                          as with INPUT_PULLUP and nothing pressed
+//
+// No serial, no interrupts: without ESP32 defined the libraries do not
+// attach any, and a test calls the ISR entry points itself. Print.h and
+// Stream.h next to this stand in for the core's classes of those names,
+// avr/ for the registers of an ATmega328 where a test builds AVR code.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define CHANGE 0x03
+
+struct HostPins
+{
+    enum
+    {
+        count = 64
+    };
+
+    uint8_t level[count];
+    uint8_t mode[count];
+
+    HostPins() { reset(); }
+
+    void reset()
+    {
+        memset(level, HIGH, sizeof(level));
+        memset(mode, INPUT, sizeof(mode));
+    }
+};
+
+inline HostPins &hostPins()
+{
+    static HostPins pins;
+    return pins;
+}
+
+inline unsigned long &hostMillis()
+{
+    static unsigned long now = 0;
+    return now;
+}
+
+inline unsigned long millis() { return hostMillis(); }
+
+inline int digitalRead(uint8_t pin) { return pin < HostPins::count ? hostPins().level[pin] : LOW; }
+
+inline void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin < HostPins::count)
+        hostPins().level[pin] = val ? HIGH : LOW;
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < HostPins::count)
+        hostPins().mode[pin] = mode;
+}
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,87 @@
+// Arduino Print stand-in for host builds
+//
+// The part of the core's Print that libraries deriving from it use:
+// write() of one byte (the subclass's), of a string and of a buffer,
+// print() and println() of strings and integers in any base, and the
+// write error flag. No floats, no String, no Printable.
+
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print
+{
+  public:
+    Print() : writeError_(0) {}
+    virtual ~Print() {}
+
+    int getWriteError() { return writeError_; }
+    void clearWriteError() { setWriteError(0); }
+
+    virtual size_t write(uint8_t) = 0;
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+        {
+            if (!write(*buffer++))
+                break;
+            n++;
+        }
+        return n;
+    }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+    size_t print(long n, int base = DEC)
+    {
+        if (base == DEC && n < 0)
+            return print('-') + printNumber(0UL - (unsigned long)n, base);
+        return printNumber((unsigned long)n, base);
+    }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T v) { return print(v) + println(); }
+    template <typename T> size_t println(T v, int base) { return print(v, base) + println(); }
+
+  protected:
+    void setWriteError(int err = 1) { writeError_ = err; }
+
+  private:
+    int writeError_;
+
+    size_t printNumber(unsigned long n, int base)
+    {
+        char buf[8 * sizeof(long) + 1];
+        char *s = &buf[sizeof(buf) - 1];
+        *s = '\0';
+        if (base < 2)
+            base = 10;
+        do
+        {
+            char c = n % base;
+            n /= base;
+            *--s = c < 10 ? c + '0' : c + 'A' - 10;
+        } while (n);
+        return write(s);
+    }
+};
+
+#endif // HOST_PRINT_H
@@ -0,0 +1,20 @@
+// Arduino Stream stand-in for host builds
+//
+// Print plus the three read calls every Stream implements. The timed
+// parsing helpers of the core (find(), parseInt(), readBytes()) are left
+// out: nothing built on the host reads through them.
+
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+#include "Print.h"
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+#endif // HOST_STREAM_H
@@ -0,0 +1,17 @@
+// avr/interrupt.h stand-in for host builds
+//
+// cli() and sei() flip the I bit of the SREG stand-in (avr/io.h), and
+// ISR() defines a plain function named after the vector, which a test
+// calls to play the interrupt.
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include "io.h"
+
+#define cli() (SREG &= (uint8_t)~_BV(SREG_I))
+#define sei() (SREG |= _BV(SREG_I))
+
+#define ISR(vector) void vector()
+
+#endif // HOST_AVR_INTERRUPT_H
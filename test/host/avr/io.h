@@ -0,0 +1,72 @@
+// avr/io.h stand-in for host builds
+//
+// The ATmega328P registers the interrupt driven libraries touch, as
+// plain bytes in hostAvr() that a test sets and reads. They are macros,
+// as in avr-libc, so a source's #if defined(TCCR2A) picks the ATmega
+// branch. No peripheral runs by itself: a test plays the timer by
+// setting the counter and calling the vector (avr/interrupt.h).
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define _BV(bit) (1 << (bit))
+
+struct HostAvr
+{
+    volatile uint8_t sreg;
+    volatile uint8_t portb, portc, portd;
+    volatile uint8_t ddrb, ddrc, ddrd;
+    volatile uint8_t tccr2a, tccr2b, tcnt2, ocr2a, ocr2b, tifr2, timsk2;
+
+    HostAvr() { reset(); }
+
+    // as after the core's init(): everything 0, interrupts on
+    void reset()
+    {
+        memset((void *)this, 0, sizeof(*this));
+        sreg = _BV(7);
+    }
+};
+
+inline HostAvr &hostAvr()
+{
+    static HostAvr avr;
+    return avr;
+}
+
+#define SREG (hostAvr().sreg)
+#define SREG_I 7
+
+#define PORTB (hostAvr().portb)
+#define PORTC (hostAvr().portc)
+#define PORTD (hostAvr().portd)
+#define DDRB (hostAvr().ddrb)
+#define DDRC (hostAvr().ddrc)
+#define DDRD (hostAvr().ddrd)
+
+// Timer2
+#define TCCR2A (hostAvr().tccr2a)
+#define TCCR2B (hostAvr().tccr2b)
+#define TCNT2 (hostAvr().tcnt2)
+#define OCR2A (hostAvr().ocr2a)
+#define OCR2B (hostAvr().ocr2b)
+#define TIFR2 (hostAvr().tifr2)
+#define TIMSK2 (hostAvr().timsk2)
+#define WGM20 0
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define TOV2 0
+#define OCF2A 1
+#define OCF2B 2
+#define TOIE2 0
+#define OCIE2A 1
+#define OCIE2B 2
+#define TIMER2_COMPA_vect hostTimer2CompA
+void hostTimer2CompA();
+
+#endif // HOST_AVR_IO_H
@@ -0,0 +1,208 @@
+// EnergyBook over 40 simulated days, on RAM flash
+//
+// A pump runs two hours every morning. One update per second, as the
+// firmware's meter read, drives the book with the power and a PZEM
+// counter of 1 Wh resolution. Every day and month bucket still kept and
+// the totals must match the exactly integrated energy to within 1 Wh,
+// with a reset (RTC shadow kept) in the middle of a run. The flash sees
+// a fixed number of commits and erases. Apart from that: a power cut
+// falls back to the last commit, and nothing is booked into a day or
+// month before the clock is set.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <EnergyBook.h>
+#include <RamFlashRegion.h>
+#include <unity.h>
+
+namespace
+{
+const uint32_t t0 = 1709251200; // 2024-03-01 00:00 local
+const uint32_t runFrom = 6 * 3600, runTo = 8 * 3600;
+
+bool runningAt(uint32_t local)
+{
+    uint32_t s = local % 86400;
+    return s >= runFrom && s < runTo;
+}
+
+float powerAt(uint32_t local)
+{
+    return runningAt(local) ? 1100 + 60 * sinf(local / 300.0f) : 0;
+}
+
+// Energy the book should have, in Wh, by bucket index
+struct Truth
+{
+    std::map<uint16_t, double> days, months;
+    double total = 0;
+    uint32_t starts = 0;
+
+    void add(uint32_t local, float power, bool start)
+    {
+        double wh = power / 3600.0;
+        days[EnergyBook::dayOf(local)] += wh;
+        months[EnergyBook::monthOf(local)] += wh;
+        total += wh;
+        starts += start;
+    }
+};
+
+bool empty(const EnergyBook::Bucket &b)
+{
+    return b.wh == 0 && b.runSeconds == 0 && b.starts == 0;
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// 40 days at 1 Hz, a reset on day 20 in the middle of the run
+void test_forty_days()
+{
+    RamFlashRegion flash(2);
+    EnergyBook::Shadow *shadow = new EnergyBook::Shadow;
+    memset(shadow, 0xA5, sizeof(*shadow)); // RTC memory after power on
+    EnergyBook *book = new EnergyBook(flash, *shadow);
+    TEST_ASSERT_FALSE(book->begin());
+
+    Truth truth;
+    double pzemWh = 123456; // the meter was not new
+    uint32_t commits = 0;
+    const uint32_t days = 40, crashAt = 19 * 86400 + 7 * 3600;
+    for (uint32_t k = 0; k <= days * 86400; k++)
+    {
+        uint32_t local = t0 + k;
+        float power = powerAt(local);
+        bool run = runningAt(local);
+        if (k == crashAt)
+        {
+            // watchdog reset: millis() restarts, RTC memory stays
+            commits += book->stats().commits;
+            const EnergyBook::Book before = book->book();
+            delete book;
+            book = new EnergyBook(flash, *shadow);
+            TEST_ASSERT_TRUE(book->begin());
+            TEST_ASSERT_TRUE(book->stats().restored);
+            TEST_ASSERT_EQUAL_MEMORY(&before, &book->book(), sizeof(before));
+        }
+        else if (k)
+        {
+            // the second up to this update; lost across the reset
+            truth.add(local, power, run && !runningAt(local - 1));
+            pzemWh += power / 3600.0;
+        }
+        unsigned long ms = (k < crashAt ? k : k - crashAt) * 1000UL;
+        book->update(ms, local, power, floor(pzemWh) / 1000.0f, run);
+    }
+    commits += book->stats().commits;
+
+    uint32_t end = t0 + days * 86400;
+    const EnergyBook::Book &b = book->book();
+    TEST_ASSERT_FLOAT_WITHIN(1.0, truth.total, b.totalWh);
+    // begin() does not take the running flag over a reset, so the motor
+    // still on after it counts as one more start
+    TEST_ASSERT_EQUAL(days, truth.starts);
+    TEST_ASSERT_EQUAL(days + 1, b.totalStarts);
+    for (uint16_t d = EnergyBook::dayOf(end) - EnergyBook::dayCount + 1; d < EnergyBook::dayOf(end); d++)
+    {
+        EnergyBook::Bucket bucket = book->day(d);
+        TEST_ASSERT_FLOAT_WITHIN(1.0, truth.days[d], bucket.wh);
+        TEST_ASSERT_EQUAL(runTo - runFrom, bucket.runSeconds);
+        TEST_ASSERT_EQUAL(1, bucket.starts);
+    }
+    TEST_ASSERT_TRUE(empty(book->day(EnergyBook::dayOf(end) - EnergyBook::dayCount))); // dropped from the ring
+    for (auto &m : truth.months)
+    {
+        EnergyBook::Bucket bucket = book->month(m.first);
+        TEST_ASSERT_FLOAT_WITHIN(1.0, m.second, bucket.wh);
+    }
+    TEST_ASSERT_EQUAL(31 + 1, book->month(EnergyBook::monthOf(t0)).starts);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0, book->deviation());
+
+    // commits a day: the day end, the first Wh of the run (more than an
+    // hour after the last commit), an hour into the run, the motor stop
+    printf("%u commits, %u erases, %u bytes written\n", (unsigned)commits, (unsigned)flash.erases(),
+           (unsigned)flash.bytesWritten());
+    TEST_ASSERT_EQUAL(4 * days, commits);
+    TEST_ASSERT_EQUAL(2, flash.erases());
+
+    delete book;
+    delete shadow;
+}
+
+// Without the RTC shadow the book is the last commit: the motor stop
+void test_power_cut_falls_back_to_last_commit()
+{
+    RamFlashRegion flash(2);
+    EnergyBook::Shadow shadow = EnergyBook::Shadow();
+    EnergyBook::Book committed = EnergyBook::Book();
+    {
+        EnergyBook book(flash, shadow);
+        book.begin();
+        uint32_t commits = 0;
+        for (uint32_t k = 0; k < runTo + 1800; k++)
+        {
+            uint32_t local = t0 + 86400 + k;
+            book.update(k * 1000UL, local, powerAt(local), NAN, runningAt(local));
+            if (book.stats().commits != commits)
+            {
+                commits = book.stats().commits;
+                committed = book.book();
+            }
+        }
+        TEST_ASSERT_TRUE(book.book().totalWh > 2000);
+    }
+    memset(&shadow, 0, sizeof(shadow)); // power cut: RTC memory lost
+    EnergyBook book(flash, shadow);
+    TEST_ASSERT_TRUE(book.begin());
+    TEST_ASSERT_FALSE(book.stats().restored);
+    TEST_ASSERT_EQUAL_MEMORY(&committed, &book.book(), sizeof(committed));
+    TEST_ASSERT_EQUAL(runTo - runFrom, book.day(EnergyBook::dayOf(t0 + 86400)).runSeconds);
+}
+
+// Until the clock is set energy counts in the totals, in no day or month
+void test_nothing_booked_before_clock_set()
+{
+    RamFlashRegion flash(2);
+    EnergyBook::Shadow shadow = EnergyBook::Shadow();
+    EnergyBook book(flash, shadow);
+    book.begin();
+
+    // an hour free running after boot, the motor on for half of it
+    for (uint32_t k = 0; k < 3600; k++)
+        book.update(k * 1000UL, 0, k < 1800 ? 1000 : 0, NAN, k < 1800);
+    TEST_ASSERT_UINT32_WITHIN(1, 500, book.book().totalWh);
+    TEST_ASSERT_EQUAL(1, book.book().totalStarts);
+    for (const EnergyBook::Bucket &b : book.book().days)
+        TEST_ASSERT_TRUE(b.index == 0 && empty(b));
+    for (const EnergyBook::Bucket &b : book.book().months)
+        TEST_ASSERT_TRUE(b.index == 0 && empty(b));
+    TEST_ASSERT_TRUE(empty(book.day(0)));
+    TEST_ASSERT_TRUE(empty(book.month(EnergyBook::monthOf(0))));
+
+    // NTP: from here on into the day it is
+    uint32_t local = t0 + 10 * 3600;
+    for (uint32_t k = 3600; k < 7200; k++)
+        book.update(k * 1000UL, local++, 1000, NAN, true);
+    uint16_t today = EnergyBook::dayOf(t0);
+    TEST_ASSERT_UINT32_WITHIN(1, 1000, book.day(today).wh);
+    TEST_ASSERT_EQUAL(1, book.day(today).starts);
+    TEST_ASSERT_UINT32_WITHIN(1, 3600, book.day(today).runSeconds);
+    TEST_ASSERT_UINT32_WITHIN(1, 1000, book.month(EnergyBook::monthOf(t0)).wh);
+    TEST_ASSERT_UINT32_WITHIN(2, 1500, book.book().totalWh);
+    TEST_ASSERT_EQUAL(2, book.book().totalStarts);
+    TEST_ASSERT_TRUE(empty(book.day(0)));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_forty_days);
+    RUN_TEST(test_power_cut_falls_back_to_last_commit);
+    RUN_TEST(test_nothing_booked_before_clock_set);
+    return UNITY_END();
+}
@@ -0,0 +1,300 @@
+// HistoryLog on a RAM flash model: wrap-around, seek, live tail, power
+// cuts and wear
+//
+// Every sample appended is also kept in a reference list in its stored
+// fixed point form (HistoryLog::toValues), so whatever the log returns
+// can be compared exactly. The wear case logs at 1 Hz for three months on
+// a region the size of the "history" partition and prints the append
+// rate and the erases per sector.
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <HistoryLog.h>
+#include <RamFlashRegion.h>
+#include <unity.h>
+
+namespace
+{
+const size_t partitionPages = 54; // "history" in partitions.csv
+
+struct Ref
+{
+    uint32_t time;
+    int32_t values[HistoryLog::channels];
+};
+
+// A pump's measurements: slow random walks, the motor switching now and then
+struct Source
+{
+    std::mt19937 rng;
+    uint32_t time;
+    float voltage = 230, energy = 100;
+    bool motor = false;
+
+    explicit Source(uint32_t seed, uint32_t start = 1700000000) : rng(seed), time(start) {}
+
+    HistoryLog::Sample next(uint32_t step)
+    {
+        time += step;
+        std::uniform_int_distribution<int> walk(-2, 2), toggle(0, 999);
+        voltage += walk(rng) * 0.1f;
+        bool event = toggle(rng) < 2;
+        if (event)
+            motor = !motor;
+        float current = motor ? 4.8f + walk(rng) * 0.01f : 0;
+        float power = motor ? voltage * current * 0.82f : 0;
+        energy += power * step / 3600000;
+        uint8_t flags = HistoryLog::flagUGT | (motor ? HistoryLog::flagMotor : 0) | (event ? HistoryLog::flagEvent : 0);
+        return HistoryLog::Sample{time, voltage, current, motor ? 0.82f : 0, power, energy, flags, 0};
+    }
+};
+
+Ref toRef(const HistoryLog::Sample &s)
+{
+    Ref r;
+    r.time = s.time;
+    HistoryLog::toValues(s, r.values);
+    return r;
+}
+
+bool same(const HistoryLog::Sample &s, const Ref &r)
+{
+    Ref got = toRef(s);
+    return got.time == r.time && memcmp(got.values, r.values, sizeof(r.values)) == 0;
+}
+
+// First reference entry at or after t
+size_t lowerBound(const std::vector<Ref> &ref, uint32_t t)
+{
+    size_t lo = 0, hi = ref.size();
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (ref[mid].time < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Read from t to the end and compare with the reference
+void readBack(const HistoryLog &log, const std::vector<Ref> &ref, uint32_t t)
+{
+    static HistoryLog::Cursor c;
+    HistoryLog::Sample s;
+    size_t i = lowerBound(ref, t < log.firstTime() ? log.firstTime() : t);
+    TEST_ASSERT_TRUE(log.seek(t, c));
+    for (; log.next(c, s); i++)
+    {
+        TEST_ASSERT_TRUE(i < ref.size());
+        TEST_ASSERT_TRUE(same(s, ref[i]));
+    }
+    TEST_ASSERT_EQUAL(ref.size(), i);
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// Several times round the ring, reading back from random places
+void test_wrap_around_and_seek()
+{
+    RamFlashRegion flash(12);
+    HistoryLog log(flash);
+    TEST_ASSERT_TRUE(log.begin());
+    TEST_ASSERT_TRUE(log.empty());
+
+    Source src(1);
+    std::vector<Ref> ref;
+    std::mt19937 rng(2);
+    for (int i = 0; i < 150000; i++)
+    {
+        HistoryLog::Sample s = src.next(10);
+        TEST_ASSERT_TRUE(log.append(s));
+        ref.push_back(toRef(s));
+
+        if (i % 9973 == 0)
+        {
+            uint32_t first = log.firstTime();
+            size_t from = lowerBound(ref, first);
+            TEST_ASSERT_EQUAL(ref[from].time, first); // oldest pages drop whole
+            for (int q = 0; q < 5; q++)
+            {
+                size_t j = from + rng() % (ref.size() - from);
+                readBack(log, ref, ref[j].time);
+                readBack(log, ref, ref[j].time - 3); // between two samples
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL(12, log.stats().pagesUsed);
+    TEST_ASSERT_GREATER_THAN(ref.front().time, log.firstTime()); // it wrapped
+
+    // before the oldest sample: the whole log; after the newest: nothing
+    readBack(log, ref, 0);
+    static HistoryLog::Cursor c;
+    TEST_ASSERT_FALSE(log.seek(log.lastTime() + 1, c));
+
+    // a reboot finds the same log
+    log.flush();
+    HistoryLog rebooted(flash);
+    TEST_ASSERT_TRUE(rebooted.begin());
+    TEST_ASSERT_EQUAL(log.lastTime(), rebooted.lastTime());
+    TEST_ASSERT_EQUAL(log.firstTime(), rebooted.firstTime());
+    readBack(rebooted, ref, rebooted.firstTime());
+}
+
+// A reader at the end sees new samples as they arrive, flushed or not
+void test_live_tail()
+{
+    RamFlashRegion flash(4);
+    HistoryLog log(flash);
+    log.begin();
+    Source src(3);
+    std::vector<Ref> ref;
+    for (int i = 0; i < 100; i++)
+    {
+        HistoryLog::Sample s = src.next(10);
+        log.append(s);
+        ref.push_back(toRef(s));
+    }
+
+    static HistoryLog::Cursor c;
+    HistoryLog::Sample s;
+    TEST_ASSERT_TRUE(log.seek(ref.back().time, c));
+    TEST_ASSERT_TRUE(log.next(c, s));
+    TEST_ASSERT_FALSE(log.next(c, s)); // caught up
+
+    size_t seen = ref.size();
+    for (int i = 0; i < 5000; i++)
+    {
+        HistoryLog::Sample in = src.next(1 + i % 7);
+        TEST_ASSERT_TRUE(log.append(in));
+        ref.push_back(toRef(in));
+        if (i % 13 == 0)
+            while (log.next(c, s))
+            {
+                TEST_ASSERT_TRUE(seen < ref.size());
+                TEST_ASSERT_TRUE(same(s, ref[seen]));
+                seen++;
+            }
+    }
+    while (log.next(c, s))
+    {
+        TEST_ASSERT_TRUE(same(s, ref[seen]));
+        seen++;
+    }
+    TEST_ASSERT_EQUAL(ref.size(), seen);
+}
+
+// Power cuts at random points: what reads back is an exact prefix of what
+// was appended, short by at most maxChunkAge seconds, and logging goes on
+void test_power_cuts()
+{
+    std::mt19937 rng(4);
+    uint32_t worstLoss = 0;
+    for (int run = 0; run < 300; run++)
+    {
+        RamFlashRegion flash(6);
+        Source src(100 + run);
+        std::vector<Ref> ref;
+        {
+            HistoryLog log(flash);
+            log.begin();
+            int before = 500 + rng() % 5000;
+            for (int i = 0; i < before; i++)
+            {
+                HistoryLog::Sample s = src.next(10);
+                log.append(s);
+                ref.push_back(toRef(s));
+            }
+
+            flash.cutAfter(rng() % 300);
+            for (;;)
+            {
+                // the sample whose write is cut may or may not make it:
+                // the cut can fall in the padding after its chunk
+                HistoryLog::Sample s = src.next(10);
+                ref.push_back(toRef(s));
+                bool ok = log.append(s);
+                if (flash.powerCut())
+                    break; // the CPU is gone with the power
+                TEST_ASSERT_TRUE(ok);
+            }
+            flash.powerOn();
+        }
+
+        HistoryLog log(flash);
+        TEST_ASSERT_TRUE(log.begin());
+        static HistoryLog::Cursor c;
+        HistoryLog::Sample s;
+        size_t i = lowerBound(ref, log.firstTime());
+        uint32_t last = 0;
+        if (log.seek(0, c))
+            for (; log.next(c, s); i++)
+            {
+                TEST_ASSERT_TRUE(i < ref.size());
+                TEST_ASSERT_TRUE(same(s, ref[i]));
+                last = s.time;
+            }
+        TEST_ASSERT_TRUE(last + HistoryLog::maxChunkAge + 10 >= ref.back().time);
+        if (ref.back().time - last > worstLoss)
+            worstLoss = ref.back().time - last;
+
+        // and on it goes, after the last sample that survived
+        for (int k = 0; k < 100; k++)
+            TEST_ASSERT_TRUE(log.append(src.next(10)));
+        TEST_ASSERT_TRUE(log.flush());
+        HistoryLog again(flash);
+        TEST_ASSERT_TRUE(again.begin());
+        TEST_ASSERT_EQUAL(src.time, again.lastTime());
+    }
+    printf("300 power cuts, at most %u s of samples lost\n", (unsigned)worstLoss);
+}
+
+// Three months at 1 Hz on the real partition size
+void test_wear_at_one_hertz()
+{
+    const uint32_t days = 90;
+    RamFlashRegion flash(partitionPages);
+    HistoryLog log(flash);
+    log.begin();
+    Source src(5);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < days * 86400; i++)
+        TEST_ASSERT_TRUE(log.append(src.next(1)));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t worst = 0;
+    for (size_t p = 0; p < partitionPages; p++)
+        if (flash.sectorErases(p) > worst)
+            worst = flash.sectorErases(p);
+    double perDay = (double)worst / days;
+    double bytesPerSample = (double)flash.bytesWritten() / log.stats().appended;
+    double keptDays = (double)(log.lastTime() - log.firstTime()) / 86400;
+    printf("%u days at 1 Hz: %.0f samples/s appended, %.2f bytes/sample, %.1f days kept, "
+           "worst sector %u erases (%.2f/day, 100k cycles in %.0f years)\n",
+           (unsigned)days, log.stats().appended / seconds, bytesPerSample, keptDays, (unsigned)worst, perDay,
+           100000 / perDay / 365);
+
+    // the header's promise: less than one erase per sector and day
+    TEST_ASSERT_LESS_OR_EQUAL(days, worst);
+    // and the wear is even: the ring touches every page alike
+    for (size_t p = 0; p < partitionPages; p++)
+        TEST_ASSERT_GREATER_OR_EQUAL(worst - 1, flash.sectorErases(p));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wrap_around_and_seek);
+    RUN_TEST(test_live_tail);
+    RUN_TEST(test_power_cuts);
+    RUN_TEST(test_wear_at_one_hertz);
+    return UNITY_END();
+}
@@ -0,0 +1,448 @@
+// MetricsStore on a RAM flash model: memory budget, three days of data,
+// reboot recovery and power cuts
+//
+// The test keeps its own model of what each tier should hold: the seconds
+// rows as fed (a single skipped second repeats the previous row), and the
+// minute and hour rows built from the same samples with the rounding
+// MetricsStore::emit() documents. summary() over a range must match the
+// model exactly.
+
+#include <stdio.h>
+#include <map>
+#include <random>
+#include <vector>
+#include <MetricsStore.h>
+#include <RamFlashRegion.h>
+#include <unity.h>
+
+namespace
+{
+struct Row
+{
+    uint16_t v, i, p, run, vMax, iMax;
+};
+
+typedef std::map<uint32_t, Row> Rows; // by time
+
+// What the three tiers should hold, fed alongside the store
+struct Model
+{
+    Rows tiers[MetricsStore::tierCount];
+    struct Acc
+    {
+        uint32_t period = 0, v = 0, i = 0, p = 0, run = 0, n = 0;
+        uint16_t vMax = 0, iMax = 0;
+    } acc[MetricsStore::tierCount];
+    uint32_t last = 0;
+
+    void emit(uint8_t tier)
+    {
+        Acc &a = acc[tier];
+        if (!a.n)
+            return;
+        uint32_t n = a.n;
+        Row r = {(uint16_t)((a.v + n / 2) / n), (uint16_t)((a.i + n / 2) / n), (uint16_t)((a.p + n / 2) / n),
+                 (uint16_t)((a.run * 60 + n / 2) / n), a.vMax, a.iMax};
+        tiers[tier][a.period * (tier == MetricsStore::Minutes ? 60 : 3600)] = r;
+        a = Acc();
+    }
+
+    void add(uint32_t t, const Row &r)
+    {
+        if (last && t <= last)
+            return; // a clock set back, dropped as by the store
+        if (last && t == last + 2)
+            tiers[MetricsStore::Seconds][t - 1] = tiers[MetricsStore::Seconds][last];
+        tiers[MetricsStore::Seconds][t] = r;
+        last = t;
+        for (uint8_t tier = MetricsStore::Minutes; tier <= MetricsStore::Hours; tier++)
+        {
+            uint32_t period = t / (tier == MetricsStore::Minutes ? 60 : 3600);
+            Acc &a = acc[tier];
+            if (a.n && a.period != period)
+                emit(tier);
+            a.period = period;
+            a.v += r.v;
+            a.i += r.i;
+            a.p += r.p;
+            a.run += r.run;
+            a.vMax = r.v > a.vMax ? r.v : a.vMax;
+            a.iMax = r.i > a.iMax ? r.i : a.iMax;
+            a.n++;
+        }
+    }
+
+    MetricsStore::Summary summary(uint8_t tier, uint32_t from, uint32_t to) const
+    {
+        uint64_t v = 0, i = 0, p = 0, run = 0;
+        uint16_t vMax = 0, iMax = 0;
+        uint32_t rows = 0;
+        const Rows &rs = tiers[tier];
+        for (Rows::const_iterator it = rs.lower_bound(from); it != rs.end() && it->first < to; ++it)
+        {
+            const Row &r = it->second;
+            rows++;
+            v += r.v;
+            i += r.i;
+            p += r.p;
+            run += r.run;
+            uint16_t rv = tier == MetricsStore::Seconds ? r.v : r.vMax;
+            uint16_t ri = tier == MetricsStore::Seconds ? r.i : r.iMax;
+            vMax = rv > vMax ? rv : vMax;
+            iMax = ri > iMax ? ri : iMax;
+        }
+        MetricsStore::Summary s;
+        s.rows = rows;
+        s.voltageAvg = rows ? (uint32_t)v / 10.0f / rows : 0;
+        s.voltageMax = vMax / 10.0f;
+        s.currentAvg = rows ? (uint32_t)i / 100.0f / rows : 0;
+        s.currentMax = iMax / 100.0f;
+        s.powerAvg = rows ? (float)(uint32_t)p / rows : 0;
+        s.runSeconds = (uint32_t)run * MetricsStore::runScale((MetricsStore::Tier)tier);
+        return s;
+    }
+};
+
+// Flash regions the size of m_sec, m_min and m_hour, or smaller ones
+struct Regions
+{
+    RamFlashRegion seconds, minutes, hours;
+
+    Regions(size_t s = MetricsStore::secondsPages, size_t m = MetricsStore::minutesPages,
+            size_t h = MetricsStore::hoursPages)
+        : seconds(s), minutes(m), hours(h)
+    {
+    }
+
+    void cutAfter(long n)
+    {
+        seconds.cutAfter(n);
+        minutes.cutAfter(n);
+        hours.cutAfter(n);
+    }
+
+    void powerOn()
+    {
+        seconds.powerOn();
+        minutes.powerOn();
+        hours.powerOn();
+    }
+
+    bool powerCut() const { return seconds.powerCut() || minutes.powerCut() || hours.powerCut(); }
+};
+
+// A pump running the first 10 minutes of every hour
+Row sample(uint32_t t)
+{
+    bool run = t % 3600 < 600;
+    Row r;
+    r.v = 2300 + t % 10;
+    r.i = run ? 500 + t % 7 : 0;
+    r.p = run ? 1000 + t % 50 : 0;
+    r.run = run;
+    r.vMax = r.v;
+    r.iMax = r.i;
+    return r;
+}
+
+void feed(MetricsStore &m, Model &model, uint32_t t, const Row &r)
+{
+    m.add(t, r.v / 10.0f, r.i / 100.0f, r.p, r.run);
+    model.add(t, r);
+}
+
+void checkSummary(const MetricsStore &m, const Model &model, MetricsStore::Tier tier, uint32_t from, uint32_t to)
+{
+    MetricsStore::Summary got = m.summary(tier, from, to);
+    MetricsStore::Summary want = model.summary(tier, from, to);
+    TEST_ASSERT_EQUAL(want.rows, got.rows);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, want.voltageAvg, got.voltageAvg);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, want.voltageMax, got.voltageMax);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, want.currentAvg, got.currentAvg);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, want.currentMax, got.currentMax);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, want.powerAvg, got.powerAvg);
+    TEST_ASSERT_EQUAL(want.runSeconds, got.runSeconds);
+}
+
+// Rows with data from a scan, to hold against the page index
+uint32_t scanRows(const MetricsTier &tier, uint32_t from, uint32_t to)
+{
+    uint32_t rows = 0;
+    tier.scan(from, to, [&](const MetricsTier::Block &b) {
+        for (uint16_t i = 0; i < b.rows; i++)
+            rows += b.col[0][i] <= MetricsTier::maxValue;
+    });
+    return rows;
+}
+
+const uint32_t t0 = 1700000000;
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// The RAM budget holds and the partitions keep what the header promises
+void test_ram_budget_and_retention()
+{
+    Regions *r = new Regions;
+    MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+    TEST_ASSERT_TRUE(m->begin());
+    printf("sizeof(MetricsStore) %u bytes, budget %u\n", (unsigned)sizeof(MetricsStore),
+           (unsigned)MetricsStore::ramBudget);
+    TEST_ASSERT_LESS_OR_EQUAL(MetricsStore::ramBudget, sizeof(MetricsStore));
+
+    const MetricsTier &sec = m->tier(MetricsStore::Seconds);
+    const MetricsTier &min = m->tier(MetricsStore::Minutes);
+    const MetricsTier &hour = m->tier(MetricsStore::Hours);
+    TEST_ASSERT_EQUAL(MetricsStore::secondsPages, sec.pages());
+    TEST_ASSERT_EQUAL(MetricsStore::minutesPages, min.pages());
+    TEST_ASSERT_EQUAL(MetricsStore::hoursPages, hour.pages());
+    TEST_ASSERT_GREATER_OR_EQUAL(86400, sec.capacity());
+    TEST_ASSERT_GREATER_OR_EQUAL(30 * 1440, min.capacity());
+    TEST_ASSERT_GREATER_OR_EQUAL(366 * 24, hour.capacity());
+    delete m;
+    delete r;
+}
+
+// Three days at 1 Hz with skipped seconds and an outage; the seconds ring
+// wraps, every tier's summaries match the model
+void test_three_days()
+{
+    Regions *r = new Regions;
+    MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+    TEST_ASSERT_TRUE(m->begin());
+    Model *model = new Model;
+
+    const uint32_t end = t0 + 3 * 86400;
+    const uint32_t outage = t0 + 86400 + 5000; // 20 minutes without readings
+    for (uint32_t t = t0; t < end; t++)
+    {
+        if (t % 97 == 0 || (t >= outage && t < outage + 1200))
+            continue;
+        Row row = sample(t);
+        if (t == end - 4000)
+            row.v = 2550; // one spike
+        feed(*m, *model, t, row);
+    }
+    m->flush();
+    TEST_ASSERT_EQUAL(end, m->endTime());
+    TEST_ASSERT_GREATER_THAN(MetricsStore::secondsPages, r->seconds.erases()); // the seconds ring wrapped
+
+    checkSummary(*m, *model, MetricsStore::Seconds, end - 86400, end);
+    checkSummary(*m, *model, MetricsStore::Minutes, t0, end);
+    checkSummary(*m, *model, MetricsStore::Hours, t0, end);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 255.0f, m->summary(MetricsStore::Seconds, end - 86400, end).voltageMax);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 255.0f, m->summary(MetricsStore::Hours, t0, end).voltageMax); // not averaged away
+
+    std::mt19937 rng(7);
+    for (int q = 0; q < 200; q++)
+    {
+        uint32_t a = end - 86400 + rng() % 86400, b = end - 86400 + rng() % 86400;
+        checkSummary(*m, *model, MetricsStore::Seconds, a < b ? a : b, a < b ? b : a);
+        a = t0 + rng() % (3 * 86400);
+        b = t0 + rng() % (3 * 86400);
+        checkSummary(*m, *model, MetricsStore::Minutes, a < b ? a : b, a < b ? b : a);
+    }
+    printf("3 days: erases %u s, %u min, %u h\n", (unsigned)r->seconds.erases(), (unsigned)r->minutes.erases(),
+           (unsigned)r->hours.erases());
+
+    delete model;
+    delete m;
+    delete r;
+}
+
+// A reboot rebuilds the indexes from flash: the same answers, and the
+// store carries on where it stopped
+void test_reboot_recovery()
+{
+    Regions *r = new Regions(20, 10, 4);
+    Model *model = new Model;
+    const uint32_t end = t0 + 6 * 3600;
+    MetricsStore::Summary before[MetricsStore::tierCount];
+    {
+        MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+        m->begin();
+        for (uint32_t t = t0; t < end; t++)
+            feed(*m, *model, t, sample(t));
+        m->flush();
+        for (uint8_t tier = 0; tier < MetricsStore::tierCount; tier++)
+            before[tier] = m->summary((MetricsStore::Tier)tier, t0, end);
+        delete m;
+    }
+
+    MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+    TEST_ASSERT_TRUE(m->begin());
+    TEST_ASSERT_EQUAL(end, m->endTime());
+    for (uint8_t tier = 0; tier < MetricsStore::tierCount; tier++)
+    {
+        MetricsStore::Summary after = m->summary((MetricsStore::Tier)tier, t0, end);
+        TEST_ASSERT_EQUAL(before[tier].rows, after.rows);
+        TEST_ASSERT_TRUE(before[tier].voltageAvg == after.voltageAvg);
+        TEST_ASSERT_TRUE(before[tier].currentMax == after.currentMax);
+        TEST_ASSERT_EQUAL(before[tier].runSeconds, after.runSeconds);
+    }
+    checkSummary(*m, *model, MetricsStore::Seconds, end - 3600, end);
+
+    // an hour later (the pump controller was off), logging goes on
+    const uint32_t resume = end + 3600;
+    for (uint32_t t = resume; t < resume + 1800; t++)
+    {
+        Row row = sample(t);
+        m->add(t, row.v / 10.0f, row.i / 100.0f, row.p, row.run);
+    }
+    m->flush();
+    TEST_ASSERT_EQUAL(1800, m->summary(MetricsStore::Seconds, resume, resume + 1800).rows);
+    TEST_ASSERT_EQUAL(0, m->summary(MetricsStore::Seconds, end, resume).rows);
+
+    delete m;
+    delete model;
+    delete r;
+}
+
+// The clock steps back (an SNTP correction) just after the seconds tier
+// opened a page, and again after a reboot: nothing is stored out of order,
+// and logging resumes once the clock passes the last sample
+void test_clock_set_back()
+{
+    Regions *r = new Regions(6, 4, 4);
+    Model *model = new Model;
+    const MetricsTier *sec;
+    uint32_t t = t0;
+    {
+        MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+        m->begin();
+        sec = &m->tier(MetricsStore::Seconds);
+        for (int step = 0; step < 3; step++)
+        {
+            uint16_t pages = sec->pagesUsed();
+            while (sec->pagesUsed() == pages)
+                feed(*m, *model, t, sample(t)), t++;
+            for (int i = 0; i < 5; i++)
+                feed(*m, *model, t, sample(t)), t++;
+
+            uint32_t end = m->endTime();
+            for (uint32_t back = t - 200; back < t + 300; back++)
+                feed(*m, *model, back, sample(back));
+            TEST_ASSERT_EQUAL(end + 300, m->endTime()); // only the seconds past the old end
+            t += 300;
+        }
+        m->flush();
+        for (uint8_t tier = 0; tier < MetricsStore::tierCount; tier++)
+            checkSummary(*m, *model, (MetricsStore::Tier)tier, t0, t);
+        delete m;
+    }
+
+    // after a reboot the store has no last sample; the tiers still refuse
+    MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+    TEST_ASSERT_TRUE(m->begin());
+    uint32_t end = m->endTime();
+    for (uint32_t back = end - 3000; back < end + 600; back++)
+        m->add(back, 230, 1, 230, true);
+    m->flush();
+    TEST_ASSERT_EQUAL(end + 600, m->endTime());
+    TEST_ASSERT_EQUAL(600, m->summary(MetricsStore::Seconds, end, end + 600).rows);
+
+    // pages stay in time order: the index agrees with a scan everywhere
+    std::mt19937 rng(3);
+    for (uint8_t tier = 0; tier < MetricsStore::tierCount; tier++)
+        for (int q = 0; q < 200; q++)
+        {
+            uint32_t a = t0 + rng() % (end + 600 - t0), b = a + rng() % (end + 700 - a);
+            TEST_ASSERT_EQUAL(scanRows(m->tier((MetricsStore::Tier)tier), a, b),
+                              m->summary((MetricsStore::Tier)tier, a, b).rows);
+        }
+
+    delete m;
+    delete model;
+    delete r;
+}
+
+// Power cuts at random points: whatever survives matches the model row
+// for row, at most the unflushed minute is lost, and logging goes on
+void test_power_cuts()
+{
+    std::mt19937 rng(11);
+    for (int run = 0; run < 300; run++)
+    {
+        Regions *r = new Regions(4, 4, 4);
+        Model *model = new Model;
+        uint32_t t = t0 + rng() % 3600;
+        uint32_t cutAt = 0;
+        {
+            MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+            m->begin();
+            uint32_t stop = t + 300 + rng() % 3000;
+            for (; t < stop; t++)
+                feed(*m, *model, t, sample(t));
+
+            r->cutAfter(rng() % 1000);
+            for (; !r->powerCut(); t++)
+                feed(*m, *model, t, sample(t));
+            cutAt = t;
+            delete m;
+            r->powerOn();
+        }
+
+        MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+        TEST_ASSERT_TRUE(m->begin());
+        const MetricsTier &sec = m->tier(MetricsStore::Seconds);
+        TEST_ASSERT_TRUE(m->endTime() + 2 * 60 >= cutAt);
+
+        // every stored seconds row is the one fed at its time
+        const Rows &want = model->tiers[MetricsStore::Seconds];
+        uint32_t rows = 0;
+        sec.scan(0, 0xFFFFFFFF, [&](const MetricsTier::Block &b) {
+            for (uint16_t i = 0; i < b.rows; i++)
+            {
+                if (b.col[MetricsStore::colVoltage][i] > MetricsTier::maxValue)
+                    continue;
+                Rows::const_iterator it = want.find(b.time + i);
+                TEST_ASSERT_TRUE(it != want.end());
+                TEST_ASSERT_EQUAL(it->second.v, b.col[MetricsStore::colVoltage][i]);
+                TEST_ASSERT_EQUAL(it->second.i, b.col[MetricsStore::colCurrent][i]);
+                TEST_ASSERT_EQUAL(it->second.p, b.col[MetricsStore::colPower][i]);
+                TEST_ASSERT_EQUAL(it->second.run, b.col[MetricsStore::colRun][i]);
+                rows++;
+            }
+        });
+        TEST_ASSERT_EQUAL(rows, m->summary(MetricsStore::Seconds, 0, 0xFFFFFFFF).rows);
+
+        // the minute rows that made it are whole
+        const Rows &minutes = model->tiers[MetricsStore::Minutes];
+        m->tier(MetricsStore::Minutes).scan(0, 0xFFFFFFFF, [&](const MetricsTier::Block &b) {
+            for (uint16_t i = 0; i < b.rows; i++)
+            {
+                if (b.col[MetricsStore::colVoltage][i] > MetricsTier::maxValue)
+                    continue;
+                Rows::const_iterator it = minutes.find(b.time + i * 60);
+                TEST_ASSERT_TRUE(it != minutes.end());
+                TEST_ASSERT_EQUAL(it->second.v, b.col[MetricsStore::colVoltage][i]);
+                TEST_ASSERT_EQUAL(it->second.run, b.col[MetricsStore::colRun][i]);
+                TEST_ASSERT_EQUAL(it->second.vMax, b.col[MetricsStore::colVoltageMax][i]);
+            }
+        });
+
+        // and on it goes
+        uint32_t resume = cutAt + 600;
+        for (uint32_t s = resume; s < resume + 100; s++)
+            m->add(s, 230, 1, 230, true);
+        m->flush();
+        TEST_ASSERT_EQUAL(100, m->summary(MetricsStore::Seconds, resume, resume + 100).rows);
+
+        delete m;
+        delete model;
+        delete r;
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ram_budget_and_retention);
+    RUN_TEST(test_three_days);
+    RUN_TEST(test_reboot_recovery);
+    RUN_TEST(test_clock_set_back);
+    RUN_TEST(test_power_cuts);
+    return UNITY_END();
+}
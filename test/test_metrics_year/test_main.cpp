@@ -0,0 +1,145 @@
+// MetricsTier range aggregates over a simulated year, against a full scan
+//
+// A year of 1 Hz samples goes through MetricsStore on RAM flash the size
+// of the partitions. Then 2000 random ranges per tier are answered twice:
+// by aggregate() (the page index plus the two boundary pages) and by a
+// scan() of every row in the range. Both must agree exactly, also on a
+// store that rebuilt its index from flash after a reboot. The time per
+// query of each is printed.
+
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <MetricsStore.h>
+#include <RamFlashRegion.h>
+#include <unity.h>
+
+namespace
+{
+struct Regions
+{
+    RamFlashRegion seconds, minutes, hours;
+
+    Regions() : seconds(MetricsStore::secondsPages), minutes(MetricsStore::minutesPages), hours(MetricsStore::hoursPages)
+    {
+    }
+};
+
+// The same aggregate, row by row
+MetricsTier::Aggregate scanAggregate(const MetricsTier &tier, uint32_t from, uint32_t to)
+{
+    MetricsTier::Aggregate a = MetricsTier::Aggregate();
+    uint8_t columns = tier.layout().columns;
+    tier.scan(from, to, [&](const MetricsTier::Block &b) {
+        for (uint16_t i = 0; i < b.rows; i++)
+        {
+            if (b.col[0][i] > MetricsTier::maxValue)
+                continue;
+            a.rows++;
+            for (uint8_t c = 0; c < columns; c++)
+            {
+                a.sum[c] += b.col[c][i];
+                if (b.col[c][i] > a.max[c])
+                    a.max[c] = b.col[c][i];
+            }
+        }
+    });
+    return a;
+}
+
+bool same(const MetricsTier::Aggregate &a, const MetricsTier::Aggregate &b, uint8_t columns)
+{
+    if (a.rows != b.rows)
+        return false;
+    for (uint8_t c = 0; c < columns; c++)
+        if (a.sum[c] != b.sum[c] || (a.rows && a.max[c] != b.max[c]))
+            return false;
+    return true;
+}
+
+const uint32_t t0 = 1700000000;
+const uint32_t yearSeconds = 366 * 86400;
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// A year of data, 2000 ranges per tier, index and scan side by side
+void test_year_of_range_queries()
+{
+    Regions *r = new Regions;
+    MetricsStore *m = new MetricsStore(r->seconds, r->minutes, r->hours);
+    TEST_ASSERT_TRUE(m->begin());
+
+    // a pump running a quarter of every two hours, noisy readings, and a
+    // second lost now and then
+    std::mt19937 rng(1);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < yearSeconds; k++)
+    {
+        if (k % 1000 == 7)
+            continue;
+        uint32_t t = t0 + k;
+        bool run = t % 7200 < 900;
+        float voltage = 220 + rng() % 300 * 0.1f;
+        m->add(t, voltage, run ? 4 + rng() % 100 * 0.01f : 0, run ? 900 + rng() % 200 : 0, run);
+    }
+    m->flush();
+    double fill = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("a year at 1 Hz stored in %.1f s\n", fill);
+    uint32_t end = t0 + yearSeconds;
+
+    MetricsStore *rebooted = new MetricsStore(r->seconds, r->minutes, r->hours);
+    TEST_ASSERT_TRUE(rebooted->begin());
+
+    const int queries = 2000;
+    const char *names[] = {"seconds", "minutes", "hours"};
+    for (uint8_t t = 0; t < MetricsStore::tierCount; t++)
+    {
+        const MetricsTier &tier = m->tier((MetricsStore::Tier)t);
+        const MetricsTier &again = rebooted->tier((MetricsStore::Tier)t);
+        uint8_t columns = tier.layout().columns;
+        // ranges anywhere in what the tier holds, up to all of it
+        uint32_t held = tier.capacity() * tier.layout().step;
+        double indexed = 0, scanned = 0;
+        for (int q = 0; q < queries; q++)
+        {
+            uint32_t from = end - held + rng() % held;
+            uint32_t to = from + rng() % (end - from + 100);
+            MetricsTier::Aggregate a, b;
+
+            auto s0 = std::chrono::steady_clock::now();
+            tier.aggregate(from, to, a);
+            auto s1 = std::chrono::steady_clock::now();
+            MetricsTier::Aggregate want = scanAggregate(tier, from, to);
+            auto s2 = std::chrono::steady_clock::now();
+            indexed += std::chrono::duration<double>(s1 - s0).count();
+            scanned += std::chrono::duration<double>(s2 - s1).count();
+
+            TEST_ASSERT_TRUE(same(a, want, columns));
+            again.aggregate(from, to, b);
+            TEST_ASSERT_TRUE(same(b, want, columns));
+        }
+        printf("%s tier, %u pages: aggregate %.1f us, scan %.1f us per range (%.0fx)\n", names[t],
+               (unsigned)tier.pages(), indexed / queries * 1e6, scanned / queries * 1e6, scanned / indexed);
+    }
+
+    // last year by the hour, up to the last complete hour
+    uint32_t hour = end / 3600 * 3600;
+    MetricsStore::Summary y = m->summary(MetricsStore::Hours, hour - 365 * 86400, hour);
+    TEST_ASSERT_EQUAL(365 * 24, y.rows);
+    TEST_ASSERT_TRUE(y.voltageMax > 249 && y.voltageMax < 250);
+    TEST_ASSERT_UINT32_WITHIN(3600, 365 * 12 * 900, y.runSeconds);
+
+    delete rebooted;
+    delete m;
+    delete r;
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_year_of_range_queries);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+// SettingsStore power-fail safety: a power cut at every byte of a commit
+//
+// For each commit under test the flash is copied, the power is cut after
+// 0, 1, 2, ... programmed bytes and erases (RamFlashRegion::cutAfter),
+// and a new store boots from what is left. Every cut must reload exactly
+// the settings before the commit or the ones after it, and the rebooted
+// store must be able to commit again. The commits cover journal appends,
+// multi-record commits and the compaction into the other slot.
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <RamFlashRegion.h>
+#include <SettingsStore.h>
+#include <unity.h>
+
+namespace
+{
+struct Settings
+{
+    float overVoltage = 250;
+    float underVoltage = 180;
+    float overCurrent = 6.5;
+    uint16_t onDelay = 5;
+    uint16_t offDelay = 15;
+    bool autoMode = false;
+    bool buzzer = true;
+};
+
+bool same(const Settings &a, const Settings &b)
+{
+    return a.overVoltage == b.overVoltage && a.underVoltage == b.underVoltage && a.overCurrent == b.overCurrent &&
+           a.onDelay == b.onDelay && a.offDelay == b.offDelay && a.autoMode == b.autoMode && a.buzzer == b.buzzer;
+}
+
+// The next settings of a sequence: one field, or fields far apart
+Settings edit(Settings s, int step)
+{
+    s.overVoltage += 1;
+    if (step % 3 == 0)
+        s.autoMode = !s.autoMode;
+    if (step % 7 == 0)
+        s.onDelay += 300; // both bytes
+    return s;
+}
+
+unsigned long cutsTried;
+
+// Cut the power at every point of committing next over flash holding cur.
+// Leaves flash with next committed.
+void cutEverywhere(RamFlashRegion &flash, const Settings &cur, const Settings &next, bool blank)
+{
+    for (long k = 0;; k++)
+    {
+        RamFlashRegion f = flash;
+        SettingsStore<Settings> store(f, 1);
+        Settings s;
+        TEST_ASSERT_EQUAL(!blank, store.load(s, Settings()));
+        TEST_ASSERT_TRUE(same(s, cur));
+        store.stage(next);
+
+        f.cutAfter(k);
+        bool ok = store.commit();
+        bool complete = ok && !f.powerCut();
+        f.powerOn();
+        cutsTried++;
+
+        // reboot on whatever the cut left
+        RamFlashRegion g = f;
+        SettingsStore<Settings> rebooted(g, 1);
+        Settings r;
+        bool valid = rebooted.load(r, Settings());
+        char where[64];
+        snprintf(where, sizeof(where), "cut after %ld bytes and erases", k);
+        TEST_ASSERT_TRUE_MESSAGE(same(r, cur) || same(r, next), where);
+        TEST_ASSERT_TRUE_MESSAGE(valid || blank, where);
+        if (complete)
+            TEST_ASSERT_TRUE_MESSAGE(same(r, next), where);
+
+        // and it can still save
+        Settings later = edit(next, 1);
+        rebooted.stage(later);
+        TEST_ASSERT_TRUE_MESSAGE(rebooted.commit(), where);
+        SettingsStore<Settings> again(g, 1);
+        TEST_ASSERT_TRUE_MESSAGE(again.load(r, Settings()), where);
+        TEST_ASSERT_TRUE_MESSAGE(same(r, later), where);
+
+        if (complete)
+        {
+            flash = f; // continue from the finished commit
+            return;
+        }
+    }
+}
+} // namespace
+
+void setUp()
+{
+    hostMillis() = 0;
+}
+
+void tearDown() {}
+
+// The very first commit on blank flash: defaults or the new settings
+void test_cut_during_first_commit()
+{
+    RamFlashRegion flash(2);
+    Settings defaults;
+    cutEverywhere(flash, defaults, edit(defaults, 0), true);
+}
+
+// Journal appends, single and multi-record, and the compactions between them
+void test_cut_at_every_byte_of_many_commits()
+{
+    RamFlashRegion flash(2);
+    Settings cur;
+    {
+        // a journal nearly full, so the commits below also switch slots
+        SettingsStore<Settings> store(flash, 1);
+        store.load(cur, Settings());
+        store.commit();
+        for (int i = 0; i < 330; i++)
+        {
+            cur = edit(cur, i);
+            store.stage(cur);
+            store.commit();
+        }
+    }
+
+    uint32_t erasesBefore = flash.erases();
+    for (int step = 0; step < 60; step++)
+    {
+        Settings next = edit(cur, step);
+        cutEverywhere(flash, cur, next, false);
+        cur = next;
+    }
+    TEST_ASSERT_GREATER_THAN(erasesBefore, flash.erases()); // a compaction was among them
+    printf("%lu power cuts\n", cutsTried);
+}
+
+// A bad snapshot in the newest slot falls back to the other slot
+void test_corrupt_newest_slot_falls_back()
+{
+    RamFlashRegion flash(2);
+    Settings first, second;
+    {
+        SettingsStore<Settings> store(flash, 1);
+        store.load(first, Settings());
+        first.overCurrent = 8;
+        store.stage(first);
+        store.commit(); // slot A
+
+        // fill the journal until the store moves to slot B
+        second = first;
+        uint32_t compactions = store.stats().compactions;
+        while (store.stats().compactions == compactions)
+        {
+            second = edit(second, 1);
+            store.stage(second);
+            store.commit();
+        }
+        TEST_ASSERT_EQUAL(1, store.stats().slot);
+    }
+
+    // slot B's snapshot starts after its header
+    flash.data()[FlashRegion::sectorSize + 24] ^= 0x01;
+
+    SettingsStore<Settings> store(flash, 1);
+    Settings r;
+    TEST_ASSERT_TRUE(store.load(r, Settings()));
+    TEST_ASSERT_EQUAL(0, store.stats().slot);
+    TEST_ASSERT_EQUAL(8, r.overCurrent); // an older, complete state, not a mix
+
+    // the next commit goes on from there
+    r.buzzer = false;
+    store.stage(r);
+    TEST_ASSERT_TRUE(store.commit());
+    SettingsStore<Settings> rebooted(flash, 1);
+    Settings a;
+    TEST_ASSERT_TRUE(rebooted.load(a, Settings()));
+    TEST_ASSERT_TRUE(same(r, a));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_cut_during_first_commit);
+    RUN_TEST(test_cut_at_every_byte_of_many_commits);
+    RUN_TEST(test_corrupt_newest_slot_falls_back);
+    return UNITY_END();
+}
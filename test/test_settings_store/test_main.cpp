@@ -0,0 +1,293 @@
+// SettingsStore on a RAM flash model: write coalescing and erase counts
+//
+// The store is meant to erase a sector only when a journal fills up, and
+// to alternate between its two sectors when it does. These tests run it
+// through many menu edits on RamFlashRegion and count what reaches flash.
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <RamFlashRegion.h>
+#include <SettingsStore.h>
+#include <unity.h>
+
+namespace
+{
+struct Settings
+{
+    float overVoltage = 250;
+    float underVoltage = 180;
+    float overCurrent = 6.5;
+    uint16_t onDelay = 5;
+    uint16_t offDelay = 15;
+    bool autoMode = false;
+    bool buzzer = true;
+};
+
+// Schema 2 appends a field
+struct Settings2
+{
+    Settings v1;
+    uint16_t dryRunSeconds = 30;
+};
+
+const unsigned long commitDelay = 3000;
+
+bool same(const Settings &a, const Settings &b)
+{
+    return a.overVoltage == b.overVoltage && a.underVoltage == b.underVoltage && a.overCurrent == b.overCurrent &&
+           a.onDelay == b.onDelay && a.offDelay == b.offDelay && a.autoMode == b.autoMode && a.buzzer == b.buzzer;
+}
+
+// Journal bytes for one record carrying n changed bytes
+size_t recordBytes(size_t n)
+{
+    return (6 + n + 3) & ~size_t(3);
+}
+
+void advance(unsigned long ms)
+{
+    hostMillis() += ms;
+}
+} // namespace
+
+void setUp()
+{
+    hostMillis() = 1000;
+}
+
+void tearDown() {}
+
+// Blank flash: defaults, written once after the quiet period
+void test_first_boot_writes_defaults_once()
+{
+    RamFlashRegion flash(2);
+    SettingsStore<Settings> store(flash, 1, commitDelay);
+    Settings s;
+    TEST_ASSERT_FALSE(store.load(s, Settings()));
+    TEST_ASSERT_TRUE(store.dirty());
+
+    store.poll(millis());
+    TEST_ASSERT_EQUAL(0, flash.erases()); // boot is not the time to write
+    advance(commitDelay);
+    store.poll(millis());
+    TEST_ASSERT_EQUAL(1, flash.erases());
+    TEST_ASSERT_FALSE(store.dirty());
+    TEST_ASSERT_EQUAL(1, store.stats().compactions);
+
+    SettingsStore<Settings> reboot(flash, 1, commitDelay);
+    Settings r;
+    TEST_ASSERT_TRUE(reboot.load(r, Settings()));
+    TEST_ASSERT_TRUE(same(s, r));
+    TEST_ASSERT_FALSE(reboot.dirty());
+}
+
+// A burst of edits inside the quiet period costs one commit
+void test_edits_are_deferred_and_coalesced()
+{
+    RamFlashRegion flash(2);
+    SettingsStore<Settings> store(flash, 1, commitDelay);
+    Settings s;
+    store.load(s, Settings());
+    store.commit();
+    uint32_t written = flash.bytesWritten();
+
+    for (int i = 0; i < 20; i++)
+    {
+        s.overVoltage += 1;
+        store.stage(s);
+        advance(100);
+        store.poll(millis());
+    }
+    TEST_ASSERT_EQUAL(written, flash.bytesWritten()); // nothing yet
+    TEST_ASSERT_TRUE(store.dirty());
+
+    advance(commitDelay);
+    store.poll(millis());
+    TEST_ASSERT_FALSE(store.dirty());
+    TEST_ASSERT_EQUAL(2, store.stats().commits);
+    TEST_ASSERT_EQUAL(1, store.stats().records); // one record, with the final value
+    TEST_ASSERT_GREATER_THAN(written, flash.bytesWritten());
+    TEST_ASSERT_LESS_OR_EQUAL(written + recordBytes(sizeof(float)), flash.bytesWritten());
+    TEST_ASSERT_EQUAL(1, flash.erases());
+
+    // staging the committed value back costs nothing
+    store.stage(s);
+    TEST_ASSERT_FALSE(store.dirty());
+}
+
+// Only the changed bytes are written; nearby changes share a record
+void test_only_changed_bytes_are_written()
+{
+    RamFlashRegion flash(2);
+    SettingsStore<Settings> store(flash, 1, commitDelay);
+    Settings s;
+    store.load(s, Settings());
+    store.commit();
+
+    uint32_t written = flash.bytesWritten();
+    s.buzzer = false;
+    store.stage(s);
+    TEST_ASSERT_TRUE(store.commit());
+    TEST_ASSERT_EQUAL(written + recordBytes(1), flash.bytesWritten());
+
+    // onDelay and offDelay are adjacent: one record over both
+    written = flash.bytesWritten();
+    uint32_t records = store.stats().records;
+    s.onDelay = 7;
+    s.offDelay = 20;
+    store.stage(s);
+    TEST_ASSERT_TRUE(store.commit());
+    TEST_ASSERT_EQUAL(records + 1, store.stats().records);
+    TEST_ASSERT_EQUAL(written + recordBytes(4), flash.bytesWritten());
+
+    // fields far apart: two records
+    records = store.stats().records;
+    s.overVoltage = 240;
+    s.autoMode = true;
+    store.stage(s);
+    TEST_ASSERT_TRUE(store.commit());
+    TEST_ASSERT_EQUAL(records + 2, store.stats().records);
+}
+
+// Thousands of edits: erases only when a journal fills, spread over both sectors
+void test_erase_count_over_many_edits()
+{
+    RamFlashRegion flash(2);
+    Settings s;
+    const int edits = 5000;
+    {
+        SettingsStore<Settings> store(flash, 1, commitDelay);
+        store.load(s, Settings());
+        store.commit();
+
+        for (int i = 0; i < edits; i++)
+        {
+            s.overVoltage += 0.5f;
+            if (i % 3 == 0)
+                s.onDelay++;
+            store.stage(s);
+            advance(commitDelay + 1000);
+            store.poll(millis());
+        }
+        TEST_ASSERT_FALSE(store.dirty());
+
+        const SettingsStore<Settings>::Stats &st = store.stats();
+        TEST_ASSERT_EQUAL(edits + 1, st.commits);
+        TEST_ASSERT_EQUAL(flash.erases(), st.lifetimeErases);
+        TEST_ASSERT_EQUAL(flash.erases(), st.compactions);
+
+        // every commit is one or two small records; a full journal costs one erase
+        size_t perCommit = recordBytes(sizeof(float)) + recordBytes(sizeof(uint16_t));
+        uint32_t bound = edits * perCommit / st.journalSize + 2;
+        printf("%d edits: %u erases (%u, %u), %u bytes written\n", edits, (unsigned)flash.erases(),
+               (unsigned)flash.sectorErases(0), (unsigned)flash.sectorErases(1), (unsigned)flash.bytesWritten());
+        TEST_ASSERT_LESS_OR_EQUAL(bound, flash.erases());
+        TEST_ASSERT_GREATER_THAN(2, flash.erases()); // the journal did fill up
+
+        // the two sectors wear alike
+        int32_t skew = (int32_t)flash.sectorErases(0) - (int32_t)flash.sectorErases(1);
+        TEST_ASSERT_TRUE(skew >= -1 && skew <= 1);
+
+        // a whole-struct rewrite per save would have cost an erase every
+        // journalSize / sizeof(Settings) edits
+        TEST_ASSERT_LESS_THAN(edits * sizeof(Settings) / st.journalSize, flash.erases());
+    }
+
+    // the lifetime count survives a reboot and keeps counting
+    uint32_t before = flash.erases();
+    SettingsStore<Settings> store(flash, 1, commitDelay);
+    Settings r;
+    TEST_ASSERT_TRUE(store.load(r, Settings()));
+    TEST_ASSERT_TRUE(same(s, r));
+    TEST_ASSERT_EQUAL(before, store.stats().lifetimeErases);
+}
+
+// An older schema loads into the new layout, new fields keep their defaults
+void test_schema_upgrade_keeps_old_fields()
+{
+    RamFlashRegion flash(2);
+    Settings s;
+    {
+        SettingsStore<Settings> store(flash, 1, commitDelay);
+        store.load(s, Settings());
+        s.overCurrent = 9.25f;
+        s.autoMode = true;
+        store.stage(s);
+        store.commit();
+    }
+
+    SettingsStore<Settings2> store(flash, 2, commitDelay);
+    Settings2 r;
+    TEST_ASSERT_TRUE(store.load(r, Settings2()));
+    TEST_ASSERT_TRUE(same(s, r.v1));
+    TEST_ASSERT_EQUAL(30, r.dryRunSeconds);
+    TEST_ASSERT_TRUE(store.dirty()); // rewritten in the new layout
+
+    r.dryRunSeconds = 45;
+    store.stage(r);
+    store.commit();
+    SettingsStore<Settings2> again(flash, 2, commitDelay);
+    Settings2 a;
+    TEST_ASSERT_TRUE(again.load(a, Settings2()));
+    TEST_ASSERT_FALSE(again.dirty());
+}
+
+// A rollback to firmware that only knows schema 1 reads its part of the
+// newer settings, writes nothing on its own, and the upgrade finds them all
+void test_schema_rollback_keeps_newer_settings()
+{
+    RamFlashRegion flash(2);
+    Settings2 n;
+    {
+        SettingsStore<Settings2> store(flash, 2, commitDelay);
+        store.load(n, Settings2());
+        n.v1.overCurrent = 9.25f;
+        n.v1.autoMode = true;
+        n.dryRunSeconds = 45;
+        store.stage(n);
+        store.commit();
+    }
+
+    uint32_t erases = flash.erases();
+    uint32_t written = flash.bytesWritten();
+    Settings o;
+    {
+        SettingsStore<Settings> old(flash, 1, commitDelay);
+        TEST_ASSERT_TRUE(old.load(o, Settings()));
+        TEST_ASSERT_TRUE(same(n.v1, o));
+        TEST_ASSERT_EQUAL_FLOAT(9.25f, o.overCurrent);
+        TEST_ASSERT_TRUE(o.autoMode);
+        TEST_ASSERT_FALSE(old.dirty());
+        advance(commitDelay);
+        old.poll(millis());
+        TEST_ASSERT_EQUAL(erases, flash.erases());
+        TEST_ASSERT_EQUAL(written, flash.bytesWritten());
+
+        // an edit on the old firmware goes into the journal, not over the slot
+        o.buzzer = false;
+        old.stage(o);
+        advance(commitDelay);
+        old.poll(millis());
+        TEST_ASSERT_FALSE(old.dirty());
+        TEST_ASSERT_EQUAL(erases, flash.erases());
+    }
+
+    SettingsStore<Settings2> upgraded(flash, 2, commitDelay);
+    Settings2 r;
+    TEST_ASSERT_TRUE(upgraded.load(r, Settings2()));
+    TEST_ASSERT_FALSE(upgraded.dirty());
+    TEST_ASSERT_TRUE(same(o, r.v1));
+    TEST_ASSERT_EQUAL(45, r.dryRunSeconds);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_boot_writes_defaults_once);
+    RUN_TEST(test_edits_are_deferred_and_coalesced);
+    RUN_TEST(test_only_changed_bytes_are_written);
+    RUN_TEST(test_erase_count_over_many_edits);
+    RUN_TEST(test_schema_upgrade_keeps_old_fields);
+    RUN_TEST(test_schema_rollback_keeps_newer_settings);
+    return UNITY_END();
+}
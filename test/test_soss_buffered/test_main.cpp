@@ -0,0 +1,242 @@
+// SendOnlySoftwareSerialBuffered's timer interrupt on stub registers
+//
+// The source is built here as for an ATmega328 at 16 MHz, against the
+// register stand-ins of test/host/avr. The test plays Timer2: each call
+// of the compare vector is one bit time, and the level the handler
+// leaves on PORTD is the line for that bit. The line is decoded the way
+// a UART would and compared with what was written, in both polarities,
+// with bytes queued while a frame is on the line up to a full buffer.
+// It also checks the timer setup and the stats() the handler keeps.
+
+#include <vector>
+#include <Arduino.h>
+#include <SendOnlySoftwareSerialBuffered.h>
+#include <unity.h>
+
+#define __AVR__ 1
+#define F_CPU 16000000UL
+// pins 0 to 7 are PD0 to PD7 and 8 to 13 PB0 to PB5, as on the Uno
+#define PB 2
+#define PD 4
+#define digitalPinToBitMask(pin) _BV((pin) & 7)
+#define digitalPinToPort(pin) ((pin) < 8 ? PD : PB)
+#define portOutputRegister(port) ((port) == PD ? &PORTD : &PORTB)
+#include <SendOnlySoftwareSerialBuffered.cpp>
+
+namespace
+{
+const uint8_t pin = 3;
+
+// One level per bit time, until the handler stops the timer
+std::vector<int> run()
+{
+    std::vector<int> line;
+    while (TIMSK2 & _BV(OCIE2A))
+    {
+        TEST_ASSERT_TRUE(line.size() < 100000);
+        TCNT2 = 12; // the timer has counted the interrupt's own time
+        TIMER2_COMPA_vect();
+        line.push_back(PORTD >> pin & 1);
+    }
+    return line;
+}
+
+// The bytes on the line, and how many idle bit times separate them
+std::vector<uint8_t> decode(const std::vector<int> &line, bool inverse, unsigned &gaps)
+{
+    std::vector<uint8_t> bytes;
+    gaps = 0;
+    for (size_t i = 0; i < line.size();)
+    {
+        if ((line[i] ^ inverse) != 0)
+        {
+            if (!bytes.empty() && i + 1 < line.size())
+                gaps++;
+            i++;
+            continue;
+        }
+        TEST_ASSERT_TRUE(i + 10 <= line.size());
+        uint8_t b = 0;
+        for (int k = 0; k < 8; k++)
+            b |= (line[i + 1 + k] ^ inverse) << k;
+        TEST_ASSERT_EQUAL(1, line[i + 9] ^ inverse); // stop bit
+        bytes.push_back(b);
+        i += 10;
+    }
+    return bytes;
+}
+
+void idle(bool inverse)
+{
+    // the host digitalWrite() does not reach PORTD
+    if (inverse)
+        PORTD &= ~_BV(pin);
+    else
+        PORTD |= _BV(pin);
+}
+} // namespace
+
+void setUp()
+{
+    hostAvr().reset();
+}
+
+void tearDown() {}
+
+// Timer2 in CTC mode with the smallest prescaler that fits a bit
+void test_timer_setup()
+{
+    SendOnlySoftwareSerialBuffered s(pin);
+    s.begin(9600);
+    TEST_ASSERT_EQUAL(_BV(WGM21), TCCR2A);
+    TEST_ASSERT_EQUAL(2, TCCR2B); // clk/8
+    TEST_ASSERT_EQUAL(207, OCR2A); // 208 ticks of 0.5 us
+    TEST_ASSERT_EQUAL(9615, s.actualBaud());
+    TEST_ASSERT_FALSE(TIMSK2 & _BV(OCIE2A)); // no interrupts while idle
+    TEST_ASSERT_EQUAL(_BV(SREG_I), SREG);
+
+    // too fast for the interrupt: refused, and write() says so
+    SendOnlySoftwareSerialBuffered fast(pin);
+    fast.begin(115200);
+    TEST_ASSERT_EQUAL(0, fast.actualBaud());
+    TEST_ASSERT_EQUAL(0, fast.write('x'));
+}
+
+// Frames decode in both polarities, and the timer stops after the last
+// stop bit has had its time
+void test_both_polarities()
+{
+    const char text[] = "Pump \x00\xff\x55 on";
+    const size_t n = sizeof(text) - 1;
+    for (int inverse = 0; inverse < 2; inverse++)
+    {
+        hostAvr().reset();
+        idle(inverse);
+        SendOnlySoftwareSerialBuffered s(pin, inverse);
+        s.begin(9600);
+        TEST_ASSERT_EQUAL(n, s.write((const uint8_t *)text, n));
+        TEST_ASSERT_TRUE(TIMSK2 & _BV(OCIE2A));
+        TEST_ASSERT_EQUAL(SOSS_TX_BUFFER_SIZE - n, s.availableForWrite()); // the first is in the shifter
+
+        std::vector<int> line = run();
+        unsigned gaps;
+        std::vector<uint8_t> got = decode(line, inverse, gaps);
+        TEST_ASSERT_EQUAL(n, got.size());
+        TEST_ASSERT_EQUAL_MEMORY(text, got.data(), n);
+        TEST_ASSERT_EQUAL(0, gaps); // back to back
+        TEST_ASSERT_EQUAL(10 * n + 1, line.size());
+        TEST_ASSERT_EQUAL(!inverse, line.back());
+
+        SendOnlySoftwareSerialBuffered::Stats st = s.stats();
+        TEST_ASSERT_EQUAL(n, st.bytes);
+        TEST_ASSERT_EQUAL(10 * n + 1, st.interrupts);
+        TEST_ASSERT_EQUAL(12 << 3, st.maxIsrCycles);
+        TEST_ASSERT_EQUAL((10 * n + 1) * (12 << 3) / n, s.cyclesPerByte());
+    }
+}
+
+// Bytes written while a frame is on the line follow it without a gap, up
+// to a full buffer; with interrupts off a write to a full buffer is dropped
+void test_queue_fills_mid_byte()
+{
+    for (int inverse = 0; inverse < 2; inverse++)
+    {
+        hostAvr().reset();
+        idle(inverse);
+        SendOnlySoftwareSerialBuffered s(pin, inverse);
+        s.begin(4800);
+        std::vector<uint8_t> sent;
+        sent.push_back(0xA5);
+        s.write(0xA5);
+
+        // four bits of the first frame, then fill the queue
+        std::vector<int> line;
+        for (int k = 0; k < 4; k++)
+        {
+            TIMER2_COMPA_vect();
+            line.push_back(PORTD >> pin & 1);
+        }
+        for (int i = 0; i < SOSS_TX_BUFFER_SIZE - 1; i++)
+        {
+            sent.push_back(i * 37);
+            TEST_ASSERT_EQUAL(1, s.write(i * 37));
+        }
+        TEST_ASSERT_EQUAL(0, s.availableForWrite());
+        cli();
+        TEST_ASSERT_EQUAL(0, s.write('!'));
+        sei();
+        TEST_ASSERT_TRUE(s.overflow());
+        TEST_ASSERT_EQUAL(1, s.stats().overflows);
+
+        // two more bits, then the rest
+        for (int k = 0; k < 2; k++)
+        {
+            TIMER2_COMPA_vect();
+            line.push_back(PORTD >> pin & 1);
+        }
+        std::vector<int> rest = run();
+        line.insert(line.end(), rest.begin(), rest.end());
+        unsigned gaps;
+        std::vector<uint8_t> got = decode(line, inverse, gaps);
+        TEST_ASSERT_EQUAL(sent.size(), got.size());
+        TEST_ASSERT_EQUAL_MEMORY(sent.data(), got.data(), sent.size());
+        TEST_ASSERT_EQUAL(0, gaps);
+        TEST_ASSERT_EQUAL(SOSS_TX_BUFFER_SIZE, s.stats().bytes);
+    }
+}
+
+// A byte queued while the last stop bit is out goes after it, with the
+// stop bit at least one bit time long
+void test_write_during_stop_bit()
+{
+    idle(false);
+    SendOnlySoftwareSerialBuffered s(pin);
+    s.begin(9600);
+    s.write('a');
+    std::vector<int> line;
+    for (int k = 0; k < 10; k++) // start, 8 data, stop
+    {
+        TIMER2_COMPA_vect();
+        line.push_back(PORTD >> pin & 1);
+    }
+    TEST_ASSERT_EQUAL(1, line.back());
+    s.write('b');
+    std::vector<int> rest = run();
+    line.insert(line.end(), rest.begin(), rest.end());
+    unsigned gaps;
+    std::vector<uint8_t> got = decode(line, false, gaps);
+    TEST_ASSERT_EQUAL(2, got.size());
+    TEST_ASSERT_EQUAL('a', got[0]);
+    TEST_ASSERT_EQUAL('b', got[1]);
+    TEST_ASSERT_EQUAL(1, gaps); // the stop bit had its full time first
+}
+
+// end() mid-frame: timer off, line back to idle
+void test_end_mid_frame()
+{
+    for (int inverse = 0; inverse < 2; inverse++)
+    {
+        hostAvr().reset();
+        idle(inverse);
+        SendOnlySoftwareSerialBuffered s(pin, inverse);
+        s.begin(9600);
+        s.write((uint8_t)0);
+        TIMER2_COMPA_vect(); // start bit
+        TEST_ASSERT_EQUAL(inverse, PORTD >> pin & 1);
+        s.end();
+        TEST_ASSERT_FALSE(TIMSK2 & _BV(OCIE2A));
+        TEST_ASSERT_EQUAL(!inverse, PORTD >> pin & 1);
+        TEST_ASSERT_EQUAL(0, s.write('x'));
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_timer_setup);
+    RUN_TEST(test_both_polarities);
+    RUN_TEST(test_queue_fills_mid_byte);
+    RUN_TEST(test_write_during_stop_bit);
+    RUN_TEST(test_end_mid_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+// SendOnlySoftwareSerial's host backend (SOSS_BACKEND_MOCK)
+//
+// What a test of code printing to a SendOnlySoftwareSerial relies on:
+// Print's formatting arrives byte for byte in sent(), levelAt() gives the
+// frames as the hardware backends drive the line, in both polarities,
+// sentMicros() their time at the begin() rate, and the capture and
+// not-begun cases report as the real backends do.
+
+#include <SendOnlySoftwareSerial.h>
+#include <unity.h>
+
+namespace
+{
+// The bytes a receiver gets from levels levelAt(from) onwards
+size_t decode(const SendOnlySoftwareSerial &s, size_t from, uint8_t *out, size_t max, bool inverse)
+{
+    size_t n = 0;
+    for (size_t bit = from; n < max; bit += 10)
+    {
+        if ((s.levelAt(bit) ^ inverse) != 0)
+            break; // no start bit: idle
+        uint8_t b = 0;
+        for (int k = 0; k < 8; k++)
+            b |= (s.levelAt(bit + 1 + k) ^ inverse) << k;
+        TEST_ASSERT_EQUAL(1, s.levelAt(bit + 9) ^ inverse);
+        out[n++] = b;
+    }
+    return n;
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// print() and println() through Print, recorded as sent
+void test_print_is_recorded()
+{
+    SendOnlySoftwareSerial s(3);
+    s.begin(9600);
+    s.print("U=");
+    s.println(230);
+    s.print(-7);
+    s.print(0x2Au, HEX);
+    TEST_ASSERT_EQUAL(11, s.sentCount());
+    TEST_ASSERT_EQUAL_MEMORY("U=230\r\n-72A", s.sent(), 11);
+
+    s.clearSent();
+    TEST_ASSERT_EQUAL(0, s.sentCount());
+    TEST_ASSERT_EQUAL(3, s.write((const uint8_t *)"abc", 3));
+    TEST_ASSERT_EQUAL_MEMORY("abc", s.sent(), 3);
+}
+
+// Start bit, 8 data bits LSB first, stop bit, then idle; inverted on request
+void test_levels_of_a_frame()
+{
+    SendOnlySoftwareSerial s(3), inv(4, true);
+    s.begin(9600);
+    inv.begin(9600);
+    s.write(0x35);
+    inv.write(0x35);
+    const int frame[] = {0, 1, 0, 1, 0, 1, 1, 0, 0, 1, 1, 1};
+    for (size_t n = 0; n < sizeof(frame) / sizeof(frame[0]); n++)
+    {
+        TEST_ASSERT_EQUAL(frame[n], s.levelAt(n));
+        TEST_ASSERT_EQUAL(!frame[n], inv.levelAt(n));
+    }
+
+    const char text[] = "levels \x00\xff\x80";
+    uint8_t got[16];
+    SendOnlySoftwareSerial *both[] = {&s, &inv};
+    for (SendOnlySoftwareSerial *p : both)
+    {
+        bool inverse = p == &inv;
+        p->clearSent();
+        p->write((const uint8_t *)text, sizeof(text) - 1);
+        TEST_ASSERT_EQUAL(sizeof(text) - 1, decode(*p, 0, got, sizeof(got), inverse));
+        TEST_ASSERT_EQUAL_MEMORY(text, got, sizeof(text) - 1);
+        TEST_ASSERT_EQUAL(!inverse, p->levelAt(10 * (sizeof(text) - 1) + 100));
+    }
+}
+
+// Ten bits per byte at the begin() rate
+void test_sent_micros()
+{
+    SendOnlySoftwareSerial s(3);
+    TEST_ASSERT_EQUAL(0, s.sentMicros());
+    s.begin(9600);
+    for (int i = 0; i < 96; i++)
+        s.write('x');
+    TEST_ASSERT_EQUAL(100000, s.sentMicros());
+    s.clearSent();
+    s.write('x');
+    TEST_ASSERT_EQUAL(1041, s.sentMicros()); // 1041.7, rounded down
+
+    s.begin(115200);
+    for (int i = 0; i < 144; i++)
+        s.write('x');
+    TEST_ASSERT_EQUAL(12500, s.sentMicros());
+}
+
+// Not begun: nothing sent, a write error. Past the capture: overflow()
+void test_not_begun_and_overflow()
+{
+    SendOnlySoftwareSerial s(3);
+    TEST_ASSERT_EQUAL(0, s.write('a'));
+    TEST_ASSERT_TRUE(s.getWriteError() != 0);
+    TEST_ASSERT_EQUAL(0, s.sentCount());
+
+    s.clearWriteError();
+    s.begin(9600);
+    for (int i = 0; i < SOSS_MOCK_CAPTURE_SIZE; i++)
+        TEST_ASSERT_EQUAL(1, s.write((uint8_t)i));
+    TEST_ASSERT_FALSE(s.overflow());
+    TEST_ASSERT_EQUAL(1, s.write('z')); // goes out, but is not recorded
+    TEST_ASSERT_TRUE(s.overflow());
+    TEST_ASSERT_FALSE(s.overflow()); // reading clears it
+    TEST_ASSERT_EQUAL(SOSS_MOCK_CAPTURE_SIZE, s.sentCount());
+    TEST_ASSERT_EQUAL(SOSS_MOCK_CAPTURE_SIZE - 1, s.sent()[SOSS_MOCK_CAPTURE_SIZE - 1]);
+    TEST_ASSERT_EQUAL(0, s.getWriteError());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_print_is_recorded);
+    RUN_TEST(test_levels_of_a_frame);
+    RUN_TEST(test_sent_micros);
+    RUN_TEST(test_not_begun_and_overflow);
+    return UNITY_END();
+}
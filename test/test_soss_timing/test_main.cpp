@@ -0,0 +1,113 @@
+// SendOnlySoftwareSerialT timing, the sosscycles check as a test
+//
+// The template's bit timing exists only as cycle counts in
+// SendOnlyTiming.h and inline assembler. tools/sosscycles models both
+// (SossModel.h): its -c run executes the assembler instruction by
+// instruction and compares every edge with what SendOnlyTiming.h says.
+// This runs the same check over the clocks and rates the template is
+// used at, and fails on any row that would not be received: every rate
+// the template accepts (feasible() and offsetPermille() within
+// SOSS_MAX_OFFSET_PERMILLE) must come out ok, a delay too long for the
+// 16-bit loop must be refused, and the classic
+// SendOnlySoftwareSerial with the loop overheads of the current compiler
+// must not fail at 8 MHz and up.
+
+#include <stdio.h>
+#include <SendOnlyTiming.h>
+#include <unity.h>
+#include "../../tools/sosscycles/SossModel.h"
+
+using namespace sossmodel;
+
+namespace
+{
+const std::vector<uint32_t> clocks = {1000000, 2000000, 4000000, 8000000, 12000000, 16000000, 16500000, 20000000};
+const std::vector<uint32_t> bauds = {300,   600,   1200,  2400,  4800,  9600,   14400,  19200,
+                                     28800, 31250, 38400, 57600, 76800, 115200, 230400, 250000};
+
+bool accepted(uint32_t fcpu, uint32_t baud)
+{
+    return soss::feasible(fcpu, baud) && soss::offsetPermille(fcpu, baud) <= SOSS_MAX_OFFSET_PERMILLE;
+}
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+// sosscycles -c: the instruction level run against SendOnlyTiming.h
+void test_model_matches_timing_header()
+{
+    TEST_ASSERT_EQUAL(0, selfCheck(clocks, bauds));
+}
+
+// No rate the template compiles for is marginal or fails
+void test_accepted_rates_are_ok()
+{
+    Template model;
+    int rates = 0;
+    for (uint32_t fcpu : clocks)
+        for (uint32_t baud : bauds)
+        {
+            if (!accepted(fcpu, baud))
+                continue;
+            Result r = analyse(model, fcpu, baud);
+            if (strcmp(verdict(r, SOSS_MAX_OFFSET_PERMILLE), "ok") != 0)
+                printf("%.2f MHz %lu baud: edge %.0f margin %.0f stop %.0f, %s\n", fcpu / 1e6, (unsigned long)baud,
+                       r.edge, r.margin, r.stop, verdict(r, SOSS_MAX_OFFSET_PERMILLE));
+            TEST_ASSERT_EQUAL_STRING("ok", verdict(r, SOSS_MAX_OFFSET_PERMILLE));
+            rates++;
+        }
+    printf("%d accepted rates ok\n", rates);
+    // the common ones are all accepted: 300 to 115200 baud from 8 MHz up
+    for (uint32_t fcpu : {8000000u, 16000000u, 16500000u, 20000000u})
+        for (uint32_t baud : {300u, 9600u, 57600u, 115200u})
+            TEST_ASSERT_TRUE(accepted(fcpu, baud));
+}
+
+// Slow rates whose start delay needs more than 0xFFFF loop passes are
+// refused, not wrapped into a short delay
+void test_delay_loop_range()
+{
+    // startDelay() 262141 cycles: 65535 passes and 0 nops, the longest
+    TEST_ASSERT_TRUE(soss::feasible(262146, 1));
+    TEST_ASSERT_EQUAL(0xFFFF, soss::delayLoops(soss::startDelay(soss::bitCycles(262146, 1))));
+    // 4 cycles more would take 65536 passes
+    TEST_ASSERT_FALSE(soss::feasible(262150, 1));
+    TEST_ASSERT_FALSE(soss::feasible(20000000, 75));
+    TEST_ASSERT_TRUE(soss::feasible(20000000, 300));
+    TEST_ASSERT_FALSE(soss::feasible(20000000, 0));
+
+    // and the model agrees: no frame where the loop would wrap
+    Template model;
+    Frame f;
+    TEST_ASSERT_FALSE(model.frame(20000000, 75, 0x55, f));
+    TEST_ASSERT_TRUE(model.frame(262146, 1, 0x55, f));
+    TEST_ASSERT_EQUAL(9 * 262146L, f.write[slots - 1]);
+}
+
+// The classic transmitter, gcc 4.8 overheads, at the usual clocks
+void test_classic_rates_do_not_fail()
+{
+    Classic model("gcc-4.8", 12, 15, 12);
+    for (uint32_t fcpu : {8000000u, 16000000u, 16500000u, 20000000u})
+        for (uint32_t baud : {300u, 1200u, 2400u, 4800u, 9600u, 19200u, 38400u, 57600u, 115200u})
+        {
+            Result r = analyse(model, fcpu, baud);
+            TEST_ASSERT_TRUE(r.feasible);
+            if (strcmp(verdict(r, SOSS_MAX_OFFSET_PERMILLE), "FAIL") == 0)
+                printf("%.2f MHz %lu baud: edge %.0f margin %.0f stop %.0f\n", fcpu / 1e6, (unsigned long)baud,
+                       r.edge, r.margin, r.stop);
+            TEST_ASSERT_TRUE(strcmp(verdict(r, SOSS_MAX_OFFSET_PERMILLE), "FAIL") != 0);
+        }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_model_matches_timing_header);
+    RUN_TEST(test_accepted_rates_are_ok);
+    RUN_TEST(test_delay_loop_range);
+    RUN_TEST(test_classic_rates_do_not_fail);
+    return UNITY_END();
+}
@@ -0,0 +1,203 @@
+// SwitchManagerWithFilterISR on synthetic bounce patterns
+//
+// The test plays the pin change interrupt: it sets the pin level and the
+// time (test/host/Arduino.h) and calls onEdge(), then check() replays the
+// queue. Each case checks which changes are reported, when, and with
+// which interval.
+
+#include <Arduino.h>
+#include <SwitchManagerWithFilterISR.h>
+#include <unity.h>
+
+namespace
+{
+const byte pin = 2;
+
+struct Report
+{
+    byte state;
+    unsigned long interval;
+    unsigned long time; // millis() when reported
+};
+
+Report reports[32];
+unsigned count;
+
+void onSwitch(const byte newState, const unsigned long interval, const byte whichPin)
+{
+    TEST_ASSERT_EQUAL(pin, whichPin);
+    if (count < sizeof(reports) / sizeof(reports[0]))
+        reports[count] = Report{newState, interval, millis()};
+    count++;
+}
+
+SwitchManagerWithFilterISR *sw;
+
+void edge(unsigned long at, byte level)
+{
+    hostMillis() = at;
+    hostPins().level[pin] = level;
+    sw->onEdge();
+}
+
+void checkAt(unsigned long at)
+{
+    hostMillis() = at;
+    sw->check();
+}
+} // namespace
+
+void setUp()
+{
+    hostPins().reset();
+    hostMillis() = 0;
+    count = 0;
+    sw = new SwitchManagerWithFilterISR;
+    sw->begin(pin, onSwitch);
+}
+
+void tearDown()
+{
+    delete sw;
+}
+
+// A bounce train settles low: one report, timed from the last bounce
+void test_bounce_train_gives_one_change()
+{
+    edge(100, LOW);
+    edge(101, HIGH);
+    edge(102, LOW);
+    edge(103, HIGH);
+    edge(104, LOW);
+
+    checkAt(110);
+    TEST_ASSERT_EQUAL(0, count); // held 6 ms so far
+
+    checkAt(120);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(LOW, reports[0].state);
+    TEST_ASSERT_EQUAL(104, reports[0].interval);
+
+    checkAt(500);
+    TEST_ASSERT_EQUAL(1, count);
+}
+
+// A pulse shorter than debounceTime is noise
+void test_short_glitch_is_filtered()
+{
+    edge(200, LOW);
+    edge(203, HIGH);
+    checkAt(300);
+    TEST_ASSERT_EQUAL(0, count);
+
+    // also when check() runs in the middle of it
+    edge(400, LOW);
+    checkAt(405);
+    edge(409, HIGH);
+    checkAt(430);
+    TEST_ASSERT_EQUAL(0, count);
+}
+
+// A whole press between two check() calls is still seen, with its length
+void test_press_between_checks_is_kept()
+{
+    edge(400, LOW);
+    edge(415, HIGH);
+    checkAt(500);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(LOW, reports[0].state);
+    TEST_ASSERT_EQUAL(HIGH, reports[1].state);
+    TEST_ASSERT_EQUAL(15, reports[1].interval);
+}
+
+// Bouncing on release does not restart the press
+void test_release_bounce()
+{
+    edge(100, LOW);
+    checkAt(150);
+    TEST_ASSERT_EQUAL(1, count);
+
+    edge(300, HIGH);
+    edge(302, LOW);
+    edge(303, HIGH);
+    edge(305, LOW);
+    edge(306, HIGH);
+    checkAt(320);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(HIGH, reports[1].state);
+    TEST_ASSERT_EQUAL(206, reports[1].interval);
+}
+
+// More edges than the queue holds: dropped edges resynchronise from the pin
+void test_overflow_resynchronises()
+{
+    // a long burst that ends where it started, high; the queue keeps the
+    // first 15 edges, the last of them low
+    unsigned long t = 1000;
+    for (int i = 0; i < 40; i++)
+        edge(t++, i & 1 ? HIGH : LOW);
+
+    checkAt(t + 1);
+    checkAt(t + 50);
+    TEST_ASSERT_EQUAL(0, count); // the low from the queue is not taken for a press
+
+    // the queue works again after the overflow
+    edge(t + 100, LOW);
+    checkAt(t + 200);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(LOW, reports[0].state);
+}
+
+// Random bounce around clean presses, check() at random times
+void test_random_bounce_matches_presses()
+{
+    uint32_t seed = 12345;
+    auto random = [&seed](uint32_t n) {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % n;
+    };
+
+    unsigned long t = 100, nextCheck = 100;
+    unsigned presses = 0;
+    for (int press = 0; press < 200; press++)
+    {
+        byte level = LOW;
+        for (int k = 0; k < 2; k++)
+        {
+            // up to 5 bounces 0..2 ms apart, then the new level; a whole
+            // press fits the queue even if no check() falls inside it
+            unsigned bounces = random(6);
+            for (unsigned b = 0; b < bounces; b++)
+            {
+                edge(t, b & 1 ? !level : level);
+                t += random(3);
+            }
+            edge(t, level);
+            t += 20 + random(200);
+            while (nextCheck < t)
+            {
+                checkAt(nextCheck);
+                nextCheck += 1 + random(60);
+            }
+            level = HIGH;
+        }
+        presses++;
+    }
+    checkAt(t + 100);
+
+    TEST_ASSERT_EQUAL(2 * presses, count);
+    for (unsigned i = 0; i < count && i < 32; i++)
+        TEST_ASSERT_EQUAL(i & 1 ? HIGH : LOW, reports[i].state);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bounce_train_gives_one_change);
+    RUN_TEST(test_short_glitch_is_filtered);
+    RUN_TEST(test_press_between_checks_is_kept);
+    RUN_TEST(test_release_bounce);
+    RUN_TEST(test_overflow_resynchronises);
+    RUN_TEST(test_random_bounce_matches_presses);
+    return UNITY_END();
+}
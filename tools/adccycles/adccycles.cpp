@@ -0,0 +1,442 @@
+// Cycle and accuracy check of the ATtiny controller's ADC to mA scaling
+//
+// supportFiles/main1.cpp used to scale its readings every 1 ms tick:
+//
+//   adcToMAx1000 = (vccMV * 1000L) / (1023L * 66L);       long * and /
+//   centerMA = (centerADC * adcToMAx1000) / 1000;          int * and /
+//   rangeMA = (rangeADC * adcToMAx1000) / 2000;            int * and /
+//   currentMA = ((long)currentRmsX16 * adcToMAx1000) / 16000;
+//
+// The ATtiny85 has no multiplier and no divider, so each of those is a
+// libgcc loop. It now scales with AdcScale (lib/PumpGuard/AdcScale.h): a
+// Q8 factor, made anew only when Vcc drifts, and a 16 x 16 bit multiply
+// and a shift per reading, once per RMS window instead of every tick.
+//
+// There is no AVR simulator here, so adccycles steps through the libgcc
+// routines for devices without MUL (__mulhi3, __mulsi3, __umulhisi3,
+// __udivmodhi4, __udivmodsi4 and the signed wrappers) with the real
+// operands, counting each instruction's cycles on the ATtiny85 (rcall 3,
+// ret 4, movw 1). The call site gets a flat 4 cycles for moving the
+// arguments, 32-bit shifts what avr-gcc -Os unrolls them to. Which operand
+// the multiply loop shifts through is up to the compiler, so a multiply
+// costs the worse of the two orders. The negation paths of the signed
+// division are estimated.
+//
+// For each Vcc it prints the cycles of the old scaling per tick, the new
+// one per RMS window and per tick on average, and the worst error in mA
+// of either against the exact conversion: the old one counted in whole
+// amps (adcToMAx1000 is mA per count, not a thousandth of it) and its
+// 16-bit products wrapped for pot readings above about 440. Exits 1 if
+// the new scaling is off by more than 1 mA + 0.01%, or AdcScale::set()
+// takes back a factor that is not its own.
+//
+// Then the ADC interrupt, which runs AcRms::add() for every conversion
+// and squares an oversampled sample every 4^bits of them. Its worst case
+// is the squaring one with the worst |d|, plus the Timer1 transmit and the
+// millis interrupts nesting inside it once each; all of it has to fit in
+// one conversion (F_CPU / 64 * 13 = 832 cycles), or the next conversion
+// waits. The old handler squared d sign-extended with __mulsi3, 32 rounds
+// for any negative d, and left ADIE on, so an overrun re-entered it and
+// tore the sums. The entry, register saves and the rest of add() are
+// estimated from the shape of avr-gcc -Os code, the nested handlers' cost
+// is -x (SendOnlySoftwareSerialBuffered::stats().maxIsrCycles measures the
+// first on the board). Exits 1 if the new worst case does not fit.
+//
+//   g++ -O2 -std=c++11 -I../../lib/PumpGuard adccycles.cpp -o adccycles
+//
+//   adccycles [-w window ms] [-b oversample bits] [-x tx,millis cycles] [-v]
+//     default: 80 ms (4 cycles of 50 Hz), 1 bit, 140,90; -v adds the
+//     routines per reading
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AdcScale.h"
+
+namespace
+{
+const long callCycles = 4; // argument and result moves at a call site
+const uint16_t mVPerAmp = 66;
+const uint16_t toleranceMV = 50;
+const long conversionCycles = 64 * 13; // ADC clock F_CPU / 64, 13 clocks
+
+// ADC interrupt around add(), estimates: response 4 and the vector's rjmp
+// 2; r0, r1, SREG and the 12 call-clobbered registers __umulhisi3 may use
+// saved and restored, 4 cycles each, reti 4; reading ADC, ADIE off, sei,
+// cli and ADIE on again 12
+const long isrFrameCycles = 4 + 2 + 15 * 4 + 2 + 1 + 4 + 12;
+// add() without the square: the volatile 16- and 32-bit sums, loaded and
+// stored each time, the compares, the shift to the oversampled value
+const long addCycles = 90;
+const long absCycles = 4; // sbrs, neg, com, adc
+
+// libgcc __mulhi3 without MUL: shift and add until the multiplier is 0 or
+// the multiplicand has been shifted out
+long mulhi3(uint16_t a, uint16_t b, uint16_t &r)
+{
+    long c = 2; // clr, clr
+    r = 0;
+    for (;;)
+    {
+        if (a & 1)
+        {
+            r += b;
+            c += 2 + 2; // sbrs skips the rjmp, add, adc
+        }
+        else
+            c += 1 + 2; // sbrs, rjmp
+        b <<= 1;
+        c += 2 + 2; // add, adc; cp, cpc
+        if (!b)
+        {
+            c += 2; // breq taken
+            break;
+        }
+        c += 1;
+        a >>= 1;
+        c += 2 + 2; // lsr, ror; sbiw
+        if (!a)
+        {
+            c += 1; // brne falls through
+            break;
+        }
+        c += 2;
+    }
+    return c + 2 + 4; // mov, mov, ret
+}
+
+// libgcc __mulsi3 without MUL: A shifts right, B left, until A is 0
+long mulsi3(uint32_t a, uint32_t b, uint32_t &r)
+{
+    long c = 4 + 2; // clr x4, rjmp
+    r = 0;
+    for (;;)
+    {
+        bool carry = a & 1;
+        a >>= 1;
+        c += 4; // lsr, ror x3
+        if (carry)
+        {
+            r += b;
+            b <<= 1;
+            c += 2 + 4 + 4; // brcs taken, add/adc x4, lsl/rol x4
+            continue;
+        }
+        c += 1 + 1; // brcs, sbci
+        if (a & 0xFFFF)
+        {
+            b <<= 1;
+            c += 2 + 4;
+            continue;
+        }
+        c += 1 + 2; // brne, sbiw
+        if (a >> 16)
+        {
+            b <<= 1;
+            c += 2 + 4;
+            continue;
+        }
+        c += 1;
+        break;
+    }
+    return c + 2 + 4; // movw x2, ret
+}
+
+long worstMulsi3(uint32_t a, uint32_t b, uint32_t &r)
+{
+    long c1 = mulsi3(a, b, r), c2 = mulsi3(b, a, r);
+    return c1 > c2 ? c1 : c2;
+}
+
+long worstMulhi3(uint16_t a, uint16_t b, uint16_t &r)
+{
+    long c1 = mulhi3(a, b, r), c2 = mulhi3(b, a, r);
+    return c1 > c2 ? c1 : c2;
+}
+
+// __umulhisi3: zero-extend both, then __mulsi3
+long umulhisi3(uint16_t a, uint16_t b, uint32_t &r)
+{
+    return 1 + 2 + 1 + 2 + worstMulsi3(a, b, r); // movw, clr x2, movw, rjmp
+}
+
+// libgcc restoring division: the dividend shifts through the remainder,
+// the quotient bits come in inverted and are complemented at the end
+long udivmod(uint32_t n, uint32_t d, int bits, uint32_t &q)
+{
+    const int bytes = bits / 8;
+    const uint32_t top = bits == 32 ? 0x80000000UL : (uint32_t)1 << (bits - 1);
+    const uint32_t mask = bits == 32 ? 0xFFFFFFFFUL : ((uint32_t)1 << bits) - 1;
+    long c = bits == 32 ? 1 + 2 + 2 : 2 + 1 + 2; // clear the remainder, ldi, rjmp
+    uint32_t a = n, rem = 0;
+    bool carry = false;
+    for (int cnt = bits + 1;;)
+    {
+        // entry point: shift the dividend, quotient bit in
+        bool out = a & top;
+        a = ((a << 1) | carry) & mask;
+        carry = out;
+        c += bytes + 1; // rol per byte, dec
+        if (!--cnt)
+        {
+            c += 1;
+            break;
+        }
+        c += 2;
+        rem = ((rem << 1) | carry) & mask;
+        c += 2 * bytes; // rol, cp/cpc per byte
+        if (rem < d)
+        {
+            carry = true;
+            c += 2; // brcs taken
+        }
+        else
+        {
+            rem -= d;
+            carry = false;
+            c += 1 + bytes; // brcs, sub/sbc per byte
+        }
+    }
+    q = ~a & mask;
+    return c + bytes + bytes + 4; // com per byte, movw per pair x2, ret
+}
+
+// __divmodsi4 / __divmodhi4: signs, the unsigned routine, sign fixes
+long divmod(int32_t n, int32_t d, int bits, int32_t &q)
+{
+    long c = bits == 32 ? 19 : 17; // both operands positive
+    bool neg = n < 0;
+    if (neg)
+        c += bits == 32 ? 14 + 13 + 12 : 10 + 9 + 2; // negate, fix quotient and remainder
+    uint32_t uq;
+    c += udivmod(neg ? -(uint32_t)n : n, d, bits, uq);
+    q = neg ? -(int32_t)uq : (int32_t)uq;
+    return c;
+}
+
+struct Cost
+{
+    long cycles = 0;
+    char detail[256] = "";
+
+    void add(const char *name, long c)
+    {
+        cycles += c + callCycles + 3; // rcall
+        size_t n = strlen(detail);
+        snprintf(detail + n, sizeof(detail) - n, "%s%s %ld", n ? ", " : "", name, c + callCycles + 3);
+    }
+
+    void plain(const char *name, long c)
+    {
+        cycles += c;
+        size_t n = strlen(detail);
+        snprintf(detail + n, sizeof(detail) - n, "%s%s %ld", n ? ", " : "", name, c);
+    }
+};
+
+// The old tick, with its int (16-bit) and long arithmetic
+struct Old
+{
+    long k;                        // adcToMAx1000
+    long centerA, rangeA, currentA; // what it called mA
+    Cost cost;
+
+    Old(uint16_t vccMV, uint16_t centerADC, uint16_t rangeADC, uint16_t rmsX16)
+    {
+        uint32_t p;
+        int32_t q;
+        uint16_t p16;
+        cost.add("mulsi3", worstMulsi3(vccMV, 1000, p));
+        cost.add("divmodsi4", divmod((int32_t)p, 1023L * 66L, 32, q));
+        k = (int16_t)q;
+
+        cost.add("mulhi3", worstMulhi3(centerADC, (uint16_t)k, p16));
+        cost.add("divmodhi4", divmod((int16_t)p16, 1000, 16, q));
+        centerA = (int16_t)q;
+        cost.add("mulhi3", worstMulhi3(rangeADC, (uint16_t)k, p16));
+        cost.add("divmodhi4", divmod((int16_t)p16, 2000, 16, q));
+        rangeA = (int16_t)q;
+
+        cost.add("mulsi3", worstMulsi3(rmsX16, (uint32_t)k, p));
+        cost.add("divmodsi4", divmod((int32_t)p, 16000, 32, q));
+        currentA = (int16_t)q;
+    }
+};
+
+// AdcScale's conversions, cycle for cycle
+struct New
+{
+    Cost cost;
+
+    New(const AdcScale &s, uint16_t centerADC, uint16_t rangeADC, uint16_t rmsX16)
+    {
+        uint32_t p;
+        cost.add("umulhisi3", umulhisi3(rmsX16, s.factor(), p));
+        cost.plain(">>12", 4 + 12); // byte moves, 4 x lsr/ror x3
+        cost.add("umulhisi3", umulhisi3(centerADC, s.factor(), p));
+        cost.plain(">>8", 4);
+        cost.add("umulhisi3", umulhisi3(rangeADC, s.factor(), p));
+        cost.plain(">>9", 4 + 4);
+    }
+};
+
+double exactMA(double vccMV, double counts)
+{
+    return counts * vccMV / 1023 / mVPerAmp * 1000;
+}
+
+// Worst cycles of the squaring call in add(), over every d an oversampled
+// sample can have: the old (int32_t)d * d and the new (uint32_t)|d| * |d|
+void squareCycles(uint8_t bits, long &oldWorst, int &oldD, long &newWorst, int &newD)
+{
+    oldWorst = newWorst = 0;
+    const int range = 1 << (10 + bits);
+    for (int d = -range + 1; d < range; d++)
+    {
+        uint32_t p;
+        long o = worstMulsi3((uint32_t)(int32_t)d, (uint32_t)(int32_t)d, p) + callCycles + 3;
+        if (o > oldWorst)
+        {
+            oldWorst = o;
+            oldD = d;
+        }
+        uint16_t m = d < 0 ? -d : d;
+        long n = umulhisi3(m, m, p) + callCycles + 3 + absCycles;
+        if (p != (uint32_t)d * d)
+            n = 1L << 30; // the model disagrees with the arithmetic
+        if (n > newWorst)
+        {
+            newWorst = n;
+            newD = d;
+        }
+    }
+}
+
+bool parseCycles(const char *s, long &tx, long &ms)
+{
+    char *end;
+    tx = strtol(s, &end, 10);
+    if (end == s || *end != ',')
+        return false;
+    ms = strtol(end + 1, &end, 10);
+    return !*end && tx >= 0 && ms >= 0;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    double windowMs = 80;
+    int bits = 1;
+    long txCycles = 140, millisCycles = 90;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc && (windowMs = atof(argv[++i])) >= 1)
+            continue;
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc && (bits = atoi(argv[++i])) >= 0 && bits <= 5)
+            continue;
+        if (strcmp(argv[i], "-x") == 0 && i + 1 < argc && parseCycles(argv[++i], txCycles, millisCycles))
+            continue;
+        if (strcmp(argv[i], "-v") == 0)
+        {
+            verbose = true;
+            continue;
+        }
+        fprintf(stderr, "usage: adccycles [-w window ms] [-b oversample bits 0..5] [-x tx,millis cycles] [-v]\n");
+        return 2;
+    }
+
+    bool failed = false;
+
+    // the division model against the real thing
+    const uint32_t divisors[] = {1, 7, 1000, 16000, 67518};
+    for (uint32_t n = 0; n < 400000; n += 997)
+        for (uint32_t d : divisors)
+        {
+            uint32_t q;
+            udivmod(n, d, 32, q);
+            if (q != n / d)
+                failed = true;
+            if (n < 65536 && d < 65536 && (udivmod(n, d, 16, q), q != n / d))
+                failed = true;
+        }
+
+    printf("ACS712 %u mV/A, Vcc tolerance %u mV, one RMS window per %.0f ticks, Vcc once per 1000\n", mVPerAmp,
+           toleranceMV, windowMs);
+    printf("cycles at center 512, range 300, current 400 counts RMS; worst error over all readings\n\n");
+    printf("   Vcc |   old/tick |   new/window  new/tick  update  remake |   old err (mA)  new err (mA)\n");
+
+    const uint16_t vccs[] = {3000, 3300, 4500, 4800, 5000, 5200, 5500};
+    long oldMax = 0, newMax = 0;
+    for (uint16_t vcc : vccs)
+    {
+        AdcScale scale(mVPerAmp, toleranceMV);
+        scale.update(vcc);
+
+        Old o(vcc, 512, 300, 400 * 16);
+        New n(scale, 512, 300, 400 * 16);
+
+        // update(): the drift check every Vcc reading, the division when it drifted
+        long check = 4 + 2 + 2 + 2 + 4 + 3; // call, load, subtract, compare, branch, ret
+        uint32_t p, q;
+        long remake = check + worstMulsi3(vcc, 256000, p) + 3 + udivmod(p + 67518 / 2, 67518, 32, q) + 3;
+        double perTick = n.cost.cycles / windowMs + check / 1000.0;
+
+        // worst error over every pot reading and RMS value
+        double oldErr = 0, newErr = 0;
+        for (uint16_t c = 0; c <= 1023; c++)
+        {
+            Old oc(vcc, c, c, 0);
+            double x = exactMA(vcc, c);
+            oldErr = fmax(oldErr, fabs(oc.centerA * 1000.0 - x));
+            oldErr = fmax(oldErr, fabs(oc.rangeA * 1000.0 - x / 2));
+            double e = fmax(fabs(scale.toMA(c) - x), fabs((scale.toMA(c) >> 1) - x / 2));
+            newErr = fmax(newErr, e);
+            if (e > 1 + x / 10000)
+                failed = true;
+        }
+        for (uint16_t r = 0; r <= 512 * 16; r++)
+        {
+            Old orms(vcc, 0, 0, r);
+            double x = exactMA(vcc, r / 16.0);
+            oldErr = fmax(oldErr, fabs(orms.currentA * 1000.0 - x));
+            double e = fabs(scale.x16ToMA(r) - x);
+            newErr = fmax(newErr, e);
+            if (e > 1 + x / 10000)
+                failed = true;
+        }
+
+        printf("%6u | %10ld | %12ld %9.1f %7ld %7ld | %14.0f %13.2f\n", vcc, o.cost.cycles, n.cost.cycles, perTick,
+               check, remake, oldErr, newErr);
+        if (verbose)
+            printf("         old: %s\n         new: %s\n", o.cost.detail, n.cost.detail);
+        oldMax = o.cost.cycles > oldMax ? o.cost.cycles : oldMax;
+        newMax = n.cost.cycles > newMax ? n.cost.cycles : newMax;
+
+        // a stored factor comes back only to the same sensor
+        AdcScale again(mVPerAmp, toleranceMV), other(100, toleranceMV);
+        if (!again.set(scale.factor(), scale.vccMV()) || again.factor() != scale.factor() ||
+            other.set(scale.factor(), scale.vccMV()) || again.set(0xFFFF, 0xFFFF))
+            failed = true;
+    }
+    printf("\nworst: old %ld cycles every tick (%.0f us at 8 MHz), new %ld per window\n", oldMax, oldMax / 8.0,
+           newMax);
+
+    long oldSquare, newSquare;
+    int oldD = 0, newD = 0;
+    squareCycles(bits, oldSquare, oldD, newSquare, newD);
+    long nested = txCycles + millisCycles;
+    long oldIsr = isrFrameCycles + addCycles + oldSquare, newIsr = isrFrameCycles + addCycles + newSquare;
+    printf("\nADC interrupt, %d oversample bit(s), one conversion every %ld cycles, nested interrupts %ld + %ld\n",
+           bits, conversionCycles, txCycles, millisCycles);
+    printf("       square (worst d)   handler   + nested   conversions\n");
+    printf("old  %8ld (%5d)  %8ld   %8ld   %s\n", oldSquare, oldD, oldIsr, oldIsr + nested,
+           oldIsr + nested > conversionCycles ? "overrun: re-enters, sums torn" : "fits");
+    printf("new  %8ld (%5d)  %8ld   %8ld   %s\n", newSquare, newD, newIsr, newIsr + nested,
+           newIsr + nested > conversionCycles ? "overrun: one waits" : "fits");
+    if (newIsr + nested > conversionCycles)
+        failed = true;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+// Host benchmark of PortDebouncer against the per-pin switch classes
+//
+// The firmware debounces all its inputs from one GPIO register read per
+// 5 ms tick (lib/PortDebouncer). The SwitchManager classes in lib/ do a
+// digitalRead() and their own timing per pin on every call. debouncebench
+// runs all three on the same simulated keys:
+//
+//   keys      -p pins, active low, each pressed every 0.2 to 2 s and held
+//             40 ms to 1 s
+//   bounce    0 to -b ms of random levels after every press and release
+//   glitches  a 1 ms low pulse in -g percent of the gaps between presses
+//   callers   SwitchManager and SwitchManagerWithFilter check() every pin
+//             once per millisecond, as loop() would; PortDebouncer gets
+//             one port word every 5 ms, as main.cpp feeds it GPIO.in/in1
+//
+// For each class it prints the host CPU time spent debouncing, per
+// simulated second and per pin and millisecond, and the presses:
+//
+//   seen      presses reported (falling edges)
+//   missed    presses not reported
+//   extra     reports that were not a press: a bounce or a glitch
+//
+// The host reads pins from an array (test/host/Arduino.h), much cheaper
+// than digitalRead() on the ESP32, so the per-pin classes fare better here
+// than on the target. Exits 1 if PortDebouncer misses or adds a press.
+//
+//   g++ -O2 -std=c++11 -I../../test/host -I../../lib/PortDebouncer -I../../lib/SwitchManager -I../../lib/SwitchManagerWithFilter debouncebench.cpp -o debouncebench
+//
+//   debouncebench [-p pins] [-t seconds] [-b bounce ms] [-g percent] [-s seed]
+//     default: 40 pins, 600 s, 5 ms bounce, 20% glitches
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <Arduino.h>
+#include <PortDebouncer.h>
+#include <SwitchManager.h>
+#include <SwitchManagerWithFilter.cpp>
+
+namespace
+{
+struct Setup
+{
+    unsigned pins = 40;
+    unsigned seconds = 600;
+    unsigned bounce = 5;    // ms
+    unsigned glitches = 20; // percent of gaps
+};
+
+const unsigned tickMs = 5; // PortDebouncer tick, as in main.cpp
+
+struct Result
+{
+    double ns = 0;              // debouncing time over the whole run
+    std::vector<unsigned> seen; // falling edges reported, per pin
+};
+
+// Port level of every millisecond, bit n = pin n
+std::vector<uint64_t> simulate(const Setup &s, std::mt19937 &rng, std::vector<unsigned> &presses)
+{
+    const unsigned ms = s.seconds * 1000;
+    std::vector<uint64_t> port(ms, ~uint64_t(0));
+    std::uniform_int_distribution<unsigned> gap(200, 2000), hold(40, 1000), bounce(0, s.bounce), coin(0, 1),
+        percent(0, 99);
+    presses.assign(s.pins, 0);
+
+    for (unsigned pin = 0; pin < s.pins; pin++)
+    {
+        const uint64_t bit = uint64_t(1) << pin;
+        unsigned t = gap(rng);
+        for (;;)
+        {
+            unsigned down = t, up = t + hold(rng), next = up + gap(rng);
+            if (next >= ms)
+                break;
+            presses[pin]++;
+            unsigned b1 = bounce(rng), b2 = bounce(rng);
+            for (unsigned i = down; i < up; i++)
+                if (i >= down + b1 || coin(rng))
+                    port[i] &= ~bit;
+            for (unsigned i = up; i < up + b2; i++)
+                if (coin(rng))
+                    port[i] &= ~bit;
+            if (percent(rng) < s.glitches)
+                port[(up + b2 + next) / 2] &= ~bit;
+            t = next;
+        }
+    }
+    return port;
+}
+
+// Drive the host pins from one port word
+void setPins(uint64_t word, unsigned pins)
+{
+    for (unsigned pin = 0; pin < pins; pin++)
+        hostPins().level[pin] = (word >> pin) & 1;
+}
+
+double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Time of a run that only drives the pins, taken off the per-pin classes
+double baseline(const std::vector<uint64_t> &port, unsigned pins)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < port.size(); t++)
+    {
+        hostMillis() = t;
+        setPins(port[t], pins);
+    }
+    return since(start);
+}
+
+unsigned currentPin;
+std::vector<unsigned> *counts;
+
+void onSwitch(const byte newState, const unsigned long)
+{
+    if (newState == LOW)
+        (*counts)[currentPin]++;
+}
+
+void onSwitchWithPin(const byte newState, const unsigned long, const byte whichPin)
+{
+    if (newState == LOW)
+        (*counts)[whichPin]++;
+}
+
+template <class Switch, class Handler>
+Result runPerPin(const std::vector<uint64_t> &port, unsigned pins, Handler handler, double base)
+{
+    Result r;
+    r.seen.assign(pins, 0);
+    counts = &r.seen;
+    std::vector<Switch> sw(pins);
+    hostMillis() = 0;
+    setPins(port[0], pins);
+    for (unsigned pin = 0; pin < pins; pin++)
+        sw[pin].begin(pin, handler);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < port.size(); t++)
+    {
+        hostMillis() = t;
+        setPins(port[t], pins);
+        for (currentPin = 0; currentPin < pins; currentPin++)
+            sw[currentPin].check();
+    }
+    r.ns = since(start) - base;
+    if (r.ns < 0)
+        r.ns = 0;
+    return r;
+}
+
+Result runPort(const std::vector<uint64_t> &port, unsigned pins)
+{
+    Result r;
+    r.seen.assign(pins, 0);
+    PortDebouncer<uint64_t> inputs;
+    inputs.begin(port[0]);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = tickMs; t < port.size(); t += tickMs)
+    {
+        uint64_t fell = inputs.update(port[t]) & ~inputs.state();
+        for (; fell; fell &= fell - 1)
+            r.seen[__builtin_ctzll(fell)]++;
+    }
+    r.ns = since(start);
+    return r;
+}
+
+// Totals of seen, missed and extra presses; true if every press was seen once
+bool tally(const Result &r, const std::vector<unsigned> &presses, unsigned &seen, unsigned &missed, unsigned &extra)
+{
+    seen = missed = extra = 0;
+    for (size_t pin = 0; pin < presses.size(); pin++)
+    {
+        seen += r.seen[pin];
+        if (r.seen[pin] < presses[pin])
+            missed += presses[pin] - r.seen[pin];
+        else
+            extra += r.seen[pin] - presses[pin];
+    }
+    return !missed && !extra;
+}
+
+void report(const char *name, const Result &r, const Setup &s, const std::vector<unsigned> &presses)
+{
+    unsigned seen, missed, extra;
+    tally(r, presses, seen, missed, extra);
+    printf("%-24s %12.0f %10.2f %8u %7u %7u\n", name, r.ns / s.seconds, r.ns / s.seconds / 1000 / s.pins, seen,
+           missed, extra);
+}
+
+bool parse(const char *s, unsigned &v)
+{
+    char *end;
+    unsigned long n = strtoul(s, &end, 10);
+    v = (unsigned)n;
+    return end != s && !*end && n == v;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Setup s;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = i + 1 < argc;
+        unsigned v = 0;
+        if (ok)
+            ok = parse(argv[i + 1], v);
+        if (!ok)
+            ;
+        else if (strcmp(argv[i], "-p") == 0)
+            s.pins = v;
+        else if (strcmp(argv[i], "-t") == 0)
+            s.seconds = v;
+        else if (strcmp(argv[i], "-b") == 0)
+            s.bounce = v;
+        else if (strcmp(argv[i], "-g") == 0)
+            s.glitches = v;
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = v;
+        else
+            ok = false;
+        if (!ok || s.pins == 0 || s.pins > 64 || s.seconds < 10 || s.bounce > 15 || s.glitches > 100)
+        {
+            fprintf(stderr, "usage: debouncebench [-p pins 1..64] [-t seconds] [-b bounce ms 0..15] "
+                            "[-g percent] [-s seed]\n");
+            return 2;
+        }
+        i++;
+    }
+    std::mt19937 rng(seed);
+
+    std::vector<unsigned> presses;
+    std::vector<uint64_t> port = simulate(s, rng, presses);
+    unsigned total = 0;
+    for (unsigned n : presses)
+        total += n;
+    printf("%u pins, %u s, %u presses, bounce up to %u ms, glitches in %u%% of the gaps\n\n", s.pins, s.seconds,
+           total, s.bounce, s.glitches);
+    printf("class                     ns per sim s  ns/pin/ms     seen  missed   extra\n");
+
+    double base = baseline(port, s.pins);
+    Result plain = runPerPin<SwitchManager>(port, s.pins, onSwitch, base);
+    Result filter = runPerPin<SwitchManagerWithFilter>(port, s.pins, onSwitchWithPin, base);
+    Result vertical = runPort(port, s.pins);
+
+    report("SwitchManager", plain, s, presses);
+    report("SwitchManagerWithFilter", filter, s, presses);
+    report("PortDebouncer<uint64_t>", vertical, s, presses);
+
+    unsigned seen, missed, extra;
+    return tally(vertical, presses, seen, missed, extra) ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+// Host benchmark of the Gorilla coder on a pump's measurement series
+//
+// HistoryLog (lib/HistoryLog) stores its samples as Gorilla blocks of up
+// to 240 bytes (lib/Gorilla). gorillabench feeds the encoder a synthetic
+// trace with the same six channels in the same fixed point units as
+// HistoryLog::toValues():
+//
+//   voltage   0.1 V, mains wandering slowly around 230 V plus noise
+//   current   0.01 A, 4.8 A while the motor runs, 0 otherwise
+//   pf        0.01, 0.82 while running
+//   power     1 W
+//   energy    Wh, the PZEM counter
+//   flags     motor and status bits
+//
+// The motor runs the first -r minutes of every hour; -i sets the sample
+// interval and every 50th interval is one second late, as the 1 Hz loop
+// is now and then.
+//
+// -f takes a recorded trace instead, either of
+//
+//   file   the CSV export of GET /history?format=csv
+//          (time,voltage,current,pf,power,energy,flags,error)
+//   dir    wlccap's output directory: the Meter columns, one sample per
+//          meter read, time in whole seconds of millis(), flags mapped
+//          to HistoryLog's
+//
+// scaled as HistoryLog::toValues() does. It prints the compressed size
+// per sample, the ratio to a packed 16 byte fixed point record and to
+// HistoryLog::Sample as held in RAM, and the encode and decode rates.
+// Every block is decoded and compared with the input; exits 1 on any
+// difference, 2 on usage errors or a trace it cannot read.
+//
+//   g++ -O2 -std=c++11 -I../../lib/Gorilla gorillabench.cpp -o gorillabench
+//
+//   gorillabench [-n samples] [-i interval s] [-r run minutes] [-s seed]
+//   gorillabench -f history.csv|capture-dir
+//     default: 1000000 samples, 1 s, 15 minutes
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <Gorilla.h>
+
+namespace
+{
+const uint8_t channels = 6;      // HistoryLog::channels
+const size_t blockBytes = 240;   // HistoryLog::maxChunkBytes
+const size_t packedBytes = 16;   // time 4, V 2, I 2, PF 1, P 2, E 4, flags 1
+const size_t sampleBytes = 28;   // sizeof(HistoryLog::Sample)
+
+struct Setup
+{
+    unsigned samples = 1000000;
+    unsigned interval = 1; // s
+    unsigned run = 15;     // minutes per hour
+};
+
+struct Trace
+{
+    std::vector<uint32_t> time;
+    std::vector<int32_t> values; // channels per sample
+};
+
+Trace simulate(const Setup &s, std::mt19937 &rng)
+{
+    Trace tr;
+    tr.time.resize(s.samples);
+    tr.values.resize((size_t)s.samples * channels);
+    std::uniform_int_distribution<int> noise(-2, 2), pfNoise(-1, 1);
+    uint32_t t = 1700000000;
+    double wh = 123456;
+    for (unsigned i = 0; i < s.samples; i++)
+    {
+        t += s.interval + (i % 50 == 49);
+        bool run = t % 3600 < s.run * 60;
+        int32_t *v = &tr.values[(size_t)i * channels];
+        v[0] = 2300 + (int32_t)(60 * sin(t / 5000.0)) + noise(rng);
+        v[1] = run ? 480 + noise(rng) * 2 : 0;
+        v[2] = run ? 82 + pfNoise(rng) : 0;
+        v[3] = run ? v[0] * v[1] * v[2] / 100000 : 0;
+        wh += v[3] * s.interval / 3600.0;
+        v[4] = (int32_t)wh;
+        v[5] = 0x01 | (run ? 0x02 : 0);
+        tr.time[i] = t;
+    }
+    return tr;
+}
+
+// HistoryLog::toValues() on the fields of a sample
+int32_t fixed(float v, float scale)
+{
+    if (isnan(v) || v < 0)
+        return 0;
+    return (int32_t)lroundf(v * scale);
+}
+
+void push(Trace &tr, uint32_t t, float voltage, float current, float pf, float power, float energy, unsigned flags,
+          unsigned error)
+{
+    tr.time.push_back(t);
+    const int32_t v[channels] = {fixed(voltage, 10),    fixed(current, 100), fixed(pf, 100),
+                                 fixed(power, 1),       fixed(energy, 1000), (int32_t)(flags | error << 8)};
+    tr.values.insert(tr.values.end(), v, v + channels);
+}
+
+// The /history CSV export
+bool loadCsv(const char *path, Trace &tr)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[256];
+    bool ok = fgets(line, sizeof(line), f) && strcmp(line, "time,voltage,current,pf,power,energy,flags,error\n") == 0;
+    if (!ok)
+        fprintf(stderr, "%s: not a /history CSV export\n", path);
+    unsigned long t;
+    float voltage, current, pf, power, energy;
+    unsigned flags, error;
+    unsigned row = 1;
+    while (ok && fgets(line, sizeof(line), f))
+    {
+        row++;
+        if (sscanf(line, "%lu,%f,%f,%f,%f,%f,%u,%u", &t, &voltage, &current, &pf, &power, &energy, &flags, &error) !=
+            8)
+        {
+            fprintf(stderr, "%s:%u: not a sample\n", path, row);
+            ok = false;
+        }
+        else
+            push(tr, t, voltage, current, pf, power, energy, flags, error);
+    }
+    fclose(f);
+    return ok;
+}
+
+template <typename T> bool loadColumn(const std::string &dir, const char *name, std::vector<T> &out)
+{
+    std::string path = dir + "/Meter/" + name;
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        fprintf(stderr, "%s: cannot open\n", path.c_str());
+        return false;
+    }
+    T v;
+    while (fread(&v, sizeof(v), 1, f) == 1)
+        out.push_back(v);
+    fclose(f);
+    return true;
+}
+
+// wlccap's Meter columns
+bool loadCapture(const char *dir, Trace &tr)
+{
+    std::vector<uint32_t> time;
+    std::vector<float> voltage, current, pf, power, energy;
+    std::vector<uint8_t> flags, error;
+    if (!loadColumn(dir, "time.u32", time) || !loadColumn(dir, "voltage.f32", voltage) ||
+        !loadColumn(dir, "current.f32", current) || !loadColumn(dir, "pf.f32", pf) ||
+        !loadColumn(dir, "power.f32", power) || !loadColumn(dir, "energy.f32", energy) ||
+        !loadColumn(dir, "flags.u8", flags) || !loadColumn(dir, "error.u8", error))
+        return false;
+    size_t n = time.size();
+    for (size_t k : {voltage.size(), current.size(), pf.size(), power.size(), energy.size(), flags.size(),
+                     error.size()})
+        if (k < n)
+            n = k; // a capture cut off mid record
+    for (size_t i = 0; i < n; i++)
+    {
+        // CaptureMeter flags: motor, relay, UGT float, OHT float
+        unsigned f = (flags[i] & 0x04 ? 0x01 : 0) | (flags[i] & 0x08 ? 0x02 : 0) | (flags[i] & 0x01 ? 0x04 : 0);
+        push(tr, time[i] / 1000, voltage[i], current[i], pf[i], power[i], energy[i], f, error[i]);
+    }
+    return true;
+}
+
+bool load(const char *path, Trace &tr)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        fprintf(stderr, "%s: not found\n", path);
+        return false;
+    }
+    return S_ISDIR(st.st_mode) ? loadCapture(path, tr) : loadCsv(path, tr);
+}
+
+struct Block
+{
+    size_t offset; // into the encoded bytes
+    size_t bytes;
+    uint16_t count;
+};
+
+double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool parse(const char *s, unsigned &v)
+{
+    char *end;
+    unsigned long n = strtoul(s, &end, 10);
+    v = (unsigned)n;
+    return end != s && !*end && n == v;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Setup s;
+    unsigned seed = 1;
+    const char *trace = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = i + 1 < argc;
+        unsigned v = 0;
+        if (!ok)
+            ;
+        else if (strcmp(argv[i], "-f") == 0)
+            trace = argv[i + 1];
+        else if (!parse(argv[i + 1], v))
+            ok = false;
+        else if (strcmp(argv[i], "-n") == 0)
+            s.samples = v;
+        else if (strcmp(argv[i], "-i") == 0)
+            s.interval = v;
+        else if (strcmp(argv[i], "-r") == 0)
+            s.run = v;
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = v;
+        else
+            ok = false;
+        if (!ok || s.samples == 0 || s.interval == 0 || s.interval > 3600 || s.run > 60)
+        {
+            fprintf(stderr, "usage: gorillabench [-n samples] [-i interval s 1..3600] [-r run minutes 0..60] "
+                            "[-s seed]\n       gorillabench -f history.csv|capture-dir\n");
+            return 2;
+        }
+        i++;
+    }
+    Trace tr;
+    if (trace)
+    {
+        if (!load(trace, tr))
+            return 2;
+        if (tr.time.empty())
+        {
+            fprintf(stderr, "%s: no samples\n", trace);
+            return 2;
+        }
+        s.samples = tr.time.size();
+    }
+    else
+    {
+        std::mt19937 rng(seed);
+        tr = simulate(s, rng);
+    }
+
+    // encode into consecutive blocks, as HistoryLog fills its chunks
+    std::vector<uint8_t> out;
+    std::vector<Block> blocks;
+    uint8_t buf[blockBytes];
+    GorillaEncoder<channels> enc;
+    enc.reset(buf, sizeof(buf));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < s.samples; i++)
+    {
+        const int32_t *v = &tr.values[(size_t)i * channels];
+        if (enc.append(tr.time[i], v))
+            continue;
+        Block b = {out.size(), enc.bytes(), enc.count()};
+        out.insert(out.end(), buf, buf + enc.bytes());
+        blocks.push_back(b);
+        enc.reset(buf, sizeof(buf));
+        enc.append(tr.time[i], v);
+    }
+    Block last = {out.size(), enc.bytes(), enc.count()};
+    out.insert(out.end(), buf, buf + enc.bytes());
+    blocks.push_back(last);
+    double encodeTime = since(start);
+
+    // decode everything and compare
+    unsigned k = 0, bad = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        GorillaDecoder<channels> dec;
+        uint32_t t;
+        int32_t v[channels];
+        while (dec.next(&out[blocks[b].offset], blocks[b].bytes, blocks[b].count, t, v))
+        {
+            if (k >= s.samples || t != tr.time[k] || memcmp(v, &tr.values[(size_t)k * channels], sizeof(v)) != 0)
+                bad++;
+            k++;
+        }
+    }
+    double decodeTime = since(start);
+    if (k != s.samples)
+        bad++;
+
+    double perSample = (double)out.size() / s.samples;
+    if (trace)
+        printf("%u samples from %s over %.1f h, %u blocks of up to %u bytes\n\n", s.samples, trace,
+               (tr.time.back() - tr.time.front()) / 3600.0, (unsigned)blocks.size(), (unsigned)blockBytes);
+    else
+        printf("%u samples every %u s, motor on %u min/h, %u blocks of up to %u bytes\n\n", s.samples, s.interval,
+               s.run, (unsigned)blocks.size(), (unsigned)blockBytes);
+    printf("bytes/sample        %8.2f\n", perSample);
+    printf("ratio to %2u B packed %7.1fx\n", (unsigned)packedBytes, packedBytes / perSample);
+    printf("ratio to %2u B Sample %7.1fx\n", (unsigned)sampleBytes, sampleBytes / perSample);
+    printf("samples/block       %8.1f\n", (double)s.samples / blocks.size());
+    printf("encode              %8.2f Msamples/s\n", s.samples / encodeTime / 1e6);
+    printf("decode              %8.2f Msamples/s\n", s.samples / decodeTime / 1e6);
+    if (bad)
+        printf("\n%u samples decoded wrong\n", bad);
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+// Turn the controller's serial output back into text
+//
+// The firmware logs binary EventLog frames (lib/EventLog) mixed with the
+// text other code prints. logdecode copies the text through and replaces
+// every valid frame by its formatted line, using the event table in
+// include/LogEvents.h. Reads a capture file or stdin, e.g. straight from
+// the port:
+//
+//   g++ -O2 -std=c++11 -I../../include -I../../lib/EventLog -I../../lib/Crc logdecode.cpp -o logdecode
+//   stty -F /dev/ttyUSB0 115200 raw && ./logdecode -t < /dev/ttyUSB0
+//
+//   -t   prefix frames with the controller's uptime and level
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "LogEvents.h"
+
+namespace
+{
+const char levels[] = "-EWID";
+
+// Decode data[0..size); returns how many bytes were used. A frame cut
+// off at the end stays for the next call unless at end of input.
+size_t decode(const uint8_t *data, size_t size, bool last, bool times)
+{
+    const size_t maxFrame = eventlog::headerSize + eventlog::maxArgs + eventlog::crcSize;
+    size_t i = 0;
+    while (i < size)
+    {
+        if (data[i] != eventlog::sync)
+        {
+            putchar(data[i++]);
+            continue;
+        }
+
+        LogFrame f;
+        size_t n = parseLogFrame(data + i, size - i, f);
+        if (n == 0)
+        {
+            if (!last && size - i < maxFrame)
+                break; // may be a frame that is not complete yet
+            putchar(data[i++]); // a 0xA5 in text or a damaged frame
+            continue;
+        }
+        char line[256];
+        formatLogFrame(line, sizeof(line), f, logEventTable, logEventCount);
+        if (times)
+            printf("[%6u.%03u %c] ", (unsigned)(f.time / 1000), (unsigned)(f.time % 1000),
+                   levels[f.level < sizeof(levels) - 1 ? f.level : 0]);
+        printf("%s\n", line);
+        i += n;
+    }
+    return i;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool times = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0)
+            times = true;
+        else
+            path = argv[i];
+    }
+
+    FILE *in = path ? fopen(path, "rb") : stdin;
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+
+    // read(), not fread(): on a port or pipe it returns what has arrived
+    // instead of waiting for the buffer to fill, so lines show up live
+    uint8_t buf[4096];
+    size_t have = 0;
+    for (;;)
+    {
+        ssize_t got = read(fileno(in), buf + have, sizeof(buf) - have);
+        if (got < 0 && errno == EINTR)
+            continue;
+        size_t n = got > 0 ? got : 0;
+        have += n;
+        size_t used = decode(buf, have, n == 0, times);
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        fflush(stdout);
+        if (n == 0)
+            break;
+    }
+    return 0;
+}
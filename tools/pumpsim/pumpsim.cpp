@@ -0,0 +1,416 @@
+// Reaction times of the ATtiny controller's old and new control loop
+//
+// supportFiles/main1.cpp used to run its checks once per loop pass and
+// then block: 2 x 5 ms per pot, 2 ms for Vcc, the status line at 9600
+// baud, the error blinks (400 ms per flash plus 1 s) and delay(1000). The
+// flow input was sampled once per pass, so pulses between two samples
+// were lost, and any pulse in the last 2 s counted as flow. It now runs a
+// 1 ms tick that never waits, measures the flow rate (lib/PumpGuard
+// FlowMeter.h) against a low-flow and a no-flow threshold, and the motor
+// current as the RMS of 4 mains cycles (AcRms.h), which is 0 while the
+// relay is open.
+//
+// pumpsim drives the controller's decision code (PumpGuard.h) with both
+// loops through one scenario, repeated with random pulse phases:
+//
+//   0 s    flow pulses at -p Hz, current in range
+//   20 s   the motor current goes above the range (until 30 s)
+//   35 s   the flow stops
+//   45 s   the flow starts again
+//   55 s   the flow drops to half the low-flow threshold (until 65 s)
+//
+// and prints, per flow rate and loop:
+//
+//   seen       flow pulses the loop counted, of those sent
+//   rate       worst error of the measured flow rate from 5 to 19 s
+//   false off  time the relay was off for lack of flow while the flow
+//              was fine
+//   trip       over current at 20 s until the relay opens
+//   retry      the trip until the relay closes again (the fault has gone)
+//   loss       last pulse before 35 s until the relay opens
+//   restart    first pulse after 45 s until the relay closes
+//   low        low flow at 55 s until the relay opens
+//
+// as mean and worst case. The old loop is modelled with its own flow rule
+// and no trip delay or retry hold; both use the fixed inrush timer and
+// check the current only while the relay is closed. The new loop sees the
+// current one RMS window late, from a random phase. It polls
+// the flow input every tick through the PCF8574, or with -i counts pulses
+// in a pin change interrupt. Exits 1 if the new loop's rate is off by
+// more than 2%, or it reacts more than -l ms later than the thresholds
+// allow: a flow stop is seen when a pulse at the low-flow rate would
+// have come, low flow within two such pulse times (a pulse just before
+// still shows enough flow), a restart with the second pulse, an over
+// current within two RMS windows and the trip delay, and the retry after
+// the hold.
+//
+//   g++ -O2 -std=c++11 -I../../lib/PumpGuard pumpsim.cpp -o pumpsim
+//
+//   pumpsim [-p Hz,...] [-k pulses/L] [-n runs] [-l ms] [-s seed] [-i]
+//     default: 10, 20, 50 and 100 Hz, K 450, 20 runs, 30 ms
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "FlowMeter.h"
+#include "PumpGuard.h"
+
+namespace
+{
+// Same numbers as main1.cpp
+const uint16_t lowFlow = 1000, noFlow = 300; // mL/min
+const uint16_t flowUpdateMs = 10;
+const uint16_t flowTimeoutMs = 2000; // the old loop
+const uint16_t inrushMs = 5000;
+const uint16_t tripMs = 20;
+const uint16_t retryMs = 10000;
+const double rmsWindowMs = 4 * 20.0; // 4 cycles of 50 Hz
+const int lowTh = 400;
+const int highTh = 600;
+
+const double rateFrom = 5000, rateTo = 19000;
+const double faultStart = 20000, faultEnd = 30000;
+const double flowStop = 35000, flowRestart = 45000, lowStart = 55000, scenarioEnd = 65000;
+
+struct Pulse
+{
+    double at, low; // falling edge, and how long the input stays low
+};
+
+struct Pump
+{
+    std::vector<Pulse> pulses;
+    double hz;
+
+    Pump(double hz, double lowHz) : hz(hz)
+    {
+        add(0, flowStop, hz);
+        add(flowRestart, lowStart, hz);
+        add(lowStart, scenarioEnd, lowHz);
+    }
+
+    // Pulses at a steady rate from a random phase, low for half a period
+    void add(double from, double to, double f)
+    {
+        double period = 1000 / f;
+        for (double t = from + period * rand() / (RAND_MAX + 1.0); t < to; t += period)
+        {
+            Pulse p = {t, period / 2};
+            pulses.push_back(p);
+        }
+    }
+
+    // The flow input, idle high; t must not go backwards
+    bool level(double t, size_t &cursor) const
+    {
+        while (cursor + 1 < pulses.size() && pulses[cursor + 1].at <= t)
+            cursor++;
+        return cursor >= pulses.size() || t < pulses[cursor].at || t >= pulses[cursor].at + pulses[cursor].low;
+    }
+
+    // The motor current: above the range during the fault, none with the relay open
+    int current(double t, bool relay) const
+    {
+        if (!relay)
+            return 0;
+        return t >= faultStart && t < faultEnd ? 700 : 500;
+    }
+};
+
+struct Result
+{
+    unsigned long sent, seen;
+    double rateErr;  // percent
+    double falseOff; // ms
+    double trip, retry, loss, restart, low; // ms, < 0: never
+};
+
+// The old loop pass: the relay was written after the ADC reads and the
+// blinks, then came the status line (about 75 characters) and delay(1000)
+double oldRelayMs(uint8_t error)
+{
+    double ms = 2 * 5 + 2; // pots, Vcc
+    return error ? ms + error * 400 + 1000 : ms;
+}
+
+double oldPassMs(uint8_t error)
+{
+    return oldRelayMs(error) + 75 * 10 * 1000.0 / 9600 + 1000;
+}
+
+// The old flow rule: a falling edge between two samples, in the last 2 s
+struct OldFlow
+{
+    bool lastLevel = true;
+    uint32_t lastPulse = 0, pulses = 0;
+
+    bool sample(uint32_t now, bool level)
+    {
+        if (lastLevel && !level)
+        {
+            lastPulse = now;
+            pulses++;
+        }
+        lastLevel = level;
+        return now - lastPulse < flowTimeoutMs;
+    }
+};
+
+Result run(const Pump &pump, uint16_t k, bool newLoop, bool interrupt)
+{
+    PumpGuard guard(lowFlow, noFlow, inrushMs, newLoop ? tripMs : 0, newLoop ? retryMs : 0);
+    FlowMeter meter(k);
+    OldFlow oldFlow;
+    Result r;
+    memset(&r, 0, sizeof(r));
+    r.trip = r.retry = r.loss = r.restart = r.low = -1;
+
+    double lastBeforeStop = 0, firstAfterRestart = flowRestart;
+    for (const Pulse &p : pump.pulses)
+    {
+        r.sent++;
+        if (p.at < flowStop)
+            lastBeforeStop = p.at;
+    }
+    for (const Pulse &p : pump.pulses)
+        if (p.at >= flowRestart)
+        {
+            firstAfterRestart = p.at;
+            break;
+        }
+    double trueRate = pump.hz * 60000 / k;
+
+    // what the sketch counts, from the interrupt or from polling
+    uint32_t count = 0, lastUs = 0;
+    size_t next = 0, cursor = 0;
+    bool lastLevel = true;
+    double lastFlowUpdate = -flowUpdateMs;
+
+    // the RMS of the window so far, and of the last complete one
+    double rmsStart = -rmsWindowMs * rand() / (RAND_MAX + 1.0), sumSq = 0, rms = 0;
+    unsigned rmsSamples = 0;
+    double trippedAt = -1;
+
+    bool relay = false; // as the relay really is
+    double t = 0, changed = 0;
+    bool offForFlow = false;
+    bool stopped = false;
+    while (t < scenarioEnd)
+    {
+        // the relay's last switch off before the flow came back
+        if (!stopped && t >= flowRestart)
+        {
+            stopped = true;
+            if (!relay)
+                r.loss = fmax(0, changed - lastBeforeStop);
+        }
+
+        uint32_t now = (uint32_t)t;
+        bool on;
+        if (newLoop)
+        {
+            if (interrupt)
+            {
+                for (; next < pump.pulses.size() && pump.pulses[next].at <= t; next++)
+                {
+                    count++;
+                    lastUs = (uint32_t)(pump.pulses[next].at * 1000);
+                }
+            }
+            else
+            {
+                bool level = pump.level(t, cursor);
+                if (lastLevel && !level)
+                {
+                    count++;
+                    lastUs = now * 1000;
+                }
+                lastLevel = level;
+            }
+            if (t - lastFlowUpdate >= flowUpdateMs)
+            {
+                meter.update(now * 1000, count, lastUs);
+                lastFlowUpdate = t;
+                if (t >= rateFrom && t < rateTo)
+                    r.rateErr = fmax(r.rateErr, fabs(meter.mlPerMinute() - trueRate) * 100 / trueRate);
+            }
+            double c = pump.current(t, relay);
+            sumSq += c * c;
+            rmsSamples++;
+            if (t - rmsStart >= rmsWindowMs)
+            {
+                rms = sqrt(sumSq / rmsSamples);
+                sumSq = 0;
+                rmsSamples = 0;
+                rmsStart = t;
+            }
+            on = guard.update(now, meter.mlPerMinute(), (int)rms, lowTh, highTh);
+        }
+        else
+        {
+            bool flow = oldFlow.sample(now, pump.level(t, cursor));
+            on = guard.update(now, flow ? 0xFFFFFFFF : 0, pump.current(t, relay), lowTh, highTh);
+        }
+        uint8_t error = guard.error();
+
+        double applied = newLoop ? t : t + oldRelayMs(error);
+        if (on != relay)
+        {
+            // off for lack of flow while it was fine, after start-up and restart
+            bool flowFine =
+                (changed >= 2500 && changed < flowStop) || (changed >= flowRestart + 2500 && changed < lowStart);
+            if (!relay && offForFlow && flowFine)
+                r.falseOff += fmin(applied, lowStart) - changed;
+            relay = on;
+            offForFlow = error == PumpGuard::NoFlow || error == PumpGuard::LowFlow;
+            changed = applied;
+            if (!on && error == PumpGuard::OverCurrent && r.trip < 0 && applied >= faultStart)
+            {
+                r.trip = applied - faultStart;
+                trippedAt = applied;
+            }
+            if (on && trippedAt >= 0 && r.retry < 0)
+                r.retry = applied - trippedAt;
+            if (on && r.restart < 0 && applied >= flowRestart)
+                r.restart = fmax(0, applied - firstAfterRestart);
+            if (!on && offForFlow && r.low < 0 && applied >= lowStart)
+                r.low = applied - lowStart;
+        }
+        t = newLoop ? t + 1 : t + oldPassMs(error);
+    }
+    r.seen = newLoop ? count : oldFlow.pulses;
+    return r;
+}
+
+struct Stat
+{
+    double sum, worst;
+    unsigned n, never;
+
+    void add(double v)
+    {
+        if (v < 0)
+        {
+            never++;
+            return;
+        }
+        sum += v;
+        worst = fmax(worst, v);
+        n++;
+    }
+
+    // "never" when a run did not react at all
+    void print() const
+    {
+        if (n)
+            printf(" %6.0f", sum / n);
+        else
+            printf(" %6s", "-");
+        if (never)
+            printf(" %5s", "never");
+        else
+            printf(" %5.0f", worst);
+    }
+};
+
+bool parseList(const char *s, std::vector<double> &out)
+{
+    out.clear();
+    while (*s)
+    {
+        char *end;
+        double v = strtod(s, &end);
+        if (end == s || v <= 0 || (*end && *end != ','))
+            return false;
+        out.push_back(v);
+        s = *end ? end + 1 : end;
+    }
+    return !out.empty();
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<double> rates = {10, 20, 50, 100};
+    long k = 450;
+    unsigned runs = 20;
+    double limit = 30;
+    unsigned seed = 1;
+    bool interrupt = false;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = true;
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            ok = parseList(argv[++i], rates);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            ok = (k = atol(argv[++i])) >= 14 && k <= 65535;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            ok = (runs = strtoul(argv[++i], NULL, 10)) > 0;
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            limit = atof(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-i") == 0)
+            interrupt = true;
+        else
+            ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "usage: pumpsim [-p Hz,...] [-k pulses/L] [-n runs] [-l ms] [-s seed] [-i]\n");
+            return 2;
+        }
+    }
+    srand(seed);
+
+    // one pulse at the low-flow rate, in ms
+    const double lowPeriod = 60000000.0 / ((double)k * lowFlow);
+    const double lowHz = k * lowFlow / 2 / 60000.0;
+
+    bool failed = false;
+    printf("K %ld pulses/L, flow %s, low flow below %u mL/min (one pulse per %.0f ms)\n", k,
+           interrupt ? "on a pin change interrupt" : "polled", lowFlow, lowPeriod);
+    printf("                    rate false off   trip (ms)    retry (ms)     loss (ms)   restart (ms)     low (ms)\n");
+    printf("   Hz  loop   seen  err %%    s/run   mean worst   mean worst   mean worst   mean worst   mean worst\n");
+    for (double hz : rates)
+        for (int newLoop = 0; newLoop < 2; newLoop++)
+        {
+            unsigned long sent = 0, seen = 0;
+            double falseOff = 0, rateErr = 0;
+            Stat trip = {}, retry = {}, loss = {}, restart = {}, low = {};
+            for (unsigned n = 0; n < runs; n++)
+            {
+                Pump pump(hz, lowHz);
+                Result r = run(pump, k, newLoop, interrupt);
+                sent += r.sent;
+                seen += r.seen;
+                falseOff += r.falseOff;
+                rateErr = fmax(rateErr, r.rateErr);
+                trip.add(r.trip);
+                retry.add(r.retry);
+                loss.add(r.loss);
+                restart.add(r.restart);
+                low.add(r.low);
+                double period = 1000 / hz;
+                if (newLoop)
+                    failed |= r.rateErr > 2 || r.trip < 0 || r.trip > 2 * rmsWindowMs + tripMs + limit ||
+                              r.retry < retryMs || r.retry > retryMs + limit || r.loss < 0 ||
+                              r.loss > lowPeriod + limit || r.restart < 0 || r.restart > period + limit ||
+                              r.low < 0 || r.low > period + 2 * lowPeriod + limit;
+            }
+            printf("%5g  %s %5.1f%%", hz, newLoop ? "new" : "old", 100.0 * seen / sent);
+            if (newLoop)
+                printf(" %6.2f", rateErr);
+            else
+                printf(" %6s", "-");
+            printf("  %7.1f ", falseOff / runs / 1000);
+            trip.print();
+            retry.print();
+            loss.print();
+            restart.print();
+            low.print();
+            printf("\n");
+        }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+// Accuracy check of AcRms, the ATtiny controller's true-RMS current sampler
+//
+// The controller (supportFiles/main1.cpp) feeds the ACS712 through the
+// free running ADC into AcRms (lib/PumpGuard/AcRms.h) and uses the RMS of
+// a few mains cycles as the motor current. rmscheck feeds the same class
+// synthetic ADC readings the way the hardware would produce them:
+//
+//   ADC rate   F_CPU / 64 / 13 (the sketch's ADC clock), from a clock
+//              that is not locked to the mains
+//   signal     mid-rail offset + a sine of the given peak in ADC counts,
+//              plus a 3rd harmonic (-3 percent), random phase
+//   noise      Gaussian, -n counts RMS, then rounded and clipped to 0..1023
+//
+// and compares the result with the exact RMS of the AC part. For each
+// peak it prints the mean and the worst error over -r windows without
+// oversampling, and with 4 and 16 samples per oversampled one. The window
+// always spans the same time (-c cycles). Exits 1 if, with the sketch's
+// setting (4 samples per oversampled one), a window is off by more than
+// 1% + half a count.
+//
+//   g++ -O2 -std=c++11 -I../../lib/PumpGuard rmscheck.cpp -o rmscheck
+//
+//   rmscheck [-f MHz] [-m mains Hz] [-c cycles] [-n noise] [-3 percent] [-o offset] [-r runs] [-s seed]
+//     default: 8 MHz, 50 Hz, 4 cycles, 0.5 counts noise, 10% 3rd harmonic,
+//              offset 512, 200 runs
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include "AcRms.h"
+
+namespace
+{
+struct Setup
+{
+    double fcpu = 8e6;
+    double mains = 50;
+    double cycles = 4;
+    double noise = 0.5;
+    double harmonic = 10; // percent of the fundamental
+    double offset = 512;
+    unsigned runs = 200;
+};
+
+struct Errors
+{
+    double sum = 0, worst = 0; // counts
+    unsigned n = 0;
+};
+
+// One window of the sampler against the signal's true RMS
+double window(const Setup &s, double peak, uint8_t bits, std::mt19937 &rng, double &truth)
+{
+    const double rate = s.fcpu / 64 / 13;
+    const uint16_t samples = (uint16_t)(rate * s.cycles / s.mains) >> (2 * bits);
+    std::uniform_real_distribution<double> phase(0, 2 * M_PI);
+    std::normal_distribution<double> noise(0, s.noise);
+
+    AcRms rms(samples, bits);
+    // the sampler's center follows the mean; start a window in, as it runs
+    for (int pass = 0; pass < 2; pass++)
+    {
+        rms.begin();
+        double p1 = phase(rng), p3 = phase(rng);
+        for (uint32_t i = 0; !rms.done(); i++)
+        {
+            double t = i / rate;
+            double x = s.offset + peak * sin(2 * M_PI * s.mains * t + p1) +
+                       peak * s.harmonic / 100 * sin(6 * M_PI * s.mains * t + p3) + noise(rng);
+            long raw = lround(x);
+            rms.add(raw < 0 ? 0 : raw > 1023 ? 1023 : raw);
+        }
+        rms.finish();
+    }
+    truth = peak * sqrt((1 + s.harmonic * s.harmonic / 10000) / 2);
+    return rms.rmsX16() / 16.0;
+}
+
+bool parse(const char *s, double &v)
+{
+    char *end;
+    v = strtod(s, &end);
+    return end != s && !*end && v >= 0;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Setup s;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = i + 1 < argc;
+        double v = 0;
+        if (ok)
+            ok = parse(argv[i + 1], v);
+        if (!ok)
+            ;
+        else if (strcmp(argv[i], "-f") == 0)
+            s.fcpu = v * 1e6;
+        else if (strcmp(argv[i], "-m") == 0)
+            s.mains = v;
+        else if (strcmp(argv[i], "-c") == 0)
+            s.cycles = v;
+        else if (strcmp(argv[i], "-n") == 0)
+            s.noise = v;
+        else if (strcmp(argv[i], "-3") == 0)
+            s.harmonic = v;
+        else if (strcmp(argv[i], "-o") == 0)
+            s.offset = v;
+        else if (strcmp(argv[i], "-r") == 0)
+            s.runs = (unsigned)v;
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = (unsigned)v;
+        else
+            ok = false;
+        if (!ok || s.fcpu <= 0 || s.mains <= 0 || s.cycles <= 0 || s.runs == 0)
+        {
+            fprintf(stderr, "usage: rmscheck [-f MHz] [-m mains Hz] [-c cycles] [-n noise] [-3 percent] [-o offset] "
+                            "[-r runs] [-s seed]\n");
+            return 2;
+        }
+        i++;
+    }
+    std::mt19937 rng(seed);
+
+    const double rate = s.fcpu / 64 / 13;
+    printf("ADC %.0f Hz, %g cycles of %g Hz, noise %.2f counts, 3rd harmonic %g%%, sizeof(AcRms) %u bytes\n", rate,
+           s.cycles, s.mains, s.noise, s.harmonic, (unsigned)sizeof(AcRms));
+    printf("samples per window:");
+    for (uint8_t bits = 0; bits <= 2; bits++)
+        printf(" %u (x%u)", (unsigned)((uint16_t)(rate * s.cycles / s.mains) >> (2 * bits)), 1u << (2 * bits));
+    printf("\n\n");
+    printf("   peak     rms |   x1: mean  worst |   x4: mean  worst      %% |  x16: mean  worst   (counts)\n");
+
+    bool failed = false;
+    const double peaks[] = {0.5, 1, 2, 5, 10, 20, 50, 100, 200, 400};
+    for (double peak : peaks)
+    {
+        Errors e[3];
+        double truth = 0;
+        for (uint8_t bits = 0; bits <= 2; bits++)
+            for (unsigned r = 0; r < s.runs; r++)
+            {
+                double err = fabs(window(s, peak, bits, rng, truth) - truth);
+                e[bits].sum += err;
+                e[bits].worst = fmax(e[bits].worst, err);
+                e[bits].n++;
+                if (bits == 1 && err > truth / 100 + 0.5)
+                    failed = true;
+            }
+        printf("%7.1f %7.2f | %10.3f %6.3f | %10.3f %6.3f %6.2f | %10.3f %6.3f\n", peak, truth, e[0].sum / e[0].n,
+               e[0].worst, e[1].sum / e[1].n, e[1].worst, e[1].worst * 100 / truth, e[2].sum / e[2].n, e[2].worst);
+    }
+    return failed ? 1 : 0;
+}
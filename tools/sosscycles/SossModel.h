@@ -0,0 +1,356 @@
+// Cycle model of SendOnlySoftwareSerial's two transmitters
+//
+// Shared by sosscycles and test/test_soss_timing: the port write times of
+// a frame under each model, the figures analyse() derives from them, and
+// selfCheck(), the instruction level run of the template against
+// SendOnlyTiming.h. See sosscycles.cpp for what the figures mean.
+
+#ifndef SossModel_h
+#define SossModel_h
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "SendOnlyTiming.h"
+
+namespace sossmodel
+{
+const int slots = 10; // start, 8 data bits, stop
+
+// Port write times of one frame, in cycles from the start bit's write
+struct Frame
+{
+    long write[slots];
+    long stopHold; // shortest time from the stop write to the next start write
+};
+
+// A timing model: the frame for a byte, or false when the rate cannot be made
+struct Model
+{
+    std::string name;
+    virtual ~Model() {}
+    virtual bool frame(uint32_t fcpu, uint32_t baud, uint8_t b, Frame &f) const = 0;
+    virtual long bitCycles(uint32_t fcpu, uint32_t baud) const = 0;
+};
+
+// SendOnlySoftwareSerial::begin() and write() with given loop overheads
+struct Classic : Model
+{
+    int startOverhead, bitOverhead, stopOverhead;
+
+    Classic(const char *n, int start, int bit, int stop) : startOverhead(start), bitOverhead(bit), stopOverhead(stop)
+    {
+        name = n;
+    }
+
+    // _tx_delay as begin() computes it, in _delay_loop_2 passes
+    static long txDelay(uint32_t fcpu, uint32_t baud)
+    {
+        uint16_t bitDelay = (fcpu / baud) / 4;
+        uint16_t sub = 15 / 4;
+        return bitDelay > sub ? bitDelay - sub : 1;
+    }
+
+    // _delay_loop_2 takes 4 cycles a pass, 0 means 65536 passes
+    static long loopCycles(long passes)
+    {
+        return 4 * (passes ? passes : 65536);
+    }
+
+    bool frame(uint32_t fcpu, uint32_t baud, uint8_t, Frame &f) const
+    {
+        long d = loopCycles(txDelay(fcpu, baud));
+        f.write[0] = 0;
+        f.write[1] = d + startOverhead;
+        for (int k = 2; k < slots - 1; k++)
+            f.write[k] = f.write[k - 1] + d + bitOverhead;
+        f.write[slots - 1] = f.write[slots - 2] + d + stopOverhead;
+        // out SREG, the delay, then at least the read-modify-write of the
+        // next start bit
+        f.stopHold = 1 + d + 3;
+        return true;
+    }
+
+    long bitCycles(uint32_t fcpu, uint32_t baud) const
+    {
+        return loopCycles(txDelay(fcpu, baud)) + bitOverhead;
+    }
+};
+
+// SendOnlySoftwareSerialT::write(), instruction by instruction. Port
+// writes (sbi/cbi) count as done at the end of the instruction, which
+// shifts all edges alike.
+struct Template : Model
+{
+    enum Op
+    {
+        START,   // sbi/cbi, 2
+        LDI,     // 1
+        DELAY,   // ldi, ldi, sbiw/brne loop, nops; arg 0 start, 1 bit
+        SBRC,    // 1, 2 when skipping
+        SBI,     // 2
+        SBRS,    // 1, 2 when skipping
+        CBI,     // 2
+        LSR,     // 1
+        DEC,     // 1
+        BRNE,    // 2 taken, 1 not taken; back to the SBRC
+        NOP,     // 1
+        STOP,    // sbi/cbi, 2
+        OUTSREG, // 1
+        DELAYC   // __builtin_avr_delay_cycles(stopDelay), exact
+    };
+
+    struct Insn
+    {
+        Op op;
+        int arg;
+    };
+
+    std::vector<Insn> program;
+
+    Template()
+    {
+        name = "template";
+        const Insn code[] = {{START, 0}, {LDI, 0}, {DELAY, 0}, {SBRC, 0}, {SBI, 0}, {SBRS, 0}, {CBI, 0},
+                             {LSR, 0},   {DELAY, 1}, {DEC, 0}, {BRNE, 3}, {NOP, 0}, {NOP, 0}, {NOP, 0},
+                             {STOP, 0},  {OUTSREG, 0}, {DELAYC, 0}};
+        program.assign(code, code + sizeof(code) / sizeof(code[0]));
+    }
+
+    // ldi lo8, ldi hi8, passes of sbiw (2) and brne (2, 1 on the last), nops
+    static long delayCycles(long passes, int nops)
+    {
+        return 2 + 4 * passes - 1 + nops;
+    }
+
+    bool frame(uint32_t fcpu, uint32_t baud, uint8_t b, Frame &f) const
+    {
+        if (!soss::feasible(fcpu, baud))
+            return false;
+        uint32_t c = soss::bitCycles(fcpu, baud);
+        const uint32_t delays[2] = {soss::startDelay(c), soss::bitDelay(c)};
+
+        long t = 0, start = 0, stop = 0;
+        int writes = 0;
+        uint8_t bits = 0;
+        bool zero = false;
+        for (size_t pc = 0; pc < program.size();)
+        {
+            const Insn &i = program[pc++];
+            switch (i.op)
+            {
+            case START:
+                t += 2;
+                start = t;
+                f.write[writes++] = 0;
+                break;
+            case LDI:
+                bits = 8;
+                t += 1;
+                break;
+            case DELAY:
+                t += delayCycles(soss::delayLoops(delays[i.arg]), soss::delayNops(delays[i.arg]));
+                break;
+            case SBRC: // skip the sbi when the bit is clear
+                if (b & 1)
+                    t += 1;
+                else
+                {
+                    t += 2;
+                    pc++;
+                }
+                break;
+            case SBRS: // skip the cbi when the bit is set
+                if (b & 1)
+                {
+                    t += 2;
+                    pc++;
+                }
+                else
+                    t += 1;
+                break;
+            case SBI:
+            case CBI:
+                t += 2;
+                f.write[writes++] = t - start;
+                break;
+            case LSR:
+                b >>= 1;
+                t += 1;
+                break;
+            case DEC:
+                zero = --bits == 0;
+                t += 1;
+                break;
+            case BRNE:
+                if (!zero)
+                {
+                    t += 2;
+                    pc = i.arg;
+                }
+                else
+                    t += 1;
+                break;
+            case NOP:
+                t += 1;
+                break;
+            case STOP:
+                t += 2;
+                stop = t;
+                f.write[writes++] = t - start;
+                break;
+            case OUTSREG:
+                t += 1;
+                break;
+            case DELAYC:
+                t += soss::stopDelay(c);
+                break;
+            }
+        }
+        // the next write()'s start bit takes at least its own sbi/cbi
+        f.stopHold = t - stop + 2;
+        return writes == slots;
+    }
+
+    long bitCycles(uint32_t fcpu, uint32_t baud) const
+    {
+        return soss::bitCycles(fcpu, baud);
+    }
+};
+
+// Figures in thousandths of a bit, worst over all byte values
+struct Result
+{
+    bool feasible;
+    long bitCycles;
+    double rateError;  // percent
+    double edge;       // worst |offset| of a port write
+    double drift;      // offset of the stop write
+    double margin;     // worst sample distance from an edge
+    double stop;       // shortest stop bit
+    double slotOffset[slots]; // worst signed offset per write
+    double slotMargin[slots];
+};
+
+inline Result analyse(const Model &model, uint32_t fcpu, uint32_t baud)
+{
+    Result r;
+    memset(&r, 0, sizeof(r));
+    const double bit = (double)fcpu / baud;
+    r.bitCycles = model.bitCycles(fcpu, baud);
+    r.margin = r.stop = 1e9;
+    for (int k = 0; k < slots; k++)
+        r.slotMargin[k] = 1e9;
+
+    for (int b = 0; b < 256; b++)
+    {
+        Frame f;
+        if (!model.frame(fcpu, baud, b, f))
+            return r;
+        for (int k = 0; k < slots; k++)
+        {
+            double offset = (f.write[k] - k * bit) * 1000 / bit;
+            if (fabs(offset) > fabs(r.slotOffset[k]))
+                r.slotOffset[k] = offset;
+            if (fabs(offset) > r.edge)
+                r.edge = fabs(offset);
+
+            // the receiver samples at the middle of the bit, timed from
+            // the start edge with its own (here perfect) clock
+            double sample = (k + 0.5) * bit;
+            long end = k + 1 < slots ? f.write[k + 1] : f.write[k] + f.stopHold;
+            double margin = fmin(sample - f.write[k], end - sample) * 1000 / bit;
+            if (margin < r.slotMargin[k])
+                r.slotMargin[k] = margin;
+            if (margin < r.margin)
+                r.margin = margin;
+        }
+        double drift = (f.write[slots - 1] - (slots - 1) * bit) * 1000 / bit;
+        if (fabs(drift) >= fabs(r.drift))
+            r.drift = drift;
+        r.rateError = 100.0 * (f.write[slots - 1] / (slots - 1.0) - bit) / bit;
+        r.stop = fmin(r.stop, f.stopHold * 1000 / bit);
+    }
+    r.feasible = true;
+    return r;
+}
+
+inline const char *verdict(const Result &r, long limit)
+{
+    if (!r.feasible)
+        return "-";
+    if (r.edge <= limit && r.margin > 0 && r.stop >= 500)
+        return "ok";
+    if (r.margin >= 100 && r.stop >= 500)
+        return "marginal";
+    return "FAIL";
+}
+
+// The template's instruction level run against SendOnlyTiming.h
+inline int selfCheck(const std::vector<uint32_t> &clocks, const std::vector<uint32_t> &bauds)
+{
+    Template model;
+    int checked = 0, failed = 0;
+    for (uint32_t fcpu : clocks)
+        for (uint32_t baud : bauds)
+        {
+            if (!soss::feasible(fcpu, baud))
+                continue;
+            const long c = soss::bitCycles(fcpu, baud);
+            for (uint32_t d : {soss::startDelay(c), soss::bitDelay(c)})
+                if (soss::delayLoops(d) < 1 || Template::delayCycles(soss::delayLoops(d), soss::delayNops(d)) != (long)d)
+                {
+                    printf("%.2f MHz %lu baud: a delay of %lu cycles does not fit the loop\n", fcpu / 1e6,
+                           (unsigned long)baud, (unsigned long)d);
+                    failed++;
+                }
+            for (int b = 0; b < 256; b++)
+            {
+                Frame f;
+                if (!model.frame(fcpu, baud, b, f))
+                {
+                    printf("%.2f MHz %lu baud: the program did not write %d times\n", fcpu / 1e6,
+                           (unsigned long)baud, slots);
+                    failed++;
+                    break;
+                }
+                for (int k = 1; k < slots - 1; k++)
+                {
+                    long expect = k * c + ((b >> (k - 1) & 1) ? -soss::edgeJitter : soss::edgeJitter);
+                    if (f.write[k] != expect)
+                    {
+                        printf("%.2f MHz %lu baud byte %02X: bit %d at %ld, SendOnlyTiming.h says %ld\n", fcpu / 1e6,
+                               (unsigned long)baud, b, k - 1, f.write[k], expect);
+                        failed++;
+                    }
+                }
+                if (f.write[slots - 1] != (slots - 1) * c)
+                {
+                    printf("%.2f MHz %lu baud byte %02X: stop edge at %ld, not %ld\n", fcpu / 1e6,
+                           (unsigned long)baud, b, f.write[slots - 1], (slots - 1) * c);
+                    failed++;
+                }
+                if (f.stopHold < c)
+                {
+                    printf("%.2f MHz %lu baud byte %02X: stop bit %ld cycles, not %ld\n", fcpu / 1e6,
+                           (unsigned long)baud, b, f.stopHold, c);
+                    failed++;
+                }
+            }
+            Result r = analyse(model, fcpu, baud);
+            if (r.edge > soss::offsetPermille(fcpu, baud) + 1) // offsetPermille() rounds down
+            {
+                printf("%.2f MHz %lu baud: worst edge %.1f, offsetPermille() %lu\n", fcpu / 1e6, (unsigned long)baud,
+                       r.edge, (unsigned long)soss::offsetPermille(fcpu, baud));
+                failed++;
+            }
+            checked++;
+        }
+    printf("%d rates checked, %d mismatches\n", checked, failed);
+    return failed ? 1 : 0;
+}
+} // namespace sossmodel
+
+#endif // SossModel_h
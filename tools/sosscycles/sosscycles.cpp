@@ -0,0 +1,171 @@
+// Cycle model and baud rate check for SendOnlySoftwareSerial
+//
+// Both transmitters time their bits by counting CPU cycles, which nobody
+// can check without a scope. sosscycles works out, cycle by cycle, when
+// each port write of a frame happens and compares that with the ideal
+// bit times:
+//
+//   classic   SendOnlySoftwareSerial: the delay begin() computes, with
+//             the loop overheads its comment quotes for gcc 4.8.2 (12
+//             cycles start to first bit, 15 between bits, 12 last bit to
+//             stop) and gcc 4.3.2 (13, 16, 14), or the ones given with
+//             -o, counted from an avr-objdump listing of write() after a
+//             compiler upgrade
+//   template  SendOnlySoftwareSerialT: runs its inline assembler
+//             instruction by instruction, for all 256 byte values
+//
+// For each F_CPU and baud rate it prints:
+//
+//   cyc/bit   cycles between two data bits
+//   rate      error of the mean bit time up to the stop edge
+//   edge      worst distance of a port write from its ideal place
+//   drift     where the stop edge lands, + late, - early
+//   margin    worst distance of the receiver's mid-bit sample from the
+//             nearest edge, 500 for perfect timing
+//   stop      shortest stop bit when write() is called back to back
+//
+// all in thousandths of a bit. A row is ok when the edge figure is within
+// the limit (-l, default SOSS_MAX_OFFSET_PERMILLE, as the template's
+// static_assert), marginal when the receiver still samples every bit
+// inside its bit with 0.1 bit to spare, and fails otherwise. -v adds the
+// per-bit figures.
+//
+// -c checks the template's model instead: that the instruction level run
+// puts every edge where SendOnlyTiming.h says, that the stop edge is
+// exactly 9 bit times after the start edge, and that offsetPermille() is
+// a true bound. It exits 1 on any mismatch. The models live in
+// SossModel.h, and test/test_soss_timing runs the same check in the
+// native tests.
+//
+//   g++ -O2 -std=c++11 -I../../lib/SendOnlySoftwareSerial sosscycles.cpp -o sosscycles
+//
+//   sosscycles [-m classic|template] [-f MHz,...] [-b baud,...] [-o start,bit,stop] [-l permille] [-v]
+//   sosscycles -c
+//   Default: both models, 1, 8, 16, 16.5 and 20 MHz, 300 to 115200 baud.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "SossModel.h"
+
+using namespace sossmodel;
+
+namespace
+{
+void printResult(const Model &model, uint32_t fcpu, uint32_t baud, long limit, bool verbose)
+{
+    Result r = analyse(model, fcpu, baud);
+    printf("%-9s %6.2f %7lu", model.name.c_str(), fcpu / 1e6, (unsigned long)baud);
+    if (!r.feasible)
+    {
+        printf("  %7s  too fast for the code\n", "-");
+        return;
+    }
+    printf("  %7ld %+7.2f%% %6.0f %+6.0f %6.0f %6.0f  %s\n", r.bitCycles, r.rateError, r.edge, r.drift, r.margin,
+           r.stop, verdict(r, limit));
+    if (verbose)
+    {
+        static const char *const names[slots] = {"start", "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "stop"};
+        printf("%27s", "offset");
+        for (int k = 0; k < slots; k++)
+            printf(" %5s:%+4.0f", names[k], r.slotOffset[k]);
+        printf("\n%27s", "margin");
+        for (int k = 0; k < slots; k++)
+            printf(" %5s:%4.0f", names[k], r.slotMargin[k]);
+        printf("\n");
+    }
+}
+
+template <typename T> bool parseList(const char *s, double scale, std::vector<T> &out)
+{
+    out.clear();
+    while (*s)
+    {
+        char *end;
+        double v = strtod(s, &end);
+        if (end == s || v <= 0)
+            return false;
+        out.push_back((T)(v * scale + 0.5));
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return false;
+    }
+    return !out.empty();
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<uint32_t> clocks = {1000000, 8000000, 16000000, 16500000, 20000000};
+    std::vector<uint32_t> bauds = {300, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+    const char *modelName = NULL;
+    const char *overheads = NULL;
+    long limit = SOSS_MAX_OFFSET_PERMILLE;
+    bool verbose = false, check = false;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = true;
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+            modelName = argv[++i];
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            ok = parseList(argv[++i], 1e6, clocks);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            ok = parseList(argv[++i], 1, bauds);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            overheads = argv[++i];
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            limit = atol(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[i], "-c") == 0)
+            check = true;
+        else
+            ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "usage: sosscycles [-m classic|template] [-f MHz,...] [-b baud,...] [-o start,bit,stop] "
+                            "[-l permille] [-v]\n       sosscycles -c\n");
+            return 2;
+        }
+    }
+
+    if (check)
+        return selfCheck(clocks, bauds);
+
+    std::vector<Model *> models;
+    if (!modelName || strcmp(modelName, "classic") == 0)
+    {
+        int start, bit, stop;
+        if (overheads)
+        {
+            if (sscanf(overheads, "%d,%d,%d", &start, &bit, &stop) != 3)
+            {
+                fprintf(stderr, "-o wants start,bit,stop cycles, e.g. 12,15,12\n");
+                return 2;
+            }
+            models.push_back(new Classic("classic", start, bit, stop));
+        }
+        else
+        {
+            models.push_back(new Classic("gcc-4.8", 12, 15, 12));
+            models.push_back(new Classic("gcc-4.3", 13, 16, 14));
+        }
+    }
+    if (!modelName || strcmp(modelName, "template") == 0)
+        models.push_back(new Template);
+    if (models.empty())
+    {
+        fprintf(stderr, "unknown model %s\n", modelName);
+        return 2;
+    }
+
+    printf("model       MHz    baud  cyc/bit    rate   edge  drift margin   stop\n");
+    for (const Model *model : models)
+        for (uint32_t fcpu : clocks)
+            for (uint32_t baud : bauds)
+                printResult(*model, fcpu, baud, limit, verbose);
+    for (Model *model : models)
+        delete model;
+    return 0;
+}
@@ -0,0 +1,267 @@
+// Waveform check for SendOnlyMultiSerial
+//
+// SendOnlyMultiSerial (lib/SendOnlySoftwareSerial) sends up to 8 channels
+// at once from bit-sliced frames. sossmulti builds those frames with the
+// library's own SendOnlyMultiFrame.h, runs its transmit loop cycle by
+// cycle to get the port writes, and decodes every channel from the
+// resulting waveform the way a UART would: wait for the start edge,
+// sample each bit in its middle, check the stop bit. For random pin sets,
+// channel subsets, bytes, polarities and other port bits it checks that
+//
+//   every sending channel decodes to its byte, with a full stop bit
+//   channels that do not send stay idle
+//   port bits that are not channels are written back unchanged
+//   no edge is further than -l thousandths of a bit from its ideal place
+//
+// and prints, per F_CPU and baud rate, the worst edge offset and how long
+// interrupts stay off per frame, which is the same for 1 or 8 channels.
+// Exits 1 on any failure.
+//
+//   g++ -O2 -std=c++11 -I../../lib/SendOnlySoftwareSerial sossmulti.cpp -o sossmulti
+//
+//   sossmulti [-f MHz,...] [-b baud,...] [-n frames] [-l permille] [-s seed] [-w]
+//     -n   frames per rate, default 2000
+//     -w   draw the first frame of each rate, one line per port bit
+//   Default: 1, 8, 16, 16.5 and 20 MHz, 300 to 230400 baud.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "SendOnlyMultiFrame.h"
+#include "SendOnlyTiming.h"
+
+namespace
+{
+struct Write
+{
+    long at; // cycles after the loop starts
+    uint8_t port;
+};
+
+// The transmit loop of SendOnlyMultiSerial::sendFrame(): port writes, and
+// the cycle interrupts go back on
+long run(const uint8_t frame[soss::multiFrameSize], uint8_t other, std::vector<Write> &writes)
+{
+    writes.clear();
+    long t = 0;
+    const uint8_t *slot = frame;
+    for (uint8_t k = 0; k < soss::multiSlots; k++, slot += soss::multiSlotBytes)
+    {
+        t += 2 + 1 + 2; // ld, or, st
+        Write w = {t, (uint8_t)(slot[0] | other)};
+        writes.push_back(w);
+        uint16_t count = slot[1] | slot[2] << 8;
+        t += 2 + 2;                           // ld, ld
+        t += 4 * (count ? count : 65536) - 1; // sbiw/brne
+        t += 1;                               // dec
+        t += k + 1 < soss::multiSlots ? 2 : 1;
+    }
+    return t + 1; // out SREG
+}
+
+// Level of port bit p at cycle t
+int levelAt(const std::vector<Write> &writes, uint8_t idlePort, int p, double t)
+{
+    uint8_t port = idlePort;
+    for (const Write &w : writes)
+    {
+        if (w.at > t)
+            break;
+        port = w.port;
+    }
+    return port >> p & 1;
+}
+
+struct Totals
+{
+    unsigned long frames, errors;
+    double worstEdge; // permille of a bit
+    long irqOff;      // cycles
+};
+
+bool fail(Totals &totals, const char *what, uint32_t fcpu, uint32_t baud, int p)
+{
+    if (totals.errors++ >= 10)
+        return false;
+    if (p < 0)
+        printf("%.2f MHz %lu baud: %s\n", fcpu / 1e6, (unsigned long)baud, what);
+    else
+        printf("%.2f MHz %lu baud: port bit %d: %s\n", fcpu / 1e6, (unsigned long)baud, p, what);
+    return false;
+}
+
+void draw(const std::vector<Write> &writes, uint8_t idlePort, long end, double bit)
+{
+    const int columns = 100;
+    for (int p = 7; p >= 0; p--)
+    {
+        printf("  bit %d ", p);
+        for (int c = 0; c < columns; c++)
+            putchar(levelAt(writes, idlePort, p, writes[0].at - bit / 2 + c * (end - writes[0].at + bit) / columns)
+                        ? '-'
+                        : '_');
+        putchar('\n');
+    }
+}
+
+bool frameOk(uint32_t fcpu, uint32_t baud, const uint16_t counts[soss::multiSlots], uint16_t stopLoops, long limit,
+             bool show, Totals &totals)
+{
+    // a random channel set, as SendOnlyMultiSerial's constructor and
+    // write() map it: channels on port bits, bytes by port bit
+    uint8_t pins = rand() & 0xFF;
+    if (!pins)
+        pins = 1 << (rand() % 8);
+    uint8_t send = rand() & pins;
+    bool inverse = rand() & 1;
+    uint8_t bytes[8];
+    for (int p = 0; p < 8; p++)
+        bytes[p] = rand();
+    uint8_t other = rand() & ~pins;
+
+    uint8_t frame[soss::multiFrameSize];
+    soss::buildMultiFrame(bytes, send, pins, inverse, counts, frame);
+    std::vector<Write> writes;
+    long irqOff = run(frame, other, writes);
+    totals.irqOff = irqOff;
+    totals.frames++;
+
+    const double bit = (double)fcpu / baud;
+    const uint8_t idle = inverse ? 0 : pins;
+    const uint8_t idlePort = idle | other;
+    const long stopEnd = irqOff + 4L * stopLoops;
+    if (show)
+    {
+        printf("%.2f MHz %lu baud, channels %02X sending %02X%s:\n", fcpu / 1e6, (unsigned long)baud, pins, send,
+               inverse ? " inverse" : "");
+        draw(writes, idlePort, stopEnd, bit);
+    }
+
+    double worst = 0;
+    for (size_t k = 0; k < writes.size(); k++)
+    {
+        worst = fmax(worst, fabs(writes[k].at - writes[0].at - k * bit) * 1000 / bit);
+        if ((writes[k].port & ~pins) != other)
+            return fail(totals, "other port bits changed", fcpu, baud, -1);
+    }
+    totals.worstEdge = fmax(totals.worstEdge, worst);
+    if (worst > limit)
+        return fail(totals, "edge too far from its place", fcpu, baud, -1);
+
+    for (int p = 0; p < 8; p++)
+    {
+        if (!(pins >> p & 1))
+            continue;
+        int idleLevel = idle >> p & 1;
+        if (!(send >> p & 1))
+        {
+            for (const Write &w : writes)
+                if ((w.port >> p & 1) != idleLevel)
+                    return fail(totals, "idle channel moved", fcpu, baud, p);
+            continue;
+        }
+
+        // a UART: the start edge, then mid-bit samples from it
+        long start = -1;
+        for (const Write &w : writes)
+            if ((w.port >> p & 1) != idleLevel)
+            {
+                start = w.at;
+                break;
+            }
+        if (start < 0)
+            return fail(totals, "no start bit", fcpu, baud, p);
+        if (levelAt(writes, idlePort, p, start + bit / 2) == idleLevel)
+            return fail(totals, "start bit too short", fcpu, baud, p);
+        uint8_t b = 0;
+        for (int j = 0; j < 8; j++)
+            b |= (levelAt(writes, idlePort, p, start + (j + 1.5) * bit) ^ inverse) << j;
+        if (b != bytes[p])
+        {
+            char what[40];
+            snprintf(what, sizeof(what), "sent %02X, received %02X", bytes[p], b);
+            return fail(totals, what, fcpu, baud, p);
+        }
+        if (levelAt(writes, idlePort, p, start + 9.5 * bit) != idleLevel)
+            return fail(totals, "no stop bit", fcpu, baud, p);
+        // the next frame's start edge comes after stopEnd
+        if (stopEnd < start + 10 * bit - 1)
+            return fail(totals, "stop bit too short", fcpu, baud, p);
+    }
+    return true;
+}
+
+template <typename T> bool parseList(const char *s, double scale, std::vector<T> &out)
+{
+    out.clear();
+    while (*s)
+    {
+        char *end;
+        double v = strtod(s, &end);
+        if (end == s || v <= 0 || (*end && *end != ','))
+            return false;
+        out.push_back((T)(v * scale + 0.5));
+        s = *end ? end + 1 : end;
+    }
+    return !out.empty();
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<uint32_t> clocks = {1000000, 8000000, 16000000, 16500000, 20000000};
+    std::vector<uint32_t> bauds = {300, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400};
+    unsigned long frames = 2000;
+    long limit = SOSS_MAX_OFFSET_PERMILLE;
+    unsigned seed = 1;
+    bool show = false;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = true;
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            ok = parseList(argv[++i], 1e6, clocks);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            ok = parseList(argv[++i], 1, bauds);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            frames = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            limit = atol(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-w") == 0)
+            show = true;
+        else
+            ok = false;
+        if (!ok)
+        {
+            fprintf(stderr,
+                    "usage: sossmulti [-f MHz,...] [-b baud,...] [-n frames] [-l permille] [-s seed] [-w]\n");
+            return 2;
+        }
+    }
+    srand(seed);
+
+    bool failed = false;
+    printf("    MHz    baud  cyc/bit   edge  irq off/frame  frames  errors\n");
+    for (uint32_t fcpu : clocks)
+        for (uint32_t baud : bauds)
+        {
+            uint16_t counts[soss::multiSlots];
+            if (!soss::multiCounts(fcpu, baud, counts))
+            {
+                printf("%7.2f %7lu  %7s  too fast for the loop\n", fcpu / 1e6, (unsigned long)baud, "-");
+                continue;
+            }
+            uint16_t stopLoops = soss::multiStopLoops(fcpu, baud);
+            Totals totals;
+            memset(&totals, 0, sizeof(totals));
+            for (unsigned long n = 0; n < frames; n++)
+                frameOk(fcpu, baud, counts, stopLoops, limit, show && n == 0, totals);
+            printf("%7.2f %7lu  %7.1f %6.0f %8.0f us %7lu %7lu\n", fcpu / 1e6, (unsigned long)baud,
+                   (double)fcpu / baud, totals.worstEdge, totals.irqOff * 1e6 / fcpu, totals.frames, totals.errors);
+            failed |= totals.errors != 0;
+        }
+    return failed ? 1 : 0;
+}
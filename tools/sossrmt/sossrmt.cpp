@@ -0,0 +1,347 @@
+// Host check of SendOnlySoftwareSerial's ESP32 RMT backend
+//
+// SendOnlySoftwareSerialRmt.cpp turns queued bytes into RMT items and
+// leaves the timing to the peripheral, so what goes out on the pin is
+// decided by the items alone. sossrmt compiles the backend unchanged
+// against stub IDF headers (stub/) and implements the legacy RMT driver
+// calls as a model of one RMT: rmt_fill_tx_items() loads a channel's
+// memory block, the items play when the backend waits (delay()), a zero
+// duration ends the chunk and the tx end callback runs as the interrupt
+// would. Between chunks the line idles for -g microseconds, the
+// interrupt latency. It then decodes each line the way a UART would:
+// wait for the start edge, sample every bit in its middle, check the stop
+// bit.
+//
+// Per baud rate two instances, one of each polarity, send -n random bytes
+// interleaved on two channels. For each it prints the clock divider, RMT
+// ticks per bit, chunks played, the most items in one chunk, the worst
+// edge offset from its ideal place and the shortest stop bit, both in
+// thousandths of a bit. Exits 1 when a byte decodes wrong, a chunk does
+// not fit the 64 items of a memory block, a channel is started while it
+// is still sending, or the critical sections do not pair up.
+//
+//   g++ -O2 -std=c++11 -DARDUINO_ARCH_ESP32 -Istub -I../../test/host -I../../lib/SendOnlySoftwareSerial sossrmt.cpp ../../lib/SendOnlySoftwareSerial/SendOnlySoftwareSerialRmt.cpp -o sossrmt
+//
+//   sossrmt [-b baud,...] [-n bytes] [-g gap us] [-s seed]
+//     default: 300, 9600, 115200 and 1000000 baud, 300 bytes, 5 us
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include <SendOnlySoftwareSerial.h>
+#include <soc/soc.h>
+
+namespace
+{
+struct Edge
+{
+    double at; // RMT ticks from the start of the line
+    int level; // pin level from here on
+};
+
+// One RMT channel and the line it drives
+struct Channel
+{
+    bool installed;
+    bool running;
+    uint8_t div;
+    int idle;
+    std::vector<rmt_item32_t> mem;
+    std::vector<Edge> line;
+    double now;
+    unsigned chunks, maxItems;
+};
+
+Channel channels[RMT_CHANNEL_MAX];
+rmt_tx_end_fn_t txEndFn;
+void *txEndArg;
+int critical;
+bool inIsr;
+double gapTicksPerDiv; // -g at a divider of 1
+unsigned faults;
+
+void fault(const char *what, int channel)
+{
+    printf("channel %d: %s\n", channel, what);
+    faults++;
+}
+
+void level(Channel &c, int level)
+{
+    if (c.line.empty() || c.line.back().level != level)
+    {
+        Edge e = {c.now, level};
+        c.line.push_back(e);
+    }
+}
+
+// The items of the memory block, up to the first zero duration
+void play(Channel &c)
+{
+    size_t n = 0;
+    for (const rmt_item32_t &item : c.mem)
+    {
+        n++;
+        if (!item.duration0)
+            break;
+        level(c, item.level0);
+        c.now += item.duration0;
+        if (!item.duration1)
+            break;
+        level(c, item.level1);
+        c.now += item.duration1;
+    }
+    level(c, c.idle);
+    c.now += gapTicksPerDiv / c.div;
+    c.chunks++;
+    if (n > c.maxItems)
+        c.maxItems = n;
+}
+
+struct Line
+{
+    double worstEdge;  // permille of a bit
+    double shortestStop;
+    std::vector<uint8_t> bytes;
+};
+
+int levelAt(const std::vector<Edge> &line, double t)
+{
+    size_t lo = 0, hi = line.size();
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (line[mid].at <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return line[lo].level;
+}
+
+// A UART receiver with a perfect clock, in logical levels
+Line decode(const std::vector<Edge> &line, double bit, bool inverse)
+{
+    Line r;
+    r.worstEdge = 0;
+    r.shortestStop = 1e9;
+    double lastStop = -1;
+    size_t e = 0;
+    while (e < line.size())
+    {
+        if ((line[e].level ^ inverse) != 0 || line[e].at < lastStop)
+        {
+            e++;
+            continue;
+        }
+        double s = line[e].at;
+        if (lastStop >= 0 && (s - lastStop) * 1000 / bit < r.shortestStop)
+            r.shortestStop = (s - lastStop) * 1000 / bit;
+        int frame = 0;
+        for (int k = 0; k < 10; k++)
+            frame |= (levelAt(line, s + (k + 0.5) * bit) ^ inverse) << k;
+        if (frame & 1 || !(frame & 0x200))
+            r.bytes.push_back(0xFF ^ (uint8_t)(frame >> 1)); // a framing error: make it differ
+        else
+            r.bytes.push_back((uint8_t)(frame >> 1));
+        for (e++; e < line.size() && line[e].at < s + 9.5 * bit; e++)
+        {
+            double d = line[e].at - s;
+            double offset = fabs(d - floor(d / bit + 0.5) * bit) * 1000 / bit;
+            if (offset > r.worstEdge)
+                r.worstEdge = offset;
+        }
+        lastStop = s + 9 * bit;
+    }
+    return r;
+}
+
+bool parseList(const char *s, std::vector<long> &out)
+{
+    out.clear();
+    while (*s)
+    {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v <= 0)
+            return false;
+        out.push_back(v);
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return false;
+    }
+    return !out.empty();
+}
+} // namespace
+
+//
+// The RMT driver, Arduino and FreeRTOS calls of the stub headers
+//
+
+void digitalWrite(uint8_t, uint8_t) {}
+
+void pinMode(uint8_t, uint8_t) {}
+
+// The backend only waits for the RMT: play every running channel's chunk
+// and run its tx end interrupt
+void delay(uint32_t)
+{
+    if (critical)
+        fault("delay() inside a critical section", -1);
+    for (int i = 0; i < RMT_CHANNEL_MAX; i++)
+    {
+        Channel &c = channels[i];
+        if (!c.running)
+            continue;
+        play(c);
+        c.running = false;
+        inIsr = true;
+        if (txEndFn)
+            txEndFn((rmt_channel_t)i, txEndArg);
+        inIsr = false;
+    }
+}
+
+esp_err_t rmt_config(const rmt_config_t *config)
+{
+    Channel &c = channels[config->channel];
+    c.div = config->clk_div;
+    c.idle = config->tx_config.idle_level == RMT_IDLE_LEVEL_HIGH;
+    level(c, c.idle);
+    c.now += gapTicksPerDiv / c.div;
+    return c.div ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t, int)
+{
+    if (channels[channel].installed)
+        fault("driver installed twice", channel);
+    channels[channel].installed = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel)
+{
+    if (channels[channel].running)
+        fault("driver removed while sending", channel);
+    channels[channel].installed = false;
+    return ESP_OK;
+}
+
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void *arg)
+{
+    rmt_tx_end_callback_t previous = {txEndFn, txEndArg};
+    txEndFn = function;
+    txEndArg = arg;
+    return previous;
+}
+
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t *item, uint16_t item_num, uint16_t mem_offset)
+{
+    if (mem_offset + item_num > RMT_MEM_ITEM_NUM)
+        fault("chunk does not fit a memory block", channel);
+    channels[channel].mem.assign(item, item + item_num);
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool)
+{
+    Channel &c = channels[channel];
+    if (!c.installed || c.running)
+        fault("started while not installed or still sending", channel);
+    c.running = true;
+    return ESP_OK;
+}
+
+void portENTER_CRITICAL(portMUX_TYPE *mux)
+{
+    if (mux->owner++)
+        fault("critical section entered twice", -1);
+    critical++;
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE *mux)
+{
+    if (--mux->owner)
+        fault("critical section left unbalanced", -1);
+    critical--;
+}
+
+bool xPortInIsrContext() { return inIsr; }
+
+int main(int argc, char **argv)
+{
+    std::vector<long> bauds = {300, 9600, 115200, 1000000};
+    long count = 300, gap = 5;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        bool ok = i + 1 < argc;
+        if (!ok)
+            ;
+        else if (strcmp(argv[i], "-b") == 0)
+            ok = parseList(argv[++i], bauds);
+        else if (strcmp(argv[i], "-n") == 0)
+            ok = (count = atol(argv[++i])) > 0;
+        else if (strcmp(argv[i], "-g") == 0)
+            ok = (gap = atol(argv[++i])) >= 0;
+        else if (strcmp(argv[i], "-s") == 0)
+            seed = (unsigned)atol(argv[++i]);
+        else
+            ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "usage: sossrmt [-b baud,...] [-n bytes] [-g gap us] [-s seed]\n");
+            return 2;
+        }
+    }
+    gapTicksPerDiv = gap * (APB_CLK_FREQ / 1000000.0);
+
+    std::mt19937 rng(seed);
+    unsigned bad = 0;
+    printf("   baud  inverse  div  ticks/bit  chunks  items   edge   stop\n");
+    for (long baud : bauds)
+    {
+        for (Channel &c : channels)
+            c = Channel();
+        std::vector<uint8_t> sent[2];
+        {
+            SendOnlySoftwareSerial normal(4), inverse(5, true);
+            SendOnlySoftwareSerial *serial[2] = {&normal, &inverse};
+            for (SendOnlySoftwareSerial *s : serial)
+                s->begin(baud);
+            if (!channels[0].installed || !channels[1].installed)
+            {
+                printf("%7ld  begin() refuses the rate\n", baud);
+                continue;
+            }
+            for (long k = 0; k < count; k++)
+                for (int j = 0; j < 2; j++)
+                {
+                    uint8_t b = rng();
+                    if (serial[j]->write(b) != 1)
+                        fault("write() failed", j);
+                    sent[j].push_back(b);
+                }
+            for (SendOnlySoftwareSerial *s : serial)
+                s->end();
+        }
+        for (int j = 0; j < 2; j++)
+        {
+            const Channel &c = channels[j];
+            double bit = APB_CLK_FREQ / (double)c.div / baud;
+            Line line = decode(c.line, bit, j == 1);
+            bool same = line.bytes == sent[j];
+            printf("%7ld  %7s  %3u  %9.1f  %6u  %5u  %5.0f  %5.0f  %s\n", baud, j ? "yes" : "no", c.div, bit,
+                   c.chunks, c.maxItems, line.worstEdge, line.shortestStop, same ? "ok" : "WRONG");
+            if (!same)
+                bad++;
+        }
+    }
+    if (faults)
+        printf("\n%u driver faults\n", faults);
+    return bad || faults ? 1 : 0;
+}
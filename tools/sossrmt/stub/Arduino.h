@@ -0,0 +1,21 @@
+// Arduino-ESP32 core stand-in for sossrmt
+//
+// The calls SendOnlySoftwareSerialRmt.cpp makes besides the RMT driver.
+// delay() is where the backend waits for the RMT, so sossrmt.cpp defines
+// it to play what the channels were given.
+
+#ifndef SOSSRMT_ARDUINO_H
+#define SOSSRMT_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIGH 0x1
+#define LOW 0x0
+#define OUTPUT 0x03
+
+void digitalWrite(uint8_t pin, uint8_t val);
+void pinMode(uint8_t pin, uint8_t mode);
+void delay(uint32_t ms);
+
+#endif // SOSSRMT_ARDUINO_H
@@ -0,0 +1,106 @@
+// ESP-IDF legacy driver/rmt.h stand-in for sossrmt
+//
+// The types and calls of the legacy RMT driver (IDF 4.x, as the Arduino
+// core ships it) that SendOnlySoftwareSerialRmt.cpp uses, with the same
+// names and layouts, plus the FreeRTOS critical sections the real header
+// pulls in. sossrmt.cpp implements the calls as a model of the RMT.
+
+#ifndef SOSSRMT_DRIVER_RMT_H
+#define SOSSRMT_DRIVER_RMT_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef int gpio_num_t;
+
+typedef enum
+{
+    RMT_CHANNEL_0,
+    RMT_CHANNEL_1,
+    RMT_CHANNEL_2,
+    RMT_CHANNEL_3,
+    RMT_CHANNEL_4,
+    RMT_CHANNEL_5,
+    RMT_CHANNEL_6,
+    RMT_CHANNEL_7,
+    RMT_CHANNEL_MAX
+} rmt_channel_t;
+
+typedef enum
+{
+    RMT_IDLE_LEVEL_LOW,
+    RMT_IDLE_LEVEL_HIGH
+} rmt_idle_level_t;
+
+// One entry of RMT memory: two (level, duration) halves, a zero duration ends the run
+typedef struct
+{
+    union
+    {
+        struct
+        {
+            uint32_t duration0 : 15;
+            uint32_t level0 : 1;
+            uint32_t duration1 : 15;
+            uint32_t level1 : 1;
+        };
+        uint32_t val;
+    };
+} rmt_item32_t;
+
+#define RMT_MEM_ITEM_NUM 64 // items in one channel's memory block
+
+typedef struct
+{
+    rmt_idle_level_t idle_level;
+    bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct
+{
+    rmt_channel_t channel;
+    gpio_num_t gpio_num;
+    uint8_t clk_div;
+    uint8_t mem_block_num;
+    rmt_tx_config_t tx_config;
+} rmt_config_t;
+
+inline rmt_config_t rmtDefaultConfigTx(gpio_num_t gpio, rmt_channel_t channel)
+{
+    rmt_config_t c = {channel, gpio, 80, 1, {RMT_IDLE_LEVEL_LOW, false}};
+    return c;
+}
+#define RMT_DEFAULT_CONFIG_TX(gpio, channel_id) rmtDefaultConfigTx(gpio, channel_id)
+
+typedef void (*rmt_tx_end_fn_t)(rmt_channel_t channel, void *arg);
+typedef struct
+{
+    rmt_tx_end_fn_t function;
+    void *arg;
+} rmt_tx_end_callback_t;
+
+esp_err_t rmt_config(const rmt_config_t *config);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags);
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel);
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void *arg);
+esp_err_t rmt_fill_tx_items(rmt_channel_t channel, const rmt_item32_t *item, uint16_t item_num, uint16_t mem_offset);
+esp_err_t rmt_tx_start(rmt_channel_t channel, bool tx_idx_rst);
+
+// FreeRTOS: one thread and no real interrupts, so a critical section
+// only has to be entered and left in pairs
+typedef struct
+{
+    int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void portENTER_CRITICAL(portMUX_TYPE *mux);
+void portEXIT_CRITICAL(portMUX_TYPE *mux);
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+bool xPortInIsrContext();
+
+#endif // SOSSRMT_DRIVER_RMT_H
@@ -0,0 +1,8 @@
+// ESP-IDF soc/soc.h stand-in for sossrmt: the RMT's clock
+
+#ifndef SOSSRMT_SOC_H
+#define SOSSRMT_SOC_H
+
+#define APB_CLK_FREQ (80 * 1000000)
+
+#endif // SOSSRMT_SOC_H
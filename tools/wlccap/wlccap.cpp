@@ -0,0 +1,395 @@
+// Receive the controller's capture stream into columnar files
+//
+// The firmware's capture command (lib/CaptureStream) sends COBS framed
+// records between the EventLog frames and console text on the same
+// port. wlccap splits the stream at the zero bytes, keeps every segment
+// that decodes to a frame with a valid CRC and passes the rest through
+// unchanged to the -l file, which logdecode reads as before.
+//
+// Each record type gets a directory with one file per column, plain
+// little endian values named after the column and its type:
+//
+//   capture/Meter/seq.u16  capture/Meter/time.u32  capture/Meter/voltage.f32 ...
+//   capture/Inputs/seq.u16 capture/Inputs/time.u32 capture/Inputs/raw.u8 ...
+//
+// so a column loads with numpy.fromfile ("capture/Meter/voltage.f32",
+// "<f4"). capture/schema.txt lists them. The columns come from
+// include/CaptureRecords.h; a newer firmware's extra columns are skipped.
+//
+// Gaps in the sequence numbers count frames lost on the controller (full
+// ring) or on the line; CRC errors count segments that looked like
+// frames of a known record but did not check.
+//
+//   g++ -O2 -std=c++11 -I../../include -I../../lib/CaptureStream -I../../lib/Crc wlccap.cpp -o wlccap
+//
+//   wlccap [-o dir] [-l log] [-b baud] [-v] [port|file]
+//     -o   output directory, default "capture"
+//     -l   write everything that is not a capture frame here
+//     -b   baud rate when reading a serial port, default 115200
+//     -v   print the counters on stderr every second
+//   Reads stdin without a port or file; stops at end of input or Ctrl-C.
+//   Start the capture on the console with "capture on".
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "CaptureRecords.h"
+
+namespace
+{
+volatile sig_atomic_t stop = 0;
+
+void onSignal(int)
+{
+    stop = 1;
+}
+
+struct Counters
+{
+    unsigned long long bytes, passed;
+    unsigned long frames[256];
+    unsigned long gaps, crcErrors;
+};
+
+class Receiver
+{
+public:
+    Receiver(const std::string &dir, FILE *log) : dir_(dir), log_(log), files_(captureRecordCount), counters_(),
+                                                  len_(0), overlong_(false), pendingZero_(false), haveSeq_(false),
+                                                  seq_(0)
+    {
+    }
+
+    ~Receiver()
+    {
+        for (auto &record : files_)
+            for (FILE *f : record)
+                if (f)
+                    fclose(f);
+    }
+
+    bool begin()
+    {
+        mkdir(dir_.c_str(), 0777);
+        FILE *schema = fopen((dir_ + "/schema.txt").c_str(), "w");
+        if (!schema)
+        {
+            perror(dir_.c_str());
+            return false;
+        }
+        fprintf(schema, "# record id column type (little endian)\n");
+        for (size_t r = 0; r < captureRecordCount; r++)
+        {
+            const CaptureRecordInfo &info = captureRecordTable[r];
+            fprintf(schema, "%s %u seq u16\n", info.name, info.id);
+            for (uint8_t c = 0; c < info.columnCount; c++)
+                fprintf(schema, "%s %u %s %c%u\n", info.name, info.id, info.columns[c].name, info.columns[c].type,
+                        info.columns[c].size * 8);
+        }
+        fclose(schema);
+        return true;
+    }
+
+    void feed(const uint8_t *data, size_t n)
+    {
+        counters_.bytes += n;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint8_t b = data[i];
+            if (b == capture::delimiter)
+            {
+                segmentEnd();
+                continue;
+            }
+            if (overlong_)
+            {
+                pass(&b, 1); // too long for a frame, text or events
+                continue;
+            }
+            segment_[len_++] = b;
+            if (len_ == sizeof(segment_))
+            {
+                flushPending();
+                pass(segment_, len_);
+                len_ = 0;
+                overlong_ = true;
+            }
+        }
+    }
+
+    void finish()
+    {
+        flushPending();
+        pass(segment_, len_);
+        len_ = 0;
+        for (auto &record : files_)
+            for (FILE *f : record)
+                if (f)
+                    fflush(f);
+        if (log_)
+            fflush(log_);
+    }
+
+    void report(FILE *out) const
+    {
+        fprintf(out, "%llu bytes:", counters_.bytes);
+        for (size_t r = 0; r < captureRecordCount; r++)
+            fprintf(out, " %lu %s,", counters_.frames[captureRecordTable[r].id], captureRecordTable[r].name);
+        fprintf(out, " %lu lost, %lu CRC errors, %llu other bytes\n", counters_.gaps, counters_.crcErrors,
+                counters_.passed);
+    }
+
+private:
+    std::string dir_;
+    FILE *log_;
+    std::vector<std::vector<FILE *>> files_; // per record: seq, then the columns
+    Counters counters_;
+
+    uint8_t segment_[capture::maxEncoded];
+    size_t len_;
+    bool overlong_;
+    bool pendingZero_; // a zero not passed on yet, it may start a frame
+    bool haveSeq_;
+    uint16_t seq_;
+
+    void pass(const uint8_t *data, size_t n)
+    {
+        if (log_ && n)
+            fwrite(data, 1, n, log_);
+        counters_.passed += n;
+    }
+
+    void flushPending()
+    {
+        if (pendingZero_)
+        {
+            uint8_t zero = 0;
+            pass(&zero, 1);
+            pendingZero_ = false;
+        }
+    }
+
+    // A zero ended a segment: either it was a frame, and the zero before
+    // it and this one were its delimiters, or it goes to the log as it came
+    void segmentEnd()
+    {
+        if (!overlong_ && record())
+        {
+            pendingZero_ = false;
+            len_ = 0;
+            return;
+        }
+        flushPending();
+        pass(segment_, len_);
+        len_ = 0;
+        overlong_ = false;
+        pendingZero_ = true;
+    }
+
+    bool record()
+    {
+        uint8_t frame[capture::maxFrame];
+        int n = capture::decodeFrame(segment_, len_, frame);
+        if (n < 0)
+        {
+            if (len_ > capture::headerSize && cobsDecodes() &&
+                findCaptureRecord(segment_[1], captureRecordTable, captureRecordCount))
+                counters_.crcErrors++;
+            return false;
+        }
+        const CaptureRecordInfo *info = findCaptureRecord(frame[0], captureRecordTable, captureRecordCount);
+        if (!info)
+            return false;
+
+        uint16_t seq = frame[1] | frame[2] << 8;
+        if (haveSeq_)
+            counters_.gaps += (uint16_t)(seq - seq_ - 1);
+        seq_ = seq;
+        haveSeq_ = true;
+        counters_.frames[info->id]++;
+
+        std::vector<FILE *> &files = files_[info - captureRecordTable];
+        if (files.empty() && !open(*info, files))
+            return true;
+        fwrite(frame + 1, 2, 1, files[0]);
+        const uint8_t *p = frame + capture::headerSize;
+        int left = n;
+        for (uint8_t c = 0; c < info->columnCount; c++)
+        {
+            uint8_t size = info->columns[c].size;
+            uint8_t value[8] = {0}; // columns an older firmware did not send are 0
+            if (left >= size)
+                memcpy(value, p, size);
+            fwrite(value, size, 1, files[c + 1]);
+            p += size;
+            left -= size;
+        }
+        return true;
+    }
+
+    // Looks like a frame whose CRC failed, rather than text
+    bool cobsDecodes() const
+    {
+        uint8_t frame[capture::maxFrame];
+        return capture::cobsDecode(segment_, len_, frame, sizeof(frame)) != 0;
+    }
+
+    bool open(const CaptureRecordInfo &info, std::vector<FILE *> &files)
+    {
+        std::string dir = dir_ + "/" + info.name;
+        mkdir(dir.c_str(), 0777);
+        std::vector<std::string> names(1, "seq.u16");
+        for (uint8_t c = 0; c < info.columnCount; c++)
+            names.push_back(std::string(info.columns[c].name) + "." + info.columns[c].type +
+                            std::to_string(info.columns[c].size * 8));
+        for (const std::string &name : names)
+        {
+            FILE *f = fopen((dir + "/" + name).c_str(), "wb");
+            if (!f)
+            {
+                perror((dir + "/" + name).c_str());
+                for (FILE *g : files)
+                    fclose(g);
+                files.clear();
+                return false;
+            }
+            files.push_back(f);
+        }
+        return true;
+    }
+};
+
+speed_t speedOf(long baud)
+{
+    switch (baud)
+    {
+    case 9600:
+        return B9600;
+    case 19200:
+        return B19200;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 230400:
+        return B230400;
+#ifdef B460800
+    case 460800:
+        return B460800;
+    case 921600:
+        return B921600;
+#endif
+    }
+    return 0;
+}
+
+// Raw mode for a serial port; other files are left as they are
+bool setupPort(int fd, long baud)
+{
+    struct termios t;
+    if (tcgetattr(fd, &t) != 0)
+        return true; // not a terminal
+    speed_t speed = speedOf(baud);
+    if (!speed)
+    {
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return false;
+    }
+    cfmakeraw(&t);
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &t) == 0;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string dir = "capture";
+    const char *logPath = NULL;
+    const char *path = NULL;
+    long baud = 115200;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            dir = argv[++i];
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            logPath = argv[++i];
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            baud = atol(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = true;
+        else if (argv[i][0] == '-' && argv[i][1])
+        {
+            fprintf(stderr, "usage: wlccap [-o dir] [-l log] [-b baud] [-v] [port|file]\n");
+            return 2;
+        }
+        else
+            path = argv[i];
+    }
+
+    int fd = path && strcmp(path, "-") != 0 ? ::open(path, O_RDONLY | O_NOCTTY) : 0;
+    if (fd < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    if (!setupPort(fd, baud))
+    {
+        perror(path);
+        return 1;
+    }
+    FILE *log = logPath ? fopen(logPath, "wb") : NULL;
+    if (logPath && !log)
+    {
+        perror(logPath);
+        return 1;
+    }
+
+    // no SA_RESTART, so Ctrl-C also ends a read() that waits on the port
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    Receiver receiver(dir, log);
+    if (!receiver.begin())
+        return 1;
+
+    static uint8_t buf[1 << 16];
+    time_t lastReport = time(NULL);
+    while (!stop)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        receiver.feed(buf, n);
+        if (verbose && time(NULL) != lastReport)
+        {
+            lastReport = time(NULL);
+            receiver.report(stderr);
+        }
+    }
+    receiver.finish();
+    receiver.report(stderr);
+    if (log)
+        fclose(log);
+    return 0;
+}
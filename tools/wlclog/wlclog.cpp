@@ -0,0 +1,604 @@
+// Per-day statistics from controller logs
+//
+// Reads the serial output of the controller in any of the forms it has
+// been collected in and prints, per day, run time, energy, motor starts
+// and stops, fault counts and the voltage range.
+//
+// Inputs (may be mixed in one file):
+//   text    the status line "V:%.2f I:%.2f PF:%.2f P:%.2f UGT:%d OHT:%d
+//           Motor:%d ERROR:%d", optionally after a timestamp:
+//             2024-05-01 12:00:05[.123]   date and time (also with T)
+//             12:00:05[.123] >            time of day (PlatformIO monitor
+//                                         time filter), the day advances
+//                                         when the time goes backwards
+//             [   12.345 I]               uptime (logdecode -t)
+//   binary  EventLog Status frames (lib/EventLog), timed by their uptime
+//
+// Lines without a timestamp are -i seconds after the previous one (the
+// firmware prints the status every 5 s). Day and time-of-day-only logs
+// start on the date given with -d.
+//
+// Energy and run time are integrated from each sample to the next, with
+// the power and motor state of the earlier one. Gaps longer than -g
+// seconds (controller off, capture stopped) are not integrated.
+//
+// Faults are counted when ERROR changes to a code >= 2:
+//   2 UGT empty   3 voltage out of range   4 over current
+//   5 under current   6 dry run
+//
+// The file is mapped and parsed in parallel: each thread turns a slice
+// of the current batch into compact records, then one pass in file order
+// resolves the times and adds them up. A record belongs to the slice it
+// starts in, so lines and frames across slice boundaries are read once.
+//
+//   g++ -O2 -std=c++11 -pthread -I../../include -I../../lib/EventLog -I../../lib/Crc wlclog.cpp -o wlclog
+//
+//   wlclog [-d YYYY-MM-DD] [-i s] [-g s] [-j threads] [-e] [-v] file...
+//     -e   list start, stop and fault events instead of the day table
+//     -v   report parse throughput on stderr
+//   wlclog -G bytes > test.log    write a synthetic log for benchmarks
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+#include "LogEvents.h"
+
+namespace
+{
+struct Options
+{
+    long startDay = 0;          // days since 1970 for logs without dates
+    double interval = 5;        // s between untimed lines
+    double maxGap = 60;         // s, longer gaps are not integrated
+    unsigned threads = 0;
+    bool events = false;
+    bool verbose = false;
+};
+
+enum TimeKind : uint8_t
+{
+    timeNone,
+    timeAbsolute,   // seconds since 1970
+    timeOfDay,      // seconds since midnight
+    timeUptime      // seconds since boot
+};
+
+struct Record
+{
+    double time;
+    float voltage;
+    float current;
+    float power;
+    uint8_t kind;
+    uint8_t motor;
+    uint8_t error;
+};
+
+struct Day
+{
+    uint32_t samples = 0;
+    double runSeconds = 0;
+    double wattSeconds = 0;
+    uint32_t starts = 0;
+    uint32_t stops = 0;
+    uint32_t faults[7] = {};
+    float vMin = 1e9f;
+    float vMax = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Parsing
+
+bool digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Unsigned integer of at most n digits (all of them if fixed)
+const char *integer(const char *p, const char *end, int n, bool fixed, long &out)
+{
+    out = 0;
+    int k = 0;
+    while (p < end && k < n && digit(*p))
+    {
+        out = out * 10 + (*p++ - '0');
+        k++;
+    }
+    return k == 0 || (fixed && k < n) ? NULL : p;
+}
+
+// [-]digits[.digits] or nan/inf; much faster than strtod for these
+const char *number(const char *p, const char *end, float &out)
+{
+    static const double scale[] = {1, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9};
+    if (end - p >= 3 && (memcmp(p, "nan", 3) == 0 || memcmp(p, "inf", 3) == 0))
+    {
+        out = 0; // the firmware clears these after printing
+        return p + 3;
+    }
+    bool neg = p < end && *p == '-';
+    if (neg)
+        p++;
+    const char *start = p;
+    uint64_t v = 0;
+    while (p < end && digit(*p))
+        v = v * 10 + (*p++ - '0');
+    int frac = 0;
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && digit(*p))
+        {
+            if (frac < 9)
+            {
+                v = v * 10 + (*p - '0');
+                frac++;
+            }
+            p++;
+        }
+    }
+    if (p == start)
+        return NULL;
+    out = (float)(v * scale[frac]);
+    if (neg)
+        out = -out;
+    return p;
+}
+
+const char *expect(const char *p, const char *end, const char *s)
+{
+    size_t n = strlen(s);
+    return end - p >= (ptrdiff_t)n && memcmp(p, s, n) == 0 ? p + n : NULL;
+}
+
+// The status line from "V:" on
+bool statusLine(const char *p, const char *end, Record &r)
+{
+    static const char *const keys[] = {"V:", " I:", " PF:", " P:", " UGT:", " OHT:", " Motor:", " ERROR:"};
+    float v[4];
+    long flag[4];
+    for (int k = 0; k < 8 && p; k++)
+    {
+        p = expect(p, end, keys[k]);
+        if (p)
+            p = k < 4 ? number(p, end, v[k]) : integer(p, end, 3, false, flag[k - 4]);
+    }
+    if (!p)
+        return false;
+    r.voltage = v[0];
+    r.current = v[1];
+    r.power = v[3];
+    r.motor = flag[2] != 0;
+    r.error = flag[3] < 7 ? flag[3] : 0;
+    return true;
+}
+
+long daysFromCivil(long y, long m, long d)
+{
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// HH:MM:SS[.fff] as seconds
+const char *hms(const char *p, const char *end, double &out)
+{
+    long h, m, s;
+    if (!(p = integer(p, end, 2, true, h)) || !(p = expect(p, end, ":")) || !(p = integer(p, end, 2, true, m)) ||
+        !(p = expect(p, end, ":")) || !(p = integer(p, end, 2, true, s)))
+        return NULL;
+    out = h * 3600 + m * 60 + s;
+    if (p < end && *p == '.')
+    {
+        double f = 0.1;
+        for (p++; p < end && digit(*p); p++, f /= 10)
+            out += (*p - '0') * f;
+    }
+    return p;
+}
+
+// Timestamp at the start of a text line
+void timestamp(const char *p, const char *end, Record &r)
+{
+    r.kind = timeNone;
+    while (p < end && (*p == '[' || *p == ' '))
+        p++;
+
+    long y, mo, d;
+    const char *q = p;
+    if ((q = integer(q, end, 4, true, y)) && (q = expect(q, end, "-")) && (q = integer(q, end, 2, true, mo)) &&
+        (q = expect(q, end, "-")) && (q = integer(q, end, 2, true, d)) && q < end && (*q == ' ' || *q == 'T') &&
+        hms(q + 1, end, r.time))
+    {
+        r.time += daysFromCivil(y, mo, d) * 86400.0;
+        r.kind = timeAbsolute;
+        return;
+    }
+    if (hms(p, end, r.time))
+    {
+        r.kind = timeOfDay;
+        return;
+    }
+    // "[   12.345 I]" from logdecode -t
+    float up;
+    q = number(p, end, up);
+    if (q && q < end && *q == ' ')
+    {
+        r.time = up;
+        r.kind = timeUptime;
+    }
+}
+
+// Text line [p, end) without the newline
+void textLine(const char *p, const char *end, std::vector<Record> &out)
+{
+    // "V:" is at the start or after a timestamp prefix
+    const char *v = p;
+    while ((v = (const char *)memchr(v, 'V', end - v)) && (v + 1 >= end || v[1] != ':'))
+        v++;
+    if (!v)
+        return;
+    Record r;
+    if (!statusLine(v, end, r))
+        return;
+    timestamp(p, v, r);
+    out.push_back(r);
+}
+
+// One slice: records starting in [begin, stop); may read on to end to
+// finish the last one
+void parseSlice(const char *begin, const char *stop, const char *end, std::vector<Record> *out)
+{
+    const uint8_t status = (uint8_t)LogEvent::Status;
+    const char *p = begin;
+    while (p < stop)
+    {
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        const char *eol = nl ? nl : end;
+        const char *frame = (const char *)memchr(p, eventlog::sync, eol - p);
+        if (!frame)
+        {
+            textLine(p, eol, *out);
+            p = eol + 1;
+            continue;
+        }
+
+        if (frame > p)
+            textLine(p, frame, *out);
+        LogFrame f;
+        size_t n = parseLogFrame((const uint8_t *)frame, end - frame, f);
+        if (n == 0)
+        {
+            p = frame + 1; // not a frame, the rest of the line may hold one
+            continue;
+        }
+        if (f.id == status && f.len == 20)
+        {
+            Record r;
+            memcpy(&r.voltage, f.args, 4);
+            memcpy(&r.current, f.args + 4, 4);
+            memcpy(&r.power, f.args + 12, 4);
+            r.motor = f.args[18] != 0;
+            r.error = f.args[19] < 7 ? f.args[19] : 0;
+            r.time = f.time / 1000.0;
+            r.kind = timeUptime;
+            out->push_back(r);
+        }
+        p = frame + n; // frames may contain newlines
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Adding up
+
+class Analysis
+{
+public:
+    explicit Analysis(const Options &o)
+        : o_(o), time_(o.startDay * 86400.0), started_(false), up_(-1), dayKey_(0), day_(NULL)
+    {
+    }
+
+    void add(const Record &r)
+    {
+        double t = resolve(r);
+        Day &day = dayOf(t);
+        day.samples++;
+        day.vMin = std::min(day.vMin, r.voltage);
+        day.vMax = std::max(day.vMax, r.voltage);
+
+        if (started_)
+        {
+            double dt = t - time_;
+            if (dt > 0 && dt <= o_.maxGap)
+            {
+                Day &from = dayOf(time_);
+                from.wattSeconds += last_.power * dt;
+                if (last_.motor)
+                    from.runSeconds += dt;
+            }
+            if (r.motor != last_.motor)
+            {
+                (r.motor ? day.starts : day.stops)++;
+                event(t, r.motor ? "start" : "stop", 0);
+            }
+            if (r.error != last_.error && r.error >= 2)
+            {
+                day.faults[r.error]++;
+                event(t, "fault", r.error);
+            }
+        }
+        time_ = t;
+        last_ = r;
+        started_ = true;
+    }
+
+    void print() const
+    {
+        if (o_.events)
+            return;
+        printf("date,samples,run_h,kwh,starts,stops,ugt_empty,voltage,over_current,under_current,dry_run,v_min,v_max\n");
+        for (std::map<long, Day>::const_iterator i = days_.begin(); i != days_.end(); ++i)
+        {
+            const Day &d = i->second;
+            printf("%s,%u,%.2f,%.3f,%u,%u,%u,%u,%u,%u,%u,%.1f,%.1f\n", date(i->first * 86400.0).c, d.samples,
+                   d.runSeconds / 3600, d.wattSeconds / 3.6e6, d.starts, d.stops, d.faults[2], d.faults[3],
+                   d.faults[4], d.faults[5], d.faults[6], d.vMin, d.vMax);
+        }
+    }
+
+private:
+    struct Text
+    {
+        char c[32];
+    };
+
+    const Options &o_;
+    double time_;       // of the previous record
+    bool started_;
+    double up_;         // uptime of the previous uptime stamped record
+    Record last_;
+    std::map<long, Day> days_;
+    long dayKey_;       // of day_, saves the map lookup for most records
+    Day *day_;
+
+    Day &dayOf(double t)
+    {
+        long key = (long)floor(t / 86400);
+        if (!day_ || key != dayKey_)
+        {
+            dayKey_ = key;
+            day_ = &days_[key];
+        }
+        return *day_;
+    }
+
+    double resolve(const Record &r)
+    {
+        double t = time_;
+        switch (r.kind)
+        {
+        case timeAbsolute:
+            t = r.time;
+            break;
+        case timeOfDay:
+        {
+            t = floor(time_ / 86400) * 86400 + r.time;
+            if (started_ && t < time_ - 3600)
+                t += 86400; // past midnight
+            break;
+        }
+        case timeUptime:
+            // a reboot restarts the uptime: carry on one interval later
+            t += up_ >= 0 && r.time >= up_ ? r.time - up_ : o_.interval;
+            up_ = r.time;
+            break;
+        default:
+            if (started_)
+                t += o_.interval;
+            break;
+        }
+        if (r.kind != timeUptime)
+            up_ = -1;
+        return t;
+    }
+
+    static Text date(double t)
+    {
+        Text s;
+        time_t tt = (time_t)t;
+        struct tm tm;
+        gmtime_r(&tt, &tm);
+        strftime(s.c, sizeof(s.c), "%Y-%m-%d", &tm);
+        return s;
+    }
+
+    void event(double t, const char *what, int code) const
+    {
+        if (!o_.events)
+            return;
+        time_t tt = (time_t)t;
+        struct tm tm;
+        gmtime_r(&tt, &tm);
+        char s[32];
+        strftime(s, sizeof(s), "%Y-%m-%d %H:%M:%S", &tm);
+        if (code)
+            printf("%s,%s,%d\n", s, what, code);
+        else
+            printf("%s,%s\n", s, what);
+    }
+};
+
+// ---------------------------------------------------------------------------
+
+bool analyse(const char *path, const Options &o)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    Analysis a(o);
+    size_t size = st.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        a.print();
+        return true;
+    }
+    const char *data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror(path);
+        return false;
+    }
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    // batches bound the memory for records; slices start after a newline
+    const size_t batch = (size_t)64 << 20;
+    unsigned threads = o.threads ? o.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::vector<Record> > records(threads);
+    const char *end = data + size;
+    size_t count = 0;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    for (const char *b = data; b < end;)
+    {
+        const char *be = end - b > (ptrdiff_t)(batch * threads) ? b + batch * threads : end;
+        std::vector<const char *> cut(threads + 1, be);
+        cut[0] = b;
+        for (unsigned k = 1; k < threads; k++)
+        {
+            const char *c = b + (be - b) * k / threads;
+            c = std::max(c, cut[k - 1]);
+            const char *nl = (const char *)memchr(c, '\n', be - c);
+            cut[k] = nl ? nl + 1 : be;
+        }
+        if (be < end)
+        {
+            const char *nl = (const char *)memchr(be, '\n', end - be);
+            be = cut[threads] = nl ? nl + 1 : end;
+        }
+
+        std::vector<std::thread> pool;
+        for (unsigned k = 0; k < threads; k++)
+        {
+            records[k].clear();
+            pool.push_back(std::thread(parseSlice, cut[k], cut[k + 1], end, &records[k]));
+        }
+        for (unsigned k = 0; k < threads; k++)
+            pool[k].join();
+
+        for (unsigned k = 0; k < threads; k++)
+        {
+            for (size_t i = 0; i < records[k].size(); i++)
+                a.add(records[k][i]);
+            count += records[k].size();
+        }
+        b = be;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (o.verbose)
+        fprintf(stderr, "%s: %.1f MB, %zu records in %.2f s, %.0f MB/s, %u threads\n", path, size / 1e6, count,
+                secs, size / 1e6 / secs, threads);
+    munmap((void *)data, size);
+    a.print();
+    return true;
+}
+
+// Synthetic log for benchmarks: time-of-day stamps every 5 s, a 2 h run
+// twice a day, now and then a fault
+void generate(unsigned long long bytes)
+{
+    unsigned long long written = 0;
+    unsigned long n = 0;
+    srand(1);
+    while (written < bytes)
+    {
+        unsigned long s = n * 5 % 86400;
+        bool run = (s >= 6 * 3600 && s < 8 * 3600) || (s >= 18 * 3600 && s < 20 * 3600);
+        int error = rand() % 20000 == 0 ? 3 + rand() % 4 : 0;
+        float v = 228 + (rand() % 200) / 10.0f;
+        float i = run ? 4.5f + (rand() % 50) / 100.0f : 0;
+        int len = printf("%02lu:%02lu:%02lu.%03lu > V:%.2f I:%.2f PF:%.2f P:%.2f UGT:%d OHT:%d Motor:%d ERROR:%d\n",
+                         s / 3600, s / 60 % 60, s % 60, n * 37 % 1000, v, i, run ? 0.85f : 0.0f,
+                         run ? v * i * 0.85f : 0.0f, 1, run ? 0 : 1, run, error);
+        written += len;
+        n++;
+    }
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-e") == 0)
+            o.events = true;
+        else if (strcmp(arg, "-v") == 0)
+            o.verbose = true;
+        else if (strcmp(arg, "-G") == 0 && value)
+        {
+            generate(strtoull(value, NULL, 10));
+            return 0;
+        }
+        else if (strcmp(arg, "-d") == 0 && value)
+        {
+            int y, m, d;
+            if (sscanf(value, "%d-%d-%d", &y, &m, &d) != 3)
+            {
+                fprintf(stderr, "bad date %s\n", value);
+                return 2;
+            }
+            o.startDay = daysFromCivil(y, m, d);
+            i++;
+        }
+        else if (strcmp(arg, "-i") == 0 && value)
+            o.interval = atof(argv[++i]);
+        else if (strcmp(arg, "-g") == 0 && value)
+            o.maxGap = atof(argv[++i]);
+        else if (strcmp(arg, "-j") == 0 && value)
+            o.threads = atoi(argv[++i]);
+        else if (arg[0] == '-')
+        {
+            fprintf(stderr, "usage: wlclog [-d YYYY-MM-DD] [-i s] [-g s] [-j threads] [-e] [-v] file...\n"
+                            "       wlclog -G bytes\n");
+            return 2;
+        }
+        else
+            files.push_back(arg);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (files.size() > 1)
+            printf("# %s\n", files[i]);
+        ok = analyse(files[i], o) && ok;
+    }
+    return ok ? 0 : 1;
+}